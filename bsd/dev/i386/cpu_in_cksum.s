@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  extern uint32_t os_cpu_in_cksum_avx2(const void *data, uint32_t len);
+ *
+ *  input :
+ *      data : starting address, no alignment requirement
+ *      len : byte stream length, a multiple of 64
+ *
+ *  output :
+ *	the byte stream is summed as native 32-bit words, and the sum
+ *	is returned folded to 17 bits (without 1's complement); the
+ *	caller (os_cpu_in_cksum_mbuf) deals with leading and trailing
+ *	bytes, odd starting addresses and the final folding
+ *
+ *  Each vector is split into its even and odd 32-bit words which are
+ *  accumulated into 64-bit lanes, so carries never need to be handled
+ *  inside the loop.
+ */
+
+	.const
+	.align	5
+
+/*
+ * a vector v0 = w7 : ... : w1 : w0 will be using the following mask to
+ * extract 0 : w6 : ... : 0 : w0
+ * then shift right quadword 32-bit to get 0 : w7 : ... : 0 : w1
+ */
+L_mask:
+	.quad	0x00000000ffffffff
+	.quad	0x00000000ffffffff
+	.quad	0x00000000ffffffff
+	.quad	0x00000000ffffffff
+
+#define Lmask	L_mask(%rip)
+
+#define	data		%rdi
+#define	len		%rsi
+#define	t		%rcx
+
+/*
+ * fold the 64-bit sum in %rax to 17 bits:
+ *	sum = (sum >> 32) + (sum & 0xffffffff);
+ *	sum = (sum >> 16) + (sum & 0xffff);
+ */
+.macro	fold_and_return
+	mov	%eax, %ecx
+	shr	$32, %rax
+	add	t, %rax
+	movzwl	%ax, %ecx
+	shr	$16, %rax
+	add	t, %rax
+	pop	%rbp
+	ret
+.endm
+
+	.globl	_os_cpu_in_cksum_avx2
+	.text
+	.align	4
+_os_cpu_in_cksum_avx2:
+	push	%rbp
+	movq	%rsp, %rbp
+
+	mov	%esi, %esi	// len is a uint32_t
+	xor	%eax, %eax
+	cmp	$0, len
+	je	1f
+
+#ifdef KERNEL
+	/* allocate stack space and save ymm0-ymm9 */
+	sub	$10*32, %rsp
+	vmovdqu	%ymm0, 0*32(%rsp)
+	vmovdqu	%ymm1, 1*32(%rsp)
+	vmovdqu	%ymm2, 2*32(%rsp)
+	vmovdqu	%ymm3, 3*32(%rsp)
+	vmovdqu	%ymm4, 4*32(%rsp)
+	vmovdqu	%ymm5, 5*32(%rsp)
+	vmovdqu	%ymm6, 6*32(%rsp)
+	vmovdqu	%ymm7, 7*32(%rsp)
+	vmovdqu	%ymm8, 8*32(%rsp)
+	vmovdqu	%ymm9, 9*32(%rsp)
+#endif
+
+	/* ymm0-ymm3 are the accumulators, ymm4 holds the mask */
+	vpxor	%ymm0, %ymm0, %ymm0
+	vpxor	%ymm1, %ymm1, %ymm1
+	vpxor	%ymm2, %ymm2, %ymm2
+	vpxor	%ymm3, %ymm3, %ymm3
+	vmovdqa	Lmask, %ymm4
+
+	/* pre-decrement len by 4*32, and if less than 4*32 bytes, do 2*32 */
+	sub	$4*32, len
+	jl	L64_bytes
+
+L128_loop:
+	vmovdqu	0*32(data), %ymm5
+	vmovdqu	1*32(data), %ymm6
+	vmovdqu	2*32(data), %ymm7
+	vmovdqu	3*32(data), %ymm8
+	add	$4*32, data
+
+	/* accumulate w7:w5:w3:w1 and w6:w4:w2:w0 of each vector */
+	vpsrlq	$32, %ymm5, %ymm9
+	vpand	%ymm4, %ymm5, %ymm5
+	vpaddq	%ymm9, %ymm0, %ymm0
+	vpaddq	%ymm5, %ymm0, %ymm0
+
+	vpsrlq	$32, %ymm6, %ymm9
+	vpand	%ymm4, %ymm6, %ymm6
+	vpaddq	%ymm9, %ymm1, %ymm1
+	vpaddq	%ymm6, %ymm1, %ymm1
+
+	vpsrlq	$32, %ymm7, %ymm9
+	vpand	%ymm4, %ymm7, %ymm7
+	vpaddq	%ymm9, %ymm2, %ymm2
+	vpaddq	%ymm7, %ymm2, %ymm2
+
+	vpsrlq	$32, %ymm8, %ymm9
+	vpand	%ymm4, %ymm8, %ymm8
+	vpaddq	%ymm9, %ymm3, %ymm3
+	vpaddq	%ymm8, %ymm3, %ymm3
+
+	sub	$4*32, len
+	jge	L128_loop
+
+L64_bytes:
+	/* len is a multiple of 64, so at most 2*32 bytes are left */
+	add	$4*32, len
+	je	L0_bytes
+
+	vmovdqu	0*32(data), %ymm5
+	vmovdqu	1*32(data), %ymm6
+
+	vpsrlq	$32, %ymm5, %ymm9
+	vpand	%ymm4, %ymm5, %ymm5
+	vpaddq	%ymm9, %ymm0, %ymm0
+	vpaddq	%ymm5, %ymm0, %ymm0
+
+	vpsrlq	$32, %ymm6, %ymm9
+	vpand	%ymm4, %ymm6, %ymm6
+	vpaddq	%ymm9, %ymm1, %ymm1
+	vpaddq	%ymm6, %ymm1, %ymm1
+
+L0_bytes:
+	/* absorb ymm1-ymm3 into ymm0 */
+	vpaddq	%ymm1, %ymm0, %ymm0
+	vpaddq	%ymm3, %ymm2, %ymm2
+	vpaddq	%ymm2, %ymm0, %ymm0
+
+	/* add the four lanes of ymm0 */
+	vextracti128	$1, %ymm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vpsrldq	$8, %xmm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vmovq	%xmm0, %rax
+
+#ifdef KERNEL
+	/* restore ymm0-ymm9 and deallocate stack space */
+	vmovdqu	0*32(%rsp), %ymm0
+	vmovdqu	1*32(%rsp), %ymm1
+	vmovdqu	2*32(%rsp), %ymm2
+	vmovdqu	3*32(%rsp), %ymm3
+	vmovdqu	4*32(%rsp), %ymm4
+	vmovdqu	5*32(%rsp), %ymm5
+	vmovdqu	6*32(%rsp), %ymm6
+	vmovdqu	7*32(%rsp), %ymm7
+	vmovdqu	8*32(%rsp), %ymm8
+	vmovdqu	9*32(%rsp), %ymm9
+	add	$10*32, %rsp
+#else
+	vzeroupper
+#endif
+1:
+	fold_and_return
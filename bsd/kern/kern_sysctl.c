@@ -4841,6 +4841,8 @@ SYSCTL_INT(_vm, OID_AUTO, lz4_max_preselects, CTLFLAG_RW | CTLFLAG_LOCKED, &vmct
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_preselection_threshold, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_preselection_threshold, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_continue_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_continue_bytes, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_profitable_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_profitable_bytes, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, compressor_selection_mem_weight, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.csel_mem_weight, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, compressor_selection_explore_interval, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.csel_explore_interval, 0, "");
 #if DEVELOPMENT || DEBUG
 extern int vm_compressor_current_codec;
 extern int vm_compressor_test_seg_wp;
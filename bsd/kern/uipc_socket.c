@@ -2048,6 +2048,7 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 	int clen = 0, error, dontroute, sendflags;
 	int atomic = sosendallatonce(so) || top;
 	int sblocked = 0;
+	int continued = 0;
 	struct proc *p = current_proc();
 	uint16_t headroom = 0;
 	ssize_t mlen;
@@ -2408,6 +2409,11 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 			    (resid <= 0)) ? PRUS_EOF :
 			    /* If there is more to send set PRUS_MORETOCOME */
 			    (resid > 0 && space > 0) ? PRUS_MORETOCOME : 0;
+			/*
+			 * Control messages only come with the first chunk; let
+			 * the protocol know the others belong to the same write.
+			 */
+			sendflags |= continued;
 
 			if ((flags & MSG_SKIPCFIL) == 0) {
 				/*
@@ -2446,6 +2452,7 @@ packet_consumed:
 				so->so_options &= ~SO_DONTROUTE;
 			}
 
+			continued = PRUS_CONTINUED;
 			clen = 0;
 			control = NULL;
 			top = NULL;
@@ -3134,6 +3141,23 @@ so_should_wait(struct socket *so, struct uio *uio, struct mbuf *m, int flags)
 	return false;
 }
 
+/*
+ * Before sleeping on an empty receive buffer, let a SO_BUSY_POLL socket
+ * spin on the receive rings; returns TRUE if data showed up meanwhile.
+ */
+static boolean_t
+so_busy_poll(struct socket *so)
+{
+	if (SOCK_DOM(so) != PF_INET && SOCK_DOM(so) != PF_INET6) {
+		return FALSE;
+	}
+	if (so->so_rcv.sb_cc != 0 || sotoinpcb(so) == NULL ||
+	    sotoinpcb(so)->inp_busy_poll_usec == 0) {
+		return FALSE;
+	}
+	return inp_busy_poll(so);
+}
+
 /*
  * Implement receive operations on a socket.
  * We depend on the way that records are added to the sockbuf
@@ -3475,7 +3499,8 @@ restart:
 		}
 
 		error = 0;
-		if (so_should_wait(so, uio, so->so_rcv.sb_mb, flags)) {
+		if (so_should_wait(so, uio, so->so_rcv.sb_mb, flags) &&
+		    !so_busy_poll(so)) {
 			error = sbwait(&so->so_rcv);
 		}
 
@@ -3956,6 +3981,28 @@ sodelayed_copy(struct socket *so, struct uio *uio, struct mbuf **free_list,
 	return error;
 }
 
+/*
+ * Whether a record on the receive buffer starts with an address and
+ * with control mbufs
+ */
+#define SO_M_LIST_ADDR          0x1
+#define SO_M_LIST_CONTROL       0x2
+
+static uint8_t
+soreceive_m_list_shape(struct mbuf *m)
+{
+	uint8_t shape = 0;
+
+	if (m->m_type == MT_SONAME) {
+		shape |= SO_M_LIST_ADDR;
+		m = m->m_next;
+	}
+	if (m != NULL && m->m_type == MT_CONTROL) {
+		shape |= SO_M_LIST_CONTROL;
+	}
+	return shape;
+}
+
 int
 soreceive_m_list(struct socket *so, u_int *pktcntp, struct mbuf **maddrp,
     struct mbuf **mp0, struct mbuf **controlp, int *flagsp)
@@ -3969,6 +4016,7 @@ soreceive_m_list(struct socket *so, u_int *pktcntp, struct mbuf **maddrp,
 	u_int npkts = 0;
 	mbuf_ref_t free_list = NULL;
 	int sblocked = 0;
+	uint8_t shape = 0;
 
 	/*
 	 * Sanity check on the parameters passed by caller
@@ -4111,6 +4159,9 @@ restart:
 		sbunlock(&so->so_rcv, TRUE);    /* keep socket locked */
 		sblocked = 0;
 
+		if (so_busy_poll(so)) {
+			goto restart;
+		}
 		error = sbwait(&so->so_rcv);
 		if (error != 0) {
 			goto release;
@@ -4122,6 +4173,16 @@ dontblock:
 	if (m == NULL) {
 		goto release;
 	}
+	/*
+	 * The address and control lists are walked in parallel with the
+	 * packet list by the caller, so end the batch at the first record
+	 * that does not have the same layout as the first one
+	 */
+	if (npkts == 0) {
+		shape = soreceive_m_list_shape(m);
+	} else if (soreceive_m_list_shape(m) != shape) {
+		goto done;
+	}
 
 	OSIncrementAtomicLong(&p->p_stats->p_ru.ru_msgrcv);
 	SBLASTRECORDCHK(&so->so_rcv, "soreceive 1");
@@ -4225,7 +4286,7 @@ dontblock:
 			goto restart;
 		}
 	}
-
+done:
 	if (flagsp != NULL) {
 		*flagsp |= flags;
 	}
@@ -4819,6 +4880,7 @@ sosetoptlock(struct socket *so, struct sockopt *sopt, int dolock)
 		case SO_WANTOOBFLAG:
 		case SO_NOWAKEFROMSLEEP:
 		case SO_NOAPNFALLBK:
+		case SO_REUSEPORT_LB:
 			error = sooptcopyin(sopt, &optval, sizeof(optval),
 			    sizeof(optval));
 			if (error != 0) {
@@ -5723,6 +5785,24 @@ sosetoptlock(struct socket *so, struct sockopt *sopt, int dolock)
 			}
 			break;
 		}
+		case SO_BUSY_POLL:
+			if (SOCK_DOM(so) != PF_INET && SOCK_DOM(so) != PF_INET6) {
+				error = EINVAL;
+				goto out;
+			}
+
+			error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval));
+			if (error != 0) {
+				goto out;
+			}
+
+			if (optval < 0 || (uint32_t)optval > inp_busy_poll_max) {
+				error = EINVAL;
+				goto out;
+			}
+			sotoinpcb(so)->inp_busy_poll_usec = (uint32_t)optval;
+			break;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -5885,6 +5965,7 @@ sogetoptlock(struct socket *so, struct sockopt *sopt, int dolock)
 		case SO_WANTOOBFLAG:
 		case SO_NOWAKEFROMSLEEP:
 		case SO_NOAPNFALLBK:
+		case SO_REUSEPORT_LB:
 			optval = so->so_options & sopt->sopt_name;
 integer:
 			error = sooptcopyout(sopt, &optval, sizeof(optval));
@@ -6260,6 +6341,13 @@ integer:
 			    1 : 0;
 			goto integer;
 		}
+		case SO_BUSY_POLL:
+			if (SOCK_DOM(so) != PF_INET && SOCK_DOM(so) != PF_INET6) {
+				error = EINVAL;
+				goto out;
+			}
+			optval = (int)sotoinpcb(so)->inp_busy_poll_usec;
+			goto integer;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -2657,14 +2657,11 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 {
 	int error = EOPNOTSUPP;
 	socket_ref_t so;
-	size_t size_of_msghdrx;
-	caddr_t msghdrxp;
-	struct user32_msghdr_x msghdrx32 = {};
-	struct user64_msghdr_x msghdrx64 = {};
+	size_t size_of_msghdrx = 0;
+	void_ptr_t umsgp = NULL;
 	int spacetype;
 	u_int i;
 	uio_t auio = NULL;
-	caddr_t src;
 	int flags;
 	mbuf_ref_t pkt_list = NULL, m;
 	mbuf_ref_t addr_list = NULL, m_addr;
@@ -2697,11 +2694,13 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 #endif /* MAC_SOCKET_SUBSET */
 
 	/*
-	 * With soreceive_m_list, all packets must be uniform, with address and
-	 * control as they are returned in parallel lists and it's only guaranteed
-	 * when pru_send_list is supported
+	 * soreceive_m_list dequeues whole records so it is only suitable
+	 * for datagram protocols, and it cannot leave the remainder of a
+	 * truncated datagram in the socket buffer for SO_DONTTRUNC.
+	 * Everything else goes through the protocol one packet at a time.
 	 */
-	if (do_recvmsg_x_donttrunc != 0 || (so->so_options & SO_DONTTRUNC)) {
+	if (do_recvmsg_x_donttrunc != 0 || (so->so_options & SO_DONTTRUNC) ||
+	    (so->so_proto->pr_flags & PR_ATOMIC) == 0) {
 		error = recvmsg_x_array(p, so, uap, retval);
 		goto done;
 	}
@@ -2718,15 +2717,12 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 	}
 
 	if (IS_64BIT_PROCESS(p)) {
-		msghdrxp = (caddr_t)&msghdrx64;
 		size_of_msghdrx = sizeof(struct user64_msghdr_x);
 		spacetype = UIO_USERSPACE64;
 	} else {
-		msghdrxp = (caddr_t)&msghdrx32;
 		size_of_msghdrx = sizeof(struct user32_msghdr_x);
 		spacetype = UIO_USERSPACE32;
 	}
-	src = __unsafe_forge_bidi_indexable(caddr_t, uap->msgp, uap->cnt);
 
 	flags = uap->flags;
 
@@ -2738,6 +2734,23 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 		goto done;
 	}
 
+	/*
+	 * Bring in the whole message header array at once so that the
+	 * packets can be copied out without going back to user space
+	 * for every header
+	 */
+	umsgp = kalloc_data(uap->cnt * size_of_msghdrx, Z_WAITOK | Z_ZERO);
+	if (umsgp == NULL) {
+		error = ENOMEM;
+		goto done;
+	}
+	error = copyin(uap->msgp, umsgp, uap->cnt * size_of_msghdrx);
+	if (error) {
+		DBG_PRINTF("%s copyin() msghdrx failed %d\n",
+		    __func__, error);
+		goto done;
+	}
+
 	/*
 	 * Receive list of packet in a single call
 	 */
@@ -2758,6 +2771,8 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 	control = ctl_list;
 
 	for (i = 0; i < pktcnt; i++) {
+		struct user64_msghdr_x *msghdrx64 = NULL;
+		struct user32_msghdr_x *msghdrx32 = NULL;
 		struct user_msghdr user_msg;
 		ssize_t len;
 		struct user_iovec *iovp;
@@ -2767,27 +2782,22 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 			panic("%s: m %p m_type %d != MT_DATA", __func__, m, m->m_type);
 		}
 
-		error = copyin((user_addr_t)(src + i * size_of_msghdrx),
-		    msghdrxp, size_of_msghdrx);
-		if (error) {
-			DBG_PRINTF("%s copyin() msghdrx failed %d\n",
-			    __func__, error);
-			goto done;
-		}
 		if (spacetype == UIO_USERSPACE64) {
-			user_msg.msg_name = msghdrx64.msg_name;
-			user_msg.msg_namelen = msghdrx64.msg_namelen;
-			user_msg.msg_iov = msghdrx64.msg_iov;
-			user_msg.msg_iovlen = msghdrx64.msg_iovlen;
-			user_msg.msg_control = msghdrx64.msg_control;
-			user_msg.msg_controllen = msghdrx64.msg_controllen;
+			msghdrx64 = ((struct user64_msghdr_x *)umsgp) + i;
+			user_msg.msg_name = msghdrx64->msg_name;
+			user_msg.msg_namelen = msghdrx64->msg_namelen;
+			user_msg.msg_iov = msghdrx64->msg_iov;
+			user_msg.msg_iovlen = msghdrx64->msg_iovlen;
+			user_msg.msg_control = msghdrx64->msg_control;
+			user_msg.msg_controllen = msghdrx64->msg_controllen;
 		} else {
-			user_msg.msg_name = msghdrx32.msg_name;
-			user_msg.msg_namelen = msghdrx32.msg_namelen;
-			user_msg.msg_iov = msghdrx32.msg_iov;
-			user_msg.msg_iovlen = msghdrx32.msg_iovlen;
-			user_msg.msg_control = msghdrx32.msg_control;
-			user_msg.msg_controllen = msghdrx32.msg_controllen;
+			msghdrx32 = ((struct user32_msghdr_x *)umsgp) + i;
+			user_msg.msg_name = msghdrx32->msg_name;
+			user_msg.msg_namelen = msghdrx32->msg_namelen;
+			user_msg.msg_iov = msghdrx32->msg_iov;
+			user_msg.msg_iovlen = msghdrx32->msg_iovlen;
+			user_msg.msg_control = msghdrx32->msg_control;
+			user_msg.msg_controllen = msghdrx32->msg_controllen;
 		}
 		user_msg.msg_flags = 0;
 		if (user_msg.msg_iovlen <= 0 ||
@@ -2802,7 +2812,7 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 		 * a new one
 		 */
 		if (auio != NULL) {
-			if (auio->uio_max_iovs <= user_msg.msg_iovlen) {
+			if (auio->uio_max_iovs >= user_msg.msg_iovlen) {
 				uio_reset_fast(auio, 0, spacetype, UIO_READ);
 			} else {
 				uio_free(auio);
@@ -2855,7 +2865,7 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 					    __func__);
 					goto done;
 				}
-				flags |= MSG_TRUNC;
+				user_msg.msg_flags |= MSG_TRUNC;
 				break;
 			}
 
@@ -2891,26 +2901,15 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 		 * Note: the original msg_iovlen and msg_iov do not change
 		 */
 		if (spacetype == UIO_USERSPACE64) {
-			msghdrx64.msg_flags = user_msg.msg_flags;
-			msghdrx64.msg_controllen = user_msg.msg_controllen;
-			msghdrx64.msg_control = user_msg.msg_control;
-			msghdrx64.msg_namelen = user_msg.msg_namelen;
-			msghdrx64.msg_name = user_msg.msg_name;
-			msghdrx64.msg_datalen = len;
+			msghdrx64->msg_flags = user_msg.msg_flags;
+			msghdrx64->msg_controllen = user_msg.msg_controllen;
+			msghdrx64->msg_namelen = user_msg.msg_namelen;
+			msghdrx64->msg_datalen = len;
 		} else {
-			msghdrx32.msg_flags = user_msg.msg_flags;
-			msghdrx32.msg_controllen = user_msg.msg_controllen;
-			msghdrx32.msg_control = (user32_addr_t) user_msg.msg_control;
-			msghdrx32.msg_name = user_msg.msg_namelen;
-			msghdrx32.msg_name = (user32_addr_t) user_msg.msg_name;
-			msghdrx32.msg_datalen = (user32_size_t) len;
-		}
-		error = copyout(msghdrxp,
-		    (user_addr_t)(src + i * size_of_msghdrx),
-		    size_of_msghdrx);
-		if (error) {
-			DBG_PRINTF("%s copyout() msghdrx failed\n", __func__);
-			goto done;
+			msghdrx32->msg_flags = user_msg.msg_flags;
+			msghdrx32->msg_controllen = user_msg.msg_controllen;
+			msghdrx32->msg_namelen = user_msg.msg_namelen;
+			msghdrx32->msg_datalen = (user32_size_t) len;
 		}
 
 		m = m->m_nextpkt;
@@ -2922,6 +2921,17 @@ recvmsg_x(struct proc *p, struct recvmsg_x_args *uap, user_ssize_t *retval)
 		}
 	}
 
+	/*
+	 * Only the headers of the datagrams that were received are updated
+	 */
+	if (pktcnt != 0) {
+		error = copyout(umsgp, uap->msgp, pktcnt * size_of_msghdrx);
+		if (error) {
+			DBG_PRINTF("%s copyout() msghdrx failed\n", __func__);
+			goto done;
+		}
+	}
+
 	uap->flags = flags;
 
 	*retval = (int)i;
@@ -2941,6 +2951,9 @@ done_no_filedrop:
 	if (auio != NULL) {
 		uio_free(auio);
 	}
+	if (umsgp != NULL) {
+		kfree_data(umsgp, uap->cnt * size_of_msghdrx);
+	}
 
 	KERNEL_DEBUG(DBG_FNC_RECVMSG_X | DBG_FUNC_END, error, 0, 0, 0, 0);
 
@@ -102,6 +102,7 @@
 #include <sys/socket.h>
 #include <sys/socketvar.h>
 #include <sys/vnode.h>
+#include <sys/ubc.h>
 
 #include <net/if.h>
 #include <net/bpf.h>
@@ -133,6 +134,14 @@
 #include <kern/thread_call.h>
 #include <libkern/section_keywords.h>
 
+#include <mach/mach_vm.h>
+#include <mach/vm_map.h>
+#include <vm/vm_kern_xnu.h>
+#include <vm/vm_map_xnu.h>
+#include <vm/vm_memory_entry_xnu.h>
+
+#include <os/atomic_private.h>
+
 #include <os/log.h>
 
 #include <IOKit/IOBSD.h>
@@ -205,6 +214,10 @@ static int bpf_hdr_comp_enable = 1;
 SYSCTL_INT(_debug, OID_AUTO, bpf_hdr_comp_enable, CTLFLAG_RW | CTLFLAG_LOCKED,
     &bpf_hdr_comp_enable, 1, "");
 
+static int bpf_jit_enable = 1;
+SYSCTL_INT(_debug, OID_AUTO, bpf_jit_enable, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bpf_jit_enable, 1, "Compile filters when they are set");
+
 static int sysctl_bpf_stats SYSCTL_HANDLER_ARGS;
 SYSCTL_PROC(_debug, OID_AUTO, bpf_stats, CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED,
     0, 0,
@@ -249,6 +262,11 @@ static int      bpf_setf(struct bpf_d *, u_int, user_addr_t, u_long);
 static int      bpf_getdltlist(struct bpf_d *, caddr_t __bidi_indexable, struct proc *);
 static int      bpf_setdlt(struct bpf_d *, u_int, struct proc *);
 static int      bpf_set_traffic_class(struct bpf_d *, int);
+static int      bpf_ring_setup(struct bpf_d *, struct bpf_ring_req *);
+static void     bpf_ring_free(struct bpf_d *);
+static void     bpf_ring_retire(struct bpf_d *);
+static uint32_t bpf_ring_pending(struct bpf_d *);
+static uint32_t bpf_ring_ready(struct bpf_d *);
 static void     bpf_set_packet_service_class(struct mbuf *, int);
 
 static void     bpf_acquire_d(struct bpf_d *);
@@ -1284,6 +1302,15 @@ bpfread(dev_t dev, struct uio *uio, int ioflag)
 
 	bpf_acquire_d(d);
 
+	/*
+	 * Packets are delivered through the shared ring
+	 */
+	if (d->bd_ring != NULL) {
+		bpf_release_d(d);
+		lck_mtx_unlock(bpf_mlock);
+		return EOPNOTSUPP;
+	}
+
 	/*
 	 * Restrict application to use a buffer the same size as
 	 * as kernel buffers.
@@ -1579,7 +1606,17 @@ bpf_timed_out(void *arg, __unused void *dummy)
 		 * now stuff to read, wake it up.
 		 */
 		d->bd_state = BPF_TIMED_OUT;
-		if (d->bd_slen != 0) {
+		if (d->bd_ring != NULL) {
+			/*
+			 * Hand the partially filled block over; the
+			 * timer is restarted by the next packet.
+			 */
+			d->bd_state = BPF_IDLE;
+			if (d->bd_ring_owned && d->bd_scnt != 0) {
+				bpf_ring_retire(d);
+				bpf_wakeup(d);
+			}
+		} else if (d->bd_slen != 0) {
 			bpf_wakeup(d);
 		}
 	} else if (d->bd_state == BPF_DRAINING) {
@@ -1816,6 +1853,13 @@ bpf_setup(struct bpf_d *d_to, uuid_t uuid_from, ifnet_t ifp, struct proc *proc)
 		    __func__, error);
 		return error;
 	}
+	if (d_from->bd_ring != NULL || d_to->bd_ring != NULL) {
+		error = EINVAL;
+		os_log_error(OS_LOG_DEFAULT,
+		    "%s: shared ring not supported error %d",
+		    __func__, error);
+		return error;
+	}
 
 	/*
 	 * Prevent any read or write while copying
@@ -2037,6 +2081,8 @@ log_bpf_ioctl_str(struct bpf_d *d, u_long cmd, int error)
  *  BIOCSEXTHDR		Set "extended header" flag
  *  BIOCSHEADDROP	Drop head of the buffer if user is not reading
  *  BIOCGHEADDROP	Get "head-drop" flag
+ *  BIOCSETRING		Map a shared memory capture ring
+ *  BIOCROTRING		Hand the current ring block over to the reader
  */
 /* ARGSUSED */
 int
@@ -2738,6 +2784,33 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t __sized_by(IOCPARM_LEN(cmd)) addr,
 			if_set_xflags(d->bd_bif->bif_ifp, IFXF_DISABLE_INPUT);
 		}
 		break;
+	case BIOCSETRING: {             /* struct bpf_ring_req */
+		struct bpf_ring_req brr;
+
+		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING)) {
+			/*
+			 * Interface already attached, unable to change buffers
+			 */
+			error = EINVAL;
+			break;
+		}
+		bcopy(addr, &brr, sizeof(brr));
+		error = bpf_ring_setup(d, &brr);
+		if (error == 0) {
+			bcopy(&brr, addr, sizeof(brr));
+		}
+		break;
+	}
+	case BIOCROTRING:
+		if (d->bd_ring == NULL) {
+			error = EINVAL;
+			break;
+		}
+		if (d->bd_ring_owned && d->bd_scnt != 0) {
+			bpf_ring_retire(d);
+			bpf_wakeup(d);
+		}
+		break;
 	}
 
 #if DEVELOPMENT || DEBUG
@@ -2762,6 +2835,7 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
     u_long cmd)
 {
 	struct bpf_insn *fcode, *old;
+	struct bpf_jit_prog *old_jit;
 	u_int flen, size;
 
 	while (d->bd_hbuf_read) {
@@ -2773,16 +2847,21 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	}
 
 	old = d->bd_filter;
+	old_jit = d->bd_jit;
 	if (bf_insns == USER_ADDR_NULL) {
 		if (bf_len != 0) {
 			return EINVAL;
 		}
 		d->bd_filter = NULL;
 		d->bd_filter_len = 0;
+		d->bd_jit = NULL;
 		reset_d(d);
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (old_jit != NULL) {
+			bpf_jit_free(old_jit);
+		}
 		return 0;
 	}
 	flen = bf_len;
@@ -2799,6 +2878,7 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	    bpf_validate(fcode, (int)flen)) {
 		d->bd_filter = fcode;
 		d->bd_filter_len = flen;
+		d->bd_jit = bpf_jit_enable ? bpf_jit_compile(fcode, flen) : NULL;
 
 		if (cmd == BIOCSETF32 || cmd == BIOCSETF64) {
 			reset_d(d);
@@ -2807,6 +2887,9 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (old_jit != NULL) {
+			bpf_jit_free(old_jit);
+		}
 
 		return 0;
 	}
@@ -3073,7 +3156,13 @@ bpfselect(dev_t dev, int which, void * wql, struct proc *proc)
 
 	switch (which) {
 	case FREAD:
-		if (d->bd_hlen != 0 ||
+		if (d->bd_ring != NULL) {
+			if (bpf_ring_ready(d) != 0) {
+				ret = 1;
+			} else {
+				selrecord(proc, &d->bd_sel, wql);
+			}
+		} else if (d->bd_hlen != 0 ||
 		    ((d->bd_immediate ||
 		    d->bd_state == BPF_TIMED_OUT) && d->bd_slen != 0)) {
 			ret = 1;         /* read has data to return */
@@ -3124,6 +3213,19 @@ filt_bpfread_common(struct knote *kn, struct kevent_qos_s *kev, struct bpf_d *d)
 	int ready = 0;
 	int64_t data = 0;
 
+	if (d->bd_ring != NULL) {
+		/*
+		 * The amount of data is the number of blocks the
+		 * reader owns; the ring keeps its own timer.
+		 */
+		data = bpf_ring_ready(d);
+		ready = (data > 0);
+		if (ready && kev) {
+			knote_fill_kevent(kn, kev, data);
+		}
+		return ready;
+	}
+
 	if (d->bd_immediate) {
 		/*
 		 * If there's data in the hold buffer, it's the
@@ -3356,9 +3458,15 @@ bpf_tap_imp(
 		}
 
 		++d->bd_rcount;
-		slen = bpf_filter(d->bd_filter, d->bd_filter_len,
-		    bpf_pkt_ptr,
-		    (u_int)bpf_pkt->bpfp_total_length, 0);
+		if (d->bd_jit != NULL) {
+			slen = bpf_jit_filter_packet(d->bd_jit, d->bd_filter,
+			    d->bd_filter_len, bpf_pkt_ptr,
+			    (u_int)bpf_pkt->bpfp_total_length);
+		} else {
+			slen = bpf_filter(d->bd_filter, d->bd_filter_len,
+			    bpf_pkt_ptr,
+			    (u_int)bpf_pkt->bpfp_total_length, 0);
+		}
 
 		if (slen != 0) {
 			if (bp->bif_ifp->if_type == IFT_PKTAP &&
@@ -4018,6 +4126,216 @@ get_common_prefix_size(const void *__bidi_indexable a, const void *__bidi_indexa
 	return (uint8_t)(i << 2);
 }
 
+/*
+ * Shared memory ring
+ *
+ * The ring is wired kernel memory that is also mapped in the task that set
+ * it up. Ownership of each block is given by the status word at its head:
+ * the kernel only writes to a block after reading BPF_RING_STATUS_KERNEL
+ * there and never reads back anything else the reader may have modified.
+ * All the ring state of the descriptor is protected by bpf_mlock.
+ */
+static int
+bpf_ring_setup(struct bpf_d *d, struct bpf_ring_req *brr)
+{
+	vm_map_t user_map = current_map();
+	vm_offset_t kaddr = 0;
+	mach_vm_offset_t uaddr = 0;
+	memory_object_size_t entry_size;
+	mach_port_t entry = MACH_PORT_NULL;
+	uint32_t size;
+	kern_return_t kr;
+	int error = 0;
+
+	LCK_MTX_ASSERT(bpf_mlock, LCK_MTX_ASSERT_OWNED);
+
+	if (d->bd_ring != NULL) {
+		return EBUSY;
+	}
+	if (brr->brr_block_size < PAGE_SIZE ||
+	    (brr->brr_block_size & PAGE_MASK) != 0 ||
+	    brr->brr_block_size > BPF_BUFSIZE_CAP ||
+	    brr->brr_block_count < BPF_RING_MIN_BLOCKS ||
+	    brr->brr_block_count > BPF_RING_MAX_BLOCKS ||
+	    os_mul_overflow(brr->brr_block_size, brr->brr_block_count, &size) ||
+	    size > BPF_RING_MAX_SIZE) {
+		return EINVAL;
+	}
+
+	/*
+	 * The allocation and the mapping may block; the mapping holds
+	 * its own reference on the memory so the entry is dropped once
+	 * the ring is mapped.
+	 */
+	lck_mtx_unlock(bpf_mlock);
+	kr = kmem_alloc(kernel_map, &kaddr, size, KMA_DATA_SHARED | KMA_ZERO,
+	    VM_KERN_MEMORY_BSD);
+	if (kr == KERN_SUCCESS) {
+		entry_size = size;
+		kr = mach_make_memory_entry_64(kernel_map, &entry_size,
+		    (memory_object_offset_t)kaddr, VM_PROT_READ | VM_PROT_WRITE,
+		    &entry, MACH_PORT_NULL);
+	}
+	if (kr == KERN_SUCCESS) {
+		kr = mach_vm_map_kernel(user_map, &uaddr, size, 0,
+		    VM_MAP_KERNEL_FLAGS_ANYWHERE(), entry, 0, FALSE,
+		    VM_PROT_READ | VM_PROT_WRITE, VM_PROT_READ | VM_PROT_WRITE,
+		    VM_INHERIT_NONE);
+	}
+	if (entry != MACH_PORT_NULL) {
+		mach_memory_entry_port_release(entry);
+	}
+	lck_mtx_lock(bpf_mlock);
+
+	if (kr != KERN_SUCCESS) {
+		error = mach_to_bsd_errno(kr);
+	} else if (d->bd_ring != NULL || d->bd_bif != NULL ||
+	    (d->bd_flags & (BPF_CLOSING | BPF_DETACHING)) != 0) {
+		/* raced with another BIOCSETRING, BIOCSETIF or close */
+		(void) mach_vm_deallocate(user_map, uaddr, size);
+		error = EBUSY;
+	}
+	if (error != 0) {
+		if (kaddr != 0) {
+			kmem_free(kernel_map, kaddr, size);
+		}
+		return error;
+	}
+
+	d->bd_ring = __unsafe_forge_bidi_indexable(caddr_t, kaddr, size);
+	d->bd_ring_size = size;
+	d->bd_ring_block_size = brr->brr_block_size;
+	d->bd_ring_block_count = brr->brr_block_count;
+	d->bd_ring_cur = 0;
+	d->bd_ring_tail = 0;
+	d->bd_ring_owned = false;
+	d->bd_ring_seq = 0;
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+
+	brr->brr_addr = uaddr;
+
+	if (bpf_debug != 0) {
+		os_log(OS_LOG_DEFAULT, "bpf%u ring %u blocks of %u bytes",
+		    d->bd_dev_minor, d->bd_ring_block_count, d->bd_ring_block_size);
+	}
+	return 0;
+}
+
+/*
+ * The mapping in the task is left alone: the memory goes away when the
+ * task unmaps it or exits.
+ */
+static void
+bpf_ring_free(struct bpf_d *d)
+{
+	vm_offset_t kaddr = (vm_offset_t)d->bd_ring;
+	uint32_t size = d->bd_ring_size;
+
+	if (d->bd_ring == NULL) {
+		return;
+	}
+	d->bd_ring = NULL;
+	d->bd_ring_size = 0;
+	kmem_free(kernel_map, kaddr, size);
+}
+
+static struct bpf_ring_block_hdr *
+bpf_ring_block(struct bpf_d *d, uint32_t idx)
+{
+	return (struct bpf_ring_block_hdr *)(void *)
+	       (d->bd_ring + (size_t)idx * d->bd_ring_block_size);
+}
+
+static uint32_t
+bpf_ring_status(struct bpf_d *d, uint32_t idx)
+{
+	return os_atomic_load(&bpf_ring_block(d, idx)->brb_status, acquire);
+}
+
+/*
+ * Return where the packets of the current block are stored, taking the
+ * block over from the reader if it was given back, or NULL if the reader
+ * still owns it.
+ */
+static caddr_t BPF_BIDI_INDEXABLE
+bpf_ring_store(struct bpf_d *d)
+{
+	if (!d->bd_ring_owned) {
+		if (bpf_ring_status(d, d->bd_ring_cur) != BPF_RING_STATUS_KERNEL) {
+			return NULL;
+		}
+		d->bd_ring_owned = true;
+		d->bd_slen = 0;
+		d->bd_scnt = 0;
+		/* compressed headers cannot refer to another block */
+		d->bd_prev_slen = 0;
+	}
+	return d->bd_ring + (size_t)d->bd_ring_cur * d->bd_ring_block_size +
+	       BPF_RING_BLOCK_HDRLEN;
+}
+
+/*
+ * Hand the current block over to the reader.
+ */
+static void
+bpf_ring_retire(struct bpf_d *d)
+{
+	struct bpf_ring_block_hdr *bh = bpf_ring_block(d, d->bd_ring_cur);
+
+	assert(d->bd_ring_owned);
+
+	bh->brb_len = d->bd_slen;
+	bh->brb_npkts = d->bd_scnt;
+	bh->brb_seq = d->bd_ring_seq++;
+	bh->brb_dcount = d->bd_dcount;
+	os_atomic_store(&bh->brb_status, BPF_RING_STATUS_USER, release);
+
+	d->bd_ring_owned = false;
+	d->bd_ring_cur = (d->bd_ring_cur + 1) % d->bd_ring_block_count;
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+}
+
+/*
+ * Return the number of blocks owned by the reader, starting from the
+ * oldest one it has not given back.
+ */
+static uint32_t
+bpf_ring_pending(struct bpf_d *d)
+{
+	uint32_t idx, n;
+
+	while (d->bd_ring_tail != d->bd_ring_cur &&
+	    bpf_ring_status(d, d->bd_ring_tail) != BPF_RING_STATUS_USER) {
+		d->bd_ring_tail = (d->bd_ring_tail + 1) % d->bd_ring_block_count;
+	}
+	idx = d->bd_ring_tail;
+	for (n = 0; n < d->bd_ring_block_count; n++) {
+		if (bpf_ring_status(d, idx) != BPF_RING_STATUS_USER) {
+			break;
+		}
+		idx = (idx + 1) % d->bd_ring_block_count;
+	}
+	return n;
+}
+
+/*
+ * Like bpf_ring_pending(), but in immediate mode an idle reader also
+ * gets the partially filled current block.
+ */
+static uint32_t
+bpf_ring_ready(struct bpf_d *d)
+{
+	uint32_t n = bpf_ring_pending(d);
+
+	if (n == 0 && d->bd_immediate && d->bd_ring_owned && d->bd_scnt != 0) {
+		bpf_ring_retire(d);
+		n = 1;
+	}
+	return n;
+}
+
 /*
  * Move the packet data from interface memory (pkt) into the
  * store buffer.  Return 1 if it's time to wakeup a listener (buffer full),
@@ -4033,11 +4351,25 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 	uint32_t hdrlen, caplen;
 	int do_wakeup = 0;
 	u_char *payload;
+	caddr_t sbuf;
+	uint32_t bufsize;
 	struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
 
 	hdrlen = (d->bd_flags & BPF_EXTENDED_HDR) ? d->bd_bif->bif_exthdrlen :
 	    (d->bd_flags & BPF_COMP_REQ) ? d->bd_bif->bif_comphdrlen:
 	    d->bd_bif->bif_hdrlen;
+	if (d->bd_ring != NULL) {
+		sbuf = bpf_ring_store(d);
+		if (sbuf == NULL) {
+			/* the reader has not given the next block back */
+			++d->bd_dcount;
+			return;
+		}
+		bufsize = d->bd_ring_block_size - BPF_RING_BLOCK_HDRLEN;
+	} else {
+		sbuf = d->bd_sbuf;
+		bufsize = d->bd_bufsize;
+	}
 	/*
 	 * Figure out how many bytes to move.  If the packet is
 	 * greater or equal to the snapshot length, transfer that
@@ -4045,8 +4377,8 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 	 * we hit the buffer size limit).
 	 */
 	totlen = hdrlen + MIN(snaplen, (int)pkt->bpfp_total_length);
-	if (totlen > d->bd_bufsize) {
-		totlen = d->bd_bufsize;
+	if (totlen > bufsize) {
+		totlen = bufsize;
 	}
 
 	if (hdrlen > totlen) {
@@ -4057,7 +4389,21 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 	 * Round up the end of the previous packet to the next longword.
 	 */
 	curlen = BPF_WORDALIGN(d->bd_slen);
-	if (curlen + totlen > d->bd_bufsize) {
+	if (curlen + totlen > bufsize && d->bd_ring != NULL) {
+		/*
+		 * Hand the full block over and move on to the next one,
+		 * unless the reader still owns it.
+		 */
+		bpf_ring_retire(d);
+		sbuf = bpf_ring_store(d);
+		if (sbuf == NULL) {
+			++d->bd_dcount;
+			bpf_wakeup(d);
+			return;
+		}
+		do_wakeup = 1;
+		curlen = 0;
+	} else if (curlen + totlen > bufsize) {
 		/*
 		 * This packet will overflow the storage buffer.
 		 * Rotate the buffers if we can, then wakeup any
@@ -4089,9 +4435,11 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		} else {
 			ROTATE_BUFFERS(d);
 		}
+		sbuf = d->bd_sbuf;
 		do_wakeup = 1;
 		curlen = 0;
-	} else if (d->bd_immediate || d->bd_state == BPF_TIMED_OUT) {
+	} else if (d->bd_ring == NULL &&
+	    (d->bd_immediate || d->bd_state == BPF_TIMED_OUT)) {
 		/*
 		 * Immediate mode is set, or the read timeout has
 		 * already expired during a select call. A packet
@@ -4107,7 +4455,7 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		microtime(&tv);
 	}
 	if (d->bd_flags & BPF_EXTENDED_HDR) {
-		ehp = (struct bpf_hdr_ext *)(void *)(d->bd_sbuf + curlen);
+		ehp = (struct bpf_hdr_ext *)(void *)(sbuf + curlen);
 		memset(ehp, 0, sizeof(*ehp));
 		ehp->bh_tstamp.tv_sec = (int)tv.tv_sec;
 		ehp->bh_tstamp.tv_usec = tv.tv_usec;
@@ -4199,7 +4547,7 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 #endif /* SKYWALK */
 		}
 	} else {
-		hp = (struct bpf_hdr *)(void *)(d->bd_sbuf + curlen);
+		hp = (struct bpf_hdr *)(void *)(sbuf + curlen);
 		memset(hp, 0, BPF_WORDALIGN(sizeof(*hp)));
 		hp->bh_tstamp.tv_sec = (int)tv.tv_sec;
 		hp->bh_tstamp.tv_usec = tv.tv_usec;
@@ -4241,7 +4589,7 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		} else {
 			struct bpf_comp_hdr *hcp;
 
-			hcp = (struct bpf_comp_hdr *)(void *)(d->bd_sbuf + curlen);
+			hcp = (struct bpf_comp_hdr *)(void *)(sbuf + curlen);
 			hcp->bh_complen = common_prefix_size;
 			if (d->bd_flags & BPF_COMP_ENABLED) {
 				hcp->bh_caplen -= common_prefix_size;
@@ -4274,6 +4622,20 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 	d->bd_bcs.bcs_total_hdr_size += pkt->bpfp_header_length;
 	d->bd_bcs.bcs_total_size += caplen;
 
+	if (d->bd_ring != NULL) {
+		if (d->bd_immediate && bpf_ring_pending(d) == 0) {
+			/*
+			 * The reader is idle: hand the block over right
+			 * away rather than waiting for it to fill up.
+			 */
+			bpf_ring_retire(d);
+			do_wakeup = 1;
+		} else {
+			/* bound the time a packet waits in the block */
+			bpf_start_timer(d);
+		}
+	}
+
 	if (do_wakeup) {
 		bpf_wakeup(d);
 	}
@@ -4355,10 +4717,15 @@ bpf_freed(struct bpf_d *d)
 	}
 
 	bpf_freebufs(d);
+	bpf_ring_free(d);
 
 	if (d->bd_filter) {
 		kfree_data_addr_sized_by(d->bd_filter, d->bd_filter_len);
 	}
+	if (d->bd_jit != NULL) {
+		bpf_jit_free(d->bd_jit);
+		d->bd_jit = NULL;
+	}
 }
 
 /*
@@ -771,6 +771,619 @@ bpf_filter(const struct bpf_insn *__counted_by(pc_len) pc_orig, u_int pc_len,
 	}
 }
 
+/*
+ * Compiled filters.
+ *
+ * bpf_jit_compile() translates a validated program into a form that is
+ * cheaper to run than the instruction stream bpf_filter() decodes on
+ * every packet: opcodes are dense so the dispatch switch is a single
+ * table jump, branch targets are absolute, the scratch memory is only
+ * cleared for programs that read it, and a packet load directly followed
+ * by a conditional branch on a constant (the bulk of what tcpdump and
+ * libpcap generate) runs as one instruction.
+ *
+ * bpf_jit_filter() runs a compiled program on a contiguous buffer.  When
+ * it is given a fallback pointer, the buffer is taken to be only the
+ * beginning of the packet: any load it cannot satisfy stops the program
+ * and sets *fallback, and the caller must run bpf_filter() on the whole
+ * packet instead.  Programs have no side effects, so running the
+ * interpreter after a partial run is always correct.  Without a fallback
+ * pointer, out of range loads reject the packet as bpf_filter() does on
+ * a contiguous buffer.
+ */
+#ifdef KERNEL
+#define BPF_JIT_ALLOC_PROG()            kalloc_type(struct bpf_jit_prog, Z_WAITOK | Z_ZERO)
+#define BPF_JIT_FREE_PROG(prog)         kfree_type(struct bpf_jit_prog, prog)
+#define BPF_JIT_ALLOC(size)             kalloc_data(size, Z_WAITOK | Z_ZERO)
+#define BPF_JIT_FREE(p, size)           kfree_data(p, size)
+#else /* KERNEL */
+#include <stdlib.h>
+#define BPF_JIT_ALLOC_PROG()            calloc(1, sizeof(struct bpf_jit_prog))
+#define BPF_JIT_FREE_PROG(prog)         free(prog)
+#define BPF_JIT_ALLOC(size)             calloc(1, size)
+#define BPF_JIT_FREE(p, size)           free(p)
+#endif /* KERNEL */
+
+enum {
+	BJ_RET_K,
+	BJ_RET_A,
+	BJ_LD_W_ABS,
+	BJ_LD_H_ABS,
+	BJ_LD_B_ABS,
+	BJ_LD_W_IND,
+	BJ_LD_H_IND,
+	BJ_LD_B_IND,
+	BJ_LDX_MSH,
+	BJ_LD_LEN,
+	BJ_LDX_LEN,
+	BJ_LD_IMM,
+	BJ_LDX_IMM,
+	BJ_LD_MEM,
+	BJ_LDX_MEM,
+	BJ_ST,
+	BJ_STX,
+	BJ_JA,
+	BJ_JGT_K,
+	BJ_JGE_K,
+	BJ_JEQ_K,
+	BJ_JSET_K,
+	BJ_JGT_X,
+	BJ_JGE_X,
+	BJ_JEQ_X,
+	BJ_JSET_X,
+	BJ_ADD_X,
+	BJ_SUB_X,
+	BJ_MUL_X,
+	BJ_DIV_X,
+	BJ_AND_X,
+	BJ_OR_X,
+	BJ_LSH_X,
+	BJ_RSH_X,
+	BJ_ADD_K,
+	BJ_SUB_K,
+	BJ_MUL_K,
+	BJ_DIV_K,
+	BJ_AND_K,
+	BJ_OR_K,
+	BJ_LSH_K,
+	BJ_RSH_K,
+	BJ_NEG,
+	BJ_TAX,
+	BJ_TXA,
+	/* load then branch on a constant, bji_cmp is the constant */
+	BJ_LD_W_ABS_JGT,
+	BJ_LD_W_ABS_JGE,
+	BJ_LD_W_ABS_JEQ,
+	BJ_LD_W_ABS_JSET,
+	BJ_LD_H_ABS_JGT,
+	BJ_LD_H_ABS_JGE,
+	BJ_LD_H_ABS_JEQ,
+	BJ_LD_H_ABS_JSET,
+	BJ_LD_B_ABS_JGT,
+	BJ_LD_B_ABS_JGE,
+	BJ_LD_B_ABS_JEQ,
+	BJ_LD_B_ABS_JSET,
+};
+
+struct bpf_jit_insn {
+	u_int16_t       bji_op;
+	u_int16_t       bji_jt;         /* index of the next insn if true, or of the BJ_JA target */
+	u_int16_t       bji_jf;         /* index of the next insn if false */
+	u_int16_t       bji_reserved;
+	u_int32_t       bji_k;          /* constant, packet offset or memory slot */
+	u_int32_t       bji_cmp;        /* branch constant of the fused loads */
+};
+
+#define BJP_F_MEM       0x1             /* program reads the scratch memory */
+
+struct bpf_jit_prog {
+	u_int32_t       bjp_flags;
+	u_int32_t       bjp_len;
+	struct bpf_jit_insn *__counted_by(bjp_len) bjp_insns;
+};
+
+static int
+bpf_jit_opcode(u_int16_t code)
+{
+	switch (code) {
+	case BPF_RET | BPF_K:                   return BJ_RET_K;
+	case BPF_RET | BPF_A:                   return BJ_RET_A;
+	case BPF_LD | BPF_W | BPF_ABS:          return BJ_LD_W_ABS;
+	case BPF_LD | BPF_H | BPF_ABS:          return BJ_LD_H_ABS;
+	case BPF_LD | BPF_B | BPF_ABS:          return BJ_LD_B_ABS;
+	case BPF_LD | BPF_W | BPF_IND:          return BJ_LD_W_IND;
+	case BPF_LD | BPF_H | BPF_IND:          return BJ_LD_H_IND;
+	case BPF_LD | BPF_B | BPF_IND:          return BJ_LD_B_IND;
+	case BPF_LDX | BPF_MSH | BPF_B:         return BJ_LDX_MSH;
+	case BPF_LD | BPF_W | BPF_LEN:          return BJ_LD_LEN;
+	case BPF_LDX | BPF_W | BPF_LEN:         return BJ_LDX_LEN;
+	case BPF_LD | BPF_IMM:                  return BJ_LD_IMM;
+	case BPF_LDX | BPF_IMM:                 return BJ_LDX_IMM;
+	case BPF_LD | BPF_MEM:                  return BJ_LD_MEM;
+	case BPF_LDX | BPF_MEM:                 return BJ_LDX_MEM;
+	case BPF_ST:                            return BJ_ST;
+	case BPF_STX:                           return BJ_STX;
+	case BPF_JMP | BPF_JA:                  return BJ_JA;
+	case BPF_JMP | BPF_JGT | BPF_K:         return BJ_JGT_K;
+	case BPF_JMP | BPF_JGE | BPF_K:         return BJ_JGE_K;
+	case BPF_JMP | BPF_JEQ | BPF_K:         return BJ_JEQ_K;
+	case BPF_JMP | BPF_JSET | BPF_K:        return BJ_JSET_K;
+	case BPF_JMP | BPF_JGT | BPF_X:         return BJ_JGT_X;
+	case BPF_JMP | BPF_JGE | BPF_X:         return BJ_JGE_X;
+	case BPF_JMP | BPF_JEQ | BPF_X:         return BJ_JEQ_X;
+	case BPF_JMP | BPF_JSET | BPF_X:        return BJ_JSET_X;
+	case BPF_ALU | BPF_ADD | BPF_X:         return BJ_ADD_X;
+	case BPF_ALU | BPF_SUB | BPF_X:         return BJ_SUB_X;
+	case BPF_ALU | BPF_MUL | BPF_X:         return BJ_MUL_X;
+	case BPF_ALU | BPF_DIV | BPF_X:         return BJ_DIV_X;
+	case BPF_ALU | BPF_AND | BPF_X:         return BJ_AND_X;
+	case BPF_ALU | BPF_OR | BPF_X:          return BJ_OR_X;
+	case BPF_ALU | BPF_LSH | BPF_X:         return BJ_LSH_X;
+	case BPF_ALU | BPF_RSH | BPF_X:         return BJ_RSH_X;
+	case BPF_ALU | BPF_ADD | BPF_K:         return BJ_ADD_K;
+	case BPF_ALU | BPF_SUB | BPF_K:         return BJ_SUB_K;
+	case BPF_ALU | BPF_MUL | BPF_K:         return BJ_MUL_K;
+	case BPF_ALU | BPF_DIV | BPF_K:         return BJ_DIV_K;
+	case BPF_ALU | BPF_AND | BPF_K:         return BJ_AND_K;
+	case BPF_ALU | BPF_OR | BPF_K:          return BJ_OR_K;
+	case BPF_ALU | BPF_LSH | BPF_K:         return BJ_LSH_K;
+	case BPF_ALU | BPF_RSH | BPF_K:         return BJ_RSH_K;
+	case BPF_ALU | BPF_NEG:                 return BJ_NEG;
+	case BPF_MISC | BPF_TAX:                return BJ_TAX;
+	case BPF_MISC | BPF_TXA:                return BJ_TXA;
+	default:                                return -1;
+	}
+}
+
+/*
+ * Compile a filter program, which the kernel must have validated
+ * already.  The structural checks are repeated so that the translation
+ * never produces a branch outside of the program.  Returns NULL if the
+ * program can't be compiled, in which case it is interpreted.
+ */
+struct bpf_jit_prog *
+bpf_jit_compile(const struct bpf_insn *__counted_by(len) f, u_int len)
+{
+	struct bpf_jit_prog *prog = NULL;
+	struct bpf_jit_insn *insns = NULL;
+	u_int16_t *map;
+	u_int32_t flags = 0;
+	u_int i, n = 0;
+	int op;
+
+	if (len < 1 || len > BPF_MAXINSNS ||
+	    BPF_CLASS(f[len - 1].code) != BPF_RET) {
+		return NULL;
+	}
+	map = BPF_JIT_ALLOC(len * sizeof(u_int16_t));
+	if (map == NULL) {
+		return NULL;
+	}
+
+	/* check the program and mark the branch targets */
+	for (i = 0; i < len; i++) {
+		const struct bpf_insn *p = &f[i];
+
+		op = bpf_jit_opcode(p->code);
+		switch (op) {
+		case -1:
+			goto fail;
+		case BJ_LD_MEM:
+		case BJ_LDX_MEM:
+		case BJ_ST:
+		case BJ_STX:
+			if (p->k >= BPF_MEMWORDS) {
+				goto fail;
+			}
+			if (op == BJ_LD_MEM || op == BJ_LDX_MEM) {
+				flags |= BJP_F_MEM;
+			}
+			break;
+		case BJ_DIV_K:
+			if (p->k == 0) {
+				goto fail;
+			}
+			break;
+		case BJ_JA:
+			if (p->k >= len - i - 1) {
+				goto fail;
+			}
+			map[i + 1 + p->k] = 1;
+			break;
+		case BJ_JGT_K:
+		case BJ_JGE_K:
+		case BJ_JEQ_K:
+		case BJ_JSET_K:
+		case BJ_JGT_X:
+		case BJ_JGE_X:
+		case BJ_JEQ_X:
+		case BJ_JSET_X:
+			if (p->jt >= len - i - 1 || p->jf >= len - i - 1) {
+				goto fail;
+			}
+			map[i + 1 + p->jt] = 1;
+			map[i + 1 + p->jf] = 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	/*
+	 * Number the compiled instructions.  An absolute load is fused with
+	 * the constant branch that follows it unless the branch is itself a
+	 * target; the branch then shares the number of its load.
+	 */
+	for (i = 0; i < len; i++) {
+		op = bpf_jit_opcode(f[i].code);
+		map[i] = (u_int16_t)n++;
+		if ((op == BJ_LD_W_ABS || op == BJ_LD_H_ABS || op == BJ_LD_B_ABS) &&
+		    i + 1 < len && map[i + 1] == 0 &&
+		    BPF_CLASS(f[i + 1].code) == BPF_JMP &&
+		    BPF_SRC(f[i + 1].code) == BPF_K &&
+		    BPF_OP(f[i + 1].code) != BPF_JA) {
+			i++;
+			map[i] = map[i - 1];
+		}
+	}
+
+	prog = BPF_JIT_ALLOC_PROG();
+	insns = BPF_JIT_ALLOC(n * sizeof(struct bpf_jit_insn));
+	if (prog == NULL || insns == NULL) {
+		goto fail;
+	}
+	for (i = 0; i < len; i++) {
+		const struct bpf_insn *p = &f[i];
+		struct bpf_jit_insn *ji = &insns[map[i]];
+
+		op = bpf_jit_opcode(p->code);
+		ji->bji_k = p->k;
+		if (i + 1 < len && map[i + 1] == map[i]) {
+			/* fused load and branch */
+			const struct bpf_insn *j = &f[++i];
+			int cmp;
+
+			switch (BPF_OP(j->code)) {
+			case BPF_JGT:
+				cmp = 0;
+				break;
+			case BPF_JGE:
+				cmp = 1;
+				break;
+			case BPF_JEQ:
+				cmp = 2;
+				break;
+			default:
+				cmp = 3;
+				break;
+			}
+			ji->bji_op = (u_int16_t)(BJ_LD_W_ABS_JGT +
+			    4 * (op - BJ_LD_W_ABS) + cmp);
+			ji->bji_cmp = j->k;
+			ji->bji_jt = map[i + 1 + j->jt];
+			ji->bji_jf = map[i + 1 + j->jf];
+			continue;
+		}
+		ji->bji_op = (u_int16_t)op;
+		if (op == BJ_JA) {
+			ji->bji_jt = map[i + 1 + p->k];
+		} else if (BPF_CLASS(p->code) == BPF_JMP) {
+			ji->bji_jt = map[i + 1 + p->jt];
+			ji->bji_jf = map[i + 1 + p->jf];
+		}
+	}
+	BPF_JIT_FREE(map, len * sizeof(u_int16_t));
+
+	prog->bjp_flags = flags;
+	prog->bjp_len = n;
+	prog->bjp_insns = insns;
+	return prog;
+
+fail:
+	if (insns != NULL) {
+		BPF_JIT_FREE(insns, n * sizeof(struct bpf_jit_insn));
+	}
+	if (prog != NULL) {
+		BPF_JIT_FREE_PROG(prog);
+	}
+	BPF_JIT_FREE(map, len * sizeof(u_int16_t));
+	return NULL;
+}
+
+void
+bpf_jit_free(struct bpf_jit_prog *prog)
+{
+	BPF_JIT_FREE(prog->bjp_insns, prog->bjp_len * sizeof(struct bpf_jit_insn));
+	BPF_JIT_FREE_PROG(prog);
+}
+
+#define BJ_LOAD_ABS(size, load) do {                                    \
+	if (ji->bji_k > buflen || (size) > buflen - ji->bji_k) {        \
+	        goto out_of_range;                                      \
+	}                                                               \
+	A = load(&p[ji->bji_k]);                                        \
+} while (0)
+
+#define BJ_LOAD_IND(size, load) do {                                    \
+	k = X + ji->bji_k;                                              \
+	if (ji->bji_k > buflen || X > buflen - ji->bji_k ||             \
+	    (size) > buflen - k) {                                      \
+	        goto out_of_range;                                      \
+	}                                                               \
+	A = load(&p[k]);                                                \
+} while (0)
+
+#define BJ_BYTE(cp)     (*(cp))
+
+#define BJ_NEXT(cond)   ((cond) ? ji->bji_jt : ji->bji_jf)
+
+u_int
+bpf_jit_filter(const struct bpf_jit_prog *prog,
+    const u_char *__sized_by(buflen) p, u_int wirelen, u_int buflen,
+    int *fallback)
+{
+	const struct bpf_jit_insn *ji;
+	u_int32_t A = 0, X = 0;
+	bpf_u_int32 k;
+	int32_t mem[BPF_MEMWORDS];
+	u_int pc = 0;
+
+	if (prog->bjp_flags & BJP_F_MEM) {
+		bzero(mem, sizeof(mem));
+	}
+
+	for (;;) {
+		ji = &prog->bjp_insns[pc++];
+		switch (ji->bji_op) {
+		case BJ_RET_K:
+			return (u_int)ji->bji_k;
+		case BJ_RET_A:
+			return (u_int)A;
+		case BJ_LD_W_ABS:
+			BJ_LOAD_ABS(sizeof(int32_t), EXTRACT_LONG);
+			continue;
+		case BJ_LD_H_ABS:
+			BJ_LOAD_ABS(sizeof(int16_t), EXTRACT_SHORT);
+			continue;
+		case BJ_LD_B_ABS:
+			BJ_LOAD_ABS(sizeof(u_int8_t), BJ_BYTE);
+			continue;
+		case BJ_LD_W_IND:
+			BJ_LOAD_IND(sizeof(int32_t), EXTRACT_LONG);
+			continue;
+		case BJ_LD_H_IND:
+			BJ_LOAD_IND(sizeof(int16_t), EXTRACT_SHORT);
+			continue;
+		case BJ_LD_B_IND:
+			BJ_LOAD_IND(sizeof(u_int8_t), BJ_BYTE);
+			continue;
+		case BJ_LDX_MSH:
+			if (ji->bji_k >= buflen) {
+				goto out_of_range;
+			}
+			X = (p[ji->bji_k] & 0xf) << 2;
+			continue;
+		case BJ_LD_LEN:
+			A = wirelen;
+			continue;
+		case BJ_LDX_LEN:
+			X = wirelen;
+			continue;
+		case BJ_LD_IMM:
+			A = ji->bji_k;
+			continue;
+		case BJ_LDX_IMM:
+			X = ji->bji_k;
+			continue;
+		case BJ_LD_MEM:
+			A = mem[ji->bji_k];
+			continue;
+		case BJ_LDX_MEM:
+			X = mem[ji->bji_k];
+			continue;
+		case BJ_ST:
+			mem[ji->bji_k] = A;
+			continue;
+		case BJ_STX:
+			mem[ji->bji_k] = X;
+			continue;
+		case BJ_JA:
+			pc = ji->bji_jt;
+			continue;
+		case BJ_JGT_K:
+			pc = BJ_NEXT(A > ji->bji_k);
+			continue;
+		case BJ_JGE_K:
+			pc = BJ_NEXT(A >= ji->bji_k);
+			continue;
+		case BJ_JEQ_K:
+			pc = BJ_NEXT(A == ji->bji_k);
+			continue;
+		case BJ_JSET_K:
+			pc = BJ_NEXT(A & ji->bji_k);
+			continue;
+		case BJ_JGT_X:
+			pc = BJ_NEXT(A > X);
+			continue;
+		case BJ_JGE_X:
+			pc = BJ_NEXT(A >= X);
+			continue;
+		case BJ_JEQ_X:
+			pc = BJ_NEXT(A == X);
+			continue;
+		case BJ_JSET_X:
+			pc = BJ_NEXT(A & X);
+			continue;
+		case BJ_ADD_X:
+			A += X;
+			continue;
+		case BJ_SUB_X:
+			A -= X;
+			continue;
+		case BJ_MUL_X:
+			A *= X;
+			continue;
+		case BJ_DIV_X:
+			if (X == 0) {
+				return 0;
+			}
+			A /= X;
+			continue;
+		case BJ_AND_X:
+			A &= X;
+			continue;
+		case BJ_OR_X:
+			A |= X;
+			continue;
+		case BJ_LSH_X:
+			A <<= X;
+			continue;
+		case BJ_RSH_X:
+			A >>= X;
+			continue;
+		case BJ_ADD_K:
+			A += ji->bji_k;
+			continue;
+		case BJ_SUB_K:
+			A -= ji->bji_k;
+			continue;
+		case BJ_MUL_K:
+			A *= ji->bji_k;
+			continue;
+		case BJ_DIV_K:
+			A /= ji->bji_k;
+			continue;
+		case BJ_AND_K:
+			A &= ji->bji_k;
+			continue;
+		case BJ_OR_K:
+			A |= ji->bji_k;
+			continue;
+		case BJ_LSH_K:
+			A <<= ji->bji_k;
+			continue;
+		case BJ_RSH_K:
+			A >>= ji->bji_k;
+			continue;
+		case BJ_NEG:
+			A = -A;
+			continue;
+		case BJ_TAX:
+			X = A;
+			continue;
+		case BJ_TXA:
+			A = X;
+			continue;
+		case BJ_LD_W_ABS_JGT:
+			BJ_LOAD_ABS(sizeof(int32_t), EXTRACT_LONG);
+			pc = BJ_NEXT(A > ji->bji_cmp);
+			continue;
+		case BJ_LD_W_ABS_JGE:
+			BJ_LOAD_ABS(sizeof(int32_t), EXTRACT_LONG);
+			pc = BJ_NEXT(A >= ji->bji_cmp);
+			continue;
+		case BJ_LD_W_ABS_JEQ:
+			BJ_LOAD_ABS(sizeof(int32_t), EXTRACT_LONG);
+			pc = BJ_NEXT(A == ji->bji_cmp);
+			continue;
+		case BJ_LD_W_ABS_JSET:
+			BJ_LOAD_ABS(sizeof(int32_t), EXTRACT_LONG);
+			pc = BJ_NEXT(A & ji->bji_cmp);
+			continue;
+		case BJ_LD_H_ABS_JGT:
+			BJ_LOAD_ABS(sizeof(int16_t), EXTRACT_SHORT);
+			pc = BJ_NEXT(A > ji->bji_cmp);
+			continue;
+		case BJ_LD_H_ABS_JGE:
+			BJ_LOAD_ABS(sizeof(int16_t), EXTRACT_SHORT);
+			pc = BJ_NEXT(A >= ji->bji_cmp);
+			continue;
+		case BJ_LD_H_ABS_JEQ:
+			BJ_LOAD_ABS(sizeof(int16_t), EXTRACT_SHORT);
+			pc = BJ_NEXT(A == ji->bji_cmp);
+			continue;
+		case BJ_LD_H_ABS_JSET:
+			BJ_LOAD_ABS(sizeof(int16_t), EXTRACT_SHORT);
+			pc = BJ_NEXT(A & ji->bji_cmp);
+			continue;
+		case BJ_LD_B_ABS_JGT:
+			BJ_LOAD_ABS(sizeof(u_int8_t), BJ_BYTE);
+			pc = BJ_NEXT(A > ji->bji_cmp);
+			continue;
+		case BJ_LD_B_ABS_JGE:
+			BJ_LOAD_ABS(sizeof(u_int8_t), BJ_BYTE);
+			pc = BJ_NEXT(A >= ji->bji_cmp);
+			continue;
+		case BJ_LD_B_ABS_JEQ:
+			BJ_LOAD_ABS(sizeof(u_int8_t), BJ_BYTE);
+			pc = BJ_NEXT(A == ji->bji_cmp);
+			continue;
+		case BJ_LD_B_ABS_JSET:
+			BJ_LOAD_ABS(sizeof(u_int8_t), BJ_BYTE);
+			pc = BJ_NEXT(A & ji->bji_cmp);
+			continue;
+		default:
+			return 0;
+		}
+	}
+
+out_of_range:
+	if (fallback != NULL) {
+		*fallback = 1;
+	}
+	return 0;
+}
+
+#ifdef KERNEL
+/*
+ * Run a compiled program on a packet described by a struct bpf_packet.
+ * The program runs on the first mbuf or buflet when there is no separate
+ * header, and the interpreter takes over for packets with a header and
+ * for loads that reach past the first segment.
+ */
+u_int
+bpf_jit_filter_packet(const struct bpf_jit_prog *prog,
+    const struct bpf_insn *__counted_by(pc_len) pc, u_int pc_len,
+    u_char *__sized_by(sizeof(struct bpf_packet)) p, u_int wirelen)
+{
+	struct bpf_packet *bp = (struct bpf_packet *)(void *)p;
+	u_char *cp = NULL;
+	size_t len = 0;
+	int fallback = 0;
+	u_int ret;
+
+	if (bp->bpfp_header_length == 0) {
+		switch (bp->bpfp_type) {
+		case BPF_PACKET_TYPE_MBUF:
+			cp = mtod(bp->bpfp_mbuf, u_char *);
+			len = bp->bpfp_mbuf->m_len;
+			break;
+#if SKYWALK
+		case BPF_PACKET_TYPE_PKT: {
+			kern_buflet_t __single buflet;
+
+			buflet = kern_packet_get_next_buflet(bp->bpfp_pkt, NULL);
+			if (buflet != NULL) {
+				cp = buflet_get_address(buflet);
+				len = kern_buflet_get_data_length(buflet);
+			}
+			break;
+		}
+#endif /* SKYWALK */
+		default:
+			break;
+		}
+	}
+	if (cp != NULL && len != 0) {
+		ret = bpf_jit_filter(prog, cp, wirelen, (u_int)len, &fallback);
+		if (fallback == 0) {
+			return ret;
+		}
+	}
+	return bpf_filter(pc, pc_len, p, wirelen, 0);
+}
+#endif /* KERNEL */
+
 #ifdef KERNEL
 /*
  * Return true if the 'fcode' is a valid filter program.
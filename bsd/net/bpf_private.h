@@ -154,6 +154,52 @@ struct bpf_comp_stats {
 #define BIOCSNOTSTAMP   _IOW('B', 145, int)
 #define BIOCGDVRTIN     _IOR('B', 146, int)
 #define BIOCSDVRTIN     _IOW('B', 146, int)
+#define BIOCSETRING     _IOWR('B', 147, struct bpf_ring_req)
+#define BIOCROTRING     _IO('B', 148)
+
+/*
+ * Shared memory capture ring
+ *
+ * BIOCSETRING replaces the read() buffers of a descriptor with a ring of
+ * brr_block_count blocks of brr_block_size bytes that is mapped in the
+ * address space of the caller at brr_addr. It must be issued before
+ * BIOCSETIF and cannot be undone; read() then fails with EOPNOTSUPP.
+ *
+ * Each block starts with a struct bpf_ring_block_hdr followed, at offset
+ * BPF_RING_BLOCK_HDRLEN, by brb_len bytes of packets laid out exactly as in
+ * a read() buffer. The kernel fills the blocks in order and hands a block
+ * over by setting brb_status to BPF_RING_STATUS_USER (with release
+ * semantics) when it is full, when the read timeout expires, on BIOCROTRING,
+ * or, in immediate mode, as soon as the reader has no other block to
+ * process. The reader must consume the blocks in order and give each one
+ * back by storing BPF_RING_STATUS_KERNEL to brb_status; packets that arrive
+ * while the next block is still owned by the reader are dropped.
+ *
+ * EVFILT_READ and select() report the descriptor readable while a block is
+ * owned by the reader; the kevent data is the number of such blocks.
+ */
+struct bpf_ring_req {
+	uint32_t        brr_block_size;  /* bytes per block, a multiple of the page size */
+	uint32_t        brr_block_count; /* number of blocks */
+	uint64_t        brr_addr;        /* out: address of the ring */
+};
+
+struct bpf_ring_block_hdr {
+	uint32_t        brb_status;     /* owner of the block */
+	uint32_t        brb_len;        /* bytes of packets in the block */
+	uint32_t        brb_npkts;      /* number of packets in the block */
+	uint32_t        brb_reserved;
+	uint64_t        brb_seq;        /* sequence number of the block */
+	uint64_t        brb_dcount;     /* packets dropped by the descriptor so far */
+};
+
+#define BPF_RING_STATUS_KERNEL  0
+#define BPF_RING_STATUS_USER    1
+
+#define BPF_RING_BLOCK_HDRLEN   BPF_WORDALIGN(sizeof(struct bpf_ring_block_hdr))
+#define BPF_RING_MIN_BLOCKS     2
+#define BPF_RING_MAX_BLOCKS     1024
+#define BPF_RING_MAX_SIZE       (64 * 1024 * 1024)
 
 /*
  * This structure must be a multiple of 4 bytes.
@@ -324,6 +370,15 @@ extern void     bpfdetach(struct ifnet *);
 extern void     bpfilterattach(int);
 extern u_int    bpf_filter(const struct bpf_insn *__counted_by(pc_len), u_int pc_len,
     u_char *__sized_by(sizeof(struct bpf_packet)), u_int wirelen, u_int);
+
+struct bpf_jit_prog;
+extern struct bpf_jit_prog *bpf_jit_compile(const struct bpf_insn *__counted_by(len), u_int len);
+extern void     bpf_jit_free(struct bpf_jit_prog *);
+extern u_int    bpf_jit_filter(const struct bpf_jit_prog *, const u_char *__sized_by(buflen),
+    u_int wirelen, u_int buflen, int *fallback);
+extern u_int    bpf_jit_filter_packet(const struct bpf_jit_prog *,
+    const struct bpf_insn *__counted_by(pc_len), u_int pc_len,
+    u_char *__sized_by(sizeof(struct bpf_packet)), u_int wirelen);
 #endif /* KERNEL_PRIVATE */
 
 #endif /* !defined(DRIVERKIT) */
@@ -124,6 +124,7 @@ struct bpf_d {
 	struct bpf_if   *bd_bif;        /* interface descriptor */
 	struct bpf_insn *__counted_by(bd_filter_len) bd_filter; /* filter code */
 	uint32_t        bd_filter_len;  /* filter code length  */
+	struct bpf_jit_prog *bd_jit;    /* compiled filter code */
 	uint64_t        bd_rcount;      /* number of packets received */
 	uint64_t        bd_dcount;      /* number of received packets dropped */
 	uint64_t        bd_fcount;      /* number of received packets which matched filter */
@@ -165,6 +166,21 @@ struct bpf_d {
 	caddr_t BPF_BIDI_INDEXABLE bd_prev_fbuf;
 
 	struct bpf_comp_stats bd_bcs;
+
+	/*
+	 * Shared memory ring (BIOCSETRING): when set, packets are stored
+	 * in the block at bd_ring_cur instead of bd_sbuf, with bd_slen and
+	 * bd_scnt describing that block. bd_ring_tail is the oldest block
+	 * that may still be owned by the reader.
+	 */
+	caddr_t __sized_by(bd_ring_size) bd_ring;
+	uint32_t        bd_ring_size;
+	uint32_t        bd_ring_block_size;
+	uint32_t        bd_ring_block_count;
+	uint32_t        bd_ring_cur;
+	uint32_t        bd_ring_tail;
+	bool            bd_ring_owned;  /* kernel holds block bd_ring_cur */
+	uint64_t        bd_ring_seq;
 };
 
 /* Values for bd_state */
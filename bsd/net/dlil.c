@@ -313,6 +313,7 @@ ifnet_delay_start_disabled_increment(void)
 unsigned int net_rxpoll = 1;
 unsigned int net_affinity = 1;
 unsigned int net_async = 1;     /* 0: synchronous, 1: asynchronous */
+unsigned int net_rss = 0;       /* number of steering input threads, 0: off */
 
 extern u_int32_t        inject_buckets;
 
@@ -1468,6 +1469,8 @@ dlil_init(void)
 
 	PE_parse_boot_argn("net_async", &net_async, sizeof(net_async));
 
+	PE_parse_boot_argn("net_rss", &net_rss, sizeof(net_rss));
+
 	PE_parse_boot_argn("if_link_heuristics", &if_link_heuristics_flags, sizeof(if_link_heuristics_flags));
 
 	VERIFY(dlil_pending_thread_cnt == 0);
@@ -1597,6 +1600,11 @@ dlil_init(void)
 	dlil_incr_pending_thread_count();
 	(void) dlil_create_input_thread(NULL, dlil_main_input_thread, NULL);
 
+	/* and the input threads flows are steered to, if enabled */
+	if (net_rss != 0) {
+		dlil_rss_init();
+	}
+
 	/*
 	 * Create ifnet detacher thread.
 	 * When an interface gets detached, part of the detach processing
@@ -265,6 +265,7 @@ extern errno_t dlil_send_arp_internal(ifnet_t, u_int16_t,
 #define NET_THREAD_TX_NOTIFY    0x100000 /* thread is doing TX notify */
 #define NET_THREAD_AYSYNC_TX    0x200000 /* require use of starter thread */
 #define NET_THREAD_SYNC_RX      0x400000 /* request synchronous Rx handler */
+#define NET_THREAD_BUSY_POLL    0x800000 /* thread is busy-polling Rx rings */
 #endif /* SKYWALK */
 
 /*
@@ -54,12 +54,38 @@
 /* rate limit debug messages */
 struct timespec dlil_dbgrate = { .tv_sec = 1, .tv_nsec = 0 };
 
+/*
+ * Receive side steering: with the net_rss boot-arg, the IP packets of
+ * Ethernet interfaces with an input thread are spread by flow hash over
+ * a set of input threads, one per cpu, instead of all being processed by
+ * the input thread of the interface.  All the packets of a flow go to the
+ * same thread, so that they are still delivered in order.
+ */
+#define DLIL_RSS_MAX_THREADS    32
+#define DLIL_RSS_NONE           UINT32_MAX
+
+struct dlil_rss_key {
+	union {
+		struct in_addr  v4;
+		struct in6_addr v6;
+	} drk_src, drk_dst;
+	uint32_t        drk_ports;
+	uint32_t        drk_proto;
+};
+
+static struct dlil_threading_info *__counted_by(dlil_rss_nthreads) dlil_rss_threads;
+static uint32_t dlil_rss_nthreads;
+static uint32_t dlil_rss_seed;
+
+extern unsigned int ml_wait_max_cpus(void);
+
 extern void proto_input_run(void);
 
 static errno_t dlil_input_async(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
 static errno_t dlil_input_sync(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
+static errno_t dlil_input_rss(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
 static void dlil_input_cksum_dbg(struct ifnet *ifp, struct mbuf *m, char *frame_header, protocol_family_t pf);
-static void dlil_input_packet_list_common(struct ifnet *, mbuf_ref_t, u_int32_t, ifnet_model_t, boolean_t);
+static void dlil_input_packet_list_common(struct ifnet *, mbuf_ref_t, u_int32_t, ifnet_model_t, boolean_t, boolean_t);
 static void dlil_input_thread_func(void *, wait_result_t);
 static void dlil_input_thread_cont(void *, wait_result_t);
 static inline void dlil_input_wakeup(struct dlil_threading_info *inp);
@@ -72,6 +98,9 @@ static void dlil_main_input_thread_cont(void *, wait_result_t);
 static void dlil_rxpoll_input_thread_func(void *, wait_result_t);
 static void dlil_rxpoll_input_thread_cont(void *, wait_result_t);
 
+static void dlil_rss_input_thread_func(void *, wait_result_t);
+static void dlil_rss_input_thread_cont(void *, wait_result_t);
+
 static uint32_t dlil_trim_overcomitted_queue_locked(class_queue_t *input_queue, dlil_freeq_t *freeq, struct ifnet_stat_increment_param *stat_delta);
 
 static inline mbuf_t handle_bridge_early_input(ifnet_t ifp, mbuf_t m, u_int32_t cnt);
@@ -119,6 +148,14 @@ dlil_create_input_thread(ifnet_t ifp, struct dlil_threading_info *inp,
 		VERIFY(inp != dlil_main_input_thread);
 		inp->dlth_name = tsnprintf(inp->dlth_name_storage, sizeof(inp->dlth_name_storage),
 		    "%s_input", if_name(ifp));
+		/*
+		 * Steer the IP flows over the RSS input threads; the
+		 * thread of the interface keeps the rest of its traffic.
+		 */
+		if (dlil_rss_nthreads != 0 &&
+		    ifp->if_family == IFNET_FAMILY_ETHERNET) {
+			inp->dlth_strategy = dlil_input_rss;
+		}
 	} else {
 		/*
 		 * Synchronous strategy if there's a netif below and
@@ -287,6 +324,11 @@ dlil_input_handler(struct ifnet *ifp, struct mbuf *m_head,
 		inp = dlil_main_input_thread;
 	}
 
+	/* a busy-polling socket waits for this input in its own thread */
+	if (__improbable(net_thread_is_marked(NET_THREAD_BUSY_POLL))) {
+		return dlil_input_sync(inp, ifp, m_head, m_tail, s, poll, tp);
+	}
+
 #if (DEVELOPMENT || DEBUG)
 	if (__improbable(net_thread_is_marked(NET_THREAD_SYNC_RX))) {
 		return dlil_input_sync(inp, ifp, m_head, m_tail, s, poll, tp);
@@ -297,18 +339,47 @@ dlil_input_handler(struct ifnet *ifp, struct mbuf *m_head,
 	}
 }
 
+/*
+ * Drive the receive rings of the interface from the calling thread,
+ * with any input they hold processed synchronously.
+ */
+__private_extern__ errno_t
+ifnet_busy_poll(struct ifnet *ifp)
+{
+#if SKYWALK
+	net_thread_marks_t __single marks;
+	uint32_t n;
+
+	if (!(ifp->if_capabilities & IFCAP_SKYWALK) || NA(ifp) == NULL) {
+		return ENOTSUP;
+	}
+	if (!ifnet_datamov_begin(ifp)) {
+		return ENXIO;
+	}
+	marks = net_thread_marks_push(NET_THREAD_BUSY_POLL);
+	n = netif_busy_poll(ifp);
+	net_thread_marks_pop(marks);
+	ifnet_datamov_end(ifp);
+
+	return (n != 0) ? 0 : EBUSY;
+#else /* !SKYWALK */
+#pragma unused(ifp)
+	return ENOTSUP;
+#endif /* !SKYWALK */
+}
+
 __private_extern__ void
 dlil_input_packet_list(struct ifnet *ifp, struct mbuf *m)
 {
 	return dlil_input_packet_list_common(ifp, m, 0,
-	           IFNET_MODEL_INPUT_POLL_OFF, FALSE);
+	           IFNET_MODEL_INPUT_POLL_OFF, FALSE, FALSE);
 }
 
 __private_extern__ void
 dlil_input_packet_list_extended(struct ifnet *ifp, struct mbuf *m,
     u_int32_t cnt, ifnet_model_t mode)
 {
-	return dlil_input_packet_list_common(ifp, m, cnt, mode, TRUE);
+	return dlil_input_packet_list_common(ifp, m, cnt, mode, TRUE, FALSE);
 }
 
 /*
@@ -612,6 +683,258 @@ dlil_input_sync(struct dlil_threading_info *inp,
 	return 0;
 }
 
+/*
+ * Returns the index of the RSS input thread for a packet received on an
+ * Ethernet interface, or DLIL_RSS_NONE if it isn't an IP packet.  The
+ * ports are left out of the hash of fragments so that all the fragments
+ * of a datagram go to the same thread.
+ */
+static uint32_t
+dlil_rss_select(struct mbuf *m)
+{
+	struct ether_header *eh = m->m_pkthdr.pkt_hdr;
+	struct dlil_rss_key key;
+	uint32_t hlen, proto;
+
+	if (eh == NULL) {
+		return DLIL_RSS_NONE;
+	}
+	bzero(&key, sizeof(key));
+
+	switch (ntohs(eh->ether_type)) {
+	case ETHERTYPE_IP: {
+		struct ip *ip;
+
+		if (m->m_len < sizeof(struct ip)) {
+			return DLIL_RSS_NONE;
+		}
+		ip = mtod(m, struct ip *);
+		if (ip->ip_v != IPVERSION) {
+			return DLIL_RSS_NONE;
+		}
+		key.drk_src.v4 = ip->ip_src;
+		key.drk_dst.v4 = ip->ip_dst;
+		hlen = ip->ip_hl << 2;
+		proto = ip->ip_p;
+		if ((ntohs(ip->ip_off) & (IP_MF | IP_OFFMASK)) != 0) {
+			proto = 0;
+		}
+		break;
+	}
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr *ip6;
+
+		if (m->m_len < sizeof(struct ip6_hdr)) {
+			return DLIL_RSS_NONE;
+		}
+		ip6 = mtod(m, struct ip6_hdr *);
+		if ((ip6->ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION) {
+			return DLIL_RSS_NONE;
+		}
+		key.drk_src.v6 = ip6->ip6_src;
+		key.drk_dst.v6 = ip6->ip6_dst;
+		hlen = sizeof(struct ip6_hdr);
+		proto = ip6->ip6_nxt;
+		break;
+	}
+	default:
+		return DLIL_RSS_NONE;
+	}
+
+	if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+	    (uint32_t)m->m_pkthdr.len >= hlen + sizeof(key.drk_ports)) {
+		/* source and destination ports lead both headers */
+		m_copydata(m, (int)hlen, sizeof(key.drk_ports), &key.drk_ports);
+		key.drk_proto = proto;
+	}
+
+	return net_flowhash(&key, sizeof(key), dlil_rss_seed) % dlil_rss_nthreads;
+}
+
+/*
+ * Trim an overcommitted RSS input queue.  The oldest packets are dropped,
+ * and may have been received on another interface: those were counted in
+ * when that interface queued them, so their drop is charged to it here,
+ * while the packets of "ifp" adjust the increments about to be added.
+ */
+static uint32_t
+dlil_rss_trim_queue_locked(struct dlil_threading_info *rinp,
+    struct ifnet *ifp, dlil_freeq_t *freeq,
+    struct ifnet_stat_increment_param *s_adj)
+{
+	struct ifnet_stat_increment_param s_trim = {};
+	dlil_freeq_t trimq;
+	struct mbuf *m;
+	uint32_t dropped;
+
+	MBUFQ_INIT(&trimq);
+	dropped = dlil_trim_overcomitted_queue_locked(&rinp->dlth_pkts,
+	    &trimq, &s_trim);
+
+	while ((m = MBUFQ_FIRST(&trimq)) != NULL) {
+		struct ifnet *rcvif = m->m_pkthdr.rcvif;
+
+		MBUFQ_DEQUEUE(&trimq, m);
+		if (rcvif == ifp) {
+			uint32_t len = m_pktlen(m);
+
+			s_adj->dropped++;
+			s_adj->packets_in -= MIN(s_adj->packets_in, 1);
+			s_adj->bytes_in -= MIN(s_adj->bytes_in, len);
+		} else if (rcvif != NULL) {
+			os_atomic_inc(&rcvif->if_data.ifi_iqdrops, relaxed);
+		}
+		MBUFQ_ENQUEUE(freeq, m);
+	}
+
+	rinp->dlth_trim_pkts_dropped += dropped;
+	rinp->dlth_trim_cnt += 1;
+
+	return dropped;
+}
+
+/*
+ * Input strategy spreading the flows of an interface over the RSS input
+ * threads.  Packets that aren't IP stay on the input thread of the
+ * interface, and the interface statistics are synchronized here since
+ * the RSS threads handle packets of many interfaces.
+ *
+ * The packets of a bridge member are first handed to the bridge, as the
+ * input thread of the interface would do; what is left of them is then
+ * all steered, since the RSS threads skip the bridge filter.  With the
+ * bridge early input disabled, bridge members are not steered at all.
+ */
+static errno_t
+dlil_input_rss(struct dlil_threading_info *inp,
+    struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
+    const struct ifnet_stat_increment_param *s, boolean_t poll,
+    struct thread *tp)
+{
+	struct {
+		struct mbuf     *head;
+		struct mbuf     *tail;
+		uint32_t        cnt;
+		uint32_t        size;
+	} q[DLIL_RSS_MAX_THREADS], local;
+	struct ifnet_stat_increment_param s_adj = *s;
+	boolean_t notify = FALSE;
+	boolean_t bridged = FALSE;
+	struct mbuf *m, *next;
+	dlil_freeq_t freeq;
+	MBUFQ_INIT(&freeq);
+
+	if (m_head == NULL) {
+		return dlil_input_async(inp, ifp, m_head, m_tail, s, poll, tp);
+	}
+	if (ifp->if_bridge != NULL) {
+		if (bridge_enable_early_input == 0) {
+			return dlil_input_async(inp, ifp, m_head, m_tail, s,
+			           poll, tp);
+		}
+		m_head = handle_bridge_early_input(ifp, m_head, s->packets_in);
+		bridged = TRUE;
+	}
+
+	bzero(q, sizeof(q[0]) * dlil_rss_nthreads);
+	bzero(&local, sizeof(local));
+	for (m = m_head; m != NULL; m = next) {
+		uint32_t idx = dlil_rss_select(m);
+		uint32_t len = m_pktlen(m);
+
+		next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		if (idx == DLIL_RSS_NONE && bridged) {
+			/* the interface thread would run the bridge again */
+			idx = 0;
+		}
+		if (idx == DLIL_RSS_NONE) {
+			if (local.head == NULL) {
+				local.head = m;
+			} else {
+				local.tail->m_nextpkt = m;
+			}
+			local.tail = m;
+			local.cnt++;
+			local.size += len;
+			continue;
+		}
+		m_add_hdr_crumb_interface_input(m, ifp->if_index, false);
+		if (q[idx].head == NULL) {
+			q[idx].head = m;
+		} else {
+			q[idx].tail->m_nextpkt = m;
+		}
+		q[idx].tail = m;
+		q[idx].cnt++;
+		q[idx].size += len;
+	}
+
+	if (local.head != NULL) {
+		struct ifnet_stat_increment_param s_local = {
+			.packets_in = local.cnt,
+			.bytes_in = local.size,
+		};
+
+		s_adj.packets_in -= MIN(s_adj.packets_in, local.cnt);
+		s_adj.bytes_in -= MIN(s_adj.bytes_in, local.size);
+		(void) dlil_input_async(inp, ifp, local.head, local.tail,
+		    &s_local, poll, tp);
+	}
+
+	for (uint32_t i = 0; i < dlil_rss_nthreads; i++) {
+		struct dlil_threading_info *rinp = &dlil_rss_threads[i];
+		classq_pkt_t head, tail;
+
+		if (q[i].head == NULL) {
+			continue;
+		}
+		CLASSQ_PKT_INIT_MBUF(&head, q[i].head);
+		CLASSQ_PKT_INIT_MBUF(&tail, q[i].tail);
+
+		lck_mtx_lock_spin(&rinp->dlth_lock);
+		_addq_multi(&rinp->dlth_pkts, &head, &tail, q[i].cnt, q[i].size);
+		if (MBUF_QUEUE_IS_OVERCOMMITTED(&rinp->dlth_pkts)) {
+			uint32_t dropped;
+
+			dropped = dlil_rss_trim_queue_locked(rinp, ifp,
+			    &freeq, &s_adj);
+
+			os_log_error(OS_LOG_DEFAULT,
+			    "%s %s burst limit %u (sysctl: %u) exceeded. "
+			    "%u packets dropped [%u total in %u events]. new qlen %u ",
+			    __func__, rinp->dlth_name, qlimit(&rinp->dlth_pkts),
+			    if_rcvq_burst_limit, dropped,
+			    rinp->dlth_trim_pkts_dropped, rinp->dlth_trim_cnt,
+			    qlen(&rinp->dlth_pkts));
+		}
+		dlil_input_wakeup(rinp);
+		lck_mtx_unlock(&rinp->dlth_lock);
+	}
+
+	lck_mtx_lock_spin(&inp->dlth_lock);
+	dlil_input_stats_add(&s_adj, inp, ifp, poll);
+#if SKYWALK
+	/*
+	 * If this interface is attached to a netif nexus,
+	 * the stats are already incremented there; otherwise
+	 * do it here.
+	 */
+	if (!(ifp->if_capabilities & IFCAP_SKYWALK))
+#endif /* SKYWALK */
+	notify = dlil_input_stats_sync(ifp, inp);
+	lck_mtx_unlock(&inp->dlth_lock);
+
+	if (!MBUFQ_EMPTY(&freeq)) {
+		m_drop_list(MBUFQ_FIRST(&freeq), ifp, DROPTAP_FLAG_DIR_IN, DROP_REASON_DLIL_BURST_LIMIT, NULL, 0);
+	}
+
+	if (notify) {
+		ifnet_notify_data_threshold(ifp);
+	}
+
+	return 0;
+}
+
 static void
 dlil_input_cksum_dbg(struct ifnet *ifp, struct mbuf *m, char *frame_header,
     protocol_family_t pf)
@@ -764,7 +1087,7 @@ dlil_input_process_wake_packet(ifnet_t ifp, protocol_family_t protocol_family, m
 
 static void
 dlil_input_packet_list_common(struct ifnet *ifp_param, mbuf_ref_t m,
-    u_int32_t cnt, ifnet_model_t mode, boolean_t ext)
+    u_int32_t cnt, ifnet_model_t mode, boolean_t ext, boolean_t bridged)
 {
 	int error = 0;
 	protocol_family_t protocol_family;
@@ -776,7 +1099,7 @@ dlil_input_packet_list_common(struct ifnet *ifp_param, mbuf_ref_t m,
 	mbuf_t *pkt_next = NULL;
 	u_int32_t poll_thresh = 0, poll_ival = 0;
 	int iorefcnt = 0;
-	boolean_t skip_bridge_filter = FALSE;
+	boolean_t skip_bridge_filter = bridged;
 
 	KERNEL_DEBUG(DBG_FNC_DLIL_INPUT | DBG_FUNC_START, 0, 0, 0, 0, 0);
 
@@ -1450,6 +1773,158 @@ dlil_main_input_thread_cont(void *v, wait_result_t wres)
 	__builtin_unreachable();
 }
 
+/*
+ * Create the RSS input threads; the number of threads asked for with the
+ * net_rss boot-arg is capped by the number of cpus.
+ */
+void
+dlil_rss_init(void)
+{
+	uint32_t n = MIN(MIN(net_rss, ml_wait_max_cpus()), DLIL_RSS_MAX_THREADS);
+
+	/* a single thread does no better than the interface input threads */
+	if (n < 2) {
+		net_rss = 0;
+		return;
+	}
+
+	dlil_rss_threads = kalloc_type(struct dlil_threading_info, n,
+	    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	dlil_rss_nthreads = n;
+	net_rss = n;
+	read_frandom(&dlil_rss_seed, sizeof(dlil_rss_seed));
+
+	for (uint32_t i = 0; i < dlil_rss_nthreads; i++) {
+		dlil_threading_info_ref_t inp = &dlil_rss_threads[i];
+		thread_precedence_policy_data_t info;
+		__unused kern_return_t kret;
+
+		inp->dlth_strategy = dlil_input_async;
+		inp->dlth_name = tsnprintf(inp->dlth_name_storage,
+		    sizeof(inp->dlth_name_storage), "rss_input_%u", i);
+		inp->dlth_lock_grp = lck_grp_alloc_init(inp->dlth_name,
+		    LCK_GRP_ATTR_NULL);
+		lck_mtx_init(&inp->dlth_lock, inp->dlth_lock_grp,
+		    &dlil_lck_attributes);
+		_qinit(&inp->dlth_pkts, Q_DROPTAIL, if_rcvq_burst_limit, QP_MBUF);
+
+		dlil_incr_pending_thread_count();
+		if (kernel_thread_start(dlil_rss_input_thread_func, inp,
+		    &inp->dlth_thread) != KERN_SUCCESS) {
+			panic_plain("%s: couldn't create %s input thread",
+			    __func__, inp->dlth_name);
+			/* NOTREACHED */
+		}
+
+		bzero(&info, sizeof(info));
+		info.importance = 0;
+		kret = thread_policy_set(inp->dlth_thread,
+		    THREAD_PRECEDENCE_POLICY, (thread_policy_t)&info,
+		    THREAD_PRECEDENCE_POLICY_COUNT);
+		ASSERT(kret == KERN_SUCCESS);
+		/*
+		 * A distinct affinity tag per thread lets the scheduler
+		 * spread them over the processors.
+		 */
+		if (net_affinity &&
+		    dlil_affinity_set(inp->dlth_thread, i + 1) == KERN_SUCCESS) {
+			inp->dlth_affinity_tag = i + 1;
+			inp->dlth_affinity = TRUE;
+		}
+		OSAddAtomic(1, &cur_dlil_input_threads);
+	}
+}
+
+__attribute__((noreturn))
+static void
+dlil_rss_input_thread_func(void *v, wait_result_t w)
+{
+#pragma unused(w)
+	dlil_threading_info_ref_t inp = v;
+
+	VERIFY(inp->dlth_ifp == NULL);
+	VERIFY(current_thread() == inp->dlth_thread);
+
+	thread_set_thread_name(inp->dlth_thread, inp->dlth_name);
+
+	lck_mtx_lock(&inp->dlth_lock);
+	VERIFY(!(inp->dlth_flags & (DLIL_INPUT_EMBRYONIC | DLIL_INPUT_RUNNING)));
+	(void) assert_wait(&inp->dlth_flags, THREAD_UNINT);
+	inp->dlth_flags |= DLIL_INPUT_EMBRYONIC;
+	/* wake up once to get out of embryonic state */
+	dlil_input_wakeup(inp);
+	lck_mtx_unlock(&inp->dlth_lock);
+	(void) thread_block_parameter(dlil_rss_input_thread_cont, inp);
+	/* NOTREACHED */
+	__builtin_unreachable();
+}
+
+/*
+ * RSS input thread: handles the packets of the flows hashed to it, for
+ * any interface, like the main input thread does for the interfaces
+ * without a dedicated input thread.
+ */
+__attribute__((noreturn))
+static void
+dlil_rss_input_thread_cont(void *v, wait_result_t wres)
+{
+	dlil_threading_info_ref_t inp = v;
+
+	/* RSS input threads are uninterruptible */
+	VERIFY(wres != THREAD_INTERRUPTED);
+	lck_mtx_lock_spin(&inp->dlth_lock);
+	VERIFY(!(inp->dlth_flags & (DLIL_INPUT_TERMINATE |
+	    DLIL_INPUT_RUNNING)));
+	inp->dlth_flags |= DLIL_INPUT_RUNNING;
+
+	while (1) {
+		struct mbuf *m = NULL;
+		classq_pkt_t pkt = CLASSQ_PKT_INITIALIZER(pkt);
+		boolean_t embryonic;
+		u_int32_t m_cnt;
+
+		inp->dlth_flags &= ~DLIL_INPUT_WAITING;
+
+		if (__improbable(embryonic =
+		    (inp->dlth_flags & DLIL_INPUT_EMBRYONIC))) {
+			inp->dlth_flags &= ~DLIL_INPUT_EMBRYONIC;
+		}
+
+		m_cnt = qlen(&inp->dlth_pkts);
+		_getq_all(&inp->dlth_pkts, &pkt, NULL, NULL, NULL);
+		m = pkt.cp_mbuf;
+
+		inp->dlth_wtot = 0;
+
+		lck_mtx_unlock(&inp->dlth_lock);
+
+		if (__improbable(embryonic)) {
+			dlil_decr_pending_thread_count();
+		}
+
+		/* the bridge saw the packets before they were steered */
+		if (__probable(m != NULL)) {
+			dlil_input_packet_list_common(NULL, m, m_cnt,
+			    IFNET_MODEL_INPUT_POLL_OFF, TRUE, TRUE);
+		}
+
+		lck_mtx_lock_spin(&inp->dlth_lock);
+		VERIFY(inp->dlth_flags & DLIL_INPUT_RUNNING);
+		if (!(inp->dlth_flags & ~DLIL_INPUT_RUNNING)) {
+			break;
+		}
+	}
+
+	inp->dlth_flags &= ~DLIL_INPUT_RUNNING;
+	(void) assert_wait(&inp->dlth_flags, THREAD_UNINT);
+	lck_mtx_unlock(&inp->dlth_lock);
+	(void) thread_block_parameter(dlil_rss_input_thread_cont, inp);
+
+	VERIFY(0);      /* we should never get here */
+	/* NOTREACHED */
+	__builtin_unreachable();
+}
+
 /*
  * Input thread for interfaces with opportunistic polling input model.
  */
@@ -378,10 +378,11 @@ preout_again:
 		}
 
 		/*
-		 * If this is a TSO packet, make sure the interface still
-		 * advertise TSO capability.
+		 * If this is a TSO packet or a UDP datagram train, make sure
+		 * the interface still advertises the capability.
 		 */
-		if (TSO_IPV4_NOTOK(ifp, m) || TSO_IPV6_NOTOK(ifp, m)) {
+		if (TSO_IPV4_NOTOK(ifp, m) || TSO_IPV6_NOTOK(ifp, m) ||
+		    UDP_GSO_NOTOK(ifp, m)) {
 			retval = EMSGSIZE;
 			m_drop_if(m, ifp, DROPTAP_FLAG_DIR_OUT, DROP_REASON_DLIL_TSO_NOT_OK, NULL, 0);
 			goto cleanup;
@@ -694,7 +695,8 @@ dlil_output_cksum_dbg(struct ifnet *ifp, struct mbuf *m, uint32_t hoff,
 	uint32_t did_sw;
 
 	if (!(hwcksum_dbg_mode & HWCKSUM_DBG_FINALIZE_FORCED) ||
-	    (m->m_pkthdr.csum_flags & (CSUM_TSO_IPV4 | CSUM_TSO_IPV6))) {
+	    (m->m_pkthdr.csum_flags &
+	    (CSUM_TSO_IPV4 | CSUM_TSO_IPV6 | CSUM_UDP_GSO))) {
 		return;
 	}
 
@@ -228,6 +228,10 @@ SYSCTL_UINT(_net_link_generic_system, OID_AUTO, dlil_input_threads,
     CTLFLAG_RD | CTLFLAG_LOCKED, &cur_dlil_input_threads, 0,
     "Current number of DLIL input threads");
 
+SYSCTL_UINT(_net_link_generic_system, OID_AUTO, rss_input_threads,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &net_rss, 0,
+    "Number of input threads packets are steered to by flow hash");
+
 
 /******************************************************************************
 * Section: hardware-assisted checksum mechanism.                             *
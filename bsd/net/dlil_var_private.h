@@ -184,6 +184,7 @@ enum {
 extern unsigned int net_rxpoll;
 extern unsigned int net_affinity;
 extern unsigned int net_async;     /* 0: synchronous, 1: asynchronous */
+extern unsigned int net_rss;       /* number of steering input threads */
 
 #if SKYWALK
 /*
@@ -375,6 +376,8 @@ int dlil_create_input_thread(ifnet_t, struct dlil_threading_info *,
 
 void dlil_terminate_input_thread(struct dlil_threading_info *);
 
+void dlil_rss_init(void);
+
 extern boolean_t dlil_is_rxpoll_input(thread_continue_t func);
 boolean_t dlil_is_native_netif_nexus(ifnet_t ifp);
 
@@ -1630,6 +1630,7 @@ __private_extern__ boolean_t ifnet_datamov_suspend_if_needed(struct ifnet *);
 __private_extern__ void ifnet_datamov_drain(struct ifnet *);
 __private_extern__ void ifnet_datamov_suspend_and_drain(struct ifnet *);
 __private_extern__ void ifnet_datamov_resume(struct ifnet *);
+__private_extern__ errno_t ifnet_busy_poll(struct ifnet *);
 __private_extern__ void ifnet_set_start_cycle(struct ifnet *,
     struct timespec *);
 __private_extern__ void ifnet_set_poll_cycle(struct ifnet *,
@@ -166,6 +166,80 @@ struct pf_state_tree_lan_ext     pf_statetbl_lan_ext;
 struct pf_state_tree_ext_gwy     pf_statetbl_ext_gwy;
 static uint32_t pf_state_tree_ext_gwy_nat64_cnt = 0;
 
+/*
+ * Hash-indexed state tables, used instead of the lan_ext and ext_gwy
+ * trees when booted with pf_state_hash=1.  The trees are never walked,
+ * state dumps go through state_list and tree_id, so only lookups,
+ * insertions and removals need to be redirected.
+ *
+ * The state key comparators treat some fields as wildcards (the
+ * external address and port, depending on the UDP filtering mode and
+ * on the protocol), so a bucket is chosen from the fields they always
+ * compare, and the comparator resolves the rest within the bucket.
+ * Tables grow and shrink by powers of two to keep about
+ * PF_STATE_HASH_LOAD keys per bucket.
+ */
+LIST_HEAD(pf_state_key_bucket, pf_state_key);
+
+struct pf_state_hash {
+	struct pf_state_key_bucket      *psh_buckets;
+	u_int32_t                       psh_mask;       /* bucket count - 1 */
+	u_int32_t                       psh_count;      /* state keys in the table */
+};
+
+#define PF_STATE_HASH_MIN       1024
+#define PF_STATE_HASH_MAX       (1 << 20)
+#define PF_STATE_HASH_LOAD      2
+
+static TUNABLE(bool, pf_state_hash_enabled, "pf_state_hash", false);
+static struct pf_state_hash pf_statehash_lan_ext;
+static struct pf_state_hash pf_statehash_ext_gwy;
+static u_int32_t pf_state_hash_seed;
+
+/*
+ * Compiled filter rulesets.  When a filter ruleset is committed or
+ * edited, pf_compile_ruleset() precomputes, for each (protocol,
+ * destination port) a packet can present, the set of rules whose
+ * protocol and destination port criteria do not exclude it.  The rule
+ * walks in pf_test_rule() and pf_test_fragment() then step from one
+ * candidate to the next instead of visiting every rule, which keeps
+ * first packet latency flat on large policies that fan out on services.
+ *
+ * Candidate sets are bitmaps indexed by rule nr.  Bitmap 0 holds the
+ * rules of any protocol, there is one bitmap per protocol named in the
+ * ruleset, and one per TCP/UDP destination port named with '=' (the
+ * protocol bitmap plus the rules naming that port).  Rules are only
+ * ever skipped when the linear walk would have rejected them, so
+ * evaluation order, last match and quick semantics are unchanged.
+ */
+struct pf_rule_dispatch_port {
+	u_int32_t                       pdp_key;        /* proto << 16 | port, 0 if free */
+	u_int32_t                       pdp_bitmap;
+};
+
+struct pf_rule_dispatch {
+	u_int32_t                       prd_nrules;
+	u_int32_t                       prd_nwords;     /* bitmap length in 64 bit words */
+	u_int32_t                       prd_nbits;      /* prd_nwords times the bitmap count */
+	u_int32_t                       prd_nports;     /* port hash size, a power of 2 */
+	u_int32_t                       prd_proto[256]; /* bitmap of each protocol */
+	struct pf_rule                  **__counted_by(prd_nrules) prd_rules;
+	u_int64_t                       *__counted_by(prd_nbits) prd_bits;
+	struct pf_rule_dispatch_port    *__counted_by(prd_nports) prd_ports;
+};
+
+struct pf_rule_cursor {
+	struct pf_ruleset               *prc_ruleset;
+	const u_int64_t                 *prc_bits;
+	u_int32_t                       prc_key;        /* 0 without a destination port */
+	u_int8_t                        prc_proto;
+};
+
+#define PF_RULE_DISPATCH_MIN            32      /* smaller rulesets are walked */
+#define PF_RULE_DISPATCH_MAX_BYTES      (8 << 20)
+
+static TUNABLE(bool, pf_rule_dispatch_enabled, "pf_rule_dispatch", true);
+
 struct pf_palist         pf_pabuf;
 struct pf_status         pf_status;
 
@@ -1094,6 +1168,215 @@ pf_addrcpy(struct pf_addr *dst, struct pf_addr *src, sa_family_t af)
 	}
 }
 
+/* flowhash input for the bucket of a state key, 12-bytes multiple */
+struct pf_state_hash_key {
+	struct pf_addr          addr;
+	u_int16_t               port;
+	u_int8_t                af;
+	u_int8_t                proto;
+	u_int8_t                proto_variant;
+	u_int8_t                nat64;
+	u_int16_t               pad;
+};
+
+/*
+ * Only hash what pf_state_compare_lan_ext/ext_gwy compare for every
+ * key: the address family and the local (lan or gwy) address, plus its
+ * port for the protocols that always compare it.
+ */
+static u_int32_t
+pf_state_hash_host(struct pf_state_host *h, sa_family_t af, u_int8_t proto,
+    u_int8_t proto_variant, u_int8_t nat64)
+{
+	struct pf_state_hash_key hk __attribute__((aligned(8)));
+
+	bzero(&hk, sizeof(hk));
+	switch (af) {
+#if INET
+	case AF_INET:
+		hk.addr.v4addr = h->addr.v4addr;
+		break;
+#endif /* INET */
+	case AF_INET6:
+		hk.addr.v6addr = h->addr.v6addr;
+		break;
+	}
+	switch (proto) {
+	case IPPROTO_UDP:
+		hk.proto_variant = proto_variant;
+		OS_FALLTHROUGH;
+	case IPPROTO_TCP:
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		hk.port = h->xport.port;
+		break;
+	}
+	hk.af = af;
+	hk.proto = proto;
+	hk.nat64 = nat64;
+
+	return net_flowhash(&hk, sizeof(hk), pf_state_hash_seed);
+}
+
+static __inline u_int32_t
+pf_state_hash_lan_ext(struct pf_state_key *sk)
+{
+	return pf_state_hash_host(&sk->lan, sk->af_lan, sk->proto,
+	           sk->proto_variant, 0);
+}
+
+static __inline u_int32_t
+pf_state_hash_ext_gwy(struct pf_state_key *sk)
+{
+	return pf_state_hash_host(&sk->gwy, sk->af_gwy, sk->proto,
+	           sk->proto_variant,
+	           (sk->af_lan == PF_INET6 && sk->af_gwy == PF_INET) ? 1 : 0);
+}
+
+void
+pf_state_hash_init(void)
+{
+	if (!pf_state_hash_enabled) {
+		return;
+	}
+	pf_state_hash_seed = RandomULong();
+	pf_statehash_lan_ext.psh_buckets = kalloc_type(struct pf_state_key_bucket,
+	    PF_STATE_HASH_MIN, Z_WAITOK_ZERO_NOFAIL);
+	pf_statehash_lan_ext.psh_mask = PF_STATE_HASH_MIN - 1;
+	pf_statehash_ext_gwy.psh_buckets = kalloc_type(struct pf_state_key_bucket,
+	    PF_STATE_HASH_MIN, Z_WAITOK_ZERO_NOFAIL);
+	pf_statehash_ext_gwy.psh_mask = PF_STATE_HASH_MIN - 1;
+}
+
+/*
+ * Rehash every key into a table of nbuckets buckets.  This runs from
+ * the packet path with pf_lock held, so the new table is allocated
+ * without blocking, and the current one is kept if that fails.
+ */
+static void
+pf_state_hash_resize(struct pf_state_hash *psh, u_int32_t nbuckets,
+    boolean_t lan_ext)
+{
+	struct pf_state_key_bucket *buckets;
+	struct pf_state_key *sk;
+
+	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
+
+	buckets = kalloc_type(struct pf_state_key_bucket, nbuckets,
+	    Z_NOWAIT | Z_ZERO);
+	if (buckets == NULL) {
+		return;
+	}
+	for (u_int32_t i = 0; i <= psh->psh_mask; i++) {
+		while ((sk = LIST_FIRST(&psh->psh_buckets[i])) != NULL) {
+			if (lan_ext) {
+				LIST_REMOVE(sk, hash_lan_ext);
+				LIST_INSERT_HEAD(&buckets[pf_state_hash_lan_ext(sk) &
+				    (nbuckets - 1)], sk, hash_lan_ext);
+			} else {
+				LIST_REMOVE(sk, hash_ext_gwy);
+				LIST_INSERT_HEAD(&buckets[pf_state_hash_ext_gwy(sk) &
+				    (nbuckets - 1)], sk, hash_ext_gwy);
+			}
+		}
+	}
+	kfree_type(struct pf_state_key_bucket, psh->psh_mask + 1,
+	    psh->psh_buckets);
+	psh->psh_buckets = buckets;
+	psh->psh_mask = nbuckets - 1;
+}
+
+static void
+pf_state_hash_inserted(struct pf_state_hash *psh, boolean_t lan_ext)
+{
+	u_int32_t nbuckets = psh->psh_mask + 1;
+
+	if (++psh->psh_count > nbuckets * PF_STATE_HASH_LOAD &&
+	    nbuckets < PF_STATE_HASH_MAX) {
+		pf_state_hash_resize(psh, nbuckets << 1, lan_ext);
+	}
+}
+
+static void
+pf_state_hash_removed(struct pf_state_hash *psh, boolean_t lan_ext)
+{
+	u_int32_t nbuckets = psh->psh_mask + 1;
+
+	VERIFY(psh->psh_count != 0);
+	/* shrink well below the growth threshold to avoid flapping */
+	if (--psh->psh_count < nbuckets * PF_STATE_HASH_LOAD / 8 &&
+	    nbuckets > PF_STATE_HASH_MIN) {
+		pf_state_hash_resize(psh, nbuckets >> 1, lan_ext);
+	}
+}
+
+static struct pf_state_key *
+pf_find_state_key_lan_ext(struct pf_state_key *key)
+{
+	struct pf_state_key_bucket *bucket;
+	struct pf_state_key *sk;
+
+	if (!pf_state_hash_enabled) {
+		return RB_FIND(pf_state_tree_lan_ext, &pf_statetbl_lan_ext, key);
+	}
+	bucket = &pf_statehash_lan_ext.psh_buckets[pf_state_hash_lan_ext(key) &
+	    pf_statehash_lan_ext.psh_mask];
+	LIST_FOREACH(sk, bucket, hash_lan_ext) {
+		if (pf_state_compare_lan_ext(key, sk) == 0) {
+			return sk;
+		}
+	}
+	return NULL;
+}
+
+static struct pf_state_key *
+pf_find_state_key_ext_gwy(struct pf_state_key *key)
+{
+	struct pf_state_key_bucket *bucket;
+	struct pf_state_key *sk;
+
+	if (!pf_state_hash_enabled) {
+		return RB_FIND(pf_state_tree_ext_gwy, &pf_statetbl_ext_gwy, key);
+	}
+	bucket = &pf_statehash_ext_gwy.psh_buckets[pf_state_hash_ext_gwy(key) &
+	    pf_statehash_ext_gwy.psh_mask];
+	LIST_FOREACH(sk, bucket, hash_ext_gwy) {
+		if (pf_state_compare_ext_gwy(key, sk) == 0) {
+			return sk;
+		}
+	}
+	return NULL;
+}
+
+/* same contract as RB_INSERT: return the colliding key, or NULL if inserted */
+static struct pf_state_key *
+pf_insert_state_key_lan_ext(struct pf_state_key *psk)
+{
+	struct pf_state_key *cur;
+
+	if (!pf_state_hash_enabled) {
+		return RB_INSERT(pf_state_tree_lan_ext, &pf_statetbl_lan_ext, psk);
+	}
+	if ((cur = pf_find_state_key_lan_ext(psk)) != NULL) {
+		return cur;
+	}
+	LIST_INSERT_HEAD(&pf_statehash_lan_ext.psh_buckets[pf_state_hash_lan_ext(psk) &
+	    pf_statehash_lan_ext.psh_mask], psk, hash_lan_ext);
+	pf_state_hash_inserted(&pf_statehash_lan_ext, TRUE);
+	return NULL;
+}
+
+static void
+pf_remove_state_key_lan_ext(struct pf_state_key *psk)
+{
+	if (!pf_state_hash_enabled) {
+		RB_REMOVE(pf_state_tree_lan_ext, &pf_statetbl_lan_ext, psk);
+		return;
+	}
+	LIST_REMOVE(psk, hash_lan_ext);
+	pf_state_hash_removed(&pf_statehash_lan_ext, TRUE);
+}
+
 struct pf_state *
 pf_find_state_byid(struct pf_state_cmp *key)
 {
@@ -1113,8 +1396,7 @@ pf_find_state(struct pfi_kif *kif, struct pf_state_key_cmp *key, u_int dir)
 
 	switch (dir) {
 	case PF_OUT:
-		sk = RB_FIND(pf_state_tree_lan_ext, &pf_statetbl_lan_ext,
-		    (struct pf_state_key *)key);
+		sk = pf_find_state_key_lan_ext((struct pf_state_key *)key);
 
 		break;
 	case PF_IN:
@@ -1135,23 +1417,19 @@ pf_find_state(struct pfi_kif *kif, struct pf_state_key_cmp *key, u_int dir)
 		if (pf_state_tree_ext_gwy_nat64_cnt > 0 &&
 		    key->af_lan == PF_INET && key->af_gwy == PF_INET) {
 			key->af_lan = PF_INET6;
-			sk = RB_FIND(pf_state_tree_ext_gwy, &pf_statetbl_ext_gwy,
-			    (struct pf_state_key *) key);
+			sk = pf_find_state_key_ext_gwy((struct pf_state_key *)key);
 			key->af_lan = PF_INET;
 		}
 
 		if (sk == NULL) {
-			sk = RB_FIND(pf_state_tree_ext_gwy, &pf_statetbl_ext_gwy,
-			    (struct pf_state_key *)key);
+			sk = pf_find_state_key_ext_gwy((struct pf_state_key *)key);
 		}
 		/*
 		 * NAT64 is done only on input, for packets coming in from
 		 * from the LAN side, need to lookup the lan_ext tree.
 		 */
 		if (sk == NULL) {
-			sk = RB_FIND(pf_state_tree_lan_ext,
-			    &pf_statetbl_lan_ext,
-			    (struct pf_state_key *)key);
+			sk = pf_find_state_key_lan_ext((struct pf_state_key *)key);
 			if (sk && sk->af_lan == sk->af_gwy) {
 				sk = NULL;
 			}
@@ -1182,20 +1460,16 @@ pf_find_state_all(struct pf_state_key_cmp *key, u_int dir, int *more)
 
 	switch (dir) {
 	case PF_OUT:
-		sk = RB_FIND(pf_state_tree_lan_ext,
-		    &pf_statetbl_lan_ext, (struct pf_state_key *)key);
+		sk = pf_find_state_key_lan_ext((struct pf_state_key *)key);
 		break;
 	case PF_IN:
-		sk = RB_FIND(pf_state_tree_ext_gwy,
-		    &pf_statetbl_ext_gwy, (struct pf_state_key *)key);
+		sk = pf_find_state_key_ext_gwy((struct pf_state_key *)key);
 		/*
 		 * NAT64 is done only on input, for packets coming in from
 		 * from the LAN side, need to lookup the lan_ext tree.
 		 */
 		if ((sk == NULL) && pf_nat64_configured) {
-			sk = RB_FIND(pf_state_tree_lan_ext,
-			    &pf_statetbl_lan_ext,
-			    (struct pf_state_key *)key);
+			sk = pf_find_state_key_lan_ext((struct pf_state_key *)key);
 			if (sk && sk->af_lan == sk->af_gwy) {
 				sk = NULL;
 			}
@@ -1466,8 +1740,15 @@ pf_stateins_err(const char *tree, struct pf_state *s, struct pfi_kif *kif)
 static __inline struct pf_state_key *
 pf_insert_state_key_ext_gwy(struct pf_state_key *psk)
 {
-	struct pf_state_key * ret = RB_INSERT(pf_state_tree_ext_gwy,
-	    &pf_statetbl_ext_gwy, psk);
+	struct pf_state_key * ret;
+
+	if (!pf_state_hash_enabled) {
+		ret = RB_INSERT(pf_state_tree_ext_gwy, &pf_statetbl_ext_gwy, psk);
+	} else if ((ret = pf_find_state_key_ext_gwy(psk)) == NULL) {
+		LIST_INSERT_HEAD(&pf_statehash_ext_gwy.psh_buckets[pf_state_hash_ext_gwy(psk) &
+		    pf_statehash_ext_gwy.psh_mask], psk, hash_ext_gwy);
+		pf_state_hash_inserted(&pf_statehash_ext_gwy, FALSE);
+	}
 	if (!ret && psk->af_lan == PF_INET6 &&
 	    psk->af_gwy == PF_INET) {
 		pf_state_tree_ext_gwy_nat64_cnt++;
@@ -1478,8 +1759,15 @@ pf_insert_state_key_ext_gwy(struct pf_state_key *psk)
 static __inline struct pf_state_key *
 pf_remove_state_key_ext_gwy(struct pf_state_key *psk)
 {
-	struct pf_state_key * ret = RB_REMOVE(pf_state_tree_ext_gwy,
-	    &pf_statetbl_ext_gwy, psk);
+	struct pf_state_key * ret;
+
+	if (!pf_state_hash_enabled) {
+		ret = RB_REMOVE(pf_state_tree_ext_gwy, &pf_statetbl_ext_gwy, psk);
+	} else {
+		LIST_REMOVE(psk, hash_ext_gwy);
+		pf_state_hash_removed(&pf_statehash_ext_gwy, FALSE);
+		ret = psk;
+	}
 	if (ret && psk->af_lan == PF_INET6 &&
 	    psk->af_gwy == PF_INET) {
 		pf_state_tree_ext_gwy_nat64_cnt--;
@@ -1496,8 +1784,7 @@ pf_insert_state(struct pfi_kif *kif, struct pf_state *s)
 	VERIFY(s->state_key != NULL);
 	s->kif = kif;
 
-	if ((cur = RB_INSERT(pf_state_tree_lan_ext, &pf_statetbl_lan_ext,
-	    s->state_key)) != NULL) {
+	if ((cur = pf_insert_state_key_lan_ext(s->state_key)) != NULL) {
 		/* key exists. check for same kif, if none, add to key */
 		TAILQ_FOREACH(sp, &cur->states, next)
 		if (sp->kif == kif) {           /* collision! */
@@ -2151,6 +2438,246 @@ pf_calc_skip_steps(struct pf_rulequeue *rules)
 	}
 }
 
+static inline u_int32_t
+pf_rule_dispatch_key(u_int8_t proto, u_int16_t port)
+{
+	return ((u_int32_t)proto << 16) | port;
+}
+
+static inline u_int32_t
+pf_rule_dispatch_hash(u_int32_t key, u_int32_t nports)
+{
+	key *= 0x9e3779b1;
+	return (key ^ (key >> 16)) & (nports - 1);
+}
+
+/* rules that can only match one TCP/UDP destination port */
+static inline int
+pf_rule_dispatch_port_rule(struct pf_rule *r)
+{
+	return (r->proto == IPPROTO_TCP || r->proto == IPPROTO_UDP) &&
+	       r->dst.xport.range.op == PF_OP_EQ;
+}
+
+static struct pf_rule_dispatch_port *
+pf_rule_dispatch_port_find(struct pf_rule_dispatch *d, u_int32_t key)
+{
+	struct pf_rule_dispatch_port *p;
+	u_int32_t h;
+
+	if (d->prd_nports == 0) {
+		return NULL;
+	}
+	for (h = pf_rule_dispatch_hash(key, d->prd_nports);;
+	    h = (h + 1) & (d->prd_nports - 1)) {
+		p = &d->prd_ports[h];
+		if (p->pdp_key == key || p->pdp_key == 0) {
+			return p;
+		}
+	}
+}
+
+static inline void
+pf_rule_dispatch_set(struct pf_rule_dispatch *d, u_int32_t bitmap,
+    u_int32_t nr)
+{
+	d->prd_bits[bitmap * d->prd_nwords + (nr >> 6)] |= 1ULL << (nr & 63);
+}
+
+static void
+pf_rule_dispatch_copy(struct pf_rule_dispatch *d, u_int32_t dst,
+    u_int32_t src)
+{
+	bcopy(&d->prd_bits[src * d->prd_nwords],
+	    &d->prd_bits[dst * d->prd_nwords],
+	    d->prd_nwords * sizeof(u_int64_t));
+}
+
+void
+pf_uncompile_ruleset(struct pf_ruleset *rs)
+{
+	struct pf_rule_dispatch *d = rs->dispatch;
+
+	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (d == NULL) {
+		return;
+	}
+	rs->dispatch = NULL;
+	kfree_type(struct pf_rule *, d->prd_nrules, d->prd_rules);
+	kfree_data(d->prd_bits, d->prd_nbits * sizeof(u_int64_t));
+	kfree_data(d->prd_ports, d->prd_nports *
+	    sizeof(struct pf_rule_dispatch_port));
+	kfree_type(struct pf_rule_dispatch, d);
+}
+
+/*
+ * Build the candidate bitmaps of an active filter ruleset.  Must be
+ * called whenever the active rules are replaced, inserted, removed or
+ * renumbered.  Rulesets that are too small, or whose candidate sets
+ * would not fit in PF_RULE_DISPATCH_MAX_BYTES, are walked linearly.
+ */
+void
+pf_compile_ruleset(struct pf_ruleset *rs, int rs_num)
+{
+	struct pf_rule_dispatch *d;
+	struct pf_rule_dispatch_port *p;
+	struct pf_rule *r;
+	u_int32_t nrules = 0, nkeys = 0, nbitmaps = 1, nports = 0;
+	u_int32_t nwords;
+
+	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (rs_num != PF_RULESET_FILTER) {
+		return;
+	}
+	pf_uncompile_ruleset(rs);
+	if (!pf_rule_dispatch_enabled) {
+		return;
+	}
+
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		/* candidates are looked up by rule number */
+		if (r->nr != nrules) {
+			return;
+		}
+		nrules++;
+		if (pf_rule_dispatch_port_rule(r)) {
+			nkeys++;
+		}
+	}
+	if (nrules < PF_RULE_DISPATCH_MIN) {
+		return;
+	}
+	nwords = (nrules + 63) / 64;
+	if (nkeys != 0) {
+		nports = 1;
+		while (nports < 2 * nkeys) {
+			nports <<= 1;
+		}
+	}
+
+	d = kalloc_type(struct pf_rule_dispatch, Z_WAITOK_ZERO_NOFAIL);
+	d->prd_nwords = nwords;
+	d->prd_nrules = nrules;
+	d->prd_rules = kalloc_type(struct pf_rule *, nrules, Z_WAITOK_ZERO_NOFAIL);
+	if (nports != 0) {
+		d->prd_nports = nports;
+		d->prd_ports = kalloc_data(nports *
+		    sizeof(struct pf_rule_dispatch_port), Z_WAITOK_ZERO_NOFAIL);
+	}
+	rs->dispatch = d;
+
+	/* number the bitmaps: any protocol, each protocol, each port */
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		d->prd_rules[r->nr] = r;
+		if (r->proto != 0 && d->prd_proto[r->proto] == 0) {
+			d->prd_proto[r->proto] = nbitmaps++;
+		}
+	}
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		if (!pf_rule_dispatch_port_rule(r)) {
+			continue;
+		}
+		p = pf_rule_dispatch_port_find(d, pf_rule_dispatch_key(r->proto,
+		    r->dst.xport.range.port[0]));
+		if (p->pdp_key == 0) {
+			p->pdp_key = pf_rule_dispatch_key(r->proto,
+			    r->dst.xport.range.port[0]);
+			p->pdp_bitmap = nbitmaps++;
+		}
+	}
+	if ((u_int64_t)nbitmaps * nwords * sizeof(u_int64_t) >
+	    PF_RULE_DISPATCH_MAX_BYTES) {
+		pf_uncompile_ruleset(rs);
+		return;
+	}
+	d->prd_nbits = nbitmaps * nwords;
+	d->prd_bits = kalloc_data(d->prd_nbits * sizeof(u_int64_t),
+	    Z_WAITOK_ZERO_NOFAIL);
+
+	/*
+	 * Fill them in order, each one starting as a copy of the set it
+	 * refines: protocol sets contain the rules of any protocol, and
+	 * port sets the rules of their protocol not tied to another port.
+	 */
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		if (r->proto == 0) {
+			pf_rule_dispatch_set(d, 0, r->nr);
+		}
+	}
+	for (u_int32_t proto = 1; proto < 256; proto++) {
+		if (d->prd_proto[proto] != 0) {
+			pf_rule_dispatch_copy(d, d->prd_proto[proto], 0);
+		}
+	}
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		if (r->proto != 0 && !pf_rule_dispatch_port_rule(r)) {
+			pf_rule_dispatch_set(d, d->prd_proto[r->proto], r->nr);
+		}
+	}
+	for (u_int32_t h = 0; h < d->prd_nports; h++) {
+		p = &d->prd_ports[h];
+		if (p->pdp_key != 0) {
+			pf_rule_dispatch_copy(d, p->pdp_bitmap,
+			    d->prd_proto[p->pdp_key >> 16]);
+		}
+	}
+	TAILQ_FOREACH(r, rs->rules[rs_num].active.ptr, entries) {
+		if (pf_rule_dispatch_port_rule(r)) {
+			p = pf_rule_dispatch_port_find(d,
+			    pf_rule_dispatch_key(r->proto,
+			    r->dst.xport.range.port[0]));
+			pf_rule_dispatch_set(d, p->pdp_bitmap, r->nr);
+		}
+	}
+}
+
+/*
+ * Return the first rule of the walk that can match the packet described
+ * by the cursor, starting with r itself.  The cursor caches the candidate
+ * set of the last ruleset it was used on, as the walk enters and leaves
+ * anchors.
+ */
+static inline struct pf_rule *
+pf_rule_dispatch_next(struct pf_rule_cursor *c, struct pf_ruleset *ruleset,
+    struct pf_rule *r)
+{
+	struct pf_rule_dispatch *d;
+	struct pf_rule_dispatch_port *p;
+	u_int64_t m;
+	u_int32_t w;
+
+	if (ruleset == NULL) {
+		ruleset = &pf_main_ruleset;
+	}
+	if (r == NULL || (d = ruleset->dispatch) == NULL) {
+		return r;
+	}
+	if (c->prc_ruleset != ruleset) {
+		w = d->prd_proto[c->prc_proto];
+		if (c->prc_key != 0 &&
+		    (p = pf_rule_dispatch_port_find(d, c->prc_key)) != NULL &&
+		    p->pdp_key != 0) {
+			w = p->pdp_bitmap;
+		}
+		c->prc_ruleset = ruleset;
+		c->prc_bits = &d->prd_bits[w * d->prd_nwords];
+	}
+	if ((u_int32_t)r->nr >= d->prd_nrules) {
+		return r;
+	}
+	w = r->nr >> 6;
+	m = c->prc_bits[w] & (~0ULL << (r->nr & 63));
+	while (m == 0) {
+		if (++w == d->prd_nwords) {
+			return NULL;
+		}
+		m = c->prc_bits[w];
+	}
+	return d->prd_rules[(w << 6) + (u_int32_t)__builtin_ctzll(m)];
+}
+
 u_int32_t
 pf_calc_state_key_flowhash(struct pf_state_key *sk)
 {
@@ -4443,8 +4970,7 @@ pf_detach_state(struct pf_state *s, int flags)
 			pf_remove_state_key_ext_gwy(sk);
 		}
 		if (!(flags & PF_DT_SKIP_LANEXT)) {
-			RB_REMOVE(pf_state_tree_lan_ext,
-			    &pf_statetbl_lan_ext, sk);
+			pf_remove_state_key_lan_ext(sk);
 		}
 		if (sk->app_state) {
 			pool_put(&pf_app_state_pl, sk->app_state);
@@ -4953,6 +5479,7 @@ pf_test_rule(struct pf_rule **rm, struct pf_state **sm, int direction,
 	struct pf_grev1_hdr     *__single grev1 = pf_pd_get_hdr_grev1(pd);
 	union pf_state_xport bxport, bdxport, nxport, sxport, dxport;
 	struct pf_state_key      psk;
+	struct pf_rule_cursor    cursor = { .prc_ruleset = NULL };
 
 	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
 
@@ -5267,7 +5794,19 @@ pf_test_rule(struct pf_rule **rm, struct pf_state **sm, int direction,
 		tag = nr->tag;
 	}
 
+	cursor.prc_proto = pd->proto;
+	if (pd->proto == IPPROTO_TCP || pd->proto == IPPROTO_UDP) {
+		cursor.prc_key = pf_rule_dispatch_key(pd->proto, th->th_dport);
+	}
 	while (r != NULL) {
+		r = pf_rule_dispatch_next(&cursor, ruleset, r);
+		if (r == NULL) {
+			if (pf_step_out_of_anchor(&asd, &ruleset,
+			    PF_RULESET_FILTER, &r, &a, &match)) {
+				break;
+			}
+			continue;
+		}
 		r->evaluations++;
 		if (pfi_kif_match(r->kif, kif) == r->ifnot) {
 			r = r->skip[PF_SKIP_IFP].ptr;
@@ -6506,9 +7045,19 @@ pf_test_fragment(struct pf_rule **rm, int direction, struct pfi_kif *kif,
 	int                      tag = -1;
 	int                      asd = 0;
 	int                      match = 0;
+	struct pf_rule_cursor    cursor = { .prc_proto = pd->proto };
 
+	/* fragments carry no port, rules naming one never match them */
 	r = TAILQ_FIRST(pf_main_ruleset.rules[PF_RULESET_FILTER].active.ptr);
 	while (r != NULL) {
+		r = pf_rule_dispatch_next(&cursor, ruleset, r);
+		if (r == NULL) {
+			if (pf_step_out_of_anchor(&asd, &ruleset,
+			    PF_RULESET_FILTER, &r, &a, &match)) {
+				break;
+			}
+			continue;
+		}
 		r->evaluations++;
 		if (pfi_kif_match(r->kif, kif) == r->ifnot) {
 			r = r->skip[PF_SKIP_IFP].ptr;
@@ -8898,12 +9447,10 @@ pf_test_state_esp(struct pf_state **state, int direction, struct pfi_kif *kif,
 			if (s) {
 				struct pf_state_key *sk = s->state_key;
 
-				RB_REMOVE(pf_state_tree_lan_ext,
-				    &pf_statetbl_lan_ext, sk);
+				pf_remove_state_key_lan_ext(sk);
 				sk->ext_lan.xport.spi = esp->spi;
 
-				if (RB_INSERT(pf_state_tree_lan_ext,
-				    &pf_statetbl_lan_ext, sk)) {
+				if (pf_insert_state_key_lan_ext(sk)) {
 					pf_detach_state(s, PF_DT_SKIP_LANEXT);
 				} else {
 					*state = s;
@@ -9354,7 +9901,7 @@ pf_route(pbuf_t **pbufp, struct pf_rule *r, int dir, struct ifnet *oifp,
 	}
 
 	if (ntohs(ip->ip_len) <= interface_mtu || TSO_IPV4_OK(ifp, m0) ||
-	    (!(ip->ip_off & htons(IP_DF)) &&
+	    UDP_GSO_OK(ifp, m0) || (!(ip->ip_off & htons(IP_DF)) &&
 	    (ifp->if_hwassist & CSUM_FRAGMENT))) {
 		ip->ip_sum = 0;
 		if (sw_csum & CSUM_DELAY_IP) {
@@ -9369,10 +9916,11 @@ pf_route(pbuf_t **pbufp, struct pf_rule *r, int dir, struct ifnet *oifp,
 	/*
 	 * Too large for interface; fragment if possible.
 	 * Must be able to put at least 8 bytes per fragment.
-	 * Balk when DF bit is set or the interface didn't support TSO.
+	 * Balk when DF bit is set or the interface didn't support TSO
+	 * or UDP segmentation.
 	 */
 	if ((ip->ip_off & htons(IP_DF)) ||
-	    (m0->m_pkthdr.csum_flags & CSUM_TSO_IPV4)) {
+	    (m0->m_pkthdr.csum_flags & (CSUM_TSO_IPV4 | CSUM_UDP_GSO))) {
 		ipstat.ips_cantfrag++;
 		if (r->rt != PF_DUPTO) {
 			icmp_error(m0, ICMP_UNREACH, ICMP_UNREACH_NEEDFRAG, 0,
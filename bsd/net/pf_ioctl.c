@@ -487,6 +487,7 @@ pfinit(void)
 
 	RB_INIT(&tree_src_tracking);
 	RB_INIT(&pf_anchors);
+	pf_state_hash_init();
 	pf_init_ruleset(&pf_main_ruleset);
 	TAILQ_INIT(&pf_pabuf);
 	TAILQ_INIT(&state_list);
@@ -1170,6 +1171,7 @@ pf_commit_rules(u_int32_t ticket, int rs_num, char const *anchor)
 	rs->rules[rs_num].active.ticket =
 	    rs->rules[rs_num].inactive.ticket;
 	pf_calc_skip_steps(rs->rules[rs_num].active.ptr);
+	pf_compile_ruleset(rs, rs_num);
 
 
 	/* Purge the old rule list. */
@@ -2514,6 +2516,10 @@ pf_delete_rule_from_ruleset(struct pf_ruleset *ruleset, int rs_num,
 
 	pf_expire_states_and_src_nodes(rule);
 
+	/* rebuilt by pf_ruleset_cleanup() */
+	if (rs_num == PF_RULESET_FILTER) {
+		pf_uncompile_ruleset(ruleset);
+	}
 	pf_rm_rule(ruleset->rules[rs_num].active.ptr, rule);
 	if (ruleset->rules[rs_num].active.rcount-- == 0) {
 		panic("%s: rcount value broken!", __func__);
@@ -2531,6 +2537,7 @@ static void
 pf_ruleset_cleanup(struct pf_ruleset *ruleset, int rs)
 {
 	pf_calc_skip_steps(ruleset->rules[rs].active.ptr);
+	pf_compile_ruleset(ruleset, rs);
 	ruleset->rules[rs].active.ticket =
 	    ++ruleset->rules[rs].inactive.ticket;
 }
@@ -3239,6 +3246,7 @@ pfioctl_ioc_rule(u_long cmd, int minordev, struct pfioc_rule *pr, struct proc *p
 		ruleset->rules[rs_num].active.ticket++;
 
 		pf_calc_skip_steps(ruleset->rules[rs_num].active.ptr);
+		pf_compile_ruleset(ruleset, rs_num);
 #if SKYWALK
 		pf_process_compatibilities();
 #endif // SKYWALK
@@ -1017,8 +1017,15 @@ struct pf_state_key {
 	u_int32_t        flowsrc;
 	u_int32_t        flowhash;
 
-	RB_ENTRY(pf_state_key)   entry_lan_ext;
-	RB_ENTRY(pf_state_key)   entry_ext_gwy;
+	/* the hash links replace the tree links when pf_state_hash is set */
+	union {
+		RB_ENTRY(pf_state_key)   entry_lan_ext;
+		LIST_ENTRY(pf_state_key) hash_lan_ext;
+	};
+	union {
+		RB_ENTRY(pf_state_key)   entry_ext_gwy;
+		LIST_ENTRY(pf_state_key) hash_ext_gwy;
+	};
 	struct pf_statelist      states;
 	u_int32_t        refcnt;
 };
@@ -1225,6 +1232,7 @@ struct pf_ruleset {
 	u_int32_t                tticket;
 	int                      tables;
 	int                      topen;
+	struct pf_rule_dispatch *dispatch;      /* compiled active filter rules */
 };
 
 RB_HEAD(pf_anchor_global, pf_anchor);
@@ -2242,6 +2250,8 @@ __private_extern__ int pf_tbladdr_setup(struct pf_ruleset *,
 __private_extern__ void pf_tbladdr_remove(struct pf_addr_wrap *);
 __private_extern__ void pf_tbladdr_copyout(struct pf_addr_wrap *);
 __private_extern__ void pf_calc_skip_steps(struct pf_rulequeue *);
+__private_extern__ void pf_compile_ruleset(struct pf_ruleset *, int);
+__private_extern__ void pf_uncompile_ruleset(struct pf_ruleset *);
 __private_extern__ u_int32_t pf_calc_state_key_flowhash(struct pf_state_key *);
 
 extern struct pool pf_src_tree_pl, pf_rule_pl;
@@ -2254,6 +2264,7 @@ extern struct thread *pf_purge_thread;
 extern void pf_register_m_tag(void);
 
 __private_extern__ void pfinit(void);
+__private_extern__ void pf_state_hash_init(void);
 __private_extern__ void pf_purge_thread_fn(void *, wait_result_t) __dead2;
 __private_extern__ void pf_purge_expired_src_nodes(void);
 __private_extern__ void pf_purge_expired_states(u_int32_t);
@@ -76,6 +76,9 @@
 #include <strings.h>
 #include <mach/boolean.h>
 #include <skywalk/os_skywalk_private.h>
+#if defined(__x86_64__)
+#include <machine/cpu_capabilities.h>
+#endif /* __x86_64__ */
 #define CKSUM_ERR(fmt, args...) fprintf_stderr(fmt, ## args)
 #endif /* !KERNEL */
 
@@ -214,6 +217,29 @@ os_cpu_in_cksum(const void *__sized_by(len) data, uint32_t len, uint32_t initial
  * reduction is done to avoid carry in long packets.
  */
 
+#if defined(__x86_64__)
+/*
+ * On x86_64, the bulk of large mbufs is summed by the AVX2 loop in
+ * bsd/dev/i386/cpu_in_cksum.s.  The kernel only uses it when built for
+ * AVX2 (x86_64h), like lz4_decode_asm; user space checks the processor
+ * capabilities at runtime.  An SSE2 version of that loop is not faster
+ * than the 64-bit accumulator below, which remains the fallback.
+ */
+#define CKSUM_VEC_MIN_LEN       256
+
+extern uint32_t os_cpu_in_cksum_avx2(const void *__sized_by(len), uint32_t len);
+
+#ifdef KERNEL
+#ifdef __AVX2__
+#define CKSUM_HAS_AVX2()        1
+#else /* !__AVX2__ */
+#define CKSUM_HAS_AVX2()        0
+#endif /* !__AVX2__ */
+#else /* !KERNEL */
+#define CKSUM_HAS_AVX2()        ((_get_cpu_capabilities() & kHasAVX2_0) != 0)
+#endif /* !KERNEL */
+#endif /* __x86_64__ */
+
 #if !defined(__LP64__)
 /* 32-bit version */
 uint32_t
@@ -438,6 +464,16 @@ post_initial_offset:
 			data += 2;
 			mlen -= 2;
 		}
+#if defined(__x86_64__)
+		if (mlen >= CKSUM_VEC_MIN_LEN && CKSUM_HAS_AVX2()) {
+			int vlen = mlen & ~63;
+
+			/* returns a 17-bit sum; partial cannot overflow */
+			partial += os_cpu_in_cksum_avx2(data, (uint32_t)vlen);
+			data += vlen;
+			mlen -= vlen;
+		}
+#endif /* __x86_64__ */
 		while (mlen >= 64) {
 			__builtin_prefetch(data + 32);
 			__builtin_prefetch(data + 64);
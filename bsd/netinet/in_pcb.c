@@ -82,6 +82,7 @@
 #include <net/dlil.h>
 
 #include <libkern/OSAtomic.h>
+#include <kern/cpu_number.h>
 #include <kern/locks.h>
 
 #include <machine/limits.h>
@@ -262,6 +263,16 @@ SYSCTL_PROC(_net_inet_ip_portrange, OID_AUTO, hilast,
 SYSCTL_INT(_net_inet_ip_portrange, OID_AUTO, ipport_allow_udp_port_exhaustion,
     CTLFLAG_LOCKED | CTLFLAG_RW, &allow_udp_port_exhaustion, 0, "");
 
+static uint32_t inp_lbgroup_percpu = 0;
+SYSCTL_UINT(_net_inet_ip, OID_AUTO, reuseport_lb_percpu,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &inp_lbgroup_percpu, 0,
+    "Pick SO_REUSEPORT_LB listeners by receiving CPU instead of flow hash");
+
+uint32_t inp_busy_poll_max = 1000;     /* usec */
+SYSCTL_UINT(_net_inet_ip, OID_AUTO, busy_poll_max,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &inp_busy_poll_max, 0,
+    "Largest SO_BUSY_POLL budget a socket may set, in usec");
+
 static uint32_t apn_fallbk_debug = 0;
 #define apn_fallbk_log(x)       do { if (apn_fallbk_debug >= 1) log x; } while (0)
 
@@ -2065,6 +2076,19 @@ in_pcbdetach(struct inpcb *inp)
 }
 
 
+/*
+ * Lockless lookups may still be looking at a pcb that has just
+ * been removed from the hash, so its memory is only returned to
+ * the zone once they have all left their smr_inpcb read section.
+ */
+static void
+in_pcbfree(smr_node_t node)
+{
+	struct inpcb *inp = __container_of(node, struct inpcb, inp_smr_node);
+
+	zfree(inp->inp_pcbinfo->ipi_zone, inp);
+}
+
 void
 in_pcbdispose(struct inpcb *inp)
 {
@@ -2135,7 +2159,8 @@ in_pcbdispose(struct inpcb *inp)
 		 * we deallocate the structure.
 		 */
 		ROUTE_RELEASE(&inp->inp_route);
-		zfree(ipi->ipi_zone, inp);
+		smr_inpcb_call(&inp->inp_smr_node,
+		    kalloc_type_size(ipi->ipi_zone), in_pcbfree);
 		proto_memacct_sub(so->so_proto, kalloc_type_size(ipi->ipi_zone));
 
 		sodealloc(so);
@@ -2339,14 +2364,14 @@ in_pcblookup_local(struct inpcbinfo *pcbinfo, struct in_addr laddr,
 	KERNEL_DEBUG(DBG_FNC_PCB_LOOKUP | DBG_FUNC_START, 0, 0, 0, 0, 0);
 
 	if (!wild_okay) {
-		struct inpcbhead *head;
+		struct smrq_list_head *head;
 		/*
 		 * Look for an unconnected (wildcard foreign addr) PCB that
 		 * matches the local address and port we're looking for.
 		 */
 		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 		    pcbinfo->ipi_hashmask)];
-		LIST_FOREACH(inp, head, inp_hash) {
+		smrq_serialized_foreach(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV4)) {
 				continue;
 			}
@@ -2429,7 +2454,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
     u_int fport_arg, struct in_addr laddr, u_int lport_arg, int wildcard,
     uid_t *uid, gid_t *gid, struct ifnet *ifp)
 {
-	struct inpcbhead *head;
+	struct smrq_list_head *head;
 	struct inpcb *inp;
 	u_short fport = (u_short)fport_arg, lport = (u_short)lport_arg;
 	int found = 0;
@@ -2450,7 +2475,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	 */
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
 	    pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
 		}
@@ -2492,7 +2517,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 	    pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
 		}
@@ -2551,6 +2576,119 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	return found;
 }
 
+/*
+ * Lookup a connected PCB in hash list without taking ipi_lock.
+ *
+ * Only exact matches with a specified foreign address are looked up
+ * here; the NECP receive policy is checked once the read section has
+ * been left.  A miss does not mean that there is no such PCB, as the
+ * bucket may be walked concurrently with a rehash; callers must fall
+ * back to the locked lookup.
+ */
+static struct inpcb *
+in_pcblookup_hash_smr(struct inpcbinfo *pcbinfo, struct in_addr faddr,
+    u_short fport, struct in_addr laddr, u_short lport, struct ifnet *ifp)
+{
+	struct smrq_list_head *head;
+	struct inpcb *inp, *match = NULL;
+
+	if (faddr.s_addr == INADDR_ANY) {
+		return NULL;
+	}
+
+	smr_inpcb_enter();
+
+	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
+	    pcbinfo->ipi_hashmask)];
+	smrq_entered_foreach(inp, head, inp_hash) {
+		if (!(inp->inp_vflag & INP_IPV4)) {
+			continue;
+		}
+		if (inp->inp_faddr.s_addr != faddr.s_addr ||
+		    inp->inp_laddr.s_addr != laddr.s_addr ||
+		    inp->inp_fport != fport ||
+		    inp->inp_lport != lport) {
+			continue;
+		}
+		if (inp_restricted_recv(inp, ifp)) {
+			continue;
+		}
+
+		if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
+			match = inp;
+		}
+		break;
+	}
+
+	smr_inpcb_leave();
+
+#if NECP
+	/*
+	 * The policy check may take locks and allocate, so it is done
+	 * outside of the read section, the want reference keeping the
+	 * pcb and its socket around.  A denied match is left to the
+	 * locked lookup, which may still find a wildcard pcb.
+	 */
+	if (match != NULL &&
+	    !necp_socket_is_allowed_to_recv_on_interface(match, ifp)) {
+		(void) in_pcb_checkstate(match, WNT_RELEASE, 0);
+		match = NULL;
+	}
+#endif /* NECP */
+
+	return match;
+}
+
+/*
+ * Lookup a SO_REUSEPORT_LB listener for a new flow, preferring a group
+ * bound to the local address over a wildcard one.
+ */
+static struct inpcb *
+in_pcblookup_lbgroup(struct inpcbinfo *pcbinfo, struct in_addr faddr,
+    u_short fport, struct in_addr laddr, u_short lport, struct ifnet *ifp)
+{
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp;
+	struct inpcblbgroup *local_wild = NULL;
+	struct inpcblbgroup *local_wild_mapped = NULL;
+	struct inpcb *inp;
+	uint32_t hash;
+
+	if (pcbinfo->ipi_lbgrouphashbase == NULL) {
+		return NULL;
+	}
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	hash = INP_PCBHASH(faddr.s_addr, lport, fport, UINT32_MAX);
+
+	LIST_FOREACH(grp, head, il_list) {
+		if (!(grp->il_vflag & INP_IPV4) || grp->il_lport != lport) {
+			continue;
+		}
+		if (grp->il_laddr.s_addr == laddr.s_addr) {
+			inp = in_pcblbgroup_select(grp, hash, ifp);
+			if (inp != NULL) {
+				return inp;
+			}
+		} else if (grp->il_laddr.s_addr == INADDR_ANY) {
+			if (grp->il_vflag & INP_IPV6) {
+				local_wild_mapped = grp;
+			} else {
+				local_wild = grp;
+			}
+		}
+	}
+	if (local_wild != NULL &&
+	    (inp = in_pcblbgroup_select(local_wild, hash, ifp)) != NULL) {
+		return inp;
+	}
+	if (local_wild_mapped != NULL) {
+		return in_pcblbgroup_select(local_wild_mapped, hash, ifp);
+	}
+	return NULL;
+}
+
 /*
  * Lookup PCB in hash list.
  */
@@ -2559,7 +2697,7 @@ in_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in_addr faddr,
     u_int fport_arg, struct in_addr laddr, u_int lport_arg, int wildcard,
     struct ifnet *ifp)
 {
-	struct inpcbhead *head;
+	struct smrq_list_head *head;
 	struct inpcb *inp;
 	u_short fport = (u_short)fport_arg, lport = (u_short)lport_arg;
 	struct inpcb *local_wild = NULL;
@@ -2570,7 +2708,7 @@ in_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	 */
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
 	    pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
 		}
@@ -2608,9 +2746,14 @@ in_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		return NULL;
 	}
 
+	inp = in_pcblookup_lbgroup(pcbinfo, faddr, fport, laddr, lport, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 	    pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
 		}
@@ -2671,6 +2814,12 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 {
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, faddr, (u_short)fport_arg, laddr,
+	    (u_short)lport_arg, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	inp = in_pcblookup_hash_locked(pcbinfo, faddr, fport_arg, laddr,
@@ -2689,6 +2838,12 @@ in_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 {
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, faddr, (u_short)fport_arg, laddr,
+	    (u_short)lport_arg, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	if (!lck_rw_try_lock_shared(&pcbinfo->ipi_lock)) {
 		return NULL;
 	}
@@ -2714,7 +2869,7 @@ in_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 int
 in_pcbinshash(struct inpcb *inp, struct sockaddr *remote, int locked)
 {
-	struct inpcbhead *pcbhash;
+	struct smrq_list_head *pcbhash;
 	struct inpcbporthead *pcbporthash;
 	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
 	struct inpcbport *phd;
@@ -2808,7 +2963,7 @@ in_pcbinshash(struct inpcb *inp, struct sockaddr *remote, int locked)
 
 	inp->inp_phd = phd;
 	LIST_INSERT_HEAD(&phd->phd_pcblist, inp, inp_portlist);
-	LIST_INSERT_HEAD(pcbhash, inp, inp_hash);
+	smrq_serialized_insert_head(pcbhash, &inp->inp_hash);
 	inp->inp_flags2 |= INP2_INHASHLIST;
 
 	if (!locked) {
@@ -2832,7 +2987,8 @@ in_pcbinshash(struct inpcb *inp, struct sockaddr *remote, int locked)
 void
 in_pcbrehash(struct inpcb *inp)
 {
-	struct inpcbhead *head;
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	struct smrq_list_head *head;
 	u_int32_t hashkey_faddr;
 
 #if SKYWALK
@@ -2878,17 +3034,23 @@ in_pcbrehash(struct inpcb *inp)
 		hashkey_faddr = inp->inp_faddr.s_addr;
 	}
 
-	inp->inp_hash_element = INP_PCBHASH(hashkey_faddr, inp->inp_lport,
-	    inp->inp_fport, inp->inp_pcbinfo->ipi_hashmask);
-	head = &inp->inp_pcbinfo->ipi_hashbase[inp->inp_hash_element];
-
 	if (inp->inp_flags2 & INP2_INHASHLIST) {
-		LIST_REMOVE(inp, inp_hash);
+		head = &pcbinfo->ipi_hashbase[inp->inp_hash_element];
+		smrq_serialized_remove(head, &inp->inp_hash);
 		inp->inp_flags2 &= ~INP2_INHASHLIST;
 	}
 
+	/*
+	 * Lockless readers still walking this pcb may follow it into
+	 * its new bucket and miss an entry; they fall back to the
+	 * locked lookup in that case.
+	 */
+	inp->inp_hash_element = INP_PCBHASH(hashkey_faddr, inp->inp_lport,
+	    inp->inp_fport, pcbinfo->ipi_hashmask);
+	head = &pcbinfo->ipi_hashbase[inp->inp_hash_element];
+
 	VERIFY(!(inp->inp_flags2 & INP2_INHASHLIST));
-	LIST_INSERT_HEAD(head, inp, inp_hash);
+	smrq_serialized_insert_head(head, &inp->inp_hash);
 	inp->inp_flags2 |= INP2_INHASHLIST;
 
 #if NECP
@@ -2897,6 +3059,155 @@ in_pcbrehash(struct inpcb *inp)
 #endif /* NECP */
 }
 
+#define INP_LBGROUP_SIZMIN      8
+
+static bool
+in_pcblbgroup_match(struct inpcblbgroup *grp, struct inpcb *inp)
+{
+	if (grp->il_lport != inp->inp_lport ||
+	    grp->il_vflag != inp->inp_vflag) {
+		return false;
+	}
+	if (inp->inp_vflag & INP_IPV6) {
+		return IN6_ARE_ADDR_EQUAL(&grp->il6_laddr, &inp->in6p_laddr) &&
+		       grp->il_lifscope == inp->inp_lifscope;
+	}
+	return grp->il_laddr.s_addr == inp->inp_laddr.s_addr;
+}
+
+/*
+ * Add a listening PCB to the SO_REUSEPORT_LB group of its local
+ * address and port, creating the group if needed.
+ */
+int
+in_pcblbgroup_insert(struct inpcb *inp)
+{
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp;
+
+	if (pcbinfo->ipi_lbgrouphashbase == NULL) {
+		return EOPNOTSUPP;
+	}
+
+	if (!lck_rw_try_lock_exclusive(&pcbinfo->ipi_lock)) {
+		socket_unlock(inp->inp_socket, 0);
+		lck_rw_lock_exclusive(&pcbinfo->ipi_lock);
+		socket_lock(inp->inp_socket, 0);
+	}
+
+	if (inp->inp_state == INPCB_STATE_DEAD) {
+		lck_rw_done(&pcbinfo->ipi_lock);
+		return ECONNABORTED;
+	}
+	if (inp->inp_flags2 & INP2_LBGROUP) {
+		lck_rw_done(&pcbinfo->ipi_lock);
+		return 0;
+	}
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(inp->inp_lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	LIST_FOREACH(grp, head, il_list) {
+		if (in_pcblbgroup_match(grp, inp)) {
+			break;
+		}
+	}
+
+	if (grp == NULL) {
+		grp = kalloc_type(struct inpcblbgroup, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		grp->il_dependladdr.il6_local = inp->in6p_laddr;
+		grp->il_lifscope = inp->inp_lifscope;
+		grp->il_lport = inp->inp_lport;
+		grp->il_vflag = inp->inp_vflag;
+		grp->il_inp = kalloc_type(struct inpcb *, INP_LBGROUP_SIZMIN,
+		    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		grp->il_inpsiz = INP_LBGROUP_SIZMIN;
+		LIST_INSERT_HEAD(head, grp, il_list);
+	} else if (grp->il_inpcnt == grp->il_inpsiz) {
+		uint32_t newsiz = grp->il_inpsiz * 2;
+
+		grp->il_inp = krealloc_type(struct inpcb *, grp->il_inpsiz,
+		    newsiz, grp->il_inp, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		grp->il_inpsiz = newsiz;
+	}
+
+	grp->il_inp[grp->il_inpcnt++] = inp;
+	inp->inp_flags2 |= INP2_LBGROUP;
+
+	lck_rw_done(&pcbinfo->ipi_lock);
+
+	return 0;
+}
+
+static void
+in_pcblbgroup_remove(struct inpcb *inp)
+{
+	struct inpcbinfo *pcbinfo = inp->inp_pcbinfo;
+	struct inpcblbgrouphead *head;
+	struct inpcblbgroup *grp;
+
+	LCK_RW_ASSERT(&pcbinfo->ipi_lock, LCK_RW_ASSERT_EXCLUSIVE);
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(inp->inp_lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	LIST_FOREACH(grp, head, il_list) {
+		for (uint32_t i = 0; i < grp->il_inpcnt; i++) {
+			if (grp->il_inp[i] != inp) {
+				continue;
+			}
+			grp->il_inp[i] = grp->il_inp[--grp->il_inpcnt];
+			grp->il_inp[grp->il_inpcnt] = NULL;
+			if (grp->il_inpcnt == 0) {
+				LIST_REMOVE(grp, il_list);
+				kfree_type(struct inpcb *, grp->il_inpsiz, grp->il_inp);
+				kfree_type(struct inpcblbgroup, grp);
+			}
+			inp->inp_flags2 &= ~INP2_LBGROUP;
+			return;
+		}
+	}
+	panic("%s: inp %p not found in its lb group", __func__, inp);
+}
+
+/*
+ * Pick a live listener of a SO_REUSEPORT_LB group for a new flow,
+ * either by flow hash or by the receiving CPU.  Returns the PCB with
+ * a want reference, or NULL if no member may receive on ifp.
+ * Must be called with the pcbinfo lock held.
+ */
+struct inpcb *
+in_pcblbgroup_select(struct inpcblbgroup *grp, uint32_t hash,
+    struct ifnet *ifp)
+{
+	uint32_t cnt = grp->il_inpcnt;
+	uint32_t idx;
+
+	if (cnt == 0) {
+		return NULL;
+	}
+	idx = (inp_lbgroup_percpu ? (uint32_t)cpu_number() : hash) % cnt;
+
+	for (uint32_t i = 0; i < cnt; i++) {
+		struct inpcb *inp = grp->il_inp[(idx + i) % cnt];
+
+		if (inp->inp_state == INPCB_STATE_DEAD) {
+			continue;
+		}
+		if (inp_restricted_recv(inp, ifp)) {
+			continue;
+		}
+#if NECP
+		if (!necp_socket_is_allowed_to_recv_on_interface(inp, ifp)) {
+			continue;
+		}
+#endif /* NECP */
+		if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
+			return inp;
+		}
+	}
+	return NULL;
+}
+
 /*
  * Remove PCB from various lists.
  * Must be called pcbinfo lock is held in exclusive mode.
@@ -2916,9 +3227,14 @@ in_pcbremlists(struct inpcb *inp)
 
 		VERIFY(phd != NULL && inp->inp_lport > 0);
 
-		LIST_REMOVE(inp, inp_hash);
-		inp->inp_hash.le_next = NULL;
-		inp->inp_hash.le_prev = NULL;
+		/*
+		 * The hash linkage is left intact for concurrent
+		 * lockless readers; the pcb itself is only freed
+		 * once they are done (see in_pcbdispose()).
+		 */
+		smrq_serialized_remove(
+			&inp->inp_pcbinfo->ipi_hashbase[inp->inp_hash_element],
+			&inp->inp_hash);
 
 		LIST_REMOVE(inp, inp_portlist);
 		inp->inp_portlist.le_next = NULL;
@@ -2937,6 +3253,10 @@ in_pcbremlists(struct inpcb *inp)
 	}
 	VERIFY(!(inp->inp_flags2 & INP2_INHASHLIST));
 
+	if (inp->inp_flags2 & INP2_LBGROUP) {
+		in_pcblbgroup_remove(inp);
+	}
+
 	if (inp->inp_flags2 & INP2_TIMEWAIT) {
 		/* Remove from time-wait queue */
 		tcp_remove_from_time_wait(inp);
@@ -4494,6 +4814,49 @@ inp_exit_bind_in_progress(struct socket *so)
 	}
 }
 
+/*
+ * SO_BUSY_POLL: rather than sleeping on an empty receive buffer, spin
+ * for up to inp_busy_poll_usec driving the receive rings of the
+ * interface the connection uses, so that its input is processed in
+ * this thread instead of being handed to the DLIL input thread.
+ * Called with the socket locked; the lock is dropped while spinning.
+ * Returns TRUE if the receive buffer is no longer empty.
+ */
+boolean_t
+inp_busy_poll(struct socket *so)
+{
+	struct inpcb *inp = sotoinpcb(so);
+	struct ifnet *ifp;
+	uint64_t deadline;
+	errno_t error;
+
+	socket_lock_assert_owned(so);
+
+	if (inp == NULL || inp->inp_busy_poll_usec == 0) {
+		return FALSE;
+	}
+	if ((ifp = inp->inp_boundifp) == NULL &&
+	    (ifp = inp->inp_last_outifp) == NULL) {
+		return FALSE;
+	}
+
+	clock_interval_to_deadline(inp->inp_busy_poll_usec, NSEC_PER_USEC,
+	    &deadline);
+	socket_unlock(so, 0);
+	do {
+		if ((error = ifnet_busy_poll(ifp)) != 0 && error != EBUSY) {
+			break;
+		}
+		if (so->so_rcv.sb_cc != 0 || so->so_error != 0 ||
+		    (so->so_state & SS_CANTRCVMORE)) {
+			break;
+		}
+	} while (mach_absolute_time() < deadline);
+	socket_lock(so, 0);
+
+	return so->so_rcv.sb_cc != 0;
+}
+
 /*
  * XXX: this is borrowed from in6_pcbsetport(). If possible, we should
  * share this function by all *bsd*...
@@ -79,6 +79,7 @@
 #include <sys/bitstring.h>
 #include <sys/tree.h>
 #include <kern/locks.h>
+#include <kern/smr.h>
 #include <kern/uipc_domain.h>
 #include <kern/zalloc.h>
 #include <netinet/in_stat.h>
@@ -111,6 +112,7 @@
  */
 LIST_HEAD(inpcbhead, inpcb);
 LIST_HEAD(inpcbporthead, inpcbport);
+LIST_HEAD(inpcblbgrouphead, inpcblbgroup);
 #endif /* BSD_KERNEL_PRIVATE */
 typedef u_quad_t        inp_gen_t;
 
@@ -159,7 +161,7 @@ struct inp_necp_attributes {
  */
 struct inpcb {
 	decl_lck_mtx_data(, inpcb_mtx); /* inpcb per-socket mutex */
-	LIST_ENTRY(inpcb) inp_hash;     /* hash list */
+	struct smrq_link inp_hash;      /* hash list, SMR protected */
 	LIST_ENTRY(inpcb) inp_list;     /* list for all PCBs of this proto */
 	void    *inp_ppcb;              /* pointer to per-protocol pcb */
 	struct inpcbinfo *inp_pcbinfo;  /* PCB list info */
@@ -169,6 +171,7 @@ struct inpcb {
 	struct inpcbport *inp_phd;      /* head of this list */
 	inp_gen_t inp_gencnt;           /* generation count of this instance */
 	int     inp_hash_element;       /* array index of pcb's hash list */
+	struct smr_node inp_smr_node;   /* deferred free after removal */
 	int     inp_wantcnt;            /* wanted count; atomically updated */
 	int     inp_state;              /* state (INUSE/CACHED/DEAD) */
 	u_short inp_fport;              /* foreign port */
@@ -254,11 +257,15 @@ struct inpcb {
 	netns_token inp_netns_token;    /* shared namespace state */
 	/* optional IPv4 wildcard namespace reservation for an IPv6 socket */
 	netns_token inp_wildcard_netns_token;
+	/* flowswitch flow coalescing received datagrams (UDP_GRO) */
+	uuid_t inp_fsw_uuid;
+	uuid_t inp_fsw_flow_uuid;
 #endif /* SKYWALK */
 	u_char *__sized_by(inp_keepalive_datalen) inp_keepalive_data;     /* for keepalive offload */
 	uint8_t inp_keepalive_datalen; /* keepalive data length */
 	uint8_t inp_keepalive_type;    /* type of application */
 	uint16_t inp_keepalive_interval; /* keepalive interval */
+	uint16_t inp_udp_gso_size;     /* UDP_SEGMENT payload size */
 	struct  nstat_sock_locus *inp_nstat_locus  __attribute__((aligned(sizeof(u_int64_t))));
 	struct media_stats  inp_mstat __attribute__((aligned(8)));    /* All counts, total/cell/wifi etc */
 	uint64_t inp_start_timestamp;
@@ -268,6 +275,7 @@ struct inpcb {
 	char inp_e_proc_name[MAXCOMLEN + 1];
 
 	uint64_t inp_max_pacing_rate; /* Per-connection maximumg pacing rate to be enforced (Bytes/second) */
+	uint32_t inp_busy_poll_usec;  /* SO_BUSY_POLL budget (usec) */
 };
 
 #define IFNET_COUNT_TYPE(_ifp)                                              \
@@ -634,6 +642,27 @@ struct inpcbport {
 	u_short phd_port;
 };
 
+/*
+ * Listeners sharing a local address and port with SO_REUSEPORT_LB;
+ * wildcard lookups pick one of them per connection.  Protected by
+ * ipi_lock.
+ */
+struct inpcblbgroup {
+	LIST_ENTRY(inpcblbgroup) il_list;
+	union {
+		struct in_addr_4in6 il46_local;
+		struct in6_addr il6_local;
+	} il_dependladdr;
+	uint32_t il_lifscope;           /* IPv6 scope ID of the local address */
+	u_short il_lport;               /* local port */
+	u_char  il_vflag;               /* inp_vflag of the members */
+	uint32_t il_inpcnt;             /* number of listeners */
+	uint32_t il_inpsiz;             /* size of il_inp */
+	struct inpcb **__counted_by(il_inpsiz) il_inp;
+};
+#define il_laddr        il_dependladdr.il46_local.ia46_addr4
+#define il6_laddr       il_dependladdr.il6_local
+
 struct intimercount {
 	u_int32_t intimer_lazy; /* lazy requests for timer scheduling */
 	u_int32_t intimer_fast; /* fast requests, can be coalesced */
@@ -701,9 +730,11 @@ struct inpcbinfo {
 
 	/*
 	 * Per-protocol hash of pcbs, hashed by local and foreign
-	 * addresses and port numbers.
+	 * addresses and port numbers.  Mutations are serialized by
+	 * ipi_lock; exact matches may be looked up without it from
+	 * an smr_inpcb read section.
 	 */
-	struct inpcbhead        *__counted_by(ipi_hashbase_count) ipi_hashbase;
+	struct smrq_list_head   *__counted_by(ipi_hashbase_count) ipi_hashbase;
 	size_t                  ipi_hashbase_count;
 	u_long                  ipi_hashmask;
 
@@ -714,6 +745,14 @@ struct inpcbinfo {
 	size_t                  ipi_porthashbase_count;
 	u_long                  ipi_porthashmask;
 
+	/*
+	 * Per-protocol hash of SO_REUSEPORT_LB groups, hashed by local
+	 * port number; NULL for protocols without listeners.
+	 */
+	struct inpcblbgrouphead *__counted_by(ipi_lbgrouphashbase_count) ipi_lbgrouphashbase;
+	size_t                  ipi_lbgrouphashbase_count;
+	u_long                  ipi_lbgrouphashmask;
+
 	/*
 	 * Misc.
 	 */
@@ -851,6 +890,8 @@ struct inpcbinfo {
 #define INP2_ULTRA_CONSTRAINED_CHECKED  0x00200000 /* Checked entitlements for ultra-constrained interfaces */
 #define INP2_RECV_LINK_ADDR_TYPE        0x00400000 /* receive the type of the link level address */
 #define INP2_CONNECTION_IDLE            0x00800000 /* Connection is idle */
+#define INP2_UDP_GRO                    0x01000000 /* receive coalesced UDP datagrams */
+#define INP2_LBGROUP                    0x02000000 /* member of a SO_REUSEPORT_LB group */
 
 /*
  * Flags passed to in_pcblookup*() functions.
@@ -929,6 +970,9 @@ extern int in_getsockaddr(struct socket *, struct sockaddr **);
 extern int in_getsockaddr_s(struct socket *, struct sockaddr_in *);
 extern int in_pcb_checkstate(struct inpcb *, int, int);
 extern void in_pcbremlists(struct inpcb *);
+extern int in_pcblbgroup_insert(struct inpcb *);
+extern struct inpcb *in_pcblbgroup_select(struct inpcblbgroup *, uint32_t,
+    struct ifnet *);
 extern void inpcb_to_compat(struct inpcb *, struct inpcb_compat *);
 #if XNU_TARGET_OS_OSX
 extern void inpcb_to_xinpcb64(struct inpcb *, struct xinpcb64 *);
@@ -990,6 +1034,8 @@ extern void inp_update_last_owner(struct socket *so, struct proc *p, struct proc
 extern void inp_copy_last_owner(struct socket *so, struct socket *head);
 extern void inp_enter_bind_in_progress(struct socket *so);
 extern void inp_exit_bind_in_progress(struct socket *so);
+extern uint32_t inp_busy_poll_max;
+extern boolean_t inp_busy_poll(struct socket *so);
 #if SKYWALK
 extern void inp_update_netns_flags(struct socket *so);
 #endif /* SKYWALK */
@@ -305,6 +305,7 @@ ip_output_list(struct mbuf *m0, int packetchain, struct mbuf *opt,
 	ipfilter_t inject_filter_ref __single = NULL;
 	mbuf_ref_t packetlist;
 	uint32_t sw_csum, pktcnt = 0, scnt = 0, bytecnt = 0;
+	uint32_t udp_gso_csum;
 	uint32_t packets_processed = 0;
 	unsigned int ifscope = IFSCOPE_NONE;
 	struct flowadv *adv = NULL;
@@ -1179,11 +1180,11 @@ sendit:
 		ipf_pktopts.ippo_flags &= ~IPPOF_MCAST_OPTS;
 
 		/*
-		 * Check that a TSO frame isn't passed to a filter.
-		 * This could happen if a filter is inserted while
-		 * TCP is sending the TSO packet.
+		 * Check that a TSO frame or a UDP datagram train isn't
+		 * passed to a filter.  This could happen if a filter is
+		 * inserted while TCP or UDP is sending it.
 		 */
-		if (m->m_pkthdr.csum_flags & CSUM_TSO_IPV4) {
+		if (m->m_pkthdr.csum_flags & (CSUM_TSO_IPV4 | CSUM_UDP_GSO)) {
 			error = EMSGSIZE;
 			drop_reason = DROP_REASON_IP_FILTER_TSO;
 			goto bad;
@@ -1562,11 +1563,11 @@ sendit:
 		ipf_pktopts.ippo_flags &= ~IPPOF_MCAST_OPTS;
 
 		/*
-		 * Check that a TSO frame isn't passed to a filter.
-		 * This could happen if a filter is inserted while
-		 * TCP is sending the TSO packet.
+		 * Check that a TSO frame or a UDP datagram train isn't
+		 * passed to a filter.  This could happen if a filter is
+		 * inserted while TCP or UDP is sending it.
 		 */
-		if (m->m_pkthdr.csum_flags & CSUM_TSO_IPV4) {
+		if (m->m_pkthdr.csum_flags & (CSUM_TSO_IPV4 | CSUM_UDP_GSO)) {
 			error = EMSGSIZE;
 			drop_reason = DROP_REASON_IP_FILTER_TSO;
 			goto bad;
@@ -1633,8 +1634,21 @@ skip_ipsec:
 		}
 	}
 
+	/*
+	 * The interface checksums every datagram of a UDP_SEGMENT train
+	 * as it splits it; leave only the IP header to the code below.
+	 */
+	if (UDP_GSO_OK(ifp, m)) {
+		udp_gso_csum = m->m_pkthdr.csum_flags &
+		    (CSUM_DELAY_DATA | CSUM_ZERO_INVERT | CSUM_UDP_GSO);
+		m->m_pkthdr.csum_flags &= ~udp_gso_csum;
+	} else {
+		udp_gso_csum = 0;
+	}
+
 	ip_output_checksum(ifp, m, (IP_VHL_HL(ip->ip_vhl) << 2),
 	    ip->ip_len, &sw_csum);
+	m->m_pkthdr.csum_flags |= udp_gso_csum;
 
 	interface_mtu = ifp->if_mtu;
 
@@ -1649,6 +1663,7 @@ skip_ipsec:
 	 * care of the fragmentation for us, can just send directly.
 	 */
 	if ((u_short)ip->ip_len <= interface_mtu || TSO_IPV4_OK(ifp, m) ||
+	    UDP_GSO_OK(ifp, m) ||
 	    (!(ip->ip_off & IP_DF) && (ifp->if_hwassist & CSUM_FRAGMENT))) {
 #if BYTE_ORDER != BIG_ENDIAN
 		HTONS(ip->ip_len);
@@ -1671,6 +1686,10 @@ skip_ipsec:
 		if ((m->m_pkthdr.csum_flags & CSUM_TSO_IPV4) &&
 		    (m->m_pkthdr.tso_segsz > 0)) {
 			scnt += m->m_pkthdr.len / m->m_pkthdr.tso_segsz;
+		} else if ((m->m_pkthdr.csum_flags & CSUM_UDP_GSO) &&
+		    (m->m_pkthdr.udp_seg_size > 0)) {
+			scnt += howmany(m->m_pkthdr.len - hlen -
+			    sizeof(struct udphdr), m->m_pkthdr.udp_seg_size);
 		} else {
 			scnt++;
 		}
@@ -1730,10 +1749,11 @@ sendchain:
 	/*
 	 * Too large for interface; fragment if possible.
 	 * Must be able to put at least 8 bytes per fragment.
-	 * Balk when DF bit is set or the interface didn't support TSO.
+	 * Balk when DF bit is set or the interface didn't support TSO
+	 * or UDP segmentation.
 	 */
 	if ((ip->ip_off & IP_DF) || pktcnt > 0 ||
-	    (m->m_pkthdr.csum_flags & CSUM_TSO_IPV4)) {
+	    (m->m_pkthdr.csum_flags & (CSUM_TSO_IPV4 | CSUM_UDP_GSO))) {
 		error = EMSGSIZE;
 		/*
 		 * This case can happen if the user changed the MTU
@@ -142,6 +142,46 @@ struct tcp_notify_ack_complete {
 #define MPTCP_EXPECTED_PROGRESS_TARGET  0x219
 #define MPTCP_FORCE_VERSION             0x21a
 #define TCP_ENABLE_L4S                  0x21b   /* Enable or disable L4S */
+#define TCP_TLS_TX                      0x21c   /* Kernel TLS transmit keys, struct tcp_tls_info */
+#define TCP_TLS_RECORD_TYPE             0x21d   /* cmsg type: TLS content type of the data sent (uint8_t) */
+
+/*
+ * TCP_TLS_TX
+ *
+ * Once the TLS handshake is done, the application hands the transmit
+ * key of the session to the socket.  From then on, everything written
+ * to the socket is framed in TLS records and encrypted by the kernel,
+ * as application data unless a TCP_TLS_RECORD_TYPE control message
+ * (cmsg_level IPPROTO_TCP) gives another content type for that write.
+ * Each write is cut into records of at most TCP_TLS_MAX_RECORD bytes
+ * of plaintext.
+ *
+ * tti_iv holds the 4 byte salt followed by the 8 byte explicit nonce
+ * of the first record for TLS 1.2 AES-GCM, and the 12 byte static IV
+ * otherwise.  tti_seq is the sequence number of the next record.  The
+ * option can be set once; getsockopt returns the state of the session
+ * without the key material.
+ */
+#define TCP_TLS_VERSION_1_2             0x0303
+#define TCP_TLS_VERSION_1_3             0x0304
+
+#define TCP_TLS_CIPHER_AES_GCM_128      1
+#define TCP_TLS_CIPHER_AES_GCM_256      2
+#define TCP_TLS_CIPHER_CHACHA20_POLY1305 3
+
+#define TCP_TLS_MAX_RECORD              16384
+#define TCP_TLS_KEY_MAX                 32
+#define TCP_TLS_IV_LEN                  12
+
+struct tcp_tls_info {
+	u_int16_t       tti_version;    /* TCP_TLS_VERSION_* */
+	u_int16_t       tti_cipher;     /* TCP_TLS_CIPHER_* */
+	u_int32_t       tti_keylen;     /* 16 or 32 bytes */
+	u_int64_t       tti_seq;        /* next record sequence number */
+	u_int8_t        tti_key[TCP_TLS_KEY_MAX];
+	u_int8_t        tti_iv[TCP_TLS_IV_LEN];
+	u_int8_t        tti_pad[4];
+};
 
 /* When adding new socket-options, you need to make sure MPTCP supports these as well! */
 
@@ -123,6 +123,7 @@
 #include <netinet6/tcp6_var.h>
 #include <netinet/tcpip.h>
 #include <netinet/tcp_log.h>
+#include <netinet/tcp_tls.h>
 
 #include <netinet6/ip6protosw.h>
 #include <netinet6/esp.h>
@@ -155,7 +156,6 @@ static tcp_cc tcp_ccgen;
 
 struct mem_acct *tcp_memacct;
 
-extern struct tcptimerlist tcp_timer_list;
 extern struct tcptailq tcp_tw_tailq;
 
 extern int tcp_awdl_rtobase;
@@ -585,6 +585,9 @@ tcp_init(struct protosw *pp, struct domain *dp)
 	hashinit_counted_by(tcp_tcbhashsize, tcbinfo.ipi_porthashbase,
 	    tcbinfo.ipi_porthashbase_count);
 	tcbinfo.ipi_porthashmask = tcbinfo.ipi_porthashbase_count - 1;
+	hashinit_counted_by(tcp_tcbhashsize, tcbinfo.ipi_lbgrouphashbase,
+	    tcbinfo.ipi_lbgrouphashbase_count);
+	tcbinfo.ipi_lbgrouphashmask = tcbinfo.ipi_lbgrouphashbase_count - 1;
 	tcbinfo.ipi_zone = tcpcbzone;
 
 	tcbinfo.ipi_gc = tcp_gc;
@@ -603,20 +606,7 @@ tcp_init(struct protosw *pp, struct domain *dp)
 	/* Initialize time wait and timer lists */
 	TAILQ_INIT(&tcp_tw_tailq);
 
-	bzero(&tcp_timer_list, sizeof(tcp_timer_list));
-	LIST_INIT(&tcp_timer_list.lhead);
-	/*
-	 * allocate group and attribute for the tcp timer list
-	 */
-	tcp_timer_list.mtx_grp = lck_grp_alloc_init("tcptimerlist",
-	    LCK_GRP_ATTR_NULL);
-	lck_mtx_init(&tcp_timer_list.mtx, tcp_timer_list.mtx_grp,
-	    LCK_ATTR_NULL);
-
-	tcp_timer_list.call = thread_call_allocate(tcp_run_timerlist, NULL);
-	if (tcp_timer_list.call == NULL) {
-		panic("failed to allocate call entry 1 in tcp_init");
-	}
+	tcp_timer_lists_init();
 
 	/* Initialize TCP Cache */
 	tcp_cache_init();
@@ -1845,6 +1835,7 @@ no_valid_rt:
 	if (tp->t_bwmeas != NULL) {
 		tcp_bwmeas_free(tp);
 	}
+	tcp_tls_free(tp);
 	tcp_rxtseg_clean(tp);
 	tcp_segs_sent_clean(tp, true);
 
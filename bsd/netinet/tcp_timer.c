@@ -111,8 +111,12 @@
  */
 #define TCP_SLEEP_TOO_LONG      (10 * 60 * 1000) /* 10 minutes in ms */
 
-/* tcp timer list */
-struct tcptimerlist tcp_timer_list;
+extern unsigned int ml_wait_max_cpus(void);
+
+/* tcp timer lists, one timing wheel per cpu */
+static struct tcptimerlist *__counted_by(tcp_timer_nlists) tcp_timer_lists;
+static uint32_t tcp_timer_nlists;
+static LCK_GRP_DECLARE(tcp_timer_mtx_grp, "tcptimerlist");
 
 /* List of pcbs in timewait state, protected by tcbinfo's ipi_lock */
 struct tcptailq tcp_tw_tailq;
@@ -350,9 +354,8 @@ int     tcp_jack_rxmt = TCP_RETRANSHZ / 2;
 static boolean_t tcp_itimer_done = FALSE;
 
 static void tcp_remove_timer(struct tcpcb *tp);
-static void tcp_sched_timerlist(uint32_t offset);
-static u_int32_t tcp_run_conn_timer(struct tcpcb *tp, u_int16_t *mode,
-    u_int16_t probe_if_index);
+static void tcp_sched_timerlist(struct tcptimerlist *listp, uint32_t offset);
+static void tcp_run_conn_timer(struct tcpcb *tp, u_int16_t probe_if_index);
 static inline void tcp_set_lotimer_index(struct tcpcb *);
 __private_extern__ void tcp_remove_from_time_wait(struct inpcb *inp);
 static inline void tcp_update_mss_core(struct tcpcb *tp, struct ifnet *ifp);
@@ -1845,23 +1848,295 @@ dropit:
 	return tp;
 }
 
+/*
+ * Timer wheel primitives, called with the lock of the timer list held.
+ *
+ * A connection is filed in the wheel under te_slot_time, which is
+ * te_runtime as of the last time the owner of the socket looked at it.
+ * The list keeps a count of the entries per level so that runs of empty
+ * slots can be skipped, and a count of the entries with fast timers to
+ * pick the mode of the list without walking it.
+ */
+static inline struct tcptimerlist *
+tcp_timer_list_of(struct tcptimerentry *te)
+{
+	return &tcp_timer_lists[te->te_list];
+}
+
+static void
+tcp_wheel_place(struct tcptimerlist *listp, struct tcptimerentry *te)
+{
+	struct timerlisthead *head;
+	uint32_t runtime = te->te_slot_time;
+	int32_t delta;
+	uint8_t level;
+
+	delta = timer_diff(runtime, 0, listp->tw_next, 0);
+	if (delta < 0) {
+		/* Already due, run it on the next tick */
+		runtime = listp->tw_next;
+		delta = 0;
+	}
+	if (delta < TCP_TW_L0_SIZE) {
+		level = 0;
+		head = &listp->tw_l0[runtime & TCP_TW_L0_MASK];
+	} else {
+		for (level = 1; level < TCP_TW_LEVELS - 1; level++) {
+			if (delta < (1 << (TCP_TW_SHIFT(level) + TCP_TW_LN_BITS))) {
+				break;
+			}
+		}
+		if (delta >= (1 << (TCP_TW_SHIFT(level) + TCP_TW_LN_BITS))) {
+			/* Beyond the wheel, wait in the farthest slot */
+			runtime = listp->tw_next +
+			    (1 << (TCP_TW_SHIFT(level) + TCP_TW_LN_BITS)) - 1;
+		}
+		head = &listp->tw_ln[level - 1][(runtime >> TCP_TW_SHIFT(level)) &
+		    TCP_TW_LN_MASK];
+	}
+	LIST_INSERT_HEAD(head, te, te_le);
+	te->te_level = level;
+	listp->tw_count[level]++;
+}
+
+static void
+tcp_wheel_unplace(struct tcptimerlist *listp, struct tcptimerentry *te)
+{
+	LIST_REMOVE(te, te_le);
+	if (te->te_level != TCP_TW_EXPIRED) {
+		VERIFY(listp->tw_count[te->te_level] > 0);
+		listp->tw_count[te->te_level]--;
+	}
+}
+
+static void
+tcp_wheel_add(struct tcptimerlist *listp, struct tcptimerentry *te,
+    uint32_t runtime, uint16_t mode)
+{
+	LCK_MTX_ASSERT(&listp->mtx, LCK_MTX_ASSERT_OWNED);
+
+	te->te_slot_time = runtime;
+	te->te_slot_mode = mode & (TCP_TIMERLIST_10MS_MODE | TCP_TIMERLIST_100MS_MODE);
+	if (te->te_slot_mode & TCP_TIMERLIST_10MS_MODE) {
+		listp->tw_fast[0]++;
+	}
+	if (te->te_slot_mode & TCP_TIMERLIST_100MS_MODE) {
+		listp->tw_fast[1]++;
+	}
+	tcp_wheel_place(listp, te);
+}
+
+static void
+tcp_wheel_remove(struct tcptimerlist *listp, struct tcptimerentry *te)
+{
+	LCK_MTX_ASSERT(&listp->mtx, LCK_MTX_ASSERT_OWNED);
+
+	tcp_wheel_unplace(listp, te);
+	if (te->te_slot_mode & TCP_TIMERLIST_10MS_MODE) {
+		listp->tw_fast[0]--;
+	}
+	if (te->te_slot_mode & TCP_TIMERLIST_100MS_MODE) {
+		listp->tw_fast[1]--;
+	}
+	te->te_slot_mode = 0;
+}
+
+static bool
+tcp_wheel_empty(struct tcptimerlist *listp)
+{
+	for (int level = 0; level < TCP_TW_LEVELS; level++) {
+		if (listp->tw_count[level] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+tcp_wheel_expire_slot(struct tcptimerlist *listp, struct timerlisthead *head)
+{
+	struct tcptimerentry *te;
+
+	while ((te = LIST_FIRST(head)) != NULL) {
+		tcp_wheel_unplace(listp, te);
+		LIST_INSERT_HEAD(&listp->tw_expired, te, te_le);
+		te->te_level = TCP_TW_EXPIRED;
+	}
+}
+
+/*
+ * Move the entries of the upper level slots that start at this tick
+ * down the wheel
+ */
+static void
+tcp_wheel_cascade(struct tcptimerlist *listp, uint32_t tick)
+{
+	struct timerlisthead moving = LIST_HEAD_INITIALIZER(moving);
+	struct tcptimerentry *te;
+
+	for (int level = 1; level < TCP_TW_LEVELS; level++) {
+		uint32_t idx = (tick >> TCP_TW_SHIFT(level)) & TCP_TW_LN_MASK;
+		struct timerlisthead *head = &listp->tw_ln[level - 1][idx];
+
+		while ((te = LIST_FIRST(head)) != NULL) {
+			tcp_wheel_unplace(listp, te);
+			LIST_INSERT_HEAD(&moving, te, te_le);
+		}
+		while ((te = LIST_FIRST(&moving)) != NULL) {
+			LIST_REMOVE(te, te_le);
+			tcp_wheel_place(listp, te);
+		}
+		if (idx != 0) {
+			break;
+		}
+	}
+}
+
+/*
+ * Advance the wheel up to the given tick, moving the entries that are due
+ * to the expired list.
+ */
+static void
+tcp_wheel_advance(struct tcptimerlist *listp, uint32_t now)
+{
+	while (TSTMP_LEQ(listp->tw_next, now)) {
+		uint32_t tick = listp->tw_next;
+
+		if (tcp_wheel_empty(listp)) {
+			listp->tw_next = now + 1;
+			break;
+		}
+		if ((tick & TCP_TW_L0_MASK) == 0) {
+			tcp_wheel_cascade(listp, tick);
+		}
+		tcp_wheel_expire_slot(listp, &listp->tw_l0[tick & TCP_TW_L0_MASK]);
+		listp->tw_next = tick + 1;
+
+		/* Skip the empty level 0 slots up to the next cascade */
+		if (listp->tw_count[0] == 0) {
+			uint32_t boundary = (tick | TCP_TW_L0_MASK) + 1;
+
+			listp->tw_next = TSTMP_GT(boundary, now + 1) ? now + 1 : boundary;
+		}
+	}
+}
+
+/*
+ * Move every entry to the expired list, for interface probes that need to
+ * look at all the connections
+ */
+static void
+tcp_wheel_drain(struct tcptimerlist *listp)
+{
+	for (int i = 0; i < TCP_TW_L0_SIZE; i++) {
+		tcp_wheel_expire_slot(listp, &listp->tw_l0[i]);
+	}
+	for (int level = 1; level < TCP_TW_LEVELS; level++) {
+		for (int i = 0; i < TCP_TW_LN_SIZE; i++) {
+			tcp_wheel_expire_slot(listp, &listp->tw_ln[level - 1][i]);
+		}
+	}
+}
+
+/*
+ * Returns the offset from tcp_now of the first slot of the wheel that has
+ * to be processed, or 0 if the wheel is empty
+ */
+static uint32_t
+tcp_wheel_next(struct tcptimerlist *listp)
+{
+	uint32_t first = 0;
+	bool found = false;
+	int32_t diff;
+
+	for (uint32_t k = 0; listp->tw_count[0] != 0 && k < TCP_TW_L0_SIZE; k++) {
+		uint32_t tick = listp->tw_next + k;
+
+		if (!LIST_EMPTY(&listp->tw_l0[tick & TCP_TW_L0_MASK])) {
+			first = tick;
+			found = true;
+			break;
+		}
+	}
+	for (int level = 1; level < TCP_TW_LEVELS; level++) {
+		uint32_t shift = TCP_TW_SHIFT(level);
+		uint32_t base = listp->tw_next >> shift;
+		uint32_t k;
+
+		if (listp->tw_count[level] == 0) {
+			continue;
+		}
+		/*
+		 * The current slot of the level has already been cascaded,
+		 * unless the wheel stopped right at its start
+		 */
+		k = (listp->tw_next & ((1U << shift) - 1)) == 0 ? 0 : 1;
+		for (; k <= TCP_TW_LN_SIZE; k++) {
+			if (!LIST_EMPTY(&listp->tw_ln[level - 1][(base + k) & TCP_TW_LN_MASK])) {
+				uint32_t start = (base + k) << shift;
+
+				if (!found || TSTMP_LT(start, first)) {
+					first = start;
+					found = true;
+				}
+				break;
+			}
+		}
+	}
+	if (!found) {
+		return 0;
+	}
+	diff = timer_diff(first, 0, tcp_now, 0);
+	return diff > 0 ? (uint32_t)diff : 1;
+}
+
+/*
+ * Allocate one timer list per cpu; each one runs from its own thread call
+ */
+void
+tcp_timer_lists_init(void)
+{
+	uint32_t n = ml_wait_max_cpus();
+
+	tcp_timer_lists = kalloc_type(struct tcptimerlist, n,
+	    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	tcp_timer_nlists = n;
+
+	for (uint32_t i = 0; i < tcp_timer_nlists; i++) {
+		struct tcptimerlist *listp = &tcp_timer_lists[i];
+
+		for (int j = 0; j < TCP_TW_L0_SIZE; j++) {
+			LIST_INIT(&listp->tw_l0[j]);
+		}
+		for (int level = 1; level < TCP_TW_LEVELS; level++) {
+			for (int j = 0; j < TCP_TW_LN_SIZE; j++) {
+				LIST_INIT(&listp->tw_ln[level - 1][j]);
+			}
+		}
+		LIST_INIT(&listp->tw_expired);
+		listp->tw_next = tcp_now;
+		lck_mtx_init(&listp->mtx, &tcp_timer_mtx_grp, LCK_ATTR_NULL);
+		listp->call = thread_call_allocate(tcp_run_timerlist, listp);
+		if (listp->call == NULL) {
+			panic("failed to allocate call entry %u in tcp_init", i);
+		}
+	}
+}
+
 /* Remove a timer entry from timer list */
 void
 tcp_remove_timer(struct tcpcb *tp)
 {
-	struct tcptimerlist *listp = &tcp_timer_list;
+	struct tcptimerlist *listp;
 
 	socket_lock_assert_owned(tp->t_inpcb->inp_socket);
 	if (!(TIMER_IS_ON_LIST(tp))) {
 		return;
 	}
+	listp = tcp_timer_list_of(&tp->tentry);
 	lck_mtx_lock(&listp->mtx);
 
-	if (listp->next_te != NULL && listp->next_te == &tp->tentry) {
-		listp->next_te = LIST_NEXT(&tp->tentry, te_le);
-	}
-
-	LIST_REMOVE(&tp->tentry, te_le);
+	tcp_wheel_remove(listp, &tp->tentry);
 	/*
 	 * The use count has been incremented when the PCB
 	 * was placed on the timer list, and needs to be decremented.
@@ -1891,9 +2166,9 @@ tcp_remove_timer(struct tcpcb *tp)
  */
 
 static boolean_t
-need_to_resched_timerlist(u_int32_t runtime, u_int16_t mode)
+need_to_resched_timerlist(struct tcptimerlist *listp, u_int32_t runtime,
+    u_int16_t mode)
 {
-	struct tcptimerlist *listp = &tcp_timer_list;
 	int32_t diff;
 
 	/*
@@ -1931,11 +2206,10 @@ need_to_resched_timerlist(u_int32_t runtime, u_int16_t mode)
 	return TRUE;
 }
 
-void
-tcp_sched_timerlist(uint32_t offset)
+static void
+tcp_sched_timerlist(struct tcptimerlist *listp, uint32_t offset)
 {
 	uint64_t deadline = 0;
-	struct tcptimerlist *listp = &tcp_timer_list;
 
 	LCK_MTX_ASSERT(&listp->mtx, LCK_MTX_ASSERT_OWNED);
 
@@ -1956,26 +2230,21 @@ tcp_sched_timerlist(uint32_t offset)
 /*
  * Function to run the timers for a connection.
  *
- * Returns the offset of next timer to be run for this connection which
- * can be used to reschedule the timerlist.
- *
- * te_mode is an out parameter that indicates the modes of active
- * timers for this connection.
+ * On return the connection is filed in the timer wheel under the deadline
+ * of its next timer, or taken off the wheel if it has none left.
  */
-u_int32_t
-tcp_run_conn_timer(struct tcpcb *tp, u_int16_t *te_mode,
-    u_int16_t probe_if_index)
+static void
+tcp_run_conn_timer(struct tcpcb *tp, u_int16_t probe_if_index)
 {
 	struct socket *so;
 	u_int16_t i = 0, index = TCPT_NONE, lo_index = TCPT_NONE;
-	u_int32_t timer_val, offset = 0, lo_timer = 0;
+	u_int32_t timer_val, lo_timer = 0;
 	int32_t diff;
 	boolean_t needtorun[TCPT_NTIMERS];
 	int count = 0;
 
 	VERIFY(tp != NULL);
 	bzero(needtorun, sizeof(needtorun));
-	*te_mode = 0;
 
 	socket_lock(tp->t_inpcb->inp_socket, 1);
 
@@ -2017,10 +2286,6 @@ tcp_run_conn_timer(struct tcpcb *tp, u_int16_t *te_mode,
 
 	diff = timer_diff(tp->tentry.te_runtime, 0, tcp_now, 0);
 	if (diff > 0) {
-		if (tp->tentry.te_index != TCPT_NONE) {
-			offset = diff;
-			*(te_mode) = tp->tentry.te_mode;
-		}
 		goto done;
 	}
 
@@ -2075,8 +2340,6 @@ tcp_run_conn_timer(struct tcpcb *tp, u_int16_t *te_mode,
 				tp->t_timer[i] = 0;
 				tp = tcp_timers(tp, i);
 				if (tp == NULL) {
-					offset = 0;
-					*(te_mode) = 0;
 					goto done;
 				}
 			}
@@ -2084,19 +2347,13 @@ tcp_run_conn_timer(struct tcpcb *tp, u_int16_t *te_mode,
 		tcp_set_lotimer_index(tp);
 	}
 
-	if (tp->tentry.te_index < TCPT_NONE) {
-		offset = tp->t_timer[tp->tentry.te_index];
-		*(te_mode) = tp->tentry.te_mode;
-	}
-
 done:
-	if (tp != NULL && tp->tentry.te_index == TCPT_NONE) {
-		tcp_remove_timer(tp);
-		offset = 0;
+	/* Connections in TIME_WAIT are handled by the 2MSL list instead */
+	if (tp != NULL && !(tp->t_inpcb->inp_flags2 & INP2_TIMEWAIT)) {
+		tcp_sched_timers(tp);
 	}
 
 	socket_unlock(so, 1);
-	return offset;
 }
 
 static void
@@ -2127,14 +2384,12 @@ tcp_timer_update_drift_stats(struct tcptimerlist  *listp)
 void
 tcp_run_timerlist(void * arg1, void * arg2)
 {
-#pragma unused(arg1, arg2)
-	struct tcptimerentry *te, *__single next_te;
-	struct tcptimerlist *__single listp = &tcp_timer_list;
+#pragma unused(arg2)
+	struct tcptimerentry *te;
+	struct tcptimerlist *__single listp = arg1;
 	struct tcpcb *__single tp;
 	uint32_t next_timer = 0; /* offset of the next timer on the list */
-	u_int16_t te_mode = 0;  /* modes of all active timers in a tcpcb */
 	u_int16_t list_mode = 0; /* cumulative of modes of all tcpcbs */
-	uint32_t num_entries;
 
 	calculate_tcp_clock();
 
@@ -2144,35 +2399,42 @@ tcp_run_timerlist(void * arg1, void * arg2)
 
 	listp->started_at = tcp_now;
 
-	num_entries = listp->entries;
 	listp->running = TRUE;
 	listp->processed_count = 0;
 
-	LIST_FOREACH_SAFE(te, &listp->lhead, te_le, next_te) {
-		uint32_t offset = 0;
-		uint32_t runtime = te->te_runtime;
+	/*
+	 * Collect the connections whose first timer is due. Connections
+	 * with later deadlines stay in the wheel and are not looked at,
+	 * unless an interface probe needs to visit all of them.
+	 */
+	if (listp->probe_if_index != 0) {
+		tcp_wheel_drain(listp);
+	}
+	tcp_wheel_advance(listp, tcp_now);
 
+	while ((te = LIST_FIRST(&listp->tw_expired)) != NULL) {
 		tp = TIMERENTRY_TO_TP(te);
 
 		listp->processed_count++;
-		if (listp->processed_count > num_entries) {
-			os_log(OS_LOG_DEFAULT, "tcp_run_timerlist done: processed_count %u > num_entries %u current %u",
-			    listp->processed_count, num_entries, listp->entries);
-			break;
-		}
+
+		/*
+		 * Put the entry back on the next tick of the wheel; the
+		 * connection files it under its new deadline once its timers
+		 * have run, and in the meantime a concurrent tcp_remove_timer()
+		 * finds it linked in the wheel.
+		 */
+		tcp_wheel_unplace(listp, te);
 
 		/*
 		 * An interface probe may need to happen before the previously scheduled runtime
 		 */
-		if (te->te_index < TCPT_NONE && TSTMP_GT(runtime, tcp_now) &&
+		if (TSTMP_GT(te->te_slot_time, tcp_now) &&
 		    !TCP_IF_STATE_CHANGED(tp, listp->probe_if_index)) {
-			offset = timer_diff(runtime, 0, tcp_now, 0);
-			if (next_timer == 0 || offset < next_timer) {
-				next_timer = offset;
-			}
-			list_mode |= te->te_mode;
+			tcp_wheel_place(listp, te);
 			continue;
 		}
+		te->te_slot_time = listp->tw_next;
+		tcp_wheel_place(listp, te);
 
 		/*
 		 * Acquire an inp wantcnt on the inpcb so that the socket
@@ -2192,38 +2454,26 @@ tcp_run_timerlist(void * arg1, void * arg2)
 			continue;
 		}
 
-		/*
-		 * Store the next timerentry pointer before releasing the
-		 * list lock. If that entry has to be removed when we
-		 * release the lock, this pointer will be updated to the
-		 * element after that.
-		 */
-		listp->next_te = next_te;
-
 		VERIFY_NEXT_LINK(&tp->tentry, te_le);
 		VERIFY_PREV_LINK(&tp->tentry, te_le);
 
 		lck_mtx_unlock(&listp->mtx);
 
-		offset = tcp_run_conn_timer(tp, &te_mode,
-		    listp->probe_if_index);
+		tcp_run_conn_timer(tp, listp->probe_if_index);
 
 		lck_mtx_lock(&listp->mtx);
-
-		next_te = listp->next_te;
-		listp->next_te = NULL;
-
-		if (offset > 0 && te_mode != 0) {
-			list_mode |= te_mode;
-
-			if (next_timer == 0 || offset < next_timer) {
-				next_timer = offset;
-			}
-		}
 	}
 
-	if (!LIST_EMPTY(&listp->lhead)) {
+	if (listp->entries != 0) {
 		uint32_t next_mode = 0;
+
+		next_timer = tcp_wheel_next(listp);
+		if (listp->tw_fast[0] != 0) {
+			list_mode |= TCP_TIMERLIST_10MS_MODE;
+		}
+		if (listp->tw_fast[1] != 0) {
+			list_mode |= TCP_TIMERLIST_100MS_MODE;
+		}
 		if ((list_mode & TCP_TIMERLIST_10MS_MODE) ||
 		    (listp->pref_mode & TCP_TIMERLIST_10MS_MODE)) {
 			next_mode = TCP_TIMERLIST_10MS_MODE;
@@ -2264,13 +2514,13 @@ tcp_run_timerlist(void * arg1, void * arg2)
 			    TCP_TIMER_500MS_QUANTUM);
 		}
 
-		tcp_sched_timerlist(next_timer);
+		tcp_sched_timerlist(listp, next_timer);
 	} else {
 		/*
 		 * No need to reschedule this timer, but always run
 		 * periodically at a much higher granularity.
 		 */
-		tcp_sched_timerlist(TCP_TIMERLIST_MAX_OFFSET);
+		tcp_sched_timerlist(listp, TCP_TIMERLIST_MAX_OFFSET);
 	}
 
 	listp->running = FALSE;
@@ -2293,7 +2543,7 @@ tcp_sched_timers(struct tcpcb *tp)
 	struct tcptimerentry *te = &tp->tentry;
 	u_int16_t index = te->te_index;
 	u_int16_t mode = te->te_mode;
-	struct tcptimerlist *listp = &tcp_timer_list;
+	struct tcptimerlist *listp;
 	int32_t offset = 0;
 	boolean_t list_locked = FALSE;
 
@@ -2322,33 +2572,50 @@ tcp_sched_timers(struct tcpcb *tp)
 	}
 
 	if (!TIMER_IS_ON_LIST(tp)) {
-		if (!list_locked) {
-			lck_mtx_lock(&listp->mtx);
-			list_locked = TRUE;
-		}
+		/*
+		 * Connections are spread over the timer lists by the cpu
+		 * that arms their first timer
+		 */
+		te->te_list = (uint16_t)(cpu_number() % tcp_timer_nlists);
+		listp = tcp_timer_list_of(te);
+		lck_mtx_lock(&listp->mtx);
+		list_locked = TRUE;
 
-		if (!TIMER_IS_ON_LIST(tp)) {
-			/*
-			 * Adding the timer entry should constitute an incresed socket use count,
-			 * otherwise the socket use count may reach zero while being referenced
-			 * via the timer entry. If this happens, the timer service routine
-			 * will run into an UAF (use after free) when attempting
-			 * to get the related protocol control block.
-			 */
-			tp->t_inpcb->inp_socket->so_usecount++;
+		/*
+		 * Adding the timer entry should constitute an incresed socket use count,
+		 * otherwise the socket use count may reach zero while being referenced
+		 * via the timer entry. If this happens, the timer service routine
+		 * will run into an UAF (use after free) when attempting
+		 * to get the related protocol control block.
+		 */
+		tp->t_inpcb->inp_socket->so_usecount++;
 
-			LIST_INSERT_HEAD(&listp->lhead, te, te_le);
-			tp->t_flags |= TF_TIMER_ONLIST;
+		/* An idle wheel is not advanced, catch up before filing */
+		if (listp->entries == 0 && TSTMP_GT(tcp_now, listp->tw_next)) {
+			listp->tw_next = tcp_now;
+		}
+		tcp_wheel_add(listp, te, te->te_runtime, mode);
+		tp->t_flags |= TF_TIMER_ONLIST;
 
-			listp->entries++;
-			if (listp->entries > listp->maxentries) {
-				listp->maxentries = listp->entries;
-			}
+		listp->entries++;
+		if (listp->entries > listp->maxentries) {
+			listp->maxentries = listp->entries;
+		}
 
-			/* if the list is not scheduled, just schedule it */
-			if (!listp->scheduled) {
-				goto schedule;
-			}
+		/* if the list is not scheduled, just schedule it */
+		if (!listp->scheduled) {
+			goto schedule;
+		}
+	} else {
+		listp = tcp_timer_list_of(te);
+		if (te->te_slot_time != te->te_runtime ||
+		    te->te_slot_mode != (mode & (TCP_TIMERLIST_10MS_MODE |
+		    TCP_TIMERLIST_100MS_MODE))) {
+			/* The deadline moved, file the entry in its new slot */
+			lck_mtx_lock(&listp->mtx);
+			list_locked = TRUE;
+			tcp_wheel_remove(listp, te);
+			tcp_wheel_add(listp, te, te->te_runtime, mode);
 		}
 	}
 
@@ -2356,7 +2623,7 @@ tcp_sched_timers(struct tcpcb *tp)
 	 * Timer entry is currently on the list, check if the list needs
 	 * to be rescheduled.
 	 */
-	if (need_to_resched_timerlist(te->te_runtime, mode)) {
+	if (need_to_resched_timerlist(listp, te->te_runtime, mode)) {
 		tcp_resched_timerlist++;
 
 		if (!list_locked) {
@@ -2411,7 +2678,7 @@ schedule:
 		listp->idleruns = 0;
 		offset = min(offset, TCP_TIMER_100MS_QUANTUM);
 	}
-	tcp_sched_timerlist(offset);
+	tcp_sched_timerlist(listp, offset);
 
 done:
 	if (list_locked) {
@@ -2722,14 +2989,10 @@ tcp_report_stats(void)
 #undef  stat
 }
 
-void
-tcp_interface_send_probe(u_int16_t probe_if_index)
+static void
+tcp_timerlist_send_probe(struct tcptimerlist *listp, u_int16_t probe_if_index)
 {
 	int32_t offset = 0;
-	struct tcptimerlist *listp = &tcp_timer_list;
-
-	/* Make sure TCP clock is up to date */
-	calculate_tcp_clock();
 
 	lck_mtx_lock(&listp->mtx);
 	if (listp->probe_if_index > 0 && listp->probe_if_index != probe_if_index) {
@@ -2767,13 +3030,24 @@ tcp_interface_send_probe(u_int16_t probe_if_index)
 	listp->mode = TCP_TIMERLIST_10MS_MODE;
 	listp->idleruns = 0;
 
-	tcp_sched_timerlist(offset);
+	tcp_sched_timerlist(listp, offset);
 
 done:
 	lck_mtx_unlock(&listp->mtx);
 	return;
 }
 
+void
+tcp_interface_send_probe(u_int16_t probe_if_index)
+{
+	/* Make sure TCP clock is up to date */
+	calculate_tcp_clock();
+
+	for (uint32_t i = 0; i < tcp_timer_nlists; i++) {
+		tcp_timerlist_send_probe(&tcp_timer_lists[i], probe_if_index);
+	}
+}
+
 /*
  * Enable read probes on this connection, if:
  * - it is in established state
@@ -2840,7 +3114,6 @@ void
 tcp_probe_connectivity(struct ifnet *ifp, u_int32_t enable)
 {
 	int32_t offset;
-	struct tcptimerlist *listp = &tcp_timer_list;
 	struct inpcbinfo *pcbinfo = &tcbinfo;
 	struct inpcb *inp, *nxt;
 
@@ -2884,29 +3157,32 @@ tcp_probe_connectivity(struct ifnet *ifp, u_int32_t enable)
 	}
 	lck_rw_done(&pcbinfo->ipi_lock);
 
-	lck_mtx_lock(&listp->mtx);
-	if (listp->running) {
-		listp->pref_mode |= TCP_TIMERLIST_10MS_MODE;
-		goto done;
-	}
+	for (uint32_t i = 0; i < tcp_timer_nlists; i++) {
+		struct tcptimerlist *listp = &tcp_timer_lists[i];
 
-	/* Reschedule within the next 10ms */
-	offset = TCP_TIMER_10MS_QUANTUM;
-	if (listp->scheduled) {
-		int32_t diff;
-		diff = timer_diff(listp->runtime, 0, tcp_now, offset);
-		if (diff <= 0) {
-			/* The timer will fire sooner than what's needed */
-			goto done;
+		lck_mtx_lock(&listp->mtx);
+		if (listp->running) {
+			listp->pref_mode |= TCP_TIMERLIST_10MS_MODE;
+			goto next;
 		}
-	}
-	listp->mode = TCP_TIMERLIST_10MS_MODE;
-	listp->idleruns = 0;
 
-	tcp_sched_timerlist(offset);
-done:
-	lck_mtx_unlock(&listp->mtx);
-	return;
+		/* Reschedule within the next 10ms */
+		offset = TCP_TIMER_10MS_QUANTUM;
+		if (listp->scheduled) {
+			int32_t diff;
+			diff = timer_diff(listp->runtime, 0, tcp_now, offset);
+			if (diff <= 0) {
+				/* The timer will fire sooner than what's needed */
+				goto next;
+			}
+		}
+		listp->mode = TCP_TIMERLIST_10MS_MODE;
+		listp->idleruns = 0;
+
+		tcp_sched_timerlist(listp, offset);
+next:
+		lck_mtx_unlock(&listp->mtx);
+	}
 }
 
 inline void
@@ -3112,3 +3388,143 @@ tcp_set_pto(struct tcpcb *tp)
 
 	tp->t_timer[TCPT_PTO] = tcp_offset_from_latest_tx(tp, pto);
 }
+
+#if (DEVELOPMENT || DEBUG)
+/*
+ * Arm, re-arm, expire and cancel timers for a large number of synthetic
+ * connections on a private wheel. Returns the average cost in nanoseconds
+ * of an arm or cancel, each done under the list lock.
+ */
+#define TCP_TIMER_WHEEL_BENCH_DEFAULT   (1000 * 1000)
+#define TCP_TIMER_WHEEL_BENCH_MAX       (4 * 1000 * 1000)
+
+static uint32_t
+tcp_timer_wheel_bench_runtime(uint32_t base, uint32_t i, uint16_t *mode)
+{
+	switch (i & 3) {
+	case 0:
+		/* retransmissions */
+		*mode = TCP_TIMERLIST_10MS_MODE;
+		return base + 1 + (random() % TCP_RETRANSHZ);
+	case 1:
+		/* delayed acks */
+		*mode = TCP_TIMERLIST_100MS_MODE;
+		return base + 1 + (random() % (2 * TCP_TIMER_100MS_QUANTUM));
+	default:
+		/* keepalives of idle connections */
+		*mode = TCP_TIMERLIST_500MS_MODE;
+		return base + 1 + (random() % TCPTV_KEEP_IDLE);
+	}
+}
+
+static int
+tcp_timer_wheel_bench(int64_t in, int64_t *out)
+{
+	struct tcptimerlist *listp;
+	struct tcptimerentry *tes, *te;
+	uint64_t start, arm_abs, rearm_abs, expire_abs, cancel_abs;
+	uint64_t arm_ns, rearm_ns, expire_ns, cancel_ns;
+	uint32_t count, base, expected = 0, expired = 0;
+	uint16_t mode;
+	int error = 0;
+
+	count = (in > 0 && in <= TCP_TIMER_WHEEL_BENCH_MAX) ? (uint32_t)in :
+	    TCP_TIMER_WHEEL_BENCH_DEFAULT;
+	base = tcp_now;
+
+	listp = kalloc_type(struct tcptimerlist, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	tes = kalloc_type(struct tcptimerentry, count, Z_WAITOK | Z_ZERO);
+	if (tes == NULL) {
+		kfree_type(struct tcptimerlist, listp);
+		return ENOMEM;
+	}
+	for (int j = 0; j < TCP_TW_L0_SIZE; j++) {
+		LIST_INIT(&listp->tw_l0[j]);
+	}
+	for (int level = 1; level < TCP_TW_LEVELS; level++) {
+		for (int j = 0; j < TCP_TW_LN_SIZE; j++) {
+			LIST_INIT(&listp->tw_ln[level - 1][j]);
+		}
+	}
+	LIST_INIT(&listp->tw_expired);
+	listp->tw_next = base;
+	lck_mtx_init(&listp->mtx, &tcp_timer_mtx_grp, LCK_ATTR_NULL);
+
+	start = mach_absolute_time();
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t runtime = tcp_timer_wheel_bench_runtime(base, i, &mode);
+
+		lck_mtx_lock(&listp->mtx);
+		tcp_wheel_add(listp, &tes[i], runtime, mode);
+		lck_mtx_unlock(&listp->mtx);
+	}
+	arm_abs = mach_absolute_time() - start;
+
+	/* every connection moves its deadline, as on the receipt of data */
+	start = mach_absolute_time();
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t runtime = tcp_timer_wheel_bench_runtime(base, i, &mode);
+
+		lck_mtx_lock(&listp->mtx);
+		tcp_wheel_remove(listp, &tes[i]);
+		tcp_wheel_add(listp, &tes[i], runtime, mode);
+		lck_mtx_unlock(&listp->mtx);
+	}
+	rearm_abs = mach_absolute_time() - start;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (TSTMP_LEQ(tes[i].te_slot_time, base + TCP_RETRANSHZ)) {
+			expected++;
+		}
+	}
+
+	/* one second worth of expirations */
+	start = mach_absolute_time();
+	lck_mtx_lock(&listp->mtx);
+	tcp_wheel_advance(listp, base + TCP_RETRANSHZ);
+	while ((te = LIST_FIRST(&listp->tw_expired)) != NULL) {
+		if (TSTMP_GT(te->te_slot_time, base + TCP_RETRANSHZ)) {
+			error = EINVAL;
+		}
+		tcp_wheel_remove(listp, te);
+		te->te_le.le_prev = NULL;
+		expired++;
+	}
+	lck_mtx_unlock(&listp->mtx);
+	expire_abs = mach_absolute_time() - start;
+
+	start = mach_absolute_time();
+	for (uint32_t i = 0; i < count; i++) {
+		if (tes[i].te_le.le_prev == NULL) {
+			continue;
+		}
+		lck_mtx_lock(&listp->mtx);
+		tcp_wheel_remove(listp, &tes[i]);
+		lck_mtx_unlock(&listp->mtx);
+	}
+	cancel_abs = mach_absolute_time() - start;
+
+	if (expired != expected || !tcp_wheel_empty(listp) ||
+	    listp->tw_fast[0] != 0 || listp->tw_fast[1] != 0) {
+		error = EINVAL;
+	}
+
+	absolutetime_to_nanoseconds(arm_abs, &arm_ns);
+	absolutetime_to_nanoseconds(rearm_abs, &rearm_ns);
+	absolutetime_to_nanoseconds(expire_abs, &expire_ns);
+	absolutetime_to_nanoseconds(cancel_abs, &cancel_ns);
+	os_log(OS_LOG_DEFAULT, "%s: %u entries arm %llu ns rearm %llu ns "
+	    "cancel %llu ns, %u/%u expired in %llu ns error %d\n", __func__,
+	    count, arm_ns / count, rearm_ns / count,
+	    cancel_ns / MAX(count - expired, 1), expired, expected,
+	    expire_ns, error);
+
+	lck_mtx_destroy(&listp->mtx, &tcp_timer_mtx_grp);
+	kfree_type(struct tcptimerentry, count, tes);
+	kfree_type(struct tcptimerlist, listp);
+
+	*out = (int64_t)((arm_ns + cancel_ns) / (count + count - expired));
+	return error;
+}
+SYSCTL_TEST_REGISTER(tcp_timer_wheel_bench, tcp_timer_wheel_bench);
+#endif /* (DEVELOPMENT || DEBUG) */
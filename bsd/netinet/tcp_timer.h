@@ -218,19 +218,45 @@ static char *tcptimers[] =
 struct tcptimerlist;
 
 struct tcptimerentry {
-	LIST_ENTRY(tcptimerentry) te_le;   /* links for timer list */
+	LIST_ENTRY(tcptimerentry) te_le;   /* links for timer wheel slot */
 	uint32_t te_timer_start;   /* tcp clock when the timer was started */
 	uint16_t te_index;         /* index of lowest timer that needs to run first */
 	uint16_t te_mode;          /* Bit-wise OR of timers that are active */
 	uint32_t te_runtime;       /* deadline at which the first timer has to fire */
+	uint32_t te_slot_time;     /* deadline the entry is filed under in the wheel */
+	uint16_t te_list;          /* index of the timer list holding the entry */
+	uint8_t  te_level;         /* wheel level of the slot holding the entry */
+	uint8_t  te_slot_mode;     /* fast timer modes accounted to the wheel */
 };
 
 LIST_HEAD(timerlisthead, tcptimerentry);
 
+/*
+ * Each timer list is a hierarchical timing wheel. Level 0 has one slot
+ * per tick of the TCP clock; every slot of the upper levels spans a full
+ * rotation of the level below it, and its entries are cascaded down when
+ * that rotation starts. With 1 ms ticks the wheel covers about 18 hours,
+ * entries due later are kept in the last slot of the top level until they
+ * get closer.
+ */
+#define TCP_TW_L0_BITS          8
+#define TCP_TW_LN_BITS          6
+#define TCP_TW_LEVELS           4
+#define TCP_TW_L0_SIZE          (1 << TCP_TW_L0_BITS)
+#define TCP_TW_LN_SIZE          (1 << TCP_TW_LN_BITS)
+#define TCP_TW_L0_MASK          (TCP_TW_L0_SIZE - 1)
+#define TCP_TW_LN_MASK          (TCP_TW_LN_SIZE - 1)
+#define TCP_TW_SHIFT(level)     (TCP_TW_L0_BITS + ((level) - 1) * TCP_TW_LN_BITS)
+#define TCP_TW_EXPIRED          0xff    /* te_level of due entries */
+
 struct tcptimerlist {
-	struct timerlisthead lhead;     /* head of the list */
+	struct timerlisthead tw_l0[TCP_TW_L0_SIZE];     /* one slot per tick */
+	struct timerlisthead tw_ln[TCP_TW_LEVELS - 1][TCP_TW_LN_SIZE];
+	struct timerlisthead tw_expired;        /* due entries left to run */
+	uint32_t tw_next;       /* next tick of the wheel to process */
+	uint32_t tw_count[TCP_TW_LEVELS];       /* entries filed per level */
+	uint32_t tw_fast[2];    /* entries with 10ms and 100ms timers */
 	lck_mtx_t mtx;          /* lock to protect the list */
-	lck_grp_t *mtx_grp;     /* mutex group definition */
 	thread_call_t call;     /* call entry */
 	uint32_t runtime;       /* time at which this list is going to run */
 	uint32_t schedtime;     /* time at which this list was scheduled */
@@ -249,7 +275,6 @@ struct tcptimerlist {
 	uint32_t pref_mode;     /* Preferred mode set by a connection */
 	uint32_t pref_offset;   /* Preferred offset set by a connection */
 	uint32_t idleruns;      /* Number of times the list has been idle in fast mode */
-	struct tcptimerentry *next_te;  /* next timer entry pointer to process */
 	u_int16_t probe_if_index; /* Interface index that needs to send probes */
 };
 
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Kernel TLS record layer.
+ *
+ * Once TCP_TLS_TX is set, tcp_usr_send() hands the plaintext written to
+ * the socket to tcp_tls_output(), which cuts it into records of at most
+ * TCP_TLS_MAX_RECORD bytes and seals each of them in place before it is
+ * appended to the send buffer.  Records are laid out as in RFC 5246 and
+ * RFC 5288 for TLS 1.2 with AES-GCM, RFC 7905 for TLS 1.2 with
+ * ChaCha20-Poly1305, and RFC 8446 for TLS 1.3:
+ *
+ *	header | [explicit nonce] | ciphertext | [inner type] | tag
+ *
+ * Since the data is encrypted in the mbufs it was copied into, sendfile()
+ * gets TLS framing without any copy on top of the file read.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/mbuf.h>
+#include <sys/socket.h>
+#include <sys/socketvar.h>
+#include <sys/sysctl.h>
+
+#include <corecrypto/cc.h>
+#include <libkern/crypto/aes.h>
+#include <libkern/crypto/chacha20poly1305.h>
+
+#include <netinet/in.h>
+#include <netinet/in_pcb.h>
+#include <netinet/tcp_includes.h>
+#include <netinet/tcp_tls.h>
+
+static uint64_t tcp_tls_tx_records = 0;
+SYSCTL_QUAD(_net_inet_tcp, OID_AUTO, tls_tx_records,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &tcp_tls_tx_records,
+    "Number of kernel TLS records sent");
+
+static uint64_t tcp_tls_tx_errors = 0;
+SYSCTL_QUAD(_net_inet_tcp, OID_AUTO, tls_tx_errors,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &tcp_tls_tx_errors,
+    "Number of kernel TLS records that could not be sealed");
+
+static inline bool
+tcp_tls_is_chacha(const struct tcp_tls *tls)
+{
+	return tls->tls_cipher == TCP_TLS_CIPHER_CHACHA20_POLY1305;
+}
+
+/* Only TLS 1.2 AES-GCM carries part of the nonce in the record */
+static inline bool
+tcp_tls_explicit_nonce(const struct tcp_tls *tls)
+{
+	return tls->tls_version == TCP_TLS_VERSION_1_2 &&
+	       !tcp_tls_is_chacha(tls);
+}
+
+static void
+tcp_tls_destroy(struct tcp_tls *tls)
+{
+	if (tls->tls_ctx != NULL) {
+		cc_clear(tls->tls_ctx_size, tls->tls_ctx);
+		kfree_data_sized_by(tls->tls_ctx, tls->tls_ctx_size);
+	}
+	cc_clear(sizeof(tls->tls_iv), tls->tls_iv);
+	kfree_type(struct tcp_tls, tls);
+}
+
+int
+tcp_tls_set_tx(struct tcpcb *tp, struct sockopt *sopt)
+{
+	struct socket *so = tp->t_inpcb->inp_socket;
+	struct tcp_tls_info tti;
+	struct tcp_tls *tls;
+	uint32_t keylen;
+	void *ctx;
+	size_t size;
+	int error;
+
+	if (tp->t_tls_tx != NULL) {
+		return EBUSY;
+	}
+	if (so->so_flags & SOF_MP_SUBFLOW) {
+		return EOPNOTSUPP;
+	}
+	if (tp->t_state < TCPS_ESTABLISHED) {
+		return ENOTCONN;
+	}
+	if (so->so_state & SS_CANTSENDMORE) {
+		return EPIPE;
+	}
+
+	error = sooptcopyin(sopt, &tti, sizeof(tti), sizeof(tti));
+	if (error != 0) {
+		return error;
+	}
+
+	switch (tti.tti_cipher) {
+	case TCP_TLS_CIPHER_AES_GCM_128:
+		keylen = 16;
+		break;
+	case TCP_TLS_CIPHER_AES_GCM_256:
+	case TCP_TLS_CIPHER_CHACHA20_POLY1305:
+		keylen = 32;
+		break;
+	default:
+		error = EINVAL;
+		goto done;
+	}
+	if (tti.tti_keylen != keylen ||
+	    (tti.tti_version != TCP_TLS_VERSION_1_2 &&
+	    tti.tti_version != TCP_TLS_VERSION_1_3)) {
+		error = EINVAL;
+		goto done;
+	}
+
+	tls = kalloc_type(struct tcp_tls, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	tls->tls_version = tti.tti_version;
+	tls->tls_cipher = tti.tti_cipher;
+	tls->tls_keylen = keylen;
+	tls->tls_seq = tti.tti_seq;
+	bcopy(tti.tti_iv, tls->tls_iv, sizeof(tls->tls_iv));
+	tls->tls_type = TCP_TLS_TYPE_APPDATA;
+
+	/* kalloc_data() memory is suitably aligned for the GCM context */
+	size = tcp_tls_is_chacha(tls) ? sizeof(chacha20poly1305_ctx) :
+	    aes_encrypt_get_ctx_size_gcm();
+	ctx = kalloc_data(size, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	tls->tls_ctx = ctx;
+	tls->tls_ctx_size = size;
+
+	if (tcp_tls_is_chacha(tls)) {
+		error = chacha20poly1305_init(tls->tls_ctx, tti.tti_key);
+	} else {
+		error = aes_encrypt_key_gcm(tti.tti_key, (int)keylen,
+		    tls->tls_ctx);
+		if (error == 0) {
+			error = aes_encrypt_reset_gcm(tls->tls_ctx);
+		}
+	}
+	if (error != 0) {
+		os_log_error(OS_LOG_DEFAULT, "%s: cipher %u setup failed %d",
+		    __func__, tti.tti_cipher, error);
+		tcp_tls_destroy(tls);
+		error = EINVAL;
+		goto done;
+	}
+	tp->t_tls_tx = tls;
+
+done:
+	cc_clear(sizeof(tti), &tti);
+	return error;
+}
+
+int
+tcp_tls_get_tx(struct tcpcb *tp, struct sockopt *sopt)
+{
+	struct tcp_tls *tls = tp->t_tls_tx;
+	struct tcp_tls_info tti;
+
+	if (tls == NULL) {
+		return ENOENT;
+	}
+
+	/* never hand the key material back */
+	bzero(&tti, sizeof(tti));
+	tti.tti_version = tls->tls_version;
+	tti.tti_cipher = tls->tls_cipher;
+	tti.tti_keylen = tls->tls_keylen;
+	tti.tti_seq = tls->tls_seq;
+
+	return sooptcopyout(sopt, &tti, sizeof(tti));
+}
+
+/*
+ * Look for the TLS content type of the data in the control messages
+ * passed to send; returns ENOMSG if there is none.
+ */
+int
+tcp_tls_record_type(struct mbuf *control, uint8_t *type)
+{
+	struct cmsghdr *cm;
+
+	for (cm = M_FIRST_CMSGHDR(control); cm;
+	    cm = M_NXT_CMSGHDR(control, cm)) {
+		if (cm->cmsg_len < sizeof(struct cmsghdr) ||
+		    cm->cmsg_len > control->m_len) {
+			return EINVAL;
+		}
+		if (cm->cmsg_level != IPPROTO_TCP ||
+		    cm->cmsg_type != TCP_TLS_RECORD_TYPE) {
+			continue;
+		}
+		if (cm->cmsg_len != CMSG_LEN(sizeof(uint8_t))) {
+			return EINVAL;
+		}
+		*type = *(uint8_t *)(void *)CMSG_DATA(cm);
+		return 0;
+	}
+	return ENOMSG;
+}
+
+static int
+tcp_tls_begin(struct tcp_tls *tls, const uint8_t *nonce, const uint8_t *aad,
+    size_t aadlen)
+{
+	int error;
+
+	if (tcp_tls_is_chacha(tls)) {
+		if ((error = chacha20poly1305_reset(tls->tls_ctx)) != 0 ||
+		    (error = chacha20poly1305_setnonce(tls->tls_ctx,
+		    nonce)) != 0) {
+			return error;
+		}
+		return chacha20poly1305_aad(tls->tls_ctx, aadlen, aad);
+	}
+	if ((error = aes_encrypt_set_iv_gcm(nonce, TCP_TLS_IV_LEN,
+	    tls->tls_ctx)) != 0) {
+		return error;
+	}
+	return aes_encrypt_aad_gcm(aad, (unsigned int)aadlen, tls->tls_ctx);
+}
+
+static int
+tcp_tls_update(struct tcp_tls *tls, uint8_t *data, size_t len)
+{
+	if (tcp_tls_is_chacha(tls)) {
+		return chacha20poly1305_encrypt(tls->tls_ctx, len, data, data);
+	}
+	return aes_encrypt_gcm(data, (unsigned int)len, data, tls->tls_ctx);
+}
+
+static int
+tcp_tls_finish(struct tcp_tls *tls, uint8_t *tag)
+{
+	if (tcp_tls_is_chacha(tls)) {
+		return chacha20poly1305_finalize(tls->tls_ctx, tag);
+	}
+	/* this also resets the context for the next record */
+	return aes_encrypt_finalize_gcm(tag, TCP_TLS_TAG_LEN, tls->tls_ctx);
+}
+
+/*
+ * Seal the plaintext in the chain at *mp into a single record, in place.
+ * On failure the chain is freed.
+ */
+static int
+tcp_tls_seal(struct tcp_tls *tls, struct mbuf **mp, uint8_t type)
+{
+	struct mbuf *m = *mp, *n;
+	const bool tls13 = (tls->tls_version == TCP_TLS_VERSION_1_3);
+	const bool explicit_nonce = tcp_tls_explicit_nonce(tls);
+	uint8_t hdr[TCP_TLS_HDR_LEN + TCP_TLS_NONCE_LEN];
+	uint8_t aad[TCP_TLS_AAD_LEN];
+	uint8_t nonce[TCP_TLS_IV_LEN];
+	uint8_t trailer[1 + TCP_TLS_TAG_LEN];
+	uint32_t plen = m_pktlen(m);
+	uint32_t hlen, tlen, rlen;
+	uint64_t seq = tls->tls_seq;
+	size_t aadlen;
+	int error;
+
+	VERIFY(plen <= TCP_TLS_MAX_RECORD);
+
+	hlen = TCP_TLS_HDR_LEN + (explicit_nonce ? TCP_TLS_NONCE_LEN : 0);
+	tlen = (tls13 ? 1 : 0) + TCP_TLS_TAG_LEN;
+	rlen = (hlen - TCP_TLS_HDR_LEN) + plen + tlen;
+
+	/*
+	 * TLS 1.2 AES-GCM: the salt followed by the explicit nonce, which
+	 * starts at the value given at setup and counts records.  Otherwise
+	 * the static IV XORed with the sequence number.
+	 */
+	bcopy(tls->tls_iv, nonce, sizeof(nonce));
+	if (!explicit_nonce) {
+		for (int i = 0; i < 8; i++) {
+			nonce[4 + i] ^= (uint8_t)(seq >> (56 - 8 * i));
+		}
+	}
+
+	/* TLS 1.3 hides the content type behind application data */
+	hdr[0] = tls13 ? TCP_TLS_TYPE_APPDATA : type;
+	hdr[1] = 0x03;
+	hdr[2] = 0x03;
+	hdr[3] = (uint8_t)(rlen >> 8);
+	hdr[4] = (uint8_t)rlen;
+	if (explicit_nonce) {
+		bcopy(&nonce[4], &hdr[TCP_TLS_HDR_LEN], TCP_TLS_NONCE_LEN);
+	}
+
+	if (tls13) {
+		bcopy(hdr, aad, TCP_TLS_HDR_LEN);
+		aadlen = TCP_TLS_HDR_LEN;
+	} else {
+		for (int i = 0; i < 8; i++) {
+			aad[i] = (uint8_t)(seq >> (56 - 8 * i));
+		}
+		aad[8] = type;
+		aad[9] = 0x03;
+		aad[10] = 0x03;
+		aad[11] = (uint8_t)(plen >> 8);
+		aad[12] = (uint8_t)plen;
+		aadlen = TCP_TLS_AAD_LEN;
+	}
+
+	if ((error = tcp_tls_begin(tls, nonce, aad, aadlen)) != 0) {
+		goto fail;
+	}
+	for (n = m; n != NULL; n = n->m_next) {
+		if (n->m_len != 0 && (error = tcp_tls_update(tls,
+		    mtod(n, uint8_t *), n->m_len)) != 0) {
+			goto fail;
+		}
+	}
+	if (tls13) {
+		trailer[0] = type;
+		if ((error = tcp_tls_update(tls, trailer, 1)) != 0) {
+			goto fail;
+		}
+	}
+	if ((error = tcp_tls_finish(tls, &trailer[tlen - TCP_TLS_TAG_LEN])) != 0) {
+		goto fail;
+	}
+	cc_clear(sizeof(nonce), nonce);
+
+	M_PREPEND(m, hlen, M_WAIT, 0);
+	if (m == NULL) {
+		*mp = NULL;
+		return ENOBUFS;
+	}
+	bcopy(hdr, mtod(m, uint8_t *), hlen);
+	if (!m_append(m, tlen, (caddr_t)trailer)) {
+		m_freem(m);
+		*mp = NULL;
+		return ENOBUFS;
+	}
+
+	tls->tls_seq++;
+	if (explicit_nonce) {
+		/* big-endian increment of the explicit nonce */
+		for (int i = TCP_TLS_IV_LEN - 1; i >= 4; i--) {
+			if (++tls->tls_iv[i] != 0) {
+				break;
+			}
+		}
+	}
+	*mp = m;
+	return 0;
+
+fail:
+	os_log_error(OS_LOG_DEFAULT, "%s: record %llu sealing failed %d",
+	    __func__, seq, error);
+	cc_clear(sizeof(nonce), nonce);
+	m_freem(m);
+	*mp = NULL;
+	return EINVAL;
+}
+
+/*
+ * Turn the plaintext at *mp into a chain of sealed records of the content
+ * type of the current write.  On failure nothing is left to send and an error is
+ * returned; the records that were sealed already are dropped along with
+ * the rest, so the caller must abort the connection as the record
+ * sequence can't be resumed.
+ */
+int
+tcp_tls_output(struct tcpcb *tp, struct mbuf **mp)
+{
+	struct tcp_tls *tls = tp->t_tls_tx;
+	const uint8_t type = tls->tls_type;
+	struct mbuf *m = *mp, *head = NULL, *rest, *n;
+	int error = 0;
+
+	*mp = NULL;
+	if (m == NULL) {
+		return 0;
+	}
+
+	/* the data is encrypted in place, make sure nobody else sees it */
+	for (n = m; n != NULL; n = n->m_next) {
+		if (!M_WRITABLE(n)) {
+			break;
+		}
+	}
+	if (n != NULL || !(m->m_flags & M_PKTHDR)) {
+		n = m_dup(m, M_WAIT);
+		m_freem(m);
+		if (n == NULL) {
+			return ENOBUFS;
+		}
+		m = n;
+	}
+
+	while (m != NULL) {
+		rest = NULL;
+		if (m_pktlen(m) > TCP_TLS_MAX_RECORD) {
+			rest = m_split(m, TCP_TLS_MAX_RECORD, M_WAIT);
+			if (rest == NULL) {
+				error = ENOBUFS;
+				break;
+			}
+		}
+		if ((error = tcp_tls_seal(tls, &m, type)) != 0) {
+			m = rest;
+			break;
+		}
+		if (head == NULL) {
+			head = m;
+		} else {
+			head->m_pkthdr.len += m_pktlen(m);
+			m->m_flags &= ~M_PKTHDR;
+			m_cat(head, m);
+		}
+		os_atomic_inc(&tcp_tls_tx_records, relaxed);
+		m = rest;
+	}
+	if (error != 0) {
+		os_atomic_inc(&tcp_tls_tx_errors, relaxed);
+		m_freem(m);
+		m_freem(head);
+		return error;
+	}
+	*mp = head;
+	return 0;
+}
+
+void
+tcp_tls_free(struct tcpcb *tp)
+{
+	if (tp->t_tls_tx != NULL) {
+		tcp_tls_destroy(tp->t_tls_tx);
+		tp->t_tls_tx = NULL;
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/* Kernel TLS record layer (TCP_TLS_TX) */
+
+#ifndef _NETINET_TCP_TLS_H_
+#define _NETINET_TCP_TLS_H_
+
+#ifdef BSD_KERNEL_PRIVATE
+
+#include <sys/mbuf.h>
+#include <netinet/tcp_private.h>
+
+#define TCP_TLS_HDR_LEN         5       /* content type, version, length */
+#define TCP_TLS_NONCE_LEN       8       /* TLS 1.2 AES-GCM explicit nonce */
+#define TCP_TLS_TAG_LEN         16
+#define TCP_TLS_AAD_LEN         13      /* TLS 1.2; TLS 1.3 uses the header */
+
+#define TCP_TLS_TYPE_APPDATA    23
+
+struct tcp_tls {
+	uint16_t        tls_version;    /* TCP_TLS_VERSION_* */
+	uint16_t        tls_cipher;     /* TCP_TLS_CIPHER_* */
+	uint32_t        tls_keylen;
+	uint64_t        tls_seq;        /* next record sequence number */
+	uint8_t         tls_iv[TCP_TLS_IV_LEN];
+	uint8_t         tls_type;       /* content type of the current write */
+	size_t          tls_ctx_size;
+	void            *__sized_by(tls_ctx_size) tls_ctx;      /* cipher state */
+};
+
+struct tcpcb;
+struct sockopt;
+
+extern int tcp_tls_set_tx(struct tcpcb *, struct sockopt *);
+extern int tcp_tls_get_tx(struct tcpcb *, struct sockopt *);
+extern int tcp_tls_record_type(struct mbuf *, uint8_t *);
+extern int tcp_tls_output(struct tcpcb *, struct mbuf **);
+extern void tcp_tls_free(struct tcpcb *);
+
+#endif /* BSD_KERNEL_PRIVATE */
+#endif /* _NETINET_TCP_TLS_H_ */
@@ -96,6 +96,7 @@
 #include <netinet/tcpip.h>
 #include <netinet/tcp_cc.h>
 #include <netinet/tcp_log.h>
+#include <netinet/tcp_tls.h>
 #include <mach/sdt.h>
 #if MPTCP
 #include <netinet/mptcp_var.h>
@@ -393,6 +394,9 @@ tcp_usr_listen(struct socket *so, struct proc *p)
 
 		inp_exit_bind_in_progress(so);
 	}
+	if (error == 0 && (so->so_options & SO_REUSEPORT_LB)) {
+		error = in_pcblbgroup_insert(inp);
+	}
 	if (error == 0) {
 		TCP_LOG_STATE(tp, TCPS_LISTEN);
 		tp->t_state = TCPS_LISTEN;
@@ -423,6 +427,9 @@ tcp6_usr_listen(struct socket *so, struct proc *p)
 
 		inp_exit_bind_in_progress(so);
 	}
+	if (error == 0 && (so->so_options & SO_REUSEPORT_LB)) {
+		error = in_pcblbgroup_insert(inp);
+	}
 	if (error == 0) {
 		TCP_LOG_STATE(tp, TCPS_LISTEN);
 		tp->t_state = TCPS_LISTEN;
@@ -1207,6 +1214,15 @@ tcp_usr_send(struct socket *so, int flags, struct mbuf *m,
 		}
 	}
 
+	/*
+	 * The content type given with the first chunk of a write holds for
+	 * the rest of it; a new write is application data unless told
+	 * otherwise.
+	 */
+	if (tp->t_tls_tx != NULL && !(flags & PRUS_CONTINUED)) {
+		tp->t_tls_tx->tls_type = TCP_TLS_TYPE_APPDATA;
+	}
+
 	if (control != NULL) {
 		if (control->m_len > 0 && net_mpklog_enabled) {
 			error = tcp_get_mpkl_send_info(control, &mpkl_send_info);
@@ -1226,6 +1242,20 @@ tcp_usr_send(struct socket *so, int flags, struct mbuf *m,
 				goto out;
 			}
 		}
+		if (control->m_len > 0 && tp->t_tls_tx != NULL) {
+			error = tcp_tls_record_type(control,
+			    &tp->t_tls_tx->tls_type);
+			if (error != 0 && error != ENOMSG) {
+				m_freem(control);
+				if (m != NULL) {
+					m_freem(m);
+				}
+				control = NULL;
+				m = NULL;
+				goto out;
+			}
+			error = 0;
+		}
 		/*
 		 * Silently drop unsupported ancillary data messages
 		 */
@@ -1233,6 +1263,19 @@ tcp_usr_send(struct socket *so, int flags, struct mbuf *m,
 		control = NULL;
 	}
 
+	/*
+	 * With kernel TLS the send buffer only ever holds sealed records.
+	 * A record that could not be sealed leaves a hole in the record
+	 * sequence the peer can't recover from, so give up on the connection.
+	 */
+	if (tp->t_tls_tx != NULL && m != NULL) {
+		error = tcp_tls_output(tp, &m);
+		if (error != 0) {
+			tp = tcp_drop(tp, error);
+			goto out;
+		}
+	}
+
 	/* MPTCP sublow socket buffers must not be compressed */
 	VERIFY(!(so->so_flags & SOF_MP_SUBFLOW) ||
 	    (so->so_snd.sb_flags & SB_NOCOMPRESS));
@@ -2818,6 +2861,9 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 				tp->t_rxt_minimum_timeout *= TCP_RETRANSHZ;
 			}
 			break;
+		case TCP_TLS_TX:
+			error = tcp_tls_set_tx(tp, sopt);
+			break;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -2991,6 +3037,9 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 		case TCP_RXT_MINIMUM_TIMEOUT:
 			optval = tp->t_rxt_minimum_timeout / TCP_RETRANSHZ;
 			break;
+		case TCP_TLS_TX:
+			error = tcp_tls_get_tx(tp, sopt);
+			goto done;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -3339,6 +3388,7 @@ tcpsockopt_cassert(void)
 	case TCP_DISABLE_BLACKHOLE_DETECTION:
 	case TCP_ECN_MODE:
 	case TCP_KEEPALIVE_OFFLOAD:
+	case TCP_TLS_TX:
 		;
 	}
 }
@@ -458,7 +458,7 @@ struct tcpcb {
 #define TF_CLOSING      0x8000000       /* pending tcp close */
 #define TF_TSO          0x10000000      /* TCP Segment Offloading is enable on this connection */
 #define TF_BLACKHOLE    0x20000000      /* Path MTU Discovery Black Hole detection */
-#define TF_TIMER_ONLIST 0x40000000      /* pcb is on tcp_timer_list */
+#define TF_TIMER_ONLIST 0x40000000      /* pcb is on a tcp timer wheel */
 /* Unused 0x80000000 */
 
 	tcp_seq snd_una;                /* send unacknowledged */
@@ -711,6 +711,7 @@ struct tcpcb {
 	uint32_t        std_dev_iaj;            /* Standard deviation */
 #endif /* TRAFFIC_MGT */
 	struct bwmeas   *t_bwmeas;              /* State for bandwidth measurement */
+	struct tcp_tls  *t_tls_tx;              /* Kernel TLS transmit state */
 	tcp_seq         t_idleat;               /* rcv_nxt at idle time */
 	uint8_t         t_fin_sent;
 	uint8_t         t_fin_rcvd;
@@ -1862,6 +1863,7 @@ void     tcp_setpersist(struct tcpcb *);
 void     tcp_gc(struct inpcbinfo *);
 void     tcp_itimer(struct inpcbinfo *ipi);
 void     tcp_check_timer_state(struct tcpcb *tp);
+void     tcp_timer_lists_init(void);
 void     tcp_run_timerlist(void *arg1, void *arg2);
 void     tcp_sched_timers(struct tcpcb *tp);
 
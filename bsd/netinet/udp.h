@@ -89,6 +89,8 @@ struct udphdr {
 #define UDP_NOCKSUM     0x01    /* don't checksum outbound payloads */
 #ifdef PRIVATE
 #define UDP_KEEPALIVE_OFFLOAD   0x02 /* Send keep-alive at a given interval */
+#define UDP_SEGMENT             0x03 /* split sends into datagrams of this size */
+#define UDP_GRO                 0x04 /* receive coalesced datagrams */
 #endif /* PRIVATE */
 
 #ifdef PRIVATE
@@ -102,6 +102,7 @@
 #include <netinet/udp.h>
 #include <netinet/udp_var.h>
 #include <netinet/udp_log.h>
+#include <netinet/kpi_ipfilter_var.h>
 #include <sys/kdebug.h>
 
 #if IPSEC
@@ -800,7 +801,8 @@ udp_input(struct mbuf *m, int iphlen)
 	}
 	if (nstat_collect) {
 		stats_functional_type ifnet_count_type = IFNET_COUNT_TYPE(ifp);
-		INP_ADD_RXSTAT(inp, ifnet_count_type, 1, m->m_pkthdr.len);
+		INP_ADD_RXSTAT(inp, ifnet_count_type, UDP_GRO_SEGS(m),
+		    m->m_pkthdr.len);
 	}
 #if CONTENT_FILTER && NECP
 	if (check_cfil && inp != NULL && inp->inp_policyresult.results.filter_control_unit == 0) {
@@ -824,7 +826,11 @@ udp_input(struct mbuf *m, int iphlen)
 	}
 #endif /* CONTENT_FILTER and NECP */
 	so_recv_data_stat(inp->inp_socket, m, 0);
-	if (sbappendaddr(&inp->inp_socket->so_rcv, append_sa,
+	if (__improbable(m->m_pkthdr.pkt_ext_flags & PKTF_EXT_UDP_GRO)) {
+		if (udp_gro_append(inp, append_sa, m, opts) != 0) {
+			sorwakeup(inp->inp_socket);
+		}
+	} else if (sbappendaddr(&inp->inp_socket->so_rcv, append_sa,
 	    m, opts, NULL) == 0) {
 		udpstat.udps_fullsock++;
 	} else {
@@ -1168,6 +1174,37 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 			}
 			break;
 		}
+		case UDP_SEGMENT:
+			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval))) != 0) {
+				break;
+			}
+
+			/* 0 turns segmentation off */
+			if (optval < 0 || optval > UINT16_MAX) {
+				error = EINVAL;
+				break;
+			}
+			inp->inp_udp_gso_size = (uint16_t)optval;
+			break;
+
+		case UDP_GRO:
+			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval))) != 0) {
+				break;
+			}
+
+			if (optval != 0) {
+				inp->inp_flags2 |= INP2_UDP_GRO;
+				if (so->so_state & SS_ISCONNECTED) {
+					udp_add_fsw_flow(inp, inp->inp_last_outifp);
+				}
+			} else {
+				inp->inp_flags2 &= ~INP2_UDP_GRO;
+				udp_del_fsw_flow(inp);
+			}
+			break;
+
 		case SO_FLUSH:
 			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
 			    sizeof(optval))) != 0) {
@@ -1189,6 +1226,14 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 			optval = inp->inp_flags & INP_UDP_NOCKSUM;
 			break;
 
+		case UDP_SEGMENT:
+			optval = inp->inp_udp_gso_size;
+			break;
+
+		case UDP_GRO:
+			optval = !!(inp->inp_flags2 & INP2_UDP_GRO);
+			break;
+
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -1557,12 +1602,195 @@ udp_check_pktinfo(struct mbuf *control, struct ifnet **outif,
 	return 0;
 }
 
+/*
+ * A UDP_SEGMENT datagram train is handed to IP in one piece only when the
+ * route leads to an interface that splits it itself (IFXF_UDP_GSO), and
+ * nothing on the way needs to see the individual datagrams: IPsec, IP
+ * filters and CLAT46 translation all work on whole packets.
+ */
+boolean_t
+udp_gso_offload_ok(struct inpcb *inp, int af, struct rtentry *rt,
+    uint32_t hdrlen)
+{
+	struct ifnet *ifp;
+
+	if (rt == NULL ||
+	    (rt->rt_flags & (RTF_UP | RTF_MULTICAST | RTF_BROADCAST)) != RTF_UP) {
+		return FALSE;
+	}
+	if (inp->inp_flags2 & INP2_CLAT46_FLOW) {
+		return FALSE;
+	}
+#if IPSEC
+	if (ipsec_bypass == 0) {
+		return FALSE;
+	}
+#endif /* IPSEC */
+	if (!TAILQ_EMPTY(af == AF_INET ? &ipv4_filters : &ipv6_filters)) {
+		return FALSE;
+	}
+	ifp = rt->rt_ifp;
+	return ifp != NULL && (ifp->if_xflags & IFXF_UDP_GSO) &&
+	       hdrlen + inp->inp_udp_gso_size <= ifp->if_mtu;
+}
+
+static void
+udp_gso_fixup(struct mbuf *m, int af, uint32_t hlen, uint32_t seglen)
+{
+	struct udphdr *uh = (struct udphdr *)(void *)(mtod(m, caddr_t) + hlen);
+	uint32_t ulen = sizeof(struct udphdr) + seglen;
+
+	uh->uh_ulen = htons((u_short)ulen);
+	if (af == AF_INET) {
+		struct ip *ip = mtod(m, struct ip *);
+
+		ip->ip_len = (u_short)(hlen + ulen);
+		if (m->m_pkthdr.csum_flags & CSUM_UDP) {
+			uh->uh_sum = in_pseudo(ip->ip_src.s_addr,
+			    ip->ip_dst.s_addr, htons((u_short)ulen + IPPROTO_UDP));
+		}
+	} else {
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+
+		/* ip6_plen is filled in by ip6_output() */
+		if (m->m_pkthdr.csum_flags & CSUM_UDPIPV6) {
+			uh->uh_sum = in6_pseudo(&ip6->ip6_src, &ip6->ip6_dst,
+			    htonl(ulen + IPPROTO_UDP));
+		}
+	}
+}
+
+/*
+ * Split a UDP_SEGMENT datagram train into datagrams of segsz payload
+ * bytes, linked through m_nextpkt behind the original mbuf which keeps
+ * the first one.  The IP and UDP headers must be contiguous in the first
+ * mbuf as udp_output() and udp6_output() lay them out; only the lengths
+ * and the pseudo header checksum are rewritten, IP finishes each datagram
+ * as usual.  The payload is shared, not copied.  On failure the whole
+ * train is freed.
+ */
+int
+udp_gso_split(struct mbuf *m0, int af, uint32_t hlen, uint16_t segsz)
+{
+	uint32_t hdrlen = hlen + sizeof(struct udphdr);
+	uint32_t off, seglen;
+	struct mbuf *m, **mnext = &m0->m_nextpkt;
+
+	VERIFY(m0->m_flags & M_PKTHDR);
+	VERIFY(m0->m_nextpkt == NULL);
+	VERIFY(m0->m_len >= hdrlen && hdrlen <= MHLEN);
+	VERIFY(segsz != 0);
+
+	for (off = hdrlen + segsz; off < (uint32_t)m0->m_pkthdr.len;
+	    off += segsz) {
+		seglen = MIN(segsz, (uint32_t)m0->m_pkthdr.len - off);
+
+		MGETHDR(m, M_DONTWAIT, MT_HEADER);      /* MAC-OK */
+		if (m == NULL) {
+			goto nobufs;
+		}
+		*mnext = m;
+		mnext = &m->m_nextpkt;
+		if (m_dup_pkthdr(m, m0, M_DONTWAIT) != 0) {
+			goto nobufs;
+		}
+		MH_ALIGN(m, hdrlen);
+		bcopy(mtod(m0, caddr_t), mtod(m, caddr_t), hdrlen);
+		m->m_len = hdrlen;
+		m->m_next = m_copym(m0, off, seglen, M_DONTWAIT);
+		if (m->m_next == NULL) {
+			goto nobufs;
+		}
+		m->m_pkthdr.len = hdrlen + seglen;
+		udp_gso_fixup(m, af, hlen, seglen);
+	}
+
+	m_adj(m0, (int)(hdrlen + segsz) - m0->m_pkthdr.len);
+	udp_gso_fixup(m0, af, hlen, segsz);
+	return 0;
+
+nobufs:
+	m_freem_list(m0);
+	return ENOBUFS;
+}
+
+/*
+ * Append a train of datagrams coalesced by the flowswitch, with its IP
+ * and UDP headers stripped, to the receive buffer of inp.  A UDP_GRO
+ * socket gets the train as a single message along with a UDP_GRO control
+ * message carrying the segment size; any other socket gets the original
+ * datagrams back.  Consumes m and opts, and returns the number of
+ * datagrams appended.
+ */
+int
+udp_gro_append(struct inpcb *inp, struct sockaddr *append_sa,
+    struct mbuf *m, struct mbuf *opts)
+{
+	struct sockbuf *sb = &inp->inp_socket->so_rcv;
+	uint16_t segsz = m->m_pkthdr.udp_seg_size;
+	int segs = UDP_GRO_SEGS(m);
+	int appended = 0;
+
+	VERIFY(segsz != 0);
+	m->m_pkthdr.pkt_ext_flags &= ~PKTF_EXT_UDP_GRO;
+	udpstat.udps_ipackets += segs - 1;
+
+	if (inp->inp_flags2 & INP2_UDP_GRO) {
+		struct mbuf **mp = &opts;
+		int optval = segsz;
+
+		while (*mp != NULL && (*mp)->m_next != NULL) {
+			mp = &(*mp)->m_next;
+		}
+		mp = sbcreatecontrol_mbuf((caddr_t)&optval, sizeof(optval),
+		    UDP_GRO, IPPROTO_UDP, mp);
+		if (*mp != NULL) {
+			if (sbappendaddr(sb, append_sa, m, opts, NULL) == 0) {
+				udpstat.udps_fullsock++;
+				return 0;
+			}
+			return segs;
+		}
+		/* no room for the control message, split the train */
+	}
+
+	while (m != NULL) {
+		struct mbuf *n = NULL, *control = opts;
+
+		if (m_pktlen(m) > segsz) {
+			n = m_split(m, segsz, M_DONTWAIT);
+			if (n == NULL) {
+				m_freem(m);
+				m = NULL;
+				break;
+			}
+			if (opts != NULL) {
+				control = m_copym(opts, 0, M_COPYALL, M_DONTWAIT);
+			}
+		} else {
+			opts = NULL;
+		}
+		if (sbappendaddr(sb, append_sa, m, control, NULL) == 0) {
+			udpstat.udps_fullsock++;
+		} else {
+			appended++;
+		}
+		m = n;
+	}
+	if (opts != NULL) {
+		m_freem(opts);
+	}
+	return appended;
+}
+
 static int
 udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
     struct mbuf *control, struct proc *p)
 {
 	struct udpiphdr *ui;
 	int len = m->m_pkthdr.len;
+	uint16_t gso_size = inp->inp_udp_gso_size;
+	uint32_t gso_segs = 1;
 	struct sockaddr_in *sin;
 	struct in_addr laddr, faddr, pi_laddr;
 	u_short lport, fport;
@@ -1659,6 +1887,19 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		goto release;
 	}
 
+	/*
+	 * With UDP_SEGMENT, a send larger than the segment size goes out
+	 * as a train of gso_size datagrams (the last one may be shorter.)
+	 */
+	if (gso_size != 0 && len > gso_size) {
+		gso_segs = howmany(len, gso_size);
+		if (gso_segs > UDP_GSO_MAX_SEGS) {
+			error = EMSGSIZE;
+			UDP_LOG(inp, "len %d too many segments error EMSGSIZE", len);
+			goto release;
+		}
+	}
+
 	if (flowadv && INP_WAIT_FOR_IF_FEEDBACK(inp)) {
 		/*
 		 * The socket is flow-controlled, drop the packets
@@ -1936,7 +2177,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	} else {
 		((struct ip *)ui)->ip_tos = inp->inp_ip_tos;    /* XXX */
 	}
-	udpstat.udps_opackets++;
+	udpstat.udps_opackets += gso_segs;
 
 	KERNEL_DEBUG(DBG_LAYER_OUT_END, ui->ui_dport, ui->ui_sport,
 	    ui->ui_src.s_addr, ui->ui_dst.s_addr, ui->ui_ulen);
@@ -2078,9 +2319,35 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		ipoa.ipoa_flags |= IPOAF_BOUND_SRCADDR;
 	}
 
+	/*
+	 * Hand a datagram train to an interface that segments it, or
+	 * split it here and send the datagrams one by one.
+	 */
+	if (gso_segs > 1) {
+		if (inpopts == NULL && !IN_MULTICAST(ntohl(faddr.s_addr)) &&
+		    udp_gso_offload_ok(inp, AF_INET, ro.ro_rt,
+		    sizeof(struct udpiphdr))) {
+			m->m_pkthdr.csum_flags |= CSUM_UDP_GSO;
+			m->m_pkthdr.udp_seg_size = gso_size;
+		} else if ((error = udp_gso_split(m, AF_INET,
+		    sizeof(struct ip), gso_size)) != 0) {
+			/* the train has been freed */
+			m = NULL;
+		}
+	}
+
 	socket_unlock(so, 0);
-	error = ip_output(m, inpopts, &ro, soopts, mopts, &ipoa);
-	m = NULL;
+	while (m != NULL) {
+		struct mbuf *n = m->m_nextpkt;
+
+		m->m_nextpkt = NULL;
+		error = ip_output(m, inpopts, &ro, soopts, mopts, &ipoa);
+		m = n;
+		if (error != 0 && m != NULL) {
+			m_freem_list(m);
+			m = NULL;
+		}
+	}
 	socket_lock(so, 0);
 	if (mopts != NULL) {
 		IMO_REMREF(mopts);
@@ -2106,7 +2373,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		if (ro.ro_rt != NULL) {
 			ifnet_count_type = IFNET_COUNT_TYPE(ro.ro_rt->rt_ifp);
 		}
-		INP_ADD_TXSTAT(inp, ifnet_count_type, 1, len);
+		INP_ADD_TXSTAT(inp, ifnet_count_type, gso_segs, len);
 	}
 
 	if (flowadv && (adv->code == FADV_FLOW_CONTROLLED ||
@@ -2272,6 +2539,7 @@ udp_abort(struct socket *so)
 		/* NOTREACHED */
 	}
 	soisdisconnected(so);
+	udp_del_fsw_flow(inp);
 	in_pcbdetach(inp);
 	return 0;
 }
@@ -2347,6 +2615,7 @@ static int
 udp_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 {
 	struct inpcb *inp;
+	struct ifnet *outif = NULL;
 	int error;
 
 	inp = sotoinpcb(so);
@@ -2379,7 +2648,7 @@ udp_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 #endif /* FLOW_DIVERT */
 #endif /* NECP */
 
-	error = in_pcbconnect(inp, nam, p, IFSCOPE_NONE, NULL);
+	error = in_pcbconnect(inp, nam, p, IFSCOPE_NONE, &outif);
 	if (error == 0) {
 #if NECP
 		/* Update NECP client with connected five-tuple */
@@ -2396,6 +2665,7 @@ udp_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 			ASSERT(inp->inp_flowhash != 0);
 		}
 		inp->inp_connect_timestamp = mach_continuous_time();
+		udp_add_fsw_flow(inp, outif);
 	}
 done:
 	UDP_LOG_CONNECT(inp, error);
@@ -2530,6 +2800,7 @@ udp_detach(struct socket *so)
 
 	UDP_LOG_CONNECTION_SUMMARY(inp);
 
+	udp_del_fsw_flow(inp);
 	in_pcbdetach(inp);
 	inp->inp_state = INPCB_STATE_DEAD;
 	return 0;
@@ -2550,6 +2821,7 @@ udp_disconnect(struct socket *so)
 
 	UDP_LOG_CONNECTION_SUMMARY(inp);
 
+	udp_del_fsw_flow(inp);
 	in_pcbdisconnect(inp);
 
 	/* reset flow controlled state, just in case */
@@ -3207,3 +3479,134 @@ udp_defunct(struct socket *so)
 
 	return 0;
 }
+
+#if SKYWALK
+
+#include <skywalk/nexus/flowswitch/nx_flowswitch.h>
+
+/*
+ * Add a flowswitch flow for the connected UDP_GRO socket inp so that
+ * the datagrams it receives on ifp get coalesced (see flow_rx_agg_udp()).
+ */
+void
+udp_add_fsw_flow(struct inpcb *inp, struct ifnet *ifp)
+{
+	struct socket *so = inp->inp_socket;
+	uuid_t fsw_uuid;
+	struct nx_flow_req nfr;
+	int err;
+
+	if (!(inp->inp_flags2 & INP2_UDP_GRO) ||
+	    !uuid_is_null(inp->inp_fsw_flow_uuid) ||
+	    !NX_FSW_UDP_RX_AGG_ENABLED()) {
+		return;
+	}
+#if IPSEC
+	/* UDP encapsulated ESP is decapsulated one datagram at a time */
+	if ((esp_udp_encap_port & 0xFFFF) != 0 &&
+	    (inp->inp_lport == htons((u_short)esp_udp_encap_port) ||
+	    inp->inp_fport == htons((u_short)esp_udp_encap_port))) {
+		return;
+	}
+#endif /* IPSEC */
+
+	if (ifp == NULL || kern_nexus_get_flowswitch_instance(ifp, fsw_uuid)) {
+		return;
+	}
+
+	memset(&nfr, 0, sizeof(nfr));
+
+	if (inp->inp_vflag & INP_IPV4) {
+		if (inp->inp_laddr.s_addr == INADDR_ANY ||
+		    inp->inp_faddr.s_addr == INADDR_ANY ||
+		    IN_MULTICAST(ntohl(inp->inp_laddr.s_addr)) ||
+		    IN_MULTICAST(ntohl(inp->inp_faddr.s_addr))) {
+			return;
+		}
+		nfr.nfr_saddr.sin.sin_len = sizeof(struct sockaddr_in);
+		nfr.nfr_saddr.sin.sin_family = AF_INET;
+		nfr.nfr_saddr.sin.sin_port = inp->inp_lport;
+		memcpy(&nfr.nfr_saddr.sin.sin_addr, &inp->inp_laddr,
+		    sizeof(struct in_addr));
+		nfr.nfr_daddr.sin.sin_len = sizeof(struct sockaddr_in);
+		nfr.nfr_daddr.sin.sin_family = AF_INET;
+		nfr.nfr_daddr.sin.sin_port = inp->inp_fport;
+		memcpy(&nfr.nfr_daddr.sin.sin_addr, &inp->inp_faddr,
+		    sizeof(struct in_addr));
+	} else {
+		if (IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_laddr) ||
+		    IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_faddr) ||
+		    IN6_IS_ADDR_MULTICAST(&inp->in6p_laddr) ||
+		    IN6_IS_ADDR_MULTICAST(&inp->in6p_faddr)) {
+			return;
+		}
+		nfr.nfr_saddr.sin6.sin6_len = sizeof(struct sockaddr_in6);
+		nfr.nfr_saddr.sin6.sin6_family = AF_INET6;
+		nfr.nfr_saddr.sin6.sin6_port = inp->inp_lport;
+		memcpy(&nfr.nfr_saddr.sin6.sin6_addr, &inp->in6p_laddr,
+		    sizeof(struct in6_addr));
+		nfr.nfr_daddr.sin6.sin6_len = sizeof(struct sockaddr_in6);
+		nfr.nfr_daddr.sin6.sin6_family = AF_INET6;
+		nfr.nfr_daddr.sin6.sin6_port = inp->inp_fport;
+		memcpy(&nfr.nfr_daddr.sin6.sin6_addr, &inp->in6p_faddr,
+		    sizeof(struct in6_addr));
+		/* clear embedded scope ID */
+		if (IN6_IS_SCOPE_EMBED(&nfr.nfr_saddr.sin6.sin6_addr)) {
+			nfr.nfr_saddr.sin6.sin6_addr.s6_addr16[1] = 0;
+		}
+		if (IN6_IS_SCOPE_EMBED(&nfr.nfr_daddr.sin6.sin6_addr)) {
+			nfr.nfr_daddr.sin6.sin6_addr.s6_addr16[1] = 0;
+		}
+	}
+
+	nfr.nfr_nx_port = 1;
+	nfr.nfr_ip_protocol = IPPROTO_UDP;
+	nfr.nfr_transport_protocol = IPPROTO_UDP;
+	nfr.nfr_flags = NXFLOWREQF_ASIS | NXFLOWREQF_UDP_GRO;
+	nfr.nfr_epid = (so != NULL ? so->last_pid : 0);
+	if (NETNS_TOKEN_VALID(&inp->inp_netns_token)) {
+		nfr.nfr_port_reservation = inp->inp_netns_token;
+		nfr.nfr_flags |= NXFLOWREQF_EXT_PORT_RSV;
+	}
+	if (inp->inp_flowhash == 0) {
+		inp_calc_flowhash(inp);
+	}
+	nfr.nfr_inp_flowhash = inp->inp_flowhash;
+
+	uuid_generate_random(nfr.nfr_flow_uuid);
+	err = kern_nexus_flow_add(kern_nexus_shared_controller(), fsw_uuid,
+	    &nfr, sizeof(nfr));
+
+	if (err == 0) {
+		uuid_copy(inp->inp_fsw_uuid, fsw_uuid);
+		uuid_copy(inp->inp_fsw_flow_uuid, nfr.nfr_flow_uuid);
+	}
+
+	UDP_LOG(inp, "add fsw flow err %d", err);
+}
+
+void
+udp_del_fsw_flow(struct inpcb *inp)
+{
+	struct nx_flow_req nfr;
+	int err;
+
+	if (uuid_is_null(inp->inp_fsw_uuid) ||
+	    uuid_is_null(inp->inp_fsw_flow_uuid)) {
+		return;
+	}
+
+	uuid_copy(nfr.nfr_flow_uuid, inp->inp_fsw_flow_uuid);
+
+	/* It's possible for this call to fail if the nexus has detached */
+	err = kern_nexus_flow_del(kern_nexus_shared_controller(),
+	    inp->inp_fsw_uuid, &nfr, sizeof(nfr));
+	VERIFY(err == 0 || err == ENOENT || err == ENXIO);
+
+	uuid_clear(inp->inp_fsw_uuid);
+	uuid_clear(inp->inp_fsw_flow_uuid);
+
+	UDP_LOG(inp, "del fsw flow err %d", err);
+}
+
+#endif /* SKYWALK */
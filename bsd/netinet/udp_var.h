@@ -139,6 +139,20 @@ struct  udpstat {
 	{ "pcblist", CTLTYPE_STRUCT },                                  \
 }
 
+/*
+ * Largest number of datagrams a single UDP_SEGMENT send may produce.
+ */
+#define UDP_GSO_MAX_SEGS        64
+
+/*
+ * Number of datagrams carried by a received mbuf, once its UDP header has
+ * been stripped: more than one for a train coalesced by the flowswitch
+ * for a UDP_GRO socket.
+ */
+#define UDP_GRO_SEGS(_m)                                                \
+	(((_m)->m_pkthdr.pkt_ext_flags & PKTF_EXT_UDP_GRO) ?            \
+	howmany(m_pktlen(_m), (_m)->m_pkthdr.udp_seg_size) : 1)
+
 #define udp6stat        udpstat
 #define udp6s_opackets  udps_opackets
 
@@ -194,6 +208,18 @@ extern lck_mtx_t *udp_getlock(struct socket *, int);
 extern void udp_get_ports_used(ifnet_t ifp, int, u_int32_t, bitstr_t *__counted_by(bitstr_size(IP_PORTRANGE_SIZE)));
 extern uint32_t udp_count_opportunistic(unsigned int, u_int32_t);
 extern uint32_t udp_find_anypcb_byaddr(struct ifaddr *);
+extern boolean_t udp_gso_offload_ok(struct inpcb *, int, struct rtentry *,
+    uint32_t);
+extern int udp_gso_split(struct mbuf *, int, uint32_t, uint16_t);
+extern int udp_gro_append(struct inpcb *, struct sockaddr *, struct mbuf *,
+    struct mbuf *);
+#if SKYWALK
+extern void udp_add_fsw_flow(struct inpcb *, struct ifnet *);
+extern void udp_del_fsw_flow(struct inpcb *);
+#else /* !SKYWALK */
+#define udp_add_fsw_flow(...)
+#define udp_del_fsw_flow(...)
+#endif /* !SKYWALK */
 
 extern void udp_fill_keepalive_offload_frames(struct ifnet *,
     struct ifnet_keepalive_offload_frame *__counted_by(frames_count) frames_array,
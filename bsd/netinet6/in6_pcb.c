@@ -1240,14 +1240,14 @@ in6_pcblookup_local(struct inpcbinfo *pcbinfo, struct in6_addr *laddr,
 	struct inpcbport *__single phd;
 
 	if (!wild_okay) {
-		struct inpcbhead *__single head;
+		struct smrq_list_head *__single head;
 		/*
 		 * Look for an unconnected (wildcard foreign addr) PCB that
 		 * matches the local address and port we're looking for.
 		 */
 		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 		    pcbinfo->ipi_hashmask)];
-		LIST_FOREACH(inp, head, inp_hash) {
+		smrq_serialized_foreach(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
 			}
@@ -1373,7 +1373,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
     u_int fport_arg, uint32_t fifscope, struct in6_addr *laddr, u_int lport_arg, uint32_t lifscope, int wildcard,
     uid_t *uid, gid_t *gid, struct ifnet *ifp, bool relaxed)
 {
-	struct inpcbhead *__single head;
+	struct smrq_list_head *__single head;
 	struct inpcb *__single inp;
 	uint16_t fport = (uint16_t)fport_arg, lport = (uint16_t)lport_arg;
 	int found;
@@ -1388,7 +1388,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	 */
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
 	    lport, fport, pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6)) {
 			continue;
 		}
@@ -1428,7 +1428,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 
 		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 		    pcbinfo->ipi_hashmask)];
-		LIST_FOREACH(inp, head, inp_hash) {
+		smrq_serialized_foreach(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
 			}
@@ -1482,6 +1482,110 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	return 0;
 }
 
+/*
+ * Lookup a connected PCB in hash list without taking ipi_lock;
+ * see in_pcblookup_hash_smr().
+ */
+static struct inpcb *
+in6_pcblookup_hash_smr(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
+    uint16_t fport, uint32_t fifscope, struct in6_addr *laddr, uint16_t lport,
+    uint32_t lifscope, struct ifnet *ifp)
+{
+	struct smrq_list_head *__single head;
+	struct inpcb *__single inp;
+	struct inpcb *__single match = NULL;
+
+	if (IN6_IS_ADDR_UNSPECIFIED(faddr)) {
+		return NULL;
+	}
+
+	smr_inpcb_enter();
+
+	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
+	    lport, fport, pcbinfo->ipi_hashmask)];
+	smrq_entered_foreach(inp, head, inp_hash) {
+		if (!(inp->inp_vflag & INP_IPV6)) {
+			continue;
+		}
+		if (inp->inp_fport != fport ||
+		    inp->inp_lport != lport ||
+		    !in6_are_addr_equal_scoped(&inp->in6p_faddr, faddr, inp->inp_fifscope, fifscope) ||
+		    !in6_are_addr_equal_scoped(&inp->in6p_laddr, laddr, inp->inp_lifscope, lifscope)) {
+			continue;
+		}
+		if (inp_restricted_recv(inp, ifp)) {
+			continue;
+		}
+
+		if (in_pcb_checkstate(inp, WNT_ACQUIRE, 0) != WNT_STOPUSING) {
+			match = inp;
+		}
+		break;
+	}
+
+	smr_inpcb_leave();
+
+#if NECP
+	/*
+	 * The policy check may take locks and allocate, so it is done
+	 * outside of the read section, the want reference keeping the
+	 * pcb and its socket around.  A denied match is left to the
+	 * locked lookup, which may still find a wildcard pcb.
+	 */
+	if (match != NULL &&
+	    !necp_socket_is_allowed_to_recv_on_interface(match, ifp)) {
+		(void) in_pcb_checkstate(match, WNT_RELEASE, 0);
+		match = NULL;
+	}
+#endif /* NECP */
+
+	return match;
+}
+
+/*
+ * Lookup a SO_REUSEPORT_LB listener for a new flow, preferring a group
+ * bound to the local address over a wildcard one.
+ */
+static struct inpcb *
+in6_pcblookup_lbgroup(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
+    uint16_t fport, struct in6_addr *laddr, uint16_t lport, uint32_t lifscope,
+    struct ifnet *ifp)
+{
+	struct inpcblbgrouphead *__single head;
+	struct inpcblbgroup *__single grp;
+	struct inpcblbgroup *__single local_wild = NULL;
+	struct inpcb *__single inp;
+	uint32_t hash;
+
+	if (pcbinfo->ipi_lbgrouphashbase == NULL) {
+		return NULL;
+	}
+
+	head = &pcbinfo->ipi_lbgrouphashbase[INP_PCBPORTHASH(lport,
+	    pcbinfo->ipi_lbgrouphashmask)];
+	hash = INP_PCBHASH(faddr->s6_addr32[3] /* XXX */, lport, fport,
+	    UINT32_MAX);
+
+	LIST_FOREACH(grp, head, il_list) {
+		if (!(grp->il_vflag & INP_IPV6) || grp->il_lport != lport) {
+			continue;
+		}
+		if (in6_are_addr_equal_scoped(&grp->il6_laddr, laddr,
+		    grp->il_lifscope, lifscope)) {
+			inp = in_pcblbgroup_select(grp, hash, ifp);
+			if (inp != NULL) {
+				return inp;
+			}
+		} else if (IN6_IS_ADDR_UNSPECIFIED(&grp->il6_laddr)) {
+			local_wild = grp;
+		}
+	}
+	if (local_wild != NULL) {
+		return in_pcblbgroup_select(local_wild, hash, ifp);
+	}
+	return NULL;
+}
+
 /*
  * Lookup PCB in hash list.
  */
@@ -1490,7 +1594,7 @@ in6_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
     u_int fport_arg, uint32_t fifscope, struct in6_addr *laddr, u_int lport_arg,
     uint32_t lifscope, int wildcard, struct ifnet *ifp)
 {
-	struct inpcbhead *__single head;
+	struct smrq_list_head *__single head;
 	struct inpcb *__single inp;
 	uint16_t fport = (uint16_t)fport_arg, lport = (uint16_t)lport_arg;
 
@@ -1499,7 +1603,7 @@ in6_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	 */
 	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
 	    lport, fport, pcbinfo->ipi_hashmask)];
-	LIST_FOREACH(inp, head, inp_hash) {
+	smrq_serialized_foreach(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6)) {
 			continue;
 		}
@@ -1533,9 +1637,15 @@ in6_pcblookup_hash_locked(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	if (wildcard) {
 		struct inpcb *__single local_wild = NULL;
 
+		inp = in6_pcblookup_lbgroup(pcbinfo, faddr, fport, laddr, lport,
+		    lifscope, ifp);
+		if (inp != NULL) {
+			return inp;
+		}
+
 		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
 		    pcbinfo->ipi_hashmask)];
-		LIST_FOREACH(inp, head, inp_hash) {
+		smrq_serialized_foreach(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
 			}
@@ -1588,6 +1698,12 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 {
 	struct inpcb *inp;
 
+	inp = in6_pcblookup_hash_smr(pcbinfo, faddr, (uint16_t)fport_arg,
+	    fifscope, laddr, (uint16_t)lport_arg, lifscope, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	inp = in6_pcblookup_hash_locked(pcbinfo, faddr, fport_arg, fifscope,
@@ -1605,6 +1721,12 @@ in6_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 {
 	struct inpcb *inp;
 
+	inp = in6_pcblookup_hash_smr(pcbinfo, faddr, (uint16_t)fport_arg,
+	    fifscope, laddr, (uint16_t)lport_arg, lifscope, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	if (!lck_rw_try_lock_shared(&pcbinfo->ipi_lock)) {
 		return NULL;
 	}
@@ -1777,7 +1777,8 @@ ip6_fragment_packet(struct mbuf **mptr, struct ip6_pktopts *opt,
 	}
 
 	/* Access without acquiring nd_ifinfo lock for performance */
-	if (dontfrag && tlen > IN6_LINKMTU(ifp)) {      /* case 2-b */
+	if (dontfrag && tlen > IN6_LINKMTU(ifp) &&
+	    !UDP_GSO_OK(ifp, m)) {                      /* case 2-b */
 		/*
 		 * We do not notify the connection in the same outbound path
 		 * to avoid lock ordering issues.
@@ -1791,7 +1792,7 @@ ip6_fragment_packet(struct mbuf **mptr, struct ip6_pktopts *opt,
 	 * transmit packet without fragmentation
 	 */
 	if (dontfrag ||
-	    (tlen <= mtu || TSO_IPV6_OK(ifp, m) ||
+	    (tlen <= mtu || TSO_IPV6_OK(ifp, m) || UDP_GSO_OK(ifp, m) ||
 	    (ifp->if_hwassist & CSUM_FRAGMENT_IPV6))) {
 		/*
 		 * mppn not updated in this case because no new chain is formed
@@ -1853,8 +1854,8 @@ ip6_do_fragmentation(struct mbuf **mptr, uint32_t optlen, struct ifnet *ifp,
 	uint32_t tlen = morig->m_pkthdr.len;
 
 	/* try to fragment the packet. case 1-b */
-	if ((morig->m_pkthdr.csum_flags & CSUM_TSO_IPV6)) {
-		/* TSO and fragment aren't compatible */
+	if ((morig->m_pkthdr.csum_flags & (CSUM_TSO_IPV6 | CSUM_UDP_GSO))) {
+		/* TSO or UDP segmentation and fragment aren't compatible */
 		in6_ifstat_inc(ifp, ifs6_out_fragfail);
 		return EMSGSIZE;
 	} else if (mtu < IPV6_MMTU) {
@@ -4288,6 +4289,17 @@ ip6_output_checksum(struct ifnet *ifp, uint32_t mtu, struct mbuf *m,
     int nxt0, uint32_t tlen, uint32_t optlen)
 {
 	uint32_t sw_csum, hwcap = ifp->if_hwassist;
+	uint32_t udp_gso_csum = 0;
+
+	/*
+	 * The interface checksums every datagram of a UDP_SEGMENT train
+	 * as it splits it.
+	 */
+	if (UDP_GSO_OK(ifp, m)) {
+		udp_gso_csum = m->m_pkthdr.csum_flags &
+		    (CSUM_DELAY_IPV6_DATA | CSUM_ZERO_INVERT | CSUM_UDP_GSO);
+		m->m_pkthdr.csum_flags &= ~udp_gso_csum;
+	}
 
 	if (!hwcksum_tx) {
 		/* do all in software; checksum offload is disabled */
@@ -4355,6 +4367,7 @@ ip6_output_checksum(struct ifnet *ifp, uint32_t mtu, struct mbuf *m,
 		/* drop all bits; checksum offload is disabled */
 		m->m_pkthdr.csum_flags = 0;
 	}
+	m->m_pkthdr.csum_flags |= udp_gso_csum;
 }
 
 /*
@@ -100,6 +100,7 @@
 #include <netinet/if_ether.h>
 #include <netinet6/in6_var.h>
 #include <netinet/ip6.h>
+#include <netinet/udp.h>
 #include <netinet6/ip6_var.h>
 #include <netinet6/nd6.h>
 #include <netinet6/scope6_var.h>
@@ -4357,6 +4358,12 @@ sendpkt:
 			if ((mcur->m_pkthdr.csum_flags & CSUM_TSO_IPV6) &&
 			    (mcur->m_pkthdr.tso_segsz > 0)) {
 				scnt = mcur->m_pkthdr.len / mcur->m_pkthdr.tso_segsz;
+			} else if ((mcur->m_pkthdr.csum_flags & CSUM_UDP_GSO) &&
+			    (mcur->m_pkthdr.udp_seg_size > 0)) {
+				/* udp6_output() offloads no extension headers */
+				scnt = howmany(mcur->m_pkthdr.len -
+				    sizeof(struct ip6_hdr) - sizeof(struct udphdr),
+				    mcur->m_pkthdr.udp_seg_size);
 			} else {
 				scnt = 1;
 			}
@@ -156,6 +156,8 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 {
 	u_int32_t ulen = m->m_pkthdr.len;
 	u_int32_t plen = sizeof(struct udphdr) + ulen;
+	uint16_t gso_size = in6p->inp_udp_gso_size;
+	uint32_t gso_segs = 1;
 	struct ip6_hdr *ip6;
 	struct udphdr *__single udp6;
 	struct in6_addr *__single laddr, *__single faddr;
@@ -434,6 +436,19 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 		INC_ATOMIC_INT64_LIM(net_api_stats.nas_socket_inet_dgram_dns);
 	}
 
+	/*
+	 * With UDP_SEGMENT, a send larger than the segment size goes out
+	 * as a train of gso_size datagrams (the last one may be shorter.)
+	 */
+	if (gso_size != 0 && ulen > gso_size) {
+		gso_segs = howmany(ulen, gso_size);
+		if (gso_segs > UDP_GSO_MAX_SEGS) {
+			error = EMSGSIZE;
+			UDP_LOG(in6p, "len %u too many segments error EMSGSIZE", ulen);
+			goto release;
+		}
+	}
+
 	/*
 	 * Calculate data length and get a mbuf
 	 * for UDP and IP6 headers.
@@ -485,7 +500,7 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 
 		flags = IPV6_OUTARGS;
 
-		udp6stat.udp6s_opackets++;
+		udp6stat.udp6s_opackets += gso_segs;
 
 #if NECP
 		{
@@ -615,9 +630,40 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 		ip6_output_setdstifscope(m, fifscope, NULL);
 		ip6_output_setsrcifscope(m, lifscope, NULL);
 
+		/*
+		 * Hand a datagram train to an interface that segments it,
+		 * or split it here and send the datagrams one by one.
+		 */
+		if (gso_segs > 1) {
+			if (plen <= IPV6_MAXPACKET &&
+			    !IN6_IS_ADDR_MULTICAST(faddr) &&
+			    (optp == NULL || (optp->ip6po_hbh == NULL &&
+			    optp->ip6po_dest1 == NULL && optp->ip6po_dest2 == NULL &&
+			    optp->ip6po_rthdr == NULL)) &&
+			    udp_gso_offload_ok(in6p, AF_INET6, ro.ro_rt,
+			    hlen + sizeof(struct udphdr))) {
+				m->m_pkthdr.csum_flags |= CSUM_UDP_GSO;
+				m->m_pkthdr.udp_seg_size = gso_size;
+			} else if ((error = udp_gso_split(m, AF_INET6, hlen,
+			    gso_size)) != 0) {
+				/* the train has been freed */
+				m = NULL;
+			}
+		}
+
 		socket_unlock(so, 0);
-		error = ip6_output(m, optp, &ro, flags, im6o, NULL, &ip6oa);
-		m = NULL;
+		while (m != NULL) {
+			struct mbuf *n = m->m_nextpkt;
+
+			m->m_nextpkt = NULL;
+			error = ip6_output(m, optp, &ro, flags, im6o, NULL,
+			    &ip6oa);
+			m = n;
+			if (error != 0 && m != NULL) {
+				m_freem_list(m);
+				m = NULL;
+			}
+		}
 		socket_lock(so, 0);
 
 		if (im6o != NULL) {
@@ -640,7 +686,7 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 				ifnet_count_type = IFNET_COUNT_TYPE(in6p->in6p_route.
 				    ro_rt->rt_ifp);
 			}
-			INP_ADD_TXSTAT(in6p, ifnet_count_type, 1, ulen);
+			INP_ADD_TXSTAT(in6p, ifnet_count_type, gso_segs, ulen);
 		}
 
 		if (flowadv && (adv->code == FADV_FLOW_CONTROLLED ||
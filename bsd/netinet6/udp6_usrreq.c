@@ -652,9 +652,17 @@ udp6_input(struct mbuf **mp, int *offp, int proto)
 	m_adj(m, off + sizeof(struct udphdr));
 	if (nstat_collect) {
 		ifnet_count_type = IFNET_COUNT_TYPE(ifp);
-		INP_ADD_RXSTAT(in6p, ifnet_count_type, 1, m->m_pkthdr.len);
+		INP_ADD_RXSTAT(in6p, ifnet_count_type, UDP_GRO_SEGS(m),
+		    m->m_pkthdr.len);
 	}
 	so_recv_data_stat(in6p->in6p_socket, m, 0);
+	if (__improbable(m->m_pkthdr.pkt_ext_flags & PKTF_EXT_UDP_GRO)) {
+		if (udp_gro_append(in6p, SA(&udp_in6), m, opts) != 0) {
+			sorwakeup(in6p->in6p_socket);
+		}
+		udp_unlock(in6p->in6p_socket, 1, 0);
+		return IPPROTO_DONE;
+	}
 	if (sbappendaddr(&in6p->in6p_socket->so_rcv,
 	    SA(&udp_in6), m, opts, NULL) == 0) {
 		UDP_LOG(in6p, "sbappendaddr full receive socket buffer");
@@ -804,6 +812,7 @@ udp6_abort(struct socket *so)
 		/* NOTREACHED */
 	}
 	soisdisconnected(so);
+	udp_del_fsw_flow(inp);
 	in6_pcbdetach(inp);
 	return 0;
 }
@@ -908,6 +917,7 @@ int
 udp6_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 {
 	struct inpcb *__single inp;
+	struct ifnet *__single outif = NULL;
 	int error;
 	struct sockaddr_in6 *__single sin6_p = SIN6(nam);
 
@@ -974,7 +984,7 @@ udp6_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 			inp->inp_vflag &= ~INP_IPV6;
 			inp->inp_vflag |= INP_V4MAPPEDV6;
 
-			error = in_pcbconnect(inp, SA(&sin), p, IFSCOPE_NONE, NULL);
+			error = in_pcbconnect(inp, SA(&sin), p, IFSCOPE_NONE, &outif);
 			if (error == 0) {
 #if NECP
 				/* Update NECP client with connected five-tuple */
@@ -985,6 +995,7 @@ udp6_connect(struct socket *so, struct sockaddr *nam, struct proc *p)
 				}
 #endif /* NECP */
 				soisconnected(so);
+				udp_add_fsw_flow(inp, outif);
 			} else {
 				inp->inp_vflag = old_flags;
 			}
@@ -1051,6 +1062,7 @@ do_flow_divert:
 			    (htonl(ip6_randomflowlabel()) & IPV6_FLOWLABEL_MASK);
 		}
 		inp->inp_connect_timestamp = mach_continuous_time();
+		udp_add_fsw_flow(inp, inp->in6p_last_outifp);
 	}
 done:
 	UDP_LOG_CONNECT(inp, error);
@@ -1082,6 +1094,7 @@ udp6_detach(struct socket *so)
 
 	UDP_LOG_CONNECTION_SUMMARY(inp);
 
+	udp_del_fsw_flow(inp);
 	in6_pcbdetach(inp);
 	return 0;
 }
@@ -1113,6 +1126,7 @@ udp6_disconnect(struct socket *so)
 
 	UDP_LOG_CONNECTION_SUMMARY(inp);
 
+	udp_del_fsw_flow(inp);
 	in6_pcbdisconnect(inp);
 
 	/* reset flow-controlled state, just in case */
@@ -127,6 +127,13 @@ uint32_t sk_fsw_rx_agg_tcp = 16384;
  */
 uint32_t sk_fsw_rx_agg_tcp_host = SK_FSW_RX_AGG_TCP_HOST_AUTO;
 
+/*
+ * Configures the RX coalescing of UDP datagrams in flowswitch, for the
+ * sockets that ask for it with UDP_GRO.  A non-zero value enables it,
+ * with the length of the coalesced datagram limited to this value.
+ */
+uint32_t sk_fsw_rx_agg_udp = 65535;  /* IP_MAXPACKET */
+
 /*
  * Configures the skywalk infrastructure for handling TCP TX aggregation.
  * A non-zero value enables the support.
@@ -408,6 +415,8 @@ skywalk_init(void)
 	parse_netif_direct();
 	(void) PE_parse_boot_argn("sk_fsw_rx_agg_tcp", &sk_fsw_rx_agg_tcp,
 	    sizeof(sk_fsw_rx_agg_tcp));
+	(void) PE_parse_boot_argn("sk_fsw_rx_agg_udp", &sk_fsw_rx_agg_udp,
+	    sizeof(sk_fsw_rx_agg_udp));
 	(void) PE_parse_boot_argn("sk_fsw_tx_agg_tcp", &sk_fsw_tx_agg_tcp,
 	    sizeof(sk_fsw_tx_agg_tcp));
 	(void) PE_parse_boot_argn("sk_fsw_gso_mtu", &sk_fsw_gso_mtu,
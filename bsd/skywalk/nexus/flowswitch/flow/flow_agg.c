@@ -35,10 +35,13 @@
 #include <netinet/tcp.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <netinet/udp_var.h>
 #include <net/pktap.h>
 #include <sys/sdt.h>
 
 #define MAX_AGG_IP_LEN()        MIN(sk_fsw_rx_agg_tcp, IP_MAXPACKET)
+#define MAX_AGG_UDP_LEN()       MIN(sk_fsw_rx_agg_udp, IP_MAXPACKET)
 #define MAX_BUFLET_COUNT        (32)
 #define TCP_FLAGS_IGNORE        (TH_FIN|TH_SYN|TH_RST|TH_URG)
 #define PKT_IS_MBUF(_pkt)       (_pkt->pkt_pflags & PKT_F_MBUF_DATA)
@@ -2577,3 +2580,312 @@ flow_rx_agg_tcp(struct nx_flowswitch *fsw, struct flow_entry *fe,
 		flow_rx_agg_channel(fsw, fe, rx_pkts, rx_bytes, is_mbuf);
 	}
 }
+
+/*
+ * UDP receive coalescing (UDP_GRO).
+ *
+ * Datagrams of a connected UDP_GRO socket's flow are chained behind the
+ * headers of the first datagram of a train, as long as they carry the
+ * same IP header fields and no more payload than that first datagram.
+ * A shorter datagram ends the train.  The resulting mbuf is tagged with
+ * PKTF_EXT_UDP_GRO and the segment size, which udp_input() uses to hand
+ * it to the socket (see udp_gro_append()).
+ */
+struct flow_agg_udp {
+	struct mbuf     *fau_smbuf;     /* first datagram, carries the headers */
+	struct mbuf     *fau_tail;      /* last mbuf of the chain */
+	uint32_t        fau_len;        /* payload bytes in the train */
+	uint16_t        fau_hlen;       /* IP + UDP header length */
+	uint16_t        fau_seg_size;   /* payload of the first datagram */
+	uint16_t        fau_seg_cnt;    /* number of datagrams */
+	bool            fau_nosum;      /* IPv4 datagrams without checksum */
+	bool            fau_closed;     /* a short datagram ended the train */
+};
+
+/*
+ * Returns true if the datagram (IP header at the start of the mbuf) can
+ * be part of a train, with its checksum verified.
+ */
+static bool
+flow_agg_udp_check(struct mbuf *m, uint16_t l2len, uint16_t *hlenp,
+    bool *nosump, struct fsw_stats *fsws)
+{
+	uint32_t pktlen = m_pktlen(m);
+	uint32_t csum_flags = m->m_pkthdr.csum_flags;
+	struct udphdr *uh;
+	uint32_t partial;
+	uint16_t iphlen, ulen, csum;
+	bool is_ipv4;
+
+	if (__improbable(m->m_pkthdr.pkt_flags & PKTF_WAKE_PKT) ||
+	    m->m_len < (int)sizeof(struct ip)) {
+		return false;
+	}
+	is_ipv4 = (mtod(m, struct ip *)->ip_v == IPVERSION);
+	if (is_ipv4) {
+		struct ip *ip = mtod(m, struct ip *);
+
+		if (ip->ip_hl != (sizeof(*ip) >> 2) || ip->ip_p != IPPROTO_UDP ||
+		    (ntohs(ip->ip_off) & (IP_MF | IP_OFFMASK)) != 0 ||
+		    ntohs(ip->ip_len) != pktlen) {
+			return false;
+		}
+		iphlen = sizeof(*ip);
+	} else {
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+
+		if (m->m_len < (int)sizeof(*ip6) ||
+		    (ip6->ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION ||
+		    ip6->ip6_nxt != IPPROTO_UDP ||
+		    ntohs(ip6->ip6_plen) + sizeof(*ip6) != pktlen) {
+			return false;
+		}
+		iphlen = sizeof(*ip6);
+	}
+	if (m->m_len < iphlen + (int)sizeof(*uh)) {
+		return false;
+	}
+	uh = (struct udphdr *)(void *)(mtod(m, uint8_t *) + iphlen);
+	ulen = ntohs(uh->uh_ulen);
+	if (ulen != pktlen - iphlen || ulen <= sizeof(*uh)) {
+		return false;
+	}
+
+	if (is_ipv4 && (csum_flags & CSUM_IP_CHECKED) == 0) {
+		csum = m_sum16(m, 0, iphlen);
+		m->m_pkthdr.csum_flags |= CSUM_IP_CHECKED;
+		if ((csum ^ 0xffff) != 0) {
+			STATS_INC(fsws, FSW_STATS_RX_AGG_BAD_CSUM);
+			return false;
+		}
+		m->m_pkthdr.csum_flags |= CSUM_IP_VALID;
+	} else if (is_ipv4 && (csum_flags & CSUM_IP_VALID) == 0) {
+		return false;
+	}
+
+	*hlenp = iphlen + sizeof(*uh);
+	*nosump = (is_ipv4 && uh->uh_sum == 0);
+	if (*nosump) {
+		return true;
+	}
+	if ((csum_flags & CSUM_RX_FULL_FLAGS) == CSUM_RX_FULL_FLAGS) {
+		csum = m->m_pkthdr.csum_rx_val;
+	} else {
+		/* the partial sum covers the UDP header and payload */
+		if ((csum_flags & (CSUM_DATA_VALID | CSUM_PARTIAL)) ==
+		    (CSUM_DATA_VALID | CSUM_PARTIAL) &&
+		    m->m_pkthdr.csum_rx_start == l2len + iphlen) {
+			partial = m->m_pkthdr.csum_rx_val;
+		} else {
+			partial = m_sum16(m, iphlen, ulen);
+		}
+		partial += htons(ulen + IPPROTO_UDP);
+		if (is_ipv4) {
+			struct ip *ip = mtod(m, struct ip *);
+			csum = in_pseudo(ip->ip_src.s_addr, ip->ip_dst.s_addr,
+			    partial);
+		} else {
+			struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+			csum = in6_pseudo(&ip6->ip6_src, &ip6->ip6_dst, partial);
+		}
+	}
+	if ((csum ^ 0xffff) != 0) {
+		STATS_INC(fsws, FSW_STATS_RX_AGG_BAD_CSUM);
+		return false;
+	}
+	return true;
+}
+
+static bool
+flow_agg_udp_is_ok(struct flow_agg_udp *fau, struct mbuf *m, uint16_t hlen,
+    bool nosum, struct fsw_stats *fsws)
+{
+	uint32_t ulen = m_pktlen(m) - hlen;
+
+	if (fau->fau_smbuf == NULL) {
+		return false;
+	}
+	if (hlen != fau->fau_hlen || nosum != fau->fau_nosum) {
+		STATS_INC(fsws, FSW_STATS_RX_AGG_NO_HDR_UDP);
+		return false;
+	}
+	if (hlen == sizeof(struct udpiphdr)) {
+		struct ip *sip = mtod(fau->fau_smbuf, struct ip *);
+		struct ip *ip = mtod(m, struct ip *);
+
+		if (ip->ip_tos != sip->ip_tos || ip->ip_ttl != sip->ip_ttl ||
+		    ((ip->ip_off ^ sip->ip_off) & htons(IP_DF)) != 0) {
+			STATS_INC(fsws, FSW_STATS_RX_AGG_NO_HDR_UDP);
+			return false;
+		}
+	} else {
+		struct ip6_hdr *sip6 = mtod(fau->fau_smbuf, struct ip6_hdr *);
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+
+		if (ip6->ip6_flow != sip6->ip6_flow ||
+		    ip6->ip6_hlim != sip6->ip6_hlim) {
+			STATS_INC(fsws, FSW_STATS_RX_AGG_NO_HDR_UDP);
+			return false;
+		}
+	}
+	if (fau->fau_closed || ulen > fau->fau_seg_size) {
+		STATS_INC(fsws, FSW_STATS_RX_AGG_NO_ULEN_UDP);
+		return false;
+	}
+	if (fau->fau_seg_cnt >= UDP_GSO_MAX_SEGS ||
+	    fau->fau_hlen + fau->fau_len + ulen > MAX_AGG_UDP_LEN()) {
+		STATS_INC(fsws, FSW_STATS_RX_AGG_LIMIT);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Fix up the headers of a train of more than one datagram; the checksum
+ * of every datagram has already been verified.
+ */
+static void
+flow_agg_udp_finalize(struct flow_agg_udp *fau)
+{
+	struct mbuf *m = fau->fau_smbuf;
+	struct udphdr *uh;
+	uint16_t iphlen = fau->fau_hlen - sizeof(*uh);
+
+	if (m == NULL || fau->fau_seg_cnt < 2) {
+		return;
+	}
+	ASSERT(m_pktlen(m) == fau->fau_hlen + fau->fau_len);
+
+	uh = (struct udphdr *)(void *)(mtod(m, uint8_t *) + iphlen);
+	uh->uh_ulen = htons((uint16_t)(sizeof(*uh) + fau->fau_len));
+	if (iphlen == sizeof(struct ip)) {
+		struct ip *ip = mtod(m, struct ip *);
+
+		ip->ip_len = htons((uint16_t)m_pktlen(m));
+		ip->ip_sum = 0;
+		ip->ip_sum = ~m_sum16(m, 0, iphlen) & 0xffff;
+		m->m_pkthdr.csum_flags = CSUM_IP_CHECKED | CSUM_IP_VALID;
+	} else {
+		struct ip6_hdr *ip6 = mtod(m, struct ip6_hdr *);
+
+		ip6->ip6_plen = htons((uint16_t)(sizeof(*uh) + fau->fau_len));
+		m->m_pkthdr.csum_flags = 0;
+	}
+	m->m_pkthdr.csum_flags |= (CSUM_DATA_VALID | CSUM_PSEUDO_HDR);
+	m->m_pkthdr.csum_rx_start = 0;
+	m->m_pkthdr.csum_rx_val = 0xffff;
+	m->m_pkthdr.pkt_ext_flags |= PKTF_EXT_UDP_GRO;
+	m->m_pkthdr.udp_seg_size = fau->fau_seg_size;
+}
+
+void
+flow_rx_agg_udp(struct nx_flowswitch *fsw, struct flow_entry *fe,
+    struct pktq *rx_pkts, uint32_t rx_bytes, struct mbufq *host_mq,
+    uint32_t flags)
+{
+	struct fsw_stats *fsws = &fsw->fsw_stats;
+	struct flow_agg_udp fau;
+	struct pktq dropped_pkts;
+	struct mbufq mq;
+	struct mbuf *__single m, *__single m_next;
+	struct mbuf *__single m_chain = NULL, *__single m_tail = NULL;
+	uint32_t cnt = 0, bytes = 0;
+	uint16_t l2len;
+
+	if (__improbable((flags & FLOW_PROC_FLAG_FRAGMENTS) != 0) ||
+	    fe->fe_nx_port != FSW_VP_HOST) {
+		dp_flow_rx_process(fsw, fe, rx_pkts, rx_bytes, host_mq, flags);
+		return;
+	}
+
+	KPKTQ_INIT(&dropped_pkts);
+
+	if (!dp_flow_rx_route_process(fsw, fe)) {
+		SK_ERR("Rx route bad");
+		fsw_snoop_and_dequeue(fe, &dropped_pkts, rx_pkts, true);
+		STATS_ADD(fsws, FSW_STATS_RX_FLOW_NONVIABLE,
+		    KPKTQ_LEN(&dropped_pkts));
+		pp_drop_pktq(&dropped_pkts, fsw->fsw_ifp, DROPTAP_FLAG_DIR_IN,
+		    DROP_REASON_FSW_FLOW_NONVIABLE, __func__, __LINE__);
+		return;
+	}
+
+	/* BSD flow; leave the datagrams alone if filters want to see them */
+	if (__improbable(!hwcksum_rx || dlil_has_ip_filter() ||
+	    dlil_has_if_filter(fsw->fsw_ifp))) {
+		fsw_host_rx_enqueue_mbq(fsw, rx_pkts, host_mq);
+		return;
+	}
+	if (__improbable(pktap_total_tap_count != 0)) {
+		fsw_snoop(fsw, fe, rx_pkts, true);
+	}
+
+	/* convert to mbufs with the L2 header stripped, as for other flows */
+	l2len = KPKTQ_FIRST(rx_pkts)->pkt_l2_len;
+	mbufq_init(&mq);
+	fsw_host_rx_enqueue_mbq(fsw, rx_pkts, &mq);
+
+	bzero(&fau, sizeof(fau));
+	for (m = mbufq_first(&mq); m != NULL; m = m_next) {
+		uint16_t hlen = 0;
+		bool nosum = false;
+		uint32_t ulen;
+
+		m_next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+
+		/* the original datagrams already went through pktap above */
+		m->m_pkthdr.pkt_flags |= PKTF_SKIP_PKTAP;
+
+		if (!flow_agg_udp_check(m, l2len, &hlen, &nosum, fsws)) {
+			/* deliver as is, and don't coalesce past it */
+			flow_agg_udp_finalize(&fau);
+			bzero(&fau, sizeof(fau));
+			goto enqueue;
+		}
+		ulen = m_pktlen(m) - hlen;
+		if (flow_agg_udp_is_ok(&fau, m, hlen, nosum, fsws)) {
+			m_adj(m, hlen);
+			m_tag_delete_chain(m);
+			m->m_flags &= ~M_PKTHDR;
+			fau.fau_tail->m_next = m;
+			while (m->m_next != NULL) {
+				m = m->m_next;
+			}
+			fau.fau_tail = m;
+			fau.fau_smbuf->m_pkthdr.len += ulen;
+			fau.fau_len += ulen;
+			fau.fau_seg_cnt++;
+			fau.fau_closed = (ulen < fau.fau_seg_size);
+			STATS_INC(fsws, FSW_STATS_RX_AGG_OK_UDP);
+			continue;
+		}
+
+		/* start a new train */
+		flow_agg_udp_finalize(&fau);
+		fau.fau_smbuf = m;
+		fau.fau_tail = m_last(m);
+		fau.fau_len = ulen;
+		fau.fau_hlen = hlen;
+		fau.fau_seg_size = (uint16_t)ulen;
+		fau.fau_seg_cnt = 1;
+		fau.fau_nosum = nosum;
+		fau.fau_closed = false;
+enqueue:
+		if (m_chain == NULL) {
+			m_chain = m;
+		} else {
+			m_tail->m_nextpkt = m;
+		}
+		m_tail = m;
+		cnt++;
+	}
+	flow_agg_udp_finalize(&fau);
+
+	for (m = m_chain; m != NULL; m = m->m_nextpkt) {
+		bytes += m_pktlen(m);
+	}
+	if (m_chain != NULL) {
+		mbufq_enqueue(host_mq, m_chain, m_tail, cnt, bytes);
+	}
+}
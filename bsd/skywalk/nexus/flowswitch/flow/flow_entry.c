@@ -559,6 +559,11 @@ flow_entry_alloc(struct flow_owner *fo, struct nx_flow_req *req, int *perr)
 	    (fe->fe_key.fk_proto == IPPROTO_TCP) &&
 	    (fe->fe_key.fk_mask == FKMASK_5TUPLE)) {
 		fe->fe_rx_process = flow_rx_agg_tcp;
+	} else if (NX_FSW_UDP_RX_AGG_ENABLED() &&
+	    (req->nfr_flags & NXFLOWREQF_UDP_GRO) != 0 &&
+	    (fe->fe_key.fk_proto == IPPROTO_UDP) &&
+	    (fe->fe_key.fk_mask == FKMASK_5TUPLE)) {
+		fe->fe_rx_process = flow_rx_agg_udp;
 	}
 	uuid_copy(fe->fe_uuid, req->nfr_flow_uuid);
 	if ((req->nfr_flags & NXFLOWREQF_LISTENER) == 0 &&
@@ -1040,6 +1040,10 @@ extern void flow_rx_agg_tcp(struct nx_flowswitch *fsw, struct flow_entry *fe,
     struct pktq *rx_pkts, uint32_t rx_bytes, struct mbufq *host_mq,
     uint32_t flags);
 
+extern void flow_rx_agg_udp(struct nx_flowswitch *fsw, struct flow_entry *fe,
+    struct pktq *rx_pkts, uint32_t rx_bytes, struct mbufq *host_mq,
+    uint32_t flags);
+
 extern void flow_route_init(void);
 extern void flow_route_fini(void);
 extern struct flow_route_bucket *__sized_by(*tot_sz)
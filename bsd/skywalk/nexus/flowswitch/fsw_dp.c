@@ -171,6 +171,9 @@ SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_tcp,
 SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_tcp_host,
     CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_rx_agg_tcp_host, 0,
     "flowswitch RX aggregation for tcp kernel path (0/1/2 (off/on/auto))");
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_udp,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_rx_agg_udp, 0,
+    "flowswitch RX coalescing for UDP_GRO sockets (max length, 0: disable)");
 SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, gso_mtu,
     CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_gso_mtu, 0,
     "flowswitch GSO for tcp flows (mtu > 0: enable, mtu == 0: disable)");
@@ -2479,7 +2482,9 @@ fsw_receive(struct nx_flowswitch *fsw, struct pktq *pktq)
 {
 #if (DEVELOPMENT || DEBUG)
 	FSW_RLOCK(fsw);
-	if (fsw->fsw_rps_nthreads != 0) {
+	/* a busy-polling thread wants the packets handled by itself */
+	if (fsw->fsw_rps_nthreads != 0 &&
+	    !net_thread_is_marked(NET_THREAD_BUSY_POLL)) {
 		struct __kern_packet *pkt, *tpkt;
 		bitmap_t map = 0;
 
@@ -117,6 +117,11 @@
  */
 #define NX_FSW_TCP_RX_AGG_ENABLED()    (sk_fsw_rx_agg_tcp != 0)
 
+/*
+ * macro to check if UDP RX coalescing is enabled in flowswitch.
+ */
+#define NX_FSW_UDP_RX_AGG_ENABLED()    (sk_fsw_rx_agg_udp != 0)
+
 struct nx_flowswitch;
 
 /*
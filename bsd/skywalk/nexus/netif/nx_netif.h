@@ -395,10 +395,16 @@ SYSCTL_DECL(_kern_skywalk_netif);
 
 typedef enum {
 	MIT_MODE_SIMPLE,
-	MIT_MODE_ADVANCED_STATIC,
-	MIT_MODE_ADVANCED_DYNAMIC,
+	MIT_MODE_ADVANCED_STATIC,       /* serviced on each interrupt */
+	MIT_MODE_ADVANCED_DYNAMIC,      /* serviced with a mitigation delay */
+	MIT_MODE_ADVANCED_POLL,         /* busy-polled, RX rings only */
 } mit_mode_t;
 
+#define NETIF_MIT_MODES         4
+
+/* service latency histogram, in power of 2 microseconds buckets */
+#define NETIF_MIT_LAT_BUCKETS   16
+
 /*
  * Mitigation support.
  */
@@ -432,6 +438,9 @@ struct nx_netif_mit {
 	uint32_t        mit_bytes_avg;          /* average # of bytes */
 	uint32_t        mit_bytes_min;          /* smallest # of bytes */
 	uint32_t        mit_bytes_max;          /* largest # of bytes */
+	uint32_t        mit_depth_avg;          /* average # of pkts per sync */
+	uint32_t        mit_pass_pkts;          /* # of pkts in current pass */
+	uint32_t        mit_idle_polls;         /* empty passes while polling */
 
 	struct pktcntr  mit_sstats;             /* pkts & bytes per sampling */
 	struct timespec mit_mode_holdtime;      /* mode holdtime in nsec */
@@ -440,6 +449,15 @@ struct nx_netif_mit {
 	struct timespec mit_sample_lasttime;    /* last sampling time in nsec */
 	struct timespec mit_start_time;         /* time of start work in nsec */
 
+	/*
+	 * Mode residency and service latency.
+	 */
+	uint64_t        mit_mode_enter;         /* mach time of mode change */
+	uint64_t        mit_mode_switches;      /* # of mode changes */
+	uint64_t        mit_mode_residency[NETIF_MIT_MODES]; /* usec per mode */
+	uint64_t        mit_req_time;           /* mach time of first request */
+	uint64_t        mit_lat_hist[NETIF_MIT_LAT_BUCKETS];
+
 	struct thread   *mit_thread;
 	char            mit_name[MAXTHREADNAMESIZE];
 
@@ -751,6 +769,7 @@ extern void netif_hwna_clear_mode(struct nexus_adapter *);
 extern errno_t netif_rxpoll_set_params(struct ifnet *,
     struct ifnet_poll_params *, boolean_t locked);
 extern void netif_rxpoll_compat_thread_func(void *, wait_result_t);
+extern uint32_t netif_busy_poll(struct ifnet *);
 
 /*
  * GSO functions
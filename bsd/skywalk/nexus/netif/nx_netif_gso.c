@@ -66,6 +66,7 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netinet/tcpip.h>
+#include <netinet/udp.h>
 #include <netinet/ip6.h>
 #include <netinet6/ip6_var.h>
 
@@ -76,14 +77,15 @@
 #include <skywalk/os_skywalk_private.h>
 #include <skywalk/nexus/netif/nx_netif.h>
 
-#define CSUM_GSO_MASK    0x00300000
+#define CSUM_GSO_MASK    0x00700000
 #define CSUM_GSO_OFFSET  20
 #define CSUM_TO_GSO(x) ((x & CSUM_GSO_MASK) >> CSUM_GSO_OFFSET)
 
 enum netif_gso_type {
-	GSO_NONE,
-	GSO_TCP4,
-	GSO_TCP6,
+	GSO_NONE = 0,
+	GSO_TCP4 = 1,
+	GSO_TCP6 = 2,
+	GSO_UDP = 4,            /* IPv4 or IPv6 */
 	GSO_END_OF_TYPE
 };
 
@@ -100,7 +102,9 @@ SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, chain_enqueue,
 int (*netif_gso_functions[GSO_END_OF_TYPE]) (struct ifnet*, struct mbuf*);
 
 /*
- * Structure that contains the state during the TCP segmentation
+ * Structure that contains the state during the TCP or UDP segmentation;
+ * for UDP, mss is the UDP_SEGMENT payload size and the tcp fields are
+ * unused.
  */
 struct netif_gso_ip_tcp_state {
 	void (*update)(struct netif_gso_ip_tcp_state*,
@@ -113,6 +117,7 @@ struct netif_gso_ip_tcp_state {
 	} hdr;
 	int af;
 	struct tcphdr *tcp;
+	struct udphdr *udp;
 	struct kern_pbufpool *pp;
 	uint32_t psuedo_hdr_csum;
 	uint32_t tcp_seq;
@@ -122,7 +127,9 @@ struct netif_gso_ip_tcp_state {
 	uint8_t mac_hlen;
 	uint8_t ip_hlen;
 	uint8_t tcp_hlen;
+	uint8_t proto;
 	boolean_t copy_data_sum;
+	boolean_t udp_nocsum;   /* UDP_NOCKSUM datagrams */
 };
 
 static inline uint8_t
@@ -255,7 +262,7 @@ netif_gso_send(struct ifnet *ifp, struct __kern_packet *head,
  * from m at the top of each segment.
  */
 static inline int
-netif_gso_tcp_segment_mbuf(struct mbuf *m, struct ifnet *ifp,
+netif_gso_segment_mbuf(struct mbuf *m, struct ifnet *ifp,
     struct netif_gso_ip_tcp_state *state, struct kern_pbufpool *pp)
 {
 	uuid_t euuid;
@@ -293,12 +300,14 @@ netif_gso_tcp_segment_mbuf(struct mbuf *m, struct ifnet *ifp,
 		goto done;
 	}
 
-	ASSERT(m->m_pkthdr.pkt_proto == IPPROTO_TCP);
+	ASSERT(m->m_pkthdr.pkt_proto == state->proto);
 	ASSERT((m->m_flags & M_BCAST) == 0);
 	ASSERT((m->m_flags & M_MCAST) == 0);
 	ASSERT(((m->m_pkthdr.pkt_flags & PKTF_TX_COMPL_TS_REQ) == 0));
 	pflags = m->m_pkthdr.pkt_flags & PKT_F_COMMON_MASK;
-	pflags |= PKTF_START_SEQ;
+	if (state->proto == IPPROTO_TCP) {
+		pflags |= PKTF_START_SEQ;
+	}
 	pflags |= (m->m_pkthdr.pkt_ext_flags & PKTF_EXT_L4S) ? PKT_F_L4S : 0;
 	(void) mbuf_get_timestamp(m, &timestamp, NULL);
 	necp_get_app_uuid_from_packet(m, euuid);
@@ -327,7 +336,7 @@ netif_gso_tcp_segment_mbuf(struct mbuf *m, struct ifnet *ifp,
 		baddr += tx_headroom;
 
 		/*
-		 * Copy the link-layer, IP and TCP header from the
+		 * Copy the link-layer, IP and TCP/UDP header from the
 		 * original packet.
 		 */
 		m_copydata(m, 0, state->hlen, baddr);
@@ -365,28 +374,31 @@ netif_gso_tcp_segment_mbuf(struct mbuf *m, struct ifnet *ifp,
 		pkt->pkt_flowsrc_type = m->m_pkthdr.pkt_flowsrc;
 		pkt->pkt_flow_token = m->m_pkthdr.pkt_flowid;
 		pkt->pkt_comp_gencnt = m->m_pkthdr.comp_gencnt;
-		pkt->pkt_flow_ip_proto = IPPROTO_TCP;
-		pkt->pkt_transport_protocol = IPPROTO_TCP;
-		pkt->pkt_flow_tcp_seq = htonl(state->tcp_seq);
+		pkt->pkt_flow_ip_proto = state->proto;
+		pkt->pkt_transport_protocol = state->proto;
+		pkt->pkt_flow_tcp_seq = (state->proto == IPPROTO_TCP) ?
+		    htonl(state->tcp_seq) : 0;
 		__packet_set_tx_timestamp(SK_PKT2PH(pkt), m_tx_timestamp);
 
 		state->update(state, pkt, baddr0);
-		/*
-		 * FIN or PUSH flags if present will be set only on the last
-		 * segment.
-		 */
-		if (n != n_pkts) {
-			state->tcp->th_flags &= ~(TH_FIN | TH_PUSH);
-		}
-		/*
-		 * CWR flag if present is set only on the first segment
-		 * and cleared on the subsequent segments.
-		 */
-		if (n != 1) {
-			state->tcp->th_flags &= ~TH_CWR;
-			state->tcp->th_seq = htonl(state->tcp_seq);
+		if (state->proto == IPPROTO_TCP) {
+			/*
+			 * FIN or PUSH flags if present will be set only on
+			 * the last segment.
+			 */
+			if (n != n_pkts) {
+				state->tcp->th_flags &= ~(TH_FIN | TH_PUSH);
+			}
+			/*
+			 * CWR flag if present is set only on the first
+			 * segment and cleared on the subsequent segments.
+			 */
+			if (n != 1) {
+				state->tcp->th_flags &= ~TH_CWR;
+				state->tcp->th_seq = htonl(state->tcp_seq);
+			}
+			ASSERT(state->tcp->th_seq == pkt->pkt_flow_tcp_seq);
 		}
-		ASSERT(state->tcp->th_seq == pkt->pkt_flow_tcp_seq);
 		state->internal(state, partial, mss, &pkt->pkt_csum_flags);
 		METADATA_ADJUST_LEN(pkt, state->hlen + mss, tx_headroom);
 		VERIFY(__packet_finalize(SK_PKT2PH(pkt)) == 0);
@@ -551,6 +563,161 @@ netif_gso_ipv6_tcp_internal(struct netif_gso_ip_tcp_state *state,
 	state->tcp_seq += payload_len;
 }
 
+/*
+ * Update the pointers to UDP and IPv4 headers
+ */
+static void
+netif_gso_ipv4_udp_update(struct netif_gso_ip_tcp_state *state,
+    struct __kern_packet *pkt, uint8_t *__bidi_indexable baddr)
+{
+	state->hdr.ip = (struct ip *)(void *)(baddr + pkt->pkt_headroom +
+	    pkt->pkt_l2_len);
+	state->udp = (struct udphdr *)(void *)(baddr + pkt->pkt_headroom +
+	    pkt->pkt_l2_len + state->ip_hlen);
+}
+
+/*
+ * Finalize the UDP and IPv4 headers
+ */
+static void
+netif_gso_ipv4_udp_internal(struct netif_gso_ip_tcp_state *state,
+    uint32_t partial, uint16_t payload_len, uint32_t *csum_flags __unused)
+{
+	uint16_t ulen = (uint16_t)(sizeof(struct udphdr) + payload_len);
+	int hlen;
+	uint8_t *__sized_by(hlen) buffer;
+
+	/*
+	 * Update IP header
+	 */
+	state->hdr.ip->ip_id = htons((state->ip_id)++);
+	state->hdr.ip->ip_len = htons(state->ip_hlen + ulen);
+	/*
+	 * IP header checksum
+	 */
+	state->hdr.ip->ip_sum = 0;
+	buffer = (uint8_t *__bidi_indexable)(struct ip *__bidi_indexable)
+	    state->hdr.ip;
+	hlen = state->ip_hlen;
+	state->hdr.ip->ip_sum = inet_cksum_buffer(buffer, 0, 0, hlen);
+	/*
+	 * UDP Checksum; a computed 0 is sent as 0xffff (RFC 768)
+	 */
+	state->udp->uh_ulen = htons(ulen);
+	state->udp->uh_sum = 0;
+	if (state->udp_nocsum) {
+		return;
+	}
+	partial = __packet_cksum(state->udp, sizeof(struct udphdr), partial);
+	partial += htons(ulen + IPPROTO_UDP);
+	partial += state->psuedo_hdr_csum;
+	ADDCARRY(partial);
+	state->udp->uh_sum = ~(uint16_t)partial;
+	if (state->udp->uh_sum == 0) {
+		state->udp->uh_sum = 0xffff;
+	}
+}
+
+static void
+netif_gso_ipv4_udp_internal_nosum(struct netif_gso_ip_tcp_state *state,
+    uint32_t partial __unused, uint16_t payload_len,
+    uint32_t *csum_flags)
+{
+	uint16_t ulen = (uint16_t)(sizeof(struct udphdr) + payload_len);
+	uint32_t sum;
+
+	/*
+	 * Update IP header
+	 */
+	state->hdr.ip->ip_id = htons((state->ip_id)++);
+	state->hdr.ip->ip_len = htons(state->ip_hlen + ulen);
+	state->udp->uh_ulen = htons(ulen);
+	if (state->udp_nocsum) {
+		state->udp->uh_sum = 0;
+		*csum_flags |= PACKET_CSUM_IP;
+		return;
+	}
+	/*
+	 * Seed the UDP checksum with the pseudo header sum, as
+	 * udp_output() does for a single datagram.
+	 */
+	sum = state->psuedo_hdr_csum + htons(ulen + IPPROTO_UDP);
+	ADDCARRY(sum);
+	state->udp->uh_sum = (uint16_t)sum;
+
+	/* offload csum to hardware */
+	*csum_flags |= PACKET_CSUM_IP | PACKET_CSUM_UDP |
+	    PACKET_CSUM_ZERO_INVERT;
+}
+
+/*
+ * Update the pointers to UDP and IPv6 headers
+ */
+static void
+netif_gso_ipv6_udp_update(struct netif_gso_ip_tcp_state *state,
+    struct __kern_packet *pkt, uint8_t *__bidi_indexable baddr)
+{
+	state->hdr.ip6 = (struct ip6_hdr *)(baddr + pkt->pkt_headroom +
+	    pkt->pkt_l2_len);
+	state->udp = (struct udphdr *)(void *)(baddr + pkt->pkt_headroom +
+	    pkt->pkt_l2_len + state->ip_hlen);
+}
+
+/*
+ * Finalize the UDP and IPv6 headers
+ */
+static void
+netif_gso_ipv6_udp_internal(struct netif_gso_ip_tcp_state *state,
+    uint32_t partial, uint16_t payload_len, uint32_t *csum_flags __unused)
+{
+	uint16_t ulen = (uint16_t)(sizeof(struct udphdr) + payload_len);
+
+	/*
+	 * Update IP header
+	 */
+	state->hdr.ip6->ip6_plen = htons(state->ip_hlen -
+	    sizeof(struct ip6_hdr) + ulen);
+	/*
+	 * UDP Checksum; a computed 0 is sent as 0xffff (RFC 8200)
+	 */
+	state->udp->uh_ulen = htons(ulen);
+	state->udp->uh_sum = 0;
+	partial = __packet_cksum(state->udp, sizeof(struct udphdr), partial);
+	partial += htonl(ulen + IPPROTO_UDP);
+	partial += state->psuedo_hdr_csum;
+	ADDCARRY(partial);
+	state->udp->uh_sum = ~(uint16_t)partial;
+	if (state->udp->uh_sum == 0) {
+		state->udp->uh_sum = 0xffff;
+	}
+}
+
+static void
+netif_gso_ipv6_udp_internal_nosum(struct netif_gso_ip_tcp_state *state,
+    uint32_t partial __unused, uint16_t payload_len,
+    uint32_t *csum_flags)
+{
+	uint16_t ulen = (uint16_t)(sizeof(struct udphdr) + payload_len);
+	uint32_t sum;
+
+	/*
+	 * Update IP header
+	 */
+	state->hdr.ip6->ip6_plen = htons(state->ip_hlen -
+	    sizeof(struct ip6_hdr) + ulen);
+	state->udp->uh_ulen = htons(ulen);
+	/*
+	 * Seed the UDP checksum with the pseudo header sum, as
+	 * udp6_output() does for a single datagram.
+	 */
+	sum = state->psuedo_hdr_csum + htonl(ulen + IPPROTO_UDP);
+	ADDCARRY(sum);
+	state->udp->uh_sum = (uint16_t)sum;
+
+	/* offload csum to hardware */
+	*csum_flags |= PACKET_CSUM_UDPIPV6 | PACKET_CSUM_ZERO_INVERT;
+}
+
 /*
  * Init the state during the TCP segmentation
  */
@@ -602,6 +769,7 @@ netif_gso_ip_tcp_init_state(struct netif_gso_ip_tcp_state *state,
 		    ip_dst.s_addr, 0);
 	}
 
+	state->proto = IPPROTO_TCP;
 	state->mac_hlen = mac_hlen;
 	state->ip_hlen = ip_hlen;
 	state->tcp_hlen = (uint8_t)(state->tcp->th_off << 2);
@@ -611,6 +779,68 @@ netif_gso_ip_tcp_init_state(struct netif_gso_ip_tcp_state *state,
 	state->tcp_seq = ntohl(state->tcp->th_seq);
 }
 
+/*
+ * Init the state during the UDP segmentation
+ */
+static inline void
+netif_gso_ip_udp_init_state(struct netif_gso_ip_tcp_state *state,
+    struct mbuf *m, uint8_t mac_hlen, uint8_t ip_hlen, bool isipv6, ifnet_t ifp)
+{
+	if (isipv6) {
+		state->af = AF_INET6;
+		state->hdr.ip6 = (struct ip6_hdr *)(mtod(m, uint8_t *) +
+		    mac_hlen);
+		/* should be atleast 16 bit aligned */
+		VERIFY(((uintptr_t)state->hdr.ip6 & (uintptr_t)0x1) == 0);
+		state->udp = (struct udphdr *)(void *)(m_mtod_current(m) +
+		    mac_hlen + ip_hlen);
+		state->update = netif_gso_ipv6_udp_update;
+		if (ifp->if_hwassist & IFNET_CSUM_UDPIPV6) {
+			state->internal = netif_gso_ipv6_udp_internal_nosum;
+			state->copy_data_sum = false;
+		} else {
+			state->internal = netif_gso_ipv6_udp_internal;
+			state->copy_data_sum = true;
+		}
+		/* checksum is mandatory over IPv6 */
+		state->udp_nocsum = false;
+		state->psuedo_hdr_csum = in6_pseudo(&state->hdr.ip6->ip6_src,
+		    &state->hdr.ip6->ip6_dst, 0);
+	} else {
+		struct in_addr ip_src, ip_dst;
+
+		state->af = AF_INET;
+		state->hdr.ip = (struct ip *)(void *)(mtod(m, uint8_t *) +
+		    mac_hlen);
+		/* should be atleast 16 bit aligned */
+		VERIFY(((uintptr_t)state->hdr.ip & (uintptr_t)0x1) == 0);
+		state->ip_id = ntohs(state->hdr.ip->ip_id);
+		state->udp = (struct udphdr *)(void *)(m_mtod_current(m) +
+		    mac_hlen + ip_hlen);
+		state->update = netif_gso_ipv4_udp_update;
+		state->udp_nocsum = !(m->m_pkthdr.csum_flags & CSUM_UDP);
+		if ((ifp->if_hwassist & (IFNET_CSUM_IP | IFNET_CSUM_UDP)) ==
+		    (IFNET_CSUM_IP | IFNET_CSUM_UDP)) {
+			state->internal = netif_gso_ipv4_udp_internal_nosum;
+			state->copy_data_sum = false;
+		} else {
+			state->internal = netif_gso_ipv4_udp_internal;
+			state->copy_data_sum = !state->udp_nocsum;
+		}
+		bcopy(&state->hdr.ip->ip_src, &ip_src, sizeof(ip_src));
+		bcopy(&state->hdr.ip->ip_dst, &ip_dst, sizeof(ip_dst));
+		state->psuedo_hdr_csum = in_pseudo(ip_src.s_addr,
+		    ip_dst.s_addr, 0);
+	}
+
+	state->proto = IPPROTO_UDP;
+	state->mac_hlen = mac_hlen;
+	state->ip_hlen = ip_hlen;
+	state->hlen = mac_hlen + ip_hlen + sizeof(struct udphdr);
+	VERIFY(m->m_pkthdr.udp_seg_size != 0);
+	state->mss = (uint16_t)m->m_pkthdr.udp_seg_size;
+}
+
 /*
  * GSO on TCP/IPv4
  */
@@ -673,7 +903,7 @@ netif_gso_ipv4_tcp(struct ifnet *ifp, struct mbuf *m)
 		}
 	}
 	netif_gso_ip_tcp_init_state(&state, m, mac_hlen, ip_hlen, false, ifp);
-	error = netif_gso_tcp_segment_mbuf(m, ifp, &state, pp);
+	error = netif_gso_segment_mbuf(m, ifp, &state, pp);
 done:
 	m_freem(m);
 	if (__improbable(pkt_dropped)) {
@@ -747,7 +977,110 @@ netif_gso_ipv6_tcp(struct ifnet *ifp, struct mbuf *m)
 		}
 	}
 	netif_gso_ip_tcp_init_state(&state, m, mac_hlen, ip_hlen, true, ifp);
-	error = netif_gso_tcp_segment_mbuf(m, ifp, &state, pp);
+	error = netif_gso_segment_mbuf(m, ifp, &state, pp);
+done:
+	m_freem(m);
+	if (__improbable(pkt_dropped)) {
+		STATS_INC(nifs, NETIF_STATS_DROP);
+	}
+	return error;
+}
+
+/*
+ * GSO on UDP/IPv4 and UDP/IPv6 (UDP_SEGMENT)
+ */
+static int
+netif_gso_udp(struct ifnet *ifp, struct mbuf *m)
+{
+	struct ip *ip;
+	struct kern_pbufpool *__single pp = NULL;
+	struct netif_gso_ip_tcp_state state;
+	int lasthdr_off;
+	uint16_t hlen;
+	uint8_t ip_hlen;
+	uint8_t mac_hlen;
+	struct netif_stats *nifs = &NA(ifp)->nifna_netif->nif_stats;
+	boolean_t pkt_dropped = false;
+	bool isipv6;
+	int error;
+
+	STATS_INC(nifs, NETIF_STATS_GSO_PKT);
+	if (__improbable(m->m_pkthdr.pkt_proto != IPPROTO_UDP)) {
+		STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_NONUDP);
+		error = ENOTSUP;
+		pkt_dropped = true;
+		goto done;
+	}
+
+	error = netif_gso_check_netif_active(ifp, m, &pp);
+	if (__improbable(error != 0)) {
+		STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_NA_INACTIVE);
+		error = ENXIO;
+		pkt_dropped = true;
+		goto done;
+	}
+
+	error = netif_gso_get_frame_header_len(m, &mac_hlen);
+	if (__improbable(error != 0)) {
+		STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_BADLEN);
+		pkt_dropped = true;
+		goto done;
+	}
+
+	hlen = mac_hlen + sizeof(struct ip);
+	if (__improbable(m->m_len < hlen)) {
+		m = m_pullup(m, hlen);
+		if (m == NULL) {
+			STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_NOMEM);
+			error = ENOBUFS;
+			pkt_dropped = true;
+			goto done;
+		}
+	}
+	ip = (struct ip *)(void *)(mtod(m, uint8_t *) + mac_hlen);
+	isipv6 = (ip->ip_v == IPV6_VERSION >> 4);
+	if (isipv6) {
+		hlen = mac_hlen + sizeof(struct ip6_hdr);
+		if (__improbable(m->m_len < hlen)) {
+			m = m_pullup(m, hlen);
+			if (m == NULL) {
+				STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_NOMEM);
+				error = ENOBUFS;
+				pkt_dropped = true;
+				goto done;
+			}
+		}
+		lasthdr_off = ip6_lasthdr(m, mac_hlen, IPPROTO_IPV6, NULL) -
+		    mac_hlen;
+		VERIFY(lasthdr_off <= UINT8_MAX);
+		ip_hlen = (uint8_t)lasthdr_off;
+	} else {
+		ip_hlen = (uint8_t)(ip->ip_hl << 2);
+	}
+	hlen = mac_hlen + ip_hlen + sizeof(struct udphdr);
+	if (__improbable(m->m_len < hlen)) {
+		m = m_pullup(m, hlen);
+		if (m == NULL) {
+			STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_NOMEM);
+			error = ENOBUFS;
+			pkt_dropped = true;
+			goto done;
+		}
+	}
+	/*
+	 * The segment size comes from the socket rather than the path
+	 * MTU; drop rather than overrun a buffer if it doesn't fit.
+	 */
+	if (__improbable(m->m_pkthdr.udp_seg_size == 0 ||
+	    ifp->if_tx_headroom + hlen + m->m_pkthdr.udp_seg_size >
+	    PP_BUF_SIZE_DEF(pp) || m_pktlen(m) <= hlen)) {
+		STATS_INC(nifs, NETIF_STATS_GSO_PKT_DROP_BADLEN);
+		error = EMSGSIZE;
+		pkt_dropped = true;
+		goto done;
+	}
+	netif_gso_ip_udp_init_state(&state, m, mac_hlen, ip_hlen, isipv6, ifp);
+	error = netif_gso_segment_mbuf(m, ifp, &state, pp);
 done:
 	m_freem(m);
 	if (__improbable(pkt_dropped)) {
@@ -764,18 +1097,22 @@ netif_gso_dispatch(struct ifnet *ifp, struct mbuf *m)
 	ASSERT(m->m_nextpkt == NULL);
 	gso_flags = CSUM_TO_GSO(m->m_pkthdr.csum_flags);
 	VERIFY(gso_flags < GSO_END_OF_TYPE);
+	VERIFY(netif_gso_functions[gso_flags] != NULL);
 	return netif_gso_functions[gso_flags](ifp, m);
 }
 
 void
 netif_gso_init(void)
 {
-	static_assert(CSUM_TO_GSO(~(CSUM_TSO_IPV4 | CSUM_TSO_IPV6)) == GSO_NONE);
+	static_assert(CSUM_TO_GSO(~(CSUM_TSO_IPV4 | CSUM_TSO_IPV6 |
+	    CSUM_UDP_GSO)) == GSO_NONE);
 	static_assert(CSUM_TO_GSO(CSUM_TSO_IPV4) == GSO_TCP4);
 	static_assert(CSUM_TO_GSO(CSUM_TSO_IPV6) == GSO_TCP6);
+	static_assert(CSUM_TO_GSO(CSUM_UDP_GSO) == GSO_UDP);
 	netif_gso_functions[GSO_NONE] = nx_netif_host_output;
 	netif_gso_functions[GSO_TCP4] = netif_gso_ipv4_tcp;
 	netif_gso_functions[GSO_TCP6] = netif_gso_ipv6_tcp;
+	netif_gso_functions[GSO_UDP] = netif_gso_udp;
 }
 
 void
@@ -784,4 +1121,5 @@ netif_gso_fini(void)
 	netif_gso_functions[GSO_NONE] = NULL;
 	netif_gso_functions[GSO_TCP4] = NULL;
 	netif_gso_functions[GSO_TCP6] = NULL;
+	netif_gso_functions[GSO_UDP] = NULL;
 }
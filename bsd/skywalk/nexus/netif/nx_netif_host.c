@@ -367,10 +367,15 @@ nx_netif_host_catch_tx(struct nexus_adapter *na, bool activate)
 		 * to perform any mbuf-pkt conversion.
 		 */
 		if (na->na_type == NA_NETIF_HOST) {
+			bool gso = nx_netif_host_is_gso_needed(na);
+
 			err = ifnet_set_output_handler(ifp,
-			    nx_netif_host_is_gso_needed(na) ?
-			    netif_gso_dispatch : nx_netif_host_output);
+			    gso ? netif_gso_dispatch : nx_netif_host_output);
 			VERIFY(err == 0);
+			/* netif_gso_dispatch() also splits UDP_SEGMENT trains */
+			if (gso) {
+				if_set_xflags(ifp, IFXF_UDP_GSO);
+			}
 		}
 	} else {
 		if (__improbable(!NA_KERNEL_ONLY(na))) {
@@ -380,6 +385,7 @@ nx_netif_host_catch_tx(struct nexus_adapter *na, bool activate)
 		 * Restore original if_output() for native drivers.
 		 */
 		if (na->na_type == NA_NETIF_HOST) {
+			if_clear_xflags(ifp, IFXF_UDP_GSO);
 			ifnet_reset_output_handler(ifp);
 		}
 	}
@@ -44,6 +44,9 @@ static void nx_netif_mit_thread_cont(void *, wait_result_t);
 static void nx_netif_mit_s_thread_cont(void *, wait_result_t);
 static void nx_netif_mit_stats(struct __kern_channel_ring *, uint64_t,
     uint64_t);
+static void nx_netif_mit_set_mode(struct nx_netif_mit *, mit_mode_t);
+static void nx_netif_mit_record_latency(struct nx_netif_mit *);
+static boolean_t nx_netif_mit_poll_pass(struct nx_netif_mit *);
 
 /* mitigation intervals in micro seconds */
 #define NETIF_BUSY_MIT_DELAY    (100)
@@ -82,6 +85,27 @@ static uint64_t netif_mit_mode_holdtime = NETIF_MIT_MODE_HOLDTIME;
 #define NETIF_MIT_SAMPLETIME            (10ULL * 1000 * 1000)   /* 10 ms */
 static uint64_t netif_mit_sample_holdtime = NETIF_MIT_SAMPLETIME;
 
+/*
+ * Busy-polling of RX rings.  A ring in its last mitigation configuration
+ * whose syncs find it at least netif_mit_poll_depth percent full is
+ * polled every netif_mit_poll_ival microseconds instead of waiting for
+ * interrupts.  It goes back to mitigation once the syncs find it less
+ * than half that full, or right away after netif_mit_poll_idle polls in
+ * a row found it empty.  Off by default; like the other mitigation knobs,
+ * it can only be turned on with the DEVELOPMENT || DEBUG sysctls.
+ */
+#define NETIF_MIT_POLL          0
+static uint32_t netif_mit_poll = NETIF_MIT_POLL;
+
+#define NETIF_MIT_POLL_IVAL     20      /* usec */
+static uint32_t netif_mit_poll_ival = NETIF_MIT_POLL_IVAL;
+
+#define NETIF_MIT_POLL_DEPTH    25      /* percent of the ring */
+static uint32_t netif_mit_poll_depth = NETIF_MIT_POLL_DEPTH;
+
+#define NETIF_MIT_POLL_IDLE     64
+static uint32_t netif_mit_poll_idle = NETIF_MIT_POLL_IDLE;
+
 /*
  * These numbers are based off 10ms netif_mit_sample_holdtime;
  * changing the hold time will require recomputing them.
@@ -139,6 +163,8 @@ static const struct mit_cfg_tbl mit_cfg_tbl_native_cellular[] = {
 
 #if (DEVELOPMENT || DEBUG)
 static int sysctl_mit_mode_holdtime SYSCTL_HANDLER_ARGS;
+static int sysctl_mit_mode_residency SYSCTL_HANDLER_ARGS;
+static int sysctl_mit_latency SYSCTL_HANDLER_ARGS;
 SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, busy_mit_delay,
     CTLFLAG_RW | CTLFLAG_LOCKED, &netif_busy_mit_delay,
     NETIF_BUSY_MIT_DELAY, "");
@@ -149,6 +175,14 @@ SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, ad_mit_sdecay,
 SYSCTL_PROC(_kern_skywalk_netif, OID_AUTO, ad_mit_freeze,
     CTLTYPE_QUAD | CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_mode_holdtime,
     NETIF_MIT_MODE_HOLDTIME, sysctl_mit_mode_holdtime, "Q", "");
+SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, mit_poll,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_poll, NETIF_MIT_POLL, "");
+SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, mit_poll_ival,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_poll_ival, NETIF_MIT_POLL_IVAL, "");
+SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, mit_poll_depth,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_poll_depth, NETIF_MIT_POLL_DEPTH, "");
+SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, mit_poll_idle,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_poll_idle, NETIF_MIT_POLL_IDLE, "");
 #endif /* !DEVELOPMENT && !DEBUG */
 
 void
@@ -236,6 +270,7 @@ nx_netif_mit_init(struct nx_netif *nif, const struct ifnet *ifp,
 	/* initialize mode and params */
 	nx_netif_mit_reset_interval(mit);
 	VERIFY(mit->mit_cfg != NULL && mit->mit_cfg_idx < mit->mit_cfg_idx_max);
+	mit->mit_mode_enter = mach_absolute_time();
 	mit->mit_flags = NETIF_MITF_INITIALIZED;
 	if (simple) {
 		/*
@@ -284,6 +319,12 @@ nx_netif_mit_init(struct nx_netif *nif, const struct ifnet *ifp,
 	skoid_create(&mit->mit_skoid, SKOID_DNODE(nif->nif_skoid), oid_name, 0);
 	skoid_add_uint(&mit->mit_skoid, "interval", CTLFLAG_RW,
 	    &mit->mit_interval);
+	skoid_add_uint(&mit->mit_skoid, "depth_avg", CTLFLAG_RD,
+	    &mit->mit_depth_avg);
+	skoid_add_handler(&mit->mit_skoid, "mode_residency", CTLFLAG_RD,
+	    sysctl_mit_mode_residency, mit, 0);
+	skoid_add_handler(&mit->mit_skoid, "latency", CTLFLAG_RD,
+	    sysctl_mit_latency, mit, 0);
 	struct skoid *skoid = &mit->mit_skoid;
 	struct mit_cfg_tbl *t;
 #define MIT_ADD_SKOID(_i)       \
@@ -336,11 +377,12 @@ nx_netif_mit_update_interval(struct nx_netif_mit *mit, boolean_t reset)
 		SK_DF(SK_VERB_NETIF_MIT, "%s: resetting [mode %u->%u]",
 		    mit->mit_name, mit->mit_mode, mode);
 
-		mit->mit_mode = mode;
+		nx_netif_mit_set_mode(mit, mode);
 		mit->mit_cfg_idx = 0;
 		mit->mit_cfg = &mit->mit_tbl[mit->mit_cfg_idx];
 		mit->mit_packets_avg = 0;
 		mit->mit_bytes_avg = 0;
+		mit->mit_depth_avg = 0;
 	}
 
 	/* calculate work duration (since last start work time) */
@@ -363,6 +405,10 @@ nx_netif_mit_update_interval(struct nx_netif_mit *mit, boolean_t reset)
 	case MIT_MODE_ADVANCED_DYNAMIC:
 		i = mit->mit_cfg->cfg_ival;
 		break;
+
+	case MIT_MODE_ADVANCED_POLL:
+		i = netif_mit_poll_ival;
+		break;
 	}
 
 	/*
@@ -421,6 +467,12 @@ nx_netif_mit_cleanup(struct nx_netif_mit *mit)
 	net_timerclear(&mit->mit_sample_lasttime);
 	net_timerclear(&mit->mit_start_time);
 
+	mit->mit_mode_enter = 0;
+	mit->mit_mode_switches = 0;
+	bzero(mit->mit_mode_residency, sizeof(mit->mit_mode_residency));
+	mit->mit_req_time = 0;
+	bzero(mit->mit_lat_hist, sizeof(mit->mit_lat_hist));
+
 #if (DEVELOPMENT || DEBUG)
 	skoid_destroy(&mit->mit_skoid);
 #endif /* !DEVELOPMENT && !DEBUG */
@@ -449,6 +501,9 @@ nx_netif_mit_tx_intr(struct __kern_channel_ring *kr, struct proc *p,
 		    &nifna->nifna_tx_mit[kr->ckr_ring_id];
 		ASSERT(mit->mit_flags & NETIF_MITF_INITIALIZED);
 		MIT_SPIN_LOCK(mit);
+		if (mit->mit_req_time == 0) {
+			mit->mit_req_time = mach_absolute_time();
+		}
 		mit->mit_requests++;
 		if (!(mit->mit_flags & (NETIF_MITF_RUNNING |
 		    NETIF_MITF_TERMINATING | NETIF_MITF_TERMINATED))) {
@@ -484,6 +539,9 @@ nx_netif_mit_rx_intr(struct __kern_channel_ring *kr, struct proc *p,
 		    &nifna->nifna_rx_mit[kr->ckr_ring_id];
 		ASSERT(mit->mit_flags & NETIF_MITF_INITIALIZED);
 		MIT_SPIN_LOCK(mit);
+		if (mit->mit_req_time == 0) {
+			mit->mit_req_time = mach_absolute_time();
+		}
 		mit->mit_requests++;
 		if (!(mit->mit_flags & (NETIF_MITF_RUNNING |
 		    NETIF_MITF_TERMINATING | NETIF_MITF_TERMINATED))) {
@@ -560,6 +618,7 @@ nx_netif_mit_s_thread_cont(void *v, wait_result_t wres)
 	for (;;) {
 		uint32_t requests = mit->mit_requests;
 
+		nx_netif_mit_record_latency(mit);
 		STATS_INC(nifs, irq_stat);
 		MIT_SPIN_UNLOCK(mit);
 
@@ -669,6 +728,8 @@ nx_netif_mit_thread_cont(void *v, wait_result_t wres)
 		uint32_t ival;
 		int error = 0;
 
+		nx_netif_mit_record_latency(mit);
+		os_atomic_store(&mit->mit_pass_pkts, 0, relaxed);
 		STATS_INC(nifs, irq_stat);
 		MIT_SPIN_UNLOCK(mit);
 
@@ -701,8 +762,19 @@ nx_netif_mit_thread_cont(void *v, wait_result_t wres)
 
 		MIT_SPIN_LOCK(mit);
 
-		if ((mit->mit_flags & NETIF_MITF_TERMINATING) != 0 ||
-		    requests == mit->mit_requests) {
+		if ((mit->mit_flags & NETIF_MITF_TERMINATING) != 0) {
+			mit->mit_requests = 0;
+			break;
+		}
+		/*
+		 * A polled ring is serviced again without waiting
+		 * for a request, for as long as it stays in that mode.
+		 */
+		if (mit->mit_mode == MIT_MODE_ADVANCED_POLL &&
+		    nx_netif_mit_poll_pass(mit)) {
+			continue;
+		}
+		if (requests == mit->mit_requests) {
 			mit->mit_requests = 0;
 			break;
 		}
@@ -760,8 +832,13 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 	mit_mode_t mode;
 	uint32_t cfg_idx;
 
+	uint32_t depth_hi;
+
 	ASSERT(mit != NULL && !(mit->mit_flags & NETIF_MITF_SIMPLE));
 
+	/* packets moved by the current service pass, for busy-polling */
+	os_atomic_add(&mit->mit_pass_pkts, (uint32_t)pkts, relaxed);
+
 	if ((os_atomic_or_orig(&mit->mit_flags, NETIF_MITF_SAMPLING, relaxed) &
 	    NETIF_MITF_SAMPLING) != 0) {
 		return;
@@ -770,6 +847,11 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 	mode = mit->mit_mode;
 	cfg_idx = mit->mit_cfg_idx;
 
+	/* each sync drains the ring; what it found is the ring depth */
+	MIT_EWMA(mit->mit_depth_avg, (uint32_t)pkts,
+	    netif_ad_mit_gdecay, netif_ad_mit_sdecay);
+	depth_hi = (kr->ckr_num_slots * netif_mit_poll_depth) / 100;
+
 	nanouptime(&now);
 	if (!net_timerisset(&mit->mit_sample_lasttime)) {
 		*(&mit->mit_sample_lasttime) = *(&now);
@@ -835,7 +917,14 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 		    (mode == MIT_MODE_ADVANCED_STATIC ? 0 :
 		    (mit->mit_tbl[mit->mit_cfg_idx].cfg_ival)));
 
-		if (mit->mit_packets_avg <= mit->mit_cfg->cfg_plowat &&
+		if (mode == MIT_MODE_ADVANCED_POLL) {
+			/* fall back to the deepest mitigation level */
+			if (mit->mit_depth_avg < (depth_hi >> 1) ||
+			    (mit->mit_packets_avg <= mit->mit_cfg->cfg_plowat &&
+			    mit->mit_bytes_avg <= mit->mit_cfg->cfg_blowat)) {
+				mode = MIT_MODE_ADVANCED_DYNAMIC;
+			}
+		} else if (mit->mit_packets_avg <= mit->mit_cfg->cfg_plowat &&
 		    mit->mit_bytes_avg <= mit->mit_cfg->cfg_blowat) {
 			if (cfg_idx == 0) {
 				mode = MIT_MODE_ADVANCED_STATIC;
@@ -848,6 +937,9 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 			mode = MIT_MODE_ADVANCED_DYNAMIC;
 			if (cfg_idx < (mit->mit_cfg_idx_max - 1)) {
 				++cfg_idx;
+			} else if (netif_mit_poll != 0 && kr->ckr_tx == NR_RX &&
+			    depth_hi != 0 && mit->mit_depth_avg >= depth_hi) {
+				mode = MIT_MODE_ADVANCED_POLL;
 			}
 		}
 
@@ -864,7 +956,7 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 			    (mode == MIT_MODE_ADVANCED_STATIC ? 0 :
 			    (mit->mit_tbl[cfg_idx].cfg_ival)));
 
-			mit->mit_mode = mode;
+			nx_netif_mit_set_mode(mit, mode);
 			mit->mit_cfg_idx = cfg_idx;
 			mit->mit_cfg = &mit->mit_tbl[mit->mit_cfg_idx];
 			*(&mit->mit_mode_lasttime) = *(&now);
@@ -875,6 +967,97 @@ done:
 	os_atomic_andnot(&mit->mit_flags, NETIF_MITF_SAMPLING, relaxed);
 }
 
+/*
+ * Switch to a new mode, accounting the time spent in the old one.
+ */
+static void
+nx_netif_mit_set_mode(struct nx_netif_mit *mit, mit_mode_t mode)
+{
+	uint64_t now, usec;
+
+	if (mode == mit->mit_mode) {
+		return;
+	}
+
+	now = mach_absolute_time();
+	if (mit->mit_mode_enter != 0) {
+		absolutetime_to_nanoseconds(now - mit->mit_mode_enter, &usec);
+		usec /= NSEC_PER_USEC;
+		ASSERT(mit->mit_mode < NETIF_MIT_MODES);
+		mit->mit_mode_residency[mit->mit_mode] += usec;
+		mit->mit_mode_switches++;
+	}
+	mit->mit_mode_enter = now;
+	mit->mit_mode = mode;
+}
+
+/*
+ * Account the time between the first request posted to an idle
+ * thread and the service pass picking it up, in log2(usec) buckets.
+ */
+static void
+nx_netif_mit_record_latency(struct nx_netif_mit *mit)
+{
+	uint64_t usec;
+	uint32_t b;
+
+	MIT_SPIN_LOCK_ASSERT_HELD(mit);
+
+	if (mit->mit_req_time == 0) {
+		return;
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - mit->mit_req_time,
+	    &usec);
+	usec /= NSEC_PER_USEC;
+	b = (usec == 0) ? 0 : MIN((uint32_t)flsll(usec),
+	    NETIF_MIT_LAT_BUCKETS - 1);
+	mit->mit_lat_hist[b]++;
+	mit->mit_req_time = 0;
+}
+
+/*
+ * Called after each pass of a polled ring; returns TRUE if the ring is
+ * to be polled again, or FALSE once it has been found empty too many
+ * times in a row, in which case it goes back to interrupts.
+ */
+static boolean_t
+nx_netif_mit_poll_pass(struct nx_netif_mit *mit)
+{
+	boolean_t poll = TRUE;
+
+	MIT_SPIN_LOCK_ASSERT_HELD(mit);
+
+	if (os_atomic_load(&mit->mit_pass_pkts, relaxed) != 0) {
+		mit->mit_idle_polls = 0;
+		return TRUE;
+	}
+	if (++mit->mit_idle_polls < netif_mit_poll_idle) {
+		return TRUE;
+	}
+	mit->mit_idle_polls = 0;
+
+	/* don't race with the mode transition in nx_netif_mit_stats() */
+	if ((os_atomic_or_orig(&mit->mit_flags, NETIF_MITF_SAMPLING, relaxed) &
+	    NETIF_MITF_SAMPLING) != 0) {
+		return TRUE;
+	}
+	if (mit->mit_mode == MIT_MODE_ADVANCED_POLL) {
+		SK_DF(SK_VERB_NETIF_MIT, "%s: idle after %u polls, "
+		    "back to interrupts", mit->mit_name, netif_mit_poll_idle);
+		nx_netif_mit_set_mode(mit, MIT_MODE_ADVANCED_STATIC);
+		mit->mit_cfg_idx = 0;
+		mit->mit_cfg = &mit->mit_tbl[mit->mit_cfg_idx];
+		mit->mit_packets_avg = 0;
+		mit->mit_bytes_avg = 0;
+		mit->mit_depth_avg = 0;
+		net_timerclear(&mit->mit_mode_lasttime);
+		poll = FALSE;
+	}
+	os_atomic_andnot(&mit->mit_flags, NETIF_MITF_SAMPLING, relaxed);
+
+	return poll;
+}
+
 #if (DEVELOPMENT || DEBUG)
 static int
 sysctl_mit_mode_holdtime SYSCTL_HANDLER_ARGS
@@ -898,4 +1081,47 @@ sysctl_mit_mode_holdtime SYSCTL_HANDLER_ARGS
 
 	return err;
 }
+
+static int
+sysctl_mit_mode_residency SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg2)
+	struct nx_netif_mit *mit = arg1;
+	uint64_t res[NETIF_MIT_MODES];
+	uint64_t usec;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+
+	MIT_SPIN_LOCK(mit);
+	bcopy(mit->mit_mode_residency, res, sizeof(res));
+	/* include the time spent so far in the current mode */
+	if (mit->mit_mode_enter != 0) {
+		absolutetime_to_nanoseconds(mach_absolute_time() -
+		    mit->mit_mode_enter, &usec);
+		res[mit->mit_mode] += usec / NSEC_PER_USEC;
+	}
+	MIT_SPIN_UNLOCK(mit);
+
+	return SYSCTL_OUT(req, res, sizeof(res));
+}
+
+static int
+sysctl_mit_latency SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg2)
+	struct nx_netif_mit *mit = arg1;
+	uint64_t hist[NETIF_MIT_LAT_BUCKETS];
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+
+	MIT_SPIN_LOCK(mit);
+	bcopy(mit->mit_lat_hist, hist, sizeof(hist));
+	MIT_SPIN_UNLOCK(mit);
+
+	return SYSCTL_OUT(req, hist, sizeof(hist));
+}
 #endif /* !DEVELOPMENT && !DEBUG */
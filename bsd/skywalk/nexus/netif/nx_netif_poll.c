@@ -514,3 +514,35 @@ netif_rxpoll_compat_thread_func(void *v, wait_result_t w)
 	/* NOTREACHED */
 	__builtin_unreachable();
 }
+
+/*
+ * Service the RX rings of the interface in the calling thread, the way
+ * the mitigation threads do on an interrupt.  Called on behalf of a
+ * SO_BUSY_POLL socket waiting for data; the caller is expected to mark
+ * the thread with NET_THREAD_BUSY_POLL so that what the rings hold is
+ * handed to the protocols before this returns.  Returns the number of
+ * rings that could be serviced.
+ */
+uint32_t
+netif_busy_poll(struct ifnet *ifp)
+{
+	struct nexus_adapter *na = &NA(ifp)->nifna_up;
+	struct __kern_channel_ring *kr;
+	uint32_t i, n = 0;
+
+	ASSERT(net_thread_is_marked(NET_THREAD_BUSY_POLL));
+
+	if (__improbable(!NA_IS_ACTIVE(na))) {
+		return 0;
+	}
+	for (i = 0; i < na_get_nrings(na, NR_RX); i++) {
+		kr = &NAKR(na, NR_RX)[i];
+		/* EBUSY if a mitigation thread is on it already */
+		if (nx_netif_common_intr(kr, kernproc, 0, NULL) == 0) {
+			n++;
+		}
+	}
+	STATS_ADD(&NA(ifp)->nifna_netif->nif_stats,
+	    NETIF_STATS_RX_BUSY_POLL, n);
+	return n;
+}
@@ -456,12 +456,14 @@ struct nx_flow_req {
 #define NXFLOWREQF_AOP_OFFLOAD            0x00008000  /* AOP2 offload flow */
 #define NXFLOWREQF_CONNECTION_IDLE        0x00010000  /* connection is idle */
 #define NXFLOWREQF_CONNECTION_REUSED      0x00020000  /* connection is reused */
+#define NXFLOWREQF_UDP_GRO                0x00040000  /* coalesce UDP datagrams (bsd flow) */
 
 #define NXFLOWREQF_BITS                                                   \
 	"\020\01TRACK\02QOS_MARKING\03FILTER\04CUSTOM_ETHER\05IPV6_ULA"   \
 	"\06LISTENER\07OVERRIDE_ADDRESS_SELECTION\010USE_STABLE_ADDRESS"  \
 	"\011ALLOC_FLOWADV\012ASIS\013LOW_LATENCY\014NOWAKEUPFROMSLEEP"   \
-	"\015REUSEPORT\017PARENT\020AOP_OFFLOAD\021CONNECTION_IDLE\022CONNECTION_REUSED"
+	"\015REUSEPORT\017PARENT\020AOP_OFFLOAD\021CONNECTION_IDLE\022CONNECTION_REUSED" \
+	"\023UDP_GRO"
 
 
 struct flow_ip_addr {
@@ -625,6 +625,7 @@
 	X(NETIF_STATS_RX_COPY_MBUF,		"RxCopyMbuf",		"\t\t%llu copy from mbuf\n")    \
 	X(NETIF_STATS_RX_COPY_ATTACH,		"RxCopyAttach",         "\t\t%llu copy by attaching mbuf under pkt\n")  \
 	X(NETIF_STATS_RX_SYNC,			"RxSYNC",		"\t\t%llu sync\n")      \
+	X(NETIF_STATS_RX_BUSY_POLL,		"RxBusyPoll",		"\t\t%llu rings serviced by busy-polling sockets\n")    \
         \
 	/* Tx stats */  \
 	X(NETIF_STATS_TX_PACKETS,		"TxPkt",		"\t%llu total Tx packets\n")    \
@@ -645,6 +646,7 @@
 	X(NETIF_STATS_GSO_PKT_DROP_NA_INACTIVE,	"GSODropNaInactive",    "\t\t%llu GSO packet dropped due to inactive netif\n") \
 	X(NETIF_STATS_GSO_PKT_DROP_BADLEN,	"GSODropBadLen",        "\t\t%llu GSO packet dropped due to bad packet length\n") \
 	X(NETIF_STATS_GSO_PKT_DROP_NONTCP,	"GSODropNonTcp",        "\t\t%llu GSO packet dropped as it is not a TCP packet\n") \
+	X(NETIF_STATS_GSO_PKT_DROP_NONUDP,	"GSODropNonUdp",        "\t\t%llu GSO packet dropped as it is not a UDP packet\n") \
         \
 	X(NETIF_STATS_DROP,			"Drop",			"\t%llu dropped\n")     \
 	X(NETIF_STATS_DROP_NOMEM_BUF,		"DropNoMemBuf",		"\t\t%llu dropped due to packet alloc failure\n")       \
@@ -847,6 +849,9 @@
 	X(FSW_STATS_RX_AGG_NO_OPTTS_TCP,        "RxAggNoOptionTStampTCP", "\t\t%llu TCP timestamp option compare mismatch\n") \
 	X(FSW_STATS_RX_AGG_BAD_CSUM,            "RxAggIncorrectChecksum", "\t\t%llu Incorrect TCP/IP checksum\n") \
 	X(FSW_STATS_RX_AGG_NO_SHORT_MBUF,       "RxAggNoShortMbuf",      "\t\t%llu mbuf too short for mask compare\n") \
+	X(FSW_STATS_RX_AGG_OK_UDP,              "RxAggUDP",             "\t\t%llu UDP datagrams coalesced\n") \
+	X(FSW_STATS_RX_AGG_NO_HDR_UDP,          "RxAggNoHdrUDP",        "\t\t%llu UDP header compare mismatch\n") \
+	X(FSW_STATS_RX_AGG_NO_ULEN_UDP,         "RxAggNoULenUDP",       "\t\t%llu UDP length compare mismatch\n") \
 	X(FSW_STATS_RX_WASTED_MBUF,                     "RxAggWastedMbuf",      "\t\t%llu wasted pre-allocate mbufs\n") \
 	X(FSW_STATS_RX_WASTED_BFLT,                     "RxAggWastedBflt",      "\t\t%llu wasted pre-allocate buflets\n") \
         \
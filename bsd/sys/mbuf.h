@@ -298,8 +298,10 @@ struct tcp_mtag {
 struct udp_mtag {
 	pid_t     _pid;
 	pid_t     _e_pid;
+	uint16_t  _seg_size;    /* UDP_SEGMENT datagram size */
 #define tx_udp_pid      proto_mtag.__pr_u.udp._pid
 #define tx_udp_e_pid    proto_mtag.__pr_u.udp._e_pid
+#define udp_seg_size    proto_mtag.__pr_u.udp._seg_size
 };
 
 struct rawip_mtag {
@@ -457,8 +459,8 @@ struct pkthdr {
 	uint32_t comp_gencnt;
 	uint32_t pkt_crumbs:16,
 	    pkt_compl_callbacks:8,
-	    pkt_ext_flags:6,
-	    pkt_unused:2; /* Currently unused - feel free to grab those 2 bits */
+	    pkt_ext_flags:7,
+	    pkt_unused:1; /* Currently unused - feel free to grab this bit */
 	/*
 	 * Module private scratch space (32-bit aligned), currently 16-bytes
 	 * large. Anything stored here is not guaranteed to survive across
@@ -575,6 +577,7 @@ struct pkthdr {
 #define PKTF_EXT_QSET_ID_VALID  0x8     /* flag to denote if traffic rules are run */
 #define PKTF_EXT_ULPN           0x10    /* packet transitted coprocessor */
 #define PKTF_EXT_LPW            0x20    /* packet received in low power wake */
+#define PKTF_EXT_UDP_GRO        0x40    /* coalesced UDP datagrams, see udp_seg_size */
 
 #define PKT_CRUMB_TS_COMP_REQ   0x0001 /* timestamp completion requested */
 #define PKT_CRUMB_TS_COMP_CB    0x0002 /* timestamp callback called */
@@ -819,6 +822,17 @@ struct mbuf {
     (!((_ifp)->if_hwassist & IFNET_TSO_IPV6) &&                         \
     ((_m)->m_pkthdr.csum_flags & CSUM_TSO_IPV6))                        \
 
+/* UDP segmentation (UDP_SEGMENT) requested on this mbuf, see udp_seg_size */
+#define CSUM_UDP_GSO            0x00400000      /* This mbuf needs to be split into datagrams */
+
+#define UDP_GSO_OK(_ifp, _m)                                            \
+    (((_ifp)->if_xflags & IFXF_UDP_GSO) &&                              \
+    ((_m)->m_pkthdr.csum_flags & CSUM_UDP_GSO))                         \
+
+#define UDP_GSO_NOTOK(_ifp, _m)                                         \
+    (!((_ifp)->if_xflags & IFXF_UDP_GSO) &&                             \
+    ((_m)->m_pkthdr.csum_flags & CSUM_UDP_GSO))                         \
+
 #endif /* XNU_KERNEL_PRIVATE */
 
 /* mbuf types */
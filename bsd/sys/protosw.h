@@ -534,6 +534,7 @@ struct pr_usrreqs {
 #define PRUS_OOB        0x1
 #define PRUS_EOF        0x2
 #define PRUS_MORETOCOME 0x4
+#define PRUS_CONTINUED  0x8     /* not the first chunk of the write */
 	int     (*pru_sense)(struct socket *, void *, int);
 	int     (*pru_shutdown)(struct socket *);
 	int     (*pru_sockaddr)(struct socket *, struct sockaddr **);
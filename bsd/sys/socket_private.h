@@ -93,6 +93,7 @@
 #define SO_NOWAKEFROMSLEEP      0x10000 /* Don't wake for traffic to this socket */
 #define SO_NOAPNFALLBK          0x20000 /* Don't attempt APN fallback for the socket */
 #define SO_TIMESTAMP_CONTINUOUS 0x40000 /* Continuous monotonic timestamp on rcvd dgram */
+#define SO_REUSEPORT_LB         0x80000 /* Balance connections across SO_REUSEPORT listeners */
 
 /*
  * Additional options, not kept in so_options.
@@ -260,6 +261,7 @@
 #define SO_MARK_DOMAIN_INFO_SILENT 0x1135  /* Domain information should be silently withheld */
 #define SO_MAX_PACING_RATE         0x1136  /* Define per-socket maximum pacing rate in bytes/sec */
 #define SO_CONNECTION_IDLE         0x1137  /* Connection is idle (int) */
+#define SO_BUSY_POLL               0x1138  /* usec to busy-poll the Rx rings before blocking (int) */
 
 struct so_mark_cellfallback_uuid_args {
 	uuid_t flow_uuid;
@@ -36,6 +36,7 @@ extern kern_return_t test_pmap_iommu_disconnect(void);
 extern kern_return_t test_pmap_extended(void);
 extern void test_pmap_call_overhead(unsigned int);
 extern uint64_t test_pmap_page_protect_overhead(unsigned int, unsigned int);
+extern uint64_t test_pmap_refmod_batch_overhead(unsigned int, unsigned int, bool);
 #if CONFIG_SPTM
 extern kern_return_t test_pmap_huge_pv_list(unsigned int, unsigned int);
 extern kern_return_t test_pmap_reentrance(unsigned int);
@@ -178,6 +179,31 @@ sysctl_test_pmap_page_protect_overhead(__unused struct sysctl_oid *oidp, __unuse
 SYSCTL_PROC(_kern, OID_AUTO, pmap_page_protect_overhead_test,
     CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_LOCKED, 0, 0, sysctl_test_pmap_page_protect_overhead, "-", "");
 
+static int
+sysctl_test_pmap_refmod_batch_overhead(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	struct {
+		unsigned int num_loops;
+		unsigned int num_pages;
+		unsigned int batched;
+	} prb_in;
+
+	int error;
+	uint64_t duration;
+
+	error = SYSCTL_IN(req, &prb_in, sizeof(prb_in));
+	if (error) {
+		return error;
+	}
+
+	duration = test_pmap_refmod_batch_overhead(prb_in.num_loops, prb_in.num_pages, prb_in.batched != 0);
+	error = SYSCTL_OUT(req, &duration, sizeof(duration));
+	return error;
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, pmap_refmod_batch_overhead_test,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_LOCKED, 0, 0, sysctl_test_pmap_refmod_batch_overhead, "-", "");
+
 #if CONFIG_SPTM
 static int
 sysctl_test_pmap_huge_pv_list(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
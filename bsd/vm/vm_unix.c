@@ -107,10 +107,12 @@
 #include <vm/vm_protos_internal.h>
 #include <vm/vm_compressor_info.h>         /* for c_segment_info */
 #include <vm/vm_compressor_xnu.h>          /* for vm_compressor_serialize_segment_debug_info() */
+#include <vm/vm_compressor_algorithms_xnu.h> /* for vm_compressor_codec_selection_info() */
 #include <vm/vm_object_xnu.h>              /* for vm_chead_select_t */
 #include <vm/vm_memory_entry_xnu.h>
 #include <vm/vm_iokit.h>
 #include <vm/vm_reclaim_xnu.h>
+#include <vm/vm_phantom_cache_xnu.h>
 
 #include <sys/kern_memorystatus.h>
 #include <sys/kern_memorystatus_freeze.h>
@@ -2481,6 +2483,190 @@ SYSCTL_SCALABLE_COUNTER(_vm, pages_grabbed_iopl, vm_page_grab_count_iopl, "Total
 SCALABLE_COUNTER_DECLARE(vm_page_grab_count_upl);
 SYSCTL_SCALABLE_COUNTER(_vm, pages_grabbed_upl, vm_page_grab_count_upl, "Total pages grabbed (upl)");
 
+SCALABLE_COUNTER_DECLARE(vm_fault_around_count);
+SYSCTL_SCALABLE_COUNTER(_vm, pages_faulted_around, vm_fault_around_count,
+    "Number of pages mapped by fault-around");
+
+extern uint32_t vm_fault_around_max;
+#if DEVELOPMENT || DEBUG
+SYSCTL_UINT(_vm, OID_AUTO, fault_around_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_fault_around_max, 0, "Maximum number of pages mapped around a read fault");
+#else
+SYSCTL_UINT(_vm, OID_AUTO, fault_around_max, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_fault_around_max, 0, "Maximum number of pages mapped around a read fault");
+#endif /* DEVELOPMENT || DEBUG */
+
+extern bool vm_mglru_enabled;
+extern uint32_t vm_mglru_max_seq;
+extern uint32_t vm_mglru_min_seq;
+extern uint32_t vm_mglru_gen_count[];
+static int
+sysctl_vm_mglru_enabled SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	int enabled = vm_mglru_enabled;
+
+	return SYSCTL_OUT(req, &enabled, sizeof(enabled));
+}
+SYSCTL_PROC(_vm, OID_AUTO, mglru_enabled, CTLTYPE_INT | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, sysctl_vm_mglru_enabled, "I", "Active queue aged in generations");
+/*
+ * Both sequence numbers only go up, and max - min stays below the number
+ * of generations: if min_seq didn't move while max_seq was read, the pair
+ * was valid at that point.
+ */
+static int
+sysctl_vm_mglru_seq SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	uint32_t seq[2];
+
+	do {
+		seq[0] = os_atomic_load(&vm_mglru_min_seq, acquire);
+		seq[1] = os_atomic_load(&vm_mglru_max_seq, acquire);
+	} while (os_atomic_load(&vm_mglru_min_seq, relaxed) != seq[0]);
+
+	return SYSCTL_OUT(req, seq, sizeof(seq));
+}
+SYSCTL_PROC(_vm, OID_AUTO, mglru_seq, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, sysctl_vm_mglru_seq, "I", "Oldest and youngest generations of the active queue, read together");
+SYSCTL_OPAQUE(_vm, OID_AUTO, mglru_gen_count, CTLFLAG_RD | CTLFLAG_LOCKED,
+    vm_mglru_gen_count, 4 * sizeof(uint32_t), "I", "Pages in each generation, indexed by sequence modulo 4");
+SCALABLE_COUNTER_DECLARE(vm_mglru_promoted);
+SYSCTL_SCALABLE_COUNTER(_vm, mglru_promoted, vm_mglru_promoted,
+    "Referenced pages moved to the youngest generation");
+SCALABLE_COUNTER_DECLARE(vm_mglru_refault_activated);
+SYSCTL_SCALABLE_COUNTER(_vm, mglru_refault_activated, vm_mglru_refault_activated,
+    "Refaulted file pages activated into the youngest generation");
+SCALABLE_COUNTER_DECLARE(vm_pageout_refmod_batches);
+SYSCTL_SCALABLE_COUNTER(_vm, pageout_refmod_batches, vm_pageout_refmod_batches,
+    "Batches of active queue reference bits harvested from the pmap");
+
+#if CONFIG_PHANTOM_CACHE
+extern uint32_t vm_refault_protect;
+extern uint32_t vm_phantom_cache_evictions;
+SYSCTL_UINT(_vm, OID_AUTO, refault_protect, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_refault_protect, 0, "Activate refaulting file pages whose refault distance is within the working set");
+SYSCTL_UINT(_vm, OID_AUTO, phantom_cache_evictions, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_phantom_cache_evictions, 0, "Eviction clock of the phantom cache");
+SCALABLE_COUNTER_DECLARE(vm_refault_activated);
+SYSCTL_SCALABLE_COUNTER(_vm, refault_activated, vm_refault_activated,
+    "Refaulted file pages activated for being within the working set");
+SCALABLE_COUNTER_DECLARE(vm_refault_deferred);
+SYSCTL_SCALABLE_COUNTER(_vm, refault_deferred, vm_refault_deferred,
+    "Refaulted file pages left inactive for refaulting from beyond the working set");
+
+/*
+ * Write a pid (0 for the caller), read back its struct vm_refault_stats.
+ */
+static int
+sysctl_vm_task_refault_stats SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	struct vm_refault_stats stats = {};
+	pid_t   pid = 0;
+	proc_t  p;
+	task_t  task;
+	int     error;
+
+	error = SYSCTL_IN(req, &pid, sizeof(pid));
+	if (error) {
+		return error;
+	}
+	if (pid == 0) {
+		pid = proc_selfpid();
+	}
+	p = proc_find(pid);
+	if (p == PROC_NULL) {
+		return ESRCH;
+	}
+	if (p != current_proc() && !kauth_cred_issuser(kauth_cred_get()) &&
+	    kauth_cred_getuid(kauth_cred_get()) != proc_getuid(p)) {
+		proc_rele(p);
+		return EPERM;
+	}
+	task = proc_task(p);
+	if (task != TASK_NULL) {
+		vm_phantom_cache_task_refault_stats(task, &stats);
+	}
+	proc_rele(p);
+
+	return SYSCTL_OUT(req, &stats, sizeof(stats));
+}
+SYSCTL_PROC(_vm, OID_AUTO, task_refault_stats,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED, 0, 0,
+    sysctl_vm_task_refault_stats, "S,vm_refault_stats", "Refault statistics of a pid");
+
+/*
+ * Write a file descriptor, read back the struct vm_refault_stats of its vnode.
+ */
+static int
+sysctl_vm_vnode_refault_stats SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	struct vm_refault_stats stats = {};
+	memory_object_control_t control;
+	proc_t  p = current_proc();
+	struct fileproc *fp = NULL;
+	vnode_t vp;
+	int     fd = -1;
+	int     error;
+
+	error = SYSCTL_IN(req, &fd, sizeof(fd));
+	if (error) {
+		return error;
+	}
+	error = fp_get_ftype(p, fd, DTYPE_VNODE, EBADF, &fp);
+	if (error) {
+		return error;
+	}
+	vp = (vnode_t)fp_get_data(fp);
+	error = vnode_getwithref(vp);
+	if (error) {
+		fp_drop(p, fd, fp, 0);
+		return error;
+	}
+	if (vp->v_type == VREG &&
+	    (control = ubc_getobject(vp, UBC_FLAGS_NONE)) != MEMORY_OBJECT_CONTROL_NULL) {
+		(void)vm_phantom_cache_refault_stats(control, &stats);
+	}
+	(void)vnode_put(vp);
+	fp_drop(p, fd, fp, 0);
+
+	return SYSCTL_OUT(req, &stats, sizeof(stats));
+}
+SYSCTL_PROC(_vm, OID_AUTO, vnode_refault_stats,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED, 0, 0,
+    sysctl_vm_vnode_refault_stats, "S,vm_refault_stats", "Refault statistics of a file descriptor's vnode");
+#endif /* CONFIG_PHANTOM_CACHE */
+
+#if VM_LPAGE
+extern uint32_t vm_lpage_enabled;
+extern uint32_t vm_lpage_pool_target;
+extern uint32_t vm_lpage_pool_count;
+extern uint64_t vm_lpage_fault_allocs;
+extern uint64_t vm_lpage_pool_empty;
+extern uint64_t vm_lpage_promote_failed;
+#if DEVELOPMENT || DEBUG
+SYSCTL_UINT(_vm, OID_AUTO, lpage_enabled, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_lpage_enabled, 0, "Populate and promote aligned anonymous runs to large pages");
+SYSCTL_UINT(_vm, OID_AUTO, lpage_pool_target, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_lpage_pool_target, 0, "Zeroed large page runs kept ready for the fault path");
+#else
+SYSCTL_UINT(_vm, OID_AUTO, lpage_enabled, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_enabled, 0, "Populate and promote aligned anonymous runs to large pages");
+SYSCTL_UINT(_vm, OID_AUTO, lpage_pool_target, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_pool_target, 0, "Zeroed large page runs kept ready for the fault path");
+#endif /* DEVELOPMENT || DEBUG */
+SYSCTL_UINT(_vm, OID_AUTO, lpage_pool_count, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_pool_count, 0, "Zeroed large page runs ready for the fault path");
+SYSCTL_QUAD(_vm, OID_AUTO, lpage_fault_allocs, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_fault_allocs, "Aligned runs populated by a zero-fill fault");
+SYSCTL_QUAD(_vm, OID_AUTO, lpage_pool_empty, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_pool_empty, "Zero-fill faults that found no large page run ready");
+SYSCTL_QUAD(_vm, OID_AUTO, lpage_promote_failed, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_lpage_promote_failed, "Populated runs that could not be promoted");
+#endif /* VM_LPAGE */
 
 #if DEVELOPMENT || DEBUG
 SCALABLE_COUNTER_DECLARE(vm_page_deactivate_behind_count);
@@ -3525,6 +3711,25 @@ SYSCTL_QUAD(_vm, OID_AUTO, object_pageout_not_pageable, CTLFLAG_RD | CTLFLAG_LOC
 SYSCTL_QUAD(_vm, OID_AUTO, object_pageout_pageable, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_object_pageout_pageable, "");
 SYSCTL_QUAD(_vm, OID_AUTO, object_pageout_active_local, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_object_pageout_active_local, "");
 
+static int
+sysctl_compressor_codec_selection(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	struct c_codec_selection_info info;
+
+	vm_compressor_codec_selection_info(&info);
+	return SYSCTL_OUT(req, &info, sizeof(info));
+}
+SYSCTL_PROC(_vm, OID_AUTO, compressor_codec_selection, CTLTYPE_STRUCT | CTLFLAG_LOCKED | CTLFLAG_RD, 0, 0, sysctl_compressor_codec_selection, "S", "");
+
+static int
+sysctl_compressor_pattern_pages(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	struct c_pattern_page_info info;
+
+	vm_compressor_pattern_page_info(&info);
+	return SYSCTL_OUT(req, &info, sizeof(info));
+}
+SYSCTL_PROC(_vm, OID_AUTO, compressor_pattern_pages, CTLTYPE_STRUCT | CTLFLAG_LOCKED | CTLFLAG_RD, 0, 0, sysctl_compressor_pattern_pages, "S", "");
 
 #if DEVELOPMENT || DEBUG
 
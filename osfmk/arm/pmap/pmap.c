@@ -1149,6 +1149,21 @@ PMAP_SUPPORT_PROTOTYPES(
 	unsigned int options), PHYS_ATTRIBUTE_CLEAR_RANGE_INDEX);
 #endif /* __ARM_RANGE_TLBI__ */
 
+PMAP_SUPPORT_PROTOTYPES(
+	unsigned int,
+	phys_attribute_clear_batch, (
+#if XNU_MONITOR
+		volatile const ppnum_t *pns,
+		volatile const unsigned int *refmod,
+#else /* !XNU_MONITOR */
+		const ppnum_t *pns,
+		const unsigned int *refmod,
+#endif /* XNU_MONITOR */
+		unsigned int index,
+		unsigned int count,
+		unsigned int mask,
+		unsigned int options), PHYS_ATTRIBUTE_CLEAR_BATCH_INDEX);
+
 
 PMAP_SUPPORT_PROTOTYPES(
 	void,
@@ -1442,6 +1457,7 @@ const void * __ptrauth_ppl_handler const ppl_handler_table[PMAP_COUNT] = {
 #if __ARM_RANGE_TLBI__
 	[PHYS_ATTRIBUTE_CLEAR_RANGE_INDEX] = phys_attribute_clear_range_internal,
 #endif /* __ARM_RANGE_TLBI__ */
+	[PHYS_ATTRIBUTE_CLEAR_BATCH_INDEX] = phys_attribute_clear_batch_internal,
 #if __has_feature(ptrauth_calls) && (defined(XNU_TARGET_OS_OSX) || (DEVELOPMENT || DEBUG))
 	[PMAP_DISABLE_USER_JOP_INDEX] = pmap_disable_user_jop_internal,
 #endif /* __has_feature(ptrauth_calls) && (defined(XNU_TARGET_OS_OSX) || (DEVELOPMENT || DEBUG)) */
@@ -7533,6 +7549,101 @@ phys_attribute_clear(
 	PMAP_TRACE(3, PMAP_CODE(PMAP__ATTRIBUTE_CLEAR) | DBG_FUNC_END);
 }
 
+static inline unsigned int
+pmap_clear_refmod_mask_to_modified_bits(const unsigned int mask);
+
+/*
+ * Clears the attribute bits selected by "mask" on pns[index..count) whose
+ * sampled refmod[] state has any of them set.  Unless PMAP_OPTIONS_NOFLUSH
+ * is given, the TLB invalidations for all of these pages are issued
+ * asynchronously and waited for once, before returning.
+ *
+ * Returns the index of the first page left to process, which is less than
+ * "count" if we stopped early because of pending preemption.
+ */
+MARK_AS_PMAP_TEXT unsigned int
+phys_attribute_clear_batch_internal(
+#if XNU_MONITOR
+	volatile const ppnum_t *pns,
+	volatile const unsigned int *refmod,
+#else /* !XNU_MONITOR */
+	const ppnum_t *pns,
+	const unsigned int *refmod,
+#endif /* XNU_MONITOR */
+	unsigned int index,
+	unsigned int count,
+	unsigned int mask,
+	unsigned int options)
+{
+	const unsigned int bits = pmap_clear_refmod_mask_to_modified_bits(mask);
+	unsigned int npages = 0;
+
+	/*
+	 * A flush range that matches no pmap: every mapping we change gets
+	 * its own asynchronous TLBI, but the wait for their completion is
+	 * left to us.
+	 */
+	pmap_tlb_flush_range_t flush_range = {
+		.ptfr_pmap = PMAP_NULL,
+		.ptfr_start = 0,
+		.ptfr_end = 0,
+		.ptfr_flush_needed = false
+	};
+	pmap_tlb_flush_range_t *flush_rangep =
+	    (options & PMAP_OPTIONS_NOFLUSH) ? NULL : &flush_range;
+
+	if (__improbable(index >= count)) {
+		panic("%s: invalid input; index: %u, count: %u", __func__, index, count);
+	}
+
+	for (; index < count; index++) {
+		if (__improbable(npages++ && pmap_pending_preemption())) {
+			break;
+		}
+		const ppnum_t pn = pns[index];
+
+		if (!(refmod[index] & mask)) {
+			continue;
+		}
+		if (__improbable(!pa_valid(ptoa(pn)))) {
+			panic("%s: page is not managed; pn: 0x%x", __func__, pn);
+		}
+		phys_attribute_clear_with_flush_range(pn, bits, options, NULL, flush_rangep);
+	}
+
+	if (flush_range.ptfr_flush_needed) {
+		sync_tlb_flush();
+	}
+	return index;
+}
+
+static void
+phys_attribute_clear_batch(
+	const ppnum_t   *pns,
+	const unsigned int *refmod,
+	unsigned int    count,
+	unsigned int    mask,
+	unsigned int    options)
+{
+	unsigned int    index = 0;
+
+	if (count > 1) {
+		pmap_verify_preemptible();
+	}
+
+	PMAP_TRACE(3, PMAP_CODE(PMAP__ATTRIBUTE_CLEAR) | DBG_FUNC_START, count, mask);
+
+	while (index < count) {
+#if XNU_MONITOR
+		index = phys_attribute_clear_batch_ppl(pns, refmod, index, count, mask, options);
+#else
+		index = phys_attribute_clear_batch_internal(pns, refmod, index, count, mask, options);
+#endif
+	}
+
+	PMAP_TRACE(3, PMAP_CODE(PMAP__ATTRIBUTE_CLEAR) | DBG_FUNC_END);
+}
+
 /*
  *	Set specified attribute bits.
  *
@@ -7698,6 +7809,32 @@ pmap_clear_refmod_options(
 	phys_attribute_clear(pn, bits, options, arg);
 }
 
+/*
+ * pmap_clear_refmod_batch(pns, refmod, count, mask, options)
+ *  samples the referenced and modified bits of "count" physical pages
+ *  and clears the bits in "mask" on those that had any of them set.
+ *  The sampling only reads the software attribute table; the clearing
+ *  is done in as few PPL calls as preemption allows, with one TLB
+ *  synchronization per call.
+ */
+void
+pmap_clear_refmod_batch(
+	const ppnum_t   *pns,
+	unsigned int    *refmod,
+	unsigned int    count,
+	unsigned int    mask,
+	unsigned int    options)
+{
+	unsigned int    i;
+
+	for (i = 0; i < count; i++) {
+		refmod[i] = pmap_get_refmod(pns[i]);
+	}
+	if (count != 0) {
+		phys_attribute_clear_batch(pns, refmod, count, mask, options);
+	}
+}
+
 /*
  * Perform pmap_clear_refmod_options on a virtual address range.
  * The operation will be performed in bulk & tlb flushes will be coalesced
@@ -739,7 +739,9 @@ void pmap_abandon_measurement(void);
 
 #define PMAP_SET_SHARED_REGION_INDEX 111
 
-#define PMAP_COUNT 112
+#define PHYS_ATTRIBUTE_CLEAR_BATCH_INDEX 112
+
+#define PMAP_COUNT 113
 
 
 /**
@@ -7347,6 +7347,34 @@ pmap_clear_refmod_options(
 	phys_attribute_clear(pn, bits, options, arg);
 }
 
+/*
+ * pmap_clear_refmod_batch(pns, refmod, count, mask, options)
+ *  samples the referenced and modified bits of "count" physical pages
+ *  and clears the bits in "mask" on those that had any of them set.
+ *  The SPTM performs the TLB maintenance for each page it is asked to
+ *  update, so this only saves the caller from sampling and clearing
+ *  each page separately.
+ */
+void
+pmap_clear_refmod_batch(
+	const ppnum_t   *pns,
+	unsigned int    *refmod,
+	unsigned int    count,
+	unsigned int    mask,
+	unsigned int    options)
+{
+	const unsigned int bits = pmap_clear_refmod_mask_to_modified_bits(mask);
+	unsigned int    i;
+
+	for (i = 0; i < count; i++) {
+		refmod[i] = pmap_get_refmod(pns[i]);
+
+		if (refmod[i] & mask) {
+			phys_attribute_clear(pns[i], bits, options, NULL);
+		}
+	}
+}
+
 /*
  * Perform pmap_clear_refmod_options on a virtual address range.
  * The operation will be performed in bulk & tlb flushes will be coalesced
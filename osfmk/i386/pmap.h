@@ -286,6 +286,7 @@ extern int      kernPhysPML4EntryCount;
 #define INTEL_PTE_SWLOCK        (0x1ULL << 52)
 #define INTEL_PDPTE_NESTED      (0x1ULL << 53)
 #define INTEL_PTE_WIRED         (0x1ULL << 54)
+#define INTEL_PDE_LPAGE         (0x1ULL << 55)  /* large mapping promoted over a kept page table */
 /* TODO: Compressed markers, potential conflict with protection keys? */
 #define INTEL_PTE_COMPRESSED_ALT (1ULL << 61) /* compressed but with "alternate accounting" */
 #define INTEL_PTE_COMPRESSED    (1ULL << 62) /* marker, for invalid PTE only -- ignored by hardware for both regular/EPT entries*/
@@ -605,6 +606,7 @@ struct pmap {
 #endif
 	ledger_t        ledger;         /* ledger tracking phys mappings */
 	uint64_t        corrected_compressed_ptes_count;
+	uint32_t        pm_lpage_count; /* promoted large mappings */
 #if MACH_ASSERT
 	boolean_t       pmap_stats_assert;
 	int             pmap_pid;
@@ -618,6 +618,48 @@ pmap_clear_refmod_options(ppnum_t pn, unsigned int mask, unsigned int options, v
 	phys_attribute_clear(pn, x86Mask, options, arg);
 }
 
+/*
+ * pmap_clear_refmod_batch(pns, refmod, count, mask, options)
+ *  samples the referenced and modified bits of "count" physical pages
+ *  and clears the bits in "mask" on those that had any of them set.
+ *  The TLB shootdowns are gathered in a single pmap_flush_context and
+ *  sent once for the whole batch.
+ */
+void
+pmap_clear_refmod_batch(
+	const ppnum_t   *pns,
+	unsigned int    *refmod,
+	unsigned int    count,
+	unsigned int    mask,
+	unsigned int    options)
+{
+	pmap_flush_context      pfc;
+	unsigned int            x86Mask;
+	unsigned int            i;
+	boolean_t               delayed_flush;
+
+	x86Mask = (((mask &   VM_MEM_MODIFIED)?   PHYS_MODIFIED : 0)
+	    | ((mask & VM_MEM_REFERENCED)? PHYS_REFERENCED : 0));
+
+	delayed_flush = !(options & PMAP_OPTIONS_NOFLUSH);
+	if (delayed_flush) {
+		pmap_flush_context_init(&pfc);
+	}
+
+	for (i = 0; i < count; i++) {
+		refmod[i] = pmap_get_refmod(pns[i]);
+
+		if (refmod[i] & mask) {
+			phys_attribute_clear(pns[i], x86Mask,
+			    options | PMAP_OPTIONS_NOFLUSH,
+			    delayed_flush ? (void *)&pfc : NULL);
+		}
+	}
+	if (delayed_flush) {
+		pmap_flush(&pfc);
+	}
+}
+
 /*
  * pmap_clear_refmod(phys, mask)
  *  clears the referenced and modified bits as specified by the mask
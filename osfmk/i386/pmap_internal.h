@@ -1284,6 +1284,34 @@ pmap_pte(pmap_t pmap, vm_map_offset_t vaddr)
 	}
 }
 
+/*
+ * Large mappings set up by pmap_promote_large() carry INTEL_PDE_LPAGE and
+ * keep the page table they replaced, so that they can be split again
+ * without allocating.  The kept PTEs stay valid while the PDE maps the run.
+ */
+extern void     pmap_lpage_demote(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr);
+extern pt_entry_t *pmap_lpage_pte(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr);
+extern pt_entry_t *pmap_lpage_clear_ref(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr);
+extern boolean_t pmap_lpage_update(pd_entry_t *pde, uint64_t clear_bits, uint64_t set_bits);
+extern void     pmap_lpage_destroy(pmap_t pmap);
+
+/*
+ * Like pmap_pte(), but first splits a promoted large mapping covering
+ * "vaddr", for callers about to change that single page's PTE.
+ */
+static inline pt_entry_t *
+pmap_pte_demote(pmap_t pmap, vm_map_offset_t vaddr)
+{
+	pt_entry_t      *ptep;
+
+	ptep = pmap_pte(pmap, vaddr);
+	if (__improbable(ptep != PT_ENTRY_NULL && (*ptep & INTEL_PDE_LPAGE))) {
+		pmap_lpage_demote(pmap, ptep, vaddr);
+		ptep = pmap_pte(pmap, vaddr);
+	}
+	return ptep;
+}
+
 extern void     pmap_alias(
 	vm_offset_t     ava,
 	vm_map_offset_t start,
@@ -545,7 +545,7 @@ pmap_update_cache_attributes_locked(ppnum_t pn, unsigned attributes)
 		do {
 			pmap = pv_e->pmap;
 			vaddr = PVE_VA(pv_e);
-			ptep = pmap_pte(pmap, vaddr);
+			ptep = pmap_pte_demote(pmap, vaddr);
 
 			if (0 == ptep) {
 				panic("pmap_update_cache_attributes_locked: Missing PTE, pmap: %p, pn: 0x%x vaddr: 0x%llx kernel_pmap: %p", pmap, pn, vaddr, kernel_pmap);
@@ -579,6 +579,393 @@ x86_filter_TLB_coherency_interrupts(boolean_t dofilter)
 	}
 }
 
+/*
+ * Transparent large pages.
+ *
+ * pmap_promote_large() points a PDE straight at a 2MB run of base pages that
+ * are already mapped by the page table under it.  The page table is kept as
+ * is, and remembered in a small hash keyed by the PDE, so that the mapping
+ * can be split again at any time without allocating: the PDE's reference
+ * and modified bits are folded into the kept PTEs, and the PDE is pointed
+ * back at the page table.  Anything that needs to change one base page of
+ * a promoted run splits it first (see pmap_pte_demote()).
+ *
+ * Promotion holds the pmap lock exclusive and the PV locks of the whole run.
+ * Demotion can run under any lock that pins the pmap, including a PV lock
+ * alone, so the hash, the counters and the PDE updates are serialized by
+ * pmap_lpage_lock.
+ */
+struct pmap_lpage {
+	struct pmap_lpage       *lpg_next;
+	pd_entry_t              *lpg_pde;       /* promoted PDE */
+	pmap_t                  lpg_pmap;
+	pd_entry_t              lpg_opde;       /* PDE value for the kept page table */
+};
+
+#define PMAP_LPAGE_HASH_SIZE    256
+#define PMAP_LPAGE_HASH(pde)    ((((uintptr_t)(pde)) >> 3) & (PMAP_LPAGE_HASH_SIZE - 1))
+
+/* PTE bits that must match across a run, and bits that prevent promotion */
+#define PMAP_LPAGE_SAME_BITS    (INTEL_PTE_VALID | INTEL_PTE_WRITE | INTEL_PTE_USER | \
+	                         INTEL_PTE_WTHRU | INTEL_PTE_NCACHE | INTEL_PTE_PAT | \
+	                         INTEL_PTE_GLOBAL | INTEL_PTE_WIRED | INTEL_PTE_NX)
+#define PMAP_LPAGE_DENY_BITS    (INTEL_PTE_WTHRU | INTEL_PTE_NCACHE | INTEL_PTE_PAT | \
+	                         INTEL_PTE_GLOBAL | INTEL_PTE_WIRED)
+
+static struct pmap_lpage        *pmap_lpage_hash[PMAP_LPAGE_HASH_SIZE];
+static struct pmap_lpage        *pmap_lpage_free_list;
+static SIMPLE_LOCK_DECLARE(pmap_lpage_lock, 0);
+static ZONE_DEFINE_TYPE(pmap_lpage_zone, "pmap large pages",
+    struct pmap_lpage, ZC_NONE);
+
+static uint64_t pmap_lpage_promotions;
+static uint64_t pmap_lpage_demotions;
+static uint64_t pmap_lpage_mappings;
+
+/*
+ * Returns the hash link pointing at the entry for "pde", or at the NULL
+ * that ends its bucket.  pmap_lpage_lock must be held.
+ */
+static struct pmap_lpage **
+pmap_lpage_lookup(pd_entry_t *pde)
+{
+	struct pmap_lpage **lpp;
+
+	lpp = &pmap_lpage_hash[PMAP_LPAGE_HASH(pde)];
+	while (*lpp != NULL && (*lpp)->lpg_pde != pde) {
+		lpp = &(*lpp)->lpg_next;
+	}
+	return lpp;
+}
+
+static void
+pmap_lpage_release_locked(struct pmap_lpage **lpp)
+{
+	struct pmap_lpage *lp = *lpp;
+
+	*lpp = lp->lpg_next;
+	lp->lpg_next = pmap_lpage_free_list;
+	pmap_lpage_free_list = lp;
+	lp->lpg_pmap->pm_lpage_count--;
+	pmap_lpage_demotions++;
+	pmap_lpage_mappings--;
+}
+
+/*
+ * Fold the reference and modified bits the hardware set in a promoted PDE
+ * into the kept PTEs, so that they survive the PDE being cleared or split.
+ */
+static void
+pmap_lpage_fold_refmod(pt_entry_t *ptep, pd_entry_t pde, uint64_t bits)
+{
+	pt_entry_t      refmod = pde & bits & (INTEL_PTE_REF | INTEL_PTE_MOD);
+	int             i;
+
+	if (refmod == 0) {
+		return;
+	}
+	for (i = 0; i < NPTEPG; i++) {
+		ptep[i] |= refmod;
+	}
+}
+
+/*
+ * Whether the page table at "ptep" maps one aligned, physically contiguous
+ * run of managed pages, all with the same cacheable, unwired attributes.
+ */
+static boolean_t
+pmap_lpage_eligible(pt_entry_t *ptep)
+{
+	pt_entry_t      first = ptep[0];
+	pmap_paddr_t    base = pte_to_pa(first);
+	int             i;
+
+	if (!(first & INTEL_PTE_VALID) || (base & I386_LPGMASK) ||
+	    (first & PMAP_LPAGE_DENY_BITS) ||
+	    !IS_MANAGED_PAGE(pa_index(base)) ||
+	    !IS_MANAGED_PAGE(pa_index(base) + NPTEPG - 1)) {
+		return FALSE;
+	}
+	for (i = 1; i < NPTEPG; i++) {
+		if (pte_to_pa(ptep[i]) != base + i386_ptob(i) ||
+		    ((ptep[i] ^ first) & PMAP_LPAGE_SAME_BITS)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+kern_return_t
+pmap_promote_large(pmap_t pmap, vm_map_offset_t va)
+{
+	struct pmap_lpage       *lp;
+	struct pmap_lpage       **lpp;
+	pdpt_entry_t            *pdpte;
+	pd_entry_t              *pde, opde;
+	pt_entry_t              *ptep, first;
+	pmap_paddr_t            base;
+	ppnum_t                 pai;
+	kern_return_t           kr = KERN_FAILURE;
+	int                     i;
+
+	if (pmap == PMAP_NULL || pmap == kernel_pmap || is_ept_pmap(pmap)) {
+		return KERN_NOT_SUPPORTED;
+	}
+	va &= ~((vm_map_offset_t)I386_LPGMASK);
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lp = pmap_lpage_free_list;
+	if (lp != NULL) {
+		pmap_lpage_free_list = lp->lpg_next;
+	}
+	simple_unlock(&pmap_lpage_lock);
+	if (lp == NULL) {
+		lp = zalloc_flags(pmap_lpage_zone, Z_WAITOK | Z_NOFAIL);
+	}
+
+	PMAP_LOCK_EXCLUSIVE(pmap);
+
+	/* nested (shared region) page tables belong to another pmap */
+	pdpte = pmap64_pdpt(pmap, va);
+	if (pdpte == NULL || !(*pdpte & INTEL_PTE_VALID) ||
+	    (*pdpte & INTEL_PDPTE_NESTED)) {
+		goto out;
+	}
+	pde = pmap_pde(pmap, va);
+	if (pde == NULL || !(*pde & INTEL_PTE_VALID) || (*pde & PTE_PS)) {
+		goto out;
+	}
+	opde = *pde;
+	ptep = (pt_entry_t *)PHYSMAP_PTOV(opde & PG_FRAME);
+	if (!pmap_lpage_eligible(ptep)) {
+		goto out;
+	}
+
+	/*
+	 * The PV paths change PTEs without the pmap lock: keep them off the
+	 * run, and check it again, while the PDE is switched over.
+	 */
+	pai = pa_index(pte_to_pa(ptep[0]));
+	for (i = 0; i < NPTEPG; i++) {
+		LOCK_PVH(pai + i);
+	}
+	if (!pmap_lpage_eligible(ptep)) {
+		for (i = NPTEPG - 1; i >= 0; i--) {
+			UNLOCK_PVH(pai + i);
+		}
+		goto out;
+	}
+	first = ptep[0];
+	base = pte_to_pa(first);
+
+	lp->lpg_pde = pde;
+	lp->lpg_pmap = pmap;
+	lp->lpg_opde = opde;
+
+	/*
+	 * Break before make: the same addresses must never be cached with
+	 * two page sizes at once, so take the page table out of the PDE and
+	 * flush it from every CPU the pmap is active on before the large
+	 * mapping goes in.  Nothing can fault the range back in meanwhile:
+	 * pmap_enter() needs the pmap lock and the PV paths the PV locks.
+	 * A non-present PDE is never cached, so the new one needs no flush.
+	 */
+	pmap_store_pte(FALSE, pde, 0);
+	PMAP_UPDATE_TLBS(pmap, va, va + I386_LPGBYTES);
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lpp = pmap_lpage_lookup(pde);
+	assert(*lpp == NULL);
+	lp->lpg_next = NULL;
+	*lpp = lp;
+	lp = NULL;
+	pmap_store_pte(FALSE, pde, base | INTEL_PTE_PS | INTEL_PTE_REF | INTEL_PDE_LPAGE |
+	    (first & (INTEL_PTE_VALID | INTEL_PTE_WRITE | INTEL_PTE_USER | INTEL_PTE_NX)));
+	pmap->pm_lpage_count++;
+	pmap_lpage_promotions++;
+	pmap_lpage_mappings++;
+	simple_unlock(&pmap_lpage_lock);
+
+	for (i = NPTEPG - 1; i >= 0; i--) {
+		UNLOCK_PVH(pai + i);
+	}
+	kr = KERN_SUCCESS;
+out:
+	PMAP_UNLOCK_EXCLUSIVE(pmap);
+
+	if (lp != NULL) {
+		simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+		lp->lpg_next = pmap_lpage_free_list;
+		pmap_lpage_free_list = lp;
+		simple_unlock(&pmap_lpage_lock);
+	}
+	return kr;
+}
+
+/*
+ * Split the promoted mapping at "pde" back into its kept page table.
+ * A no-op if someone else already did.
+ */
+void
+pmap_lpage_demote(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr)
+{
+	struct pmap_lpage       **lpp;
+	pt_entry_t              *ptep;
+	pd_entry_t              opde;
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lpp = pmap_lpage_lookup(pde);
+	if (*lpp == NULL) {
+		simple_unlock(&pmap_lpage_lock);
+		return;
+	}
+	assert((*lpp)->lpg_pmap == pmap);
+	ptep = (pt_entry_t *)PHYSMAP_PTOV((*lpp)->lpg_opde & PG_FRAME);
+	do {
+		opde = *pde;
+		pmap_lpage_fold_refmod(ptep, opde, INTEL_PTE_REF | INTEL_PTE_MOD);
+	} while (!pmap_cmpx_pte(pde, opde, (*lpp)->lpg_opde));
+	pmap_lpage_release_locked(lpp);
+	simple_unlock(&pmap_lpage_lock);
+
+	vaddr &= ~((vm_map_offset_t)I386_LPGMASK);
+	PMAP_UPDATE_TLBS(pmap, vaddr, vaddr + I386_LPGBYTES);
+}
+
+/*
+ * Returns the kept PTE for "vaddr" under the promoted PDE "pde", or the
+ * current PTE if the mapping has been split in the meantime.
+ */
+pt_entry_t *
+pmap_lpage_pte(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr)
+{
+	struct pmap_lpage       *lp;
+	pt_entry_t              *ptep = PT_ENTRY_NULL;
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lp = *pmap_lpage_lookup(pde);
+	if (lp != NULL) {
+		ptep = (pt_entry_t *)PHYSMAP_PTOV(lp->lpg_opde & PG_FRAME);
+	}
+	simple_unlock(&pmap_lpage_lock);
+
+	if (ptep == PT_ENTRY_NULL) {
+		return pmap_pte(pmap, vaddr);
+	}
+	return &ptep[ptenum(vaddr)];
+}
+
+/*
+ * Clears the reference bit of a promoted PDE, after handing it down to the
+ * kept PTEs so that the other pages of the run still look referenced.
+ * Returns the kept PTE for "vaddr", on which the caller clears the bit for
+ * that page.  The modified bit stays on the PDE.
+ */
+pt_entry_t *
+pmap_lpage_clear_ref(pmap_t pmap, pd_entry_t *pde, vm_map_offset_t vaddr)
+{
+	struct pmap_lpage       *lp;
+	pt_entry_t              *ptep;
+	pd_entry_t              opde;
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lp = *pmap_lpage_lookup(pde);
+	if (lp == NULL) {
+		simple_unlock(&pmap_lpage_lock);
+		return pmap_pte(pmap, vaddr);
+	}
+	ptep = (pt_entry_t *)PHYSMAP_PTOV(lp->lpg_opde & PG_FRAME);
+	do {
+		opde = *pde;
+		pmap_lpage_fold_refmod(ptep, opde, INTEL_PTE_REF);
+	} while (!pmap_cmpx_pte(pde, opde, opde & ~INTEL_PTE_REF));
+	simple_unlock(&pmap_lpage_lock);
+
+	return &ptep[ptenum(vaddr)];
+}
+
+/*
+ * Applies a protection change covering a whole promoted run to its PDE and
+ * its kept PTEs together.  Returns FALSE if the run has been split in the
+ * meantime, in which case nothing was changed.
+ */
+boolean_t
+pmap_lpage_update(pd_entry_t *pde, uint64_t clear_bits, uint64_t set_bits)
+{
+	struct pmap_lpage       *lp;
+	pt_entry_t              *ptep;
+	int                     i;
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	lp = *pmap_lpage_lookup(pde);
+	if (lp == NULL) {
+		simple_unlock(&pmap_lpage_lock);
+		return FALSE;
+	}
+	ptep = (pt_entry_t *)PHYSMAP_PTOV(lp->lpg_opde & PG_FRAME);
+	for (i = 0; i < NPTEPG; i++) {
+		pmap_update_pte(FALSE, &ptep[i], clear_bits, set_bits, false);
+	}
+	pmap_update_pte(FALSE, pde, clear_bits, set_bits, false);
+	simple_unlock(&pmap_lpage_lock);
+	return TRUE;
+}
+
+/*
+ * Forget the promoted mappings of a pmap being destroyed.
+ */
+void
+pmap_lpage_destroy(pmap_t pmap)
+{
+	struct pmap_lpage       **lpp;
+	int                     i;
+
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	for (i = 0; i < PMAP_LPAGE_HASH_SIZE && pmap->pm_lpage_count != 0; i++) {
+		lpp = &pmap_lpage_hash[i];
+		while (*lpp != NULL) {
+			if ((*lpp)->lpg_pmap == pmap) {
+				pmap_lpage_release_locked(lpp);
+			} else {
+				lpp = &(*lpp)->lpg_next;
+			}
+		}
+	}
+	simple_unlock(&pmap_lpage_lock);
+}
+
+void
+pmap_large_page_stats(uint64_t *promotions, uint64_t *demotions, uint64_t *mappings)
+{
+	simple_lock(&pmap_lpage_lock, LCK_GRP_NULL);
+	*promotions = pmap_lpage_promotions;
+	*demotions = pmap_lpage_demotions;
+	*mappings = pmap_lpage_mappings;
+	simple_unlock(&pmap_lpage_lock);
+}
+
+/*
+ * Whether the promoted PDE "pde" already maps "pa" at "vaddr" the way
+ * pmap_enter_options() was asked to, in which case there is nothing to do.
+ */
+static inline boolean_t
+pmap_lpage_covers(pd_entry_t pde, vm_map_offset_t vaddr, pmap_paddr_t pa,
+    vm_prot_t prot, boolean_t set_NX, unsigned int flags, boolean_t wired)
+{
+	if (wired ||
+	    (flags & (VM_MEM_NOT_CACHEABLE | VM_WIMG_USE_DEFAULT)) == VM_MEM_NOT_CACHEABLE ||
+	    pmap_get_cache_attributes(pa_index(pa), FALSE) != 0) {
+		return FALSE;
+	}
+	if ((pde & PG_FRAME & ~((pd_entry_t)I386_LPGMASK)) + (vaddr & I386_LPGMASK) != pa) {
+		return FALSE;
+	}
+	if (!(pde & INTEL_PTE_WRITE) != !(prot & VM_PROT_WRITE)) {
+		return FALSE;
+	}
+	return !(pde & INTEL_PTE_NX) == !set_NX;
+}
+
 
 /*
  *	Insert the given physical page (p) at
@@ -765,6 +1152,22 @@ Retry:
 		goto done1;
 	}
 
+	if (__improbable(*pte & INTEL_PDE_LPAGE)) {
+		/*
+		 * A promoted large mapping covers this address: leave it
+		 * alone if it already maps the page as requested, split it
+		 * otherwise.
+		 */
+		if (!superpage &&
+		    pmap_lpage_covers(*pte, vaddr, pa, prot, set_NX, flags, wired)) {
+			goto done2;
+		}
+		pmap_lpage_demote(pmap, pte, vaddr);
+		if (!superpage) {
+			pte = pmap_pte(pmap, vaddr);
+		}
+	}
+
 	if (__improbable(superpage && *pte && !(*pte & PTE_PS))) {
 		/*
 		 * There is still an empty page table mapped that
@@ -1664,6 +2067,10 @@ pmap_remove_options(
 		pde = pmap_pde(map, s64);
 
 		if (pde && (*pde & PTE_VALID_MASK(is_ept))) {
+			if (__improbable(*pde & INTEL_PDE_LPAGE)) {
+				/* remove through the kept page table */
+				pmap_lpage_demote(map, pde, s64);
+			}
 			if (*pde & PTE_PS) {
 				/*
 				 * If we're removing a superpage, pmap_remove_range()
@@ -1798,7 +2205,7 @@ pmap_page_protect_options(
 		pmap = pv_e->pmap;
 		is_ept = is_ept_pmap(pmap);
 		vaddr = PVE_VA(pv_e);
-		pte = pmap_pte(pmap, vaddr);
+		pte = pmap_pte_demote(pmap, vaddr);
 
 		pmap_assert2((pa_index(pte_to_pa(*pte)) == pn),
 		    "pmap_page_protect: PTE mismatch, pn: 0x%x, pmap: %p, vaddr: 0x%llx, pte: 0x%llx", pn, pmap, vaddr, *pte);
@@ -2098,6 +2505,20 @@ phys_attribute_clear(
 
 			if (bits) {
 				pte = pmap_pte(pmap, va);
+				if (__improbable(*pte & INTEL_PDE_LPAGE)) {
+					/*
+					 * The reference bit can be cleared on a
+					 * promoted run by way of its kept PTEs;
+					 * anything else splits it.
+					 */
+					if (bits == PHYS_REFERENCED &&
+					    !(options & PMAP_OPTIONS_CLEAR_WRITE)) {
+						pte = pmap_lpage_clear_ref(pmap, pte, va);
+					} else {
+						pmap_lpage_demote(pmap, pte, va);
+						pte = pmap_pte(pmap, va);
+					}
+				}
 				/* grab ref/mod bits from this PTE */
 				pte_bits = (*pte & (PTE_REF(is_ept) | PTE_MOD(is_ept)));
 				/* propagate to page's global attributes */
@@ -2299,6 +2720,11 @@ phys_attribute_test(
 			 */
 
 			pte = pmap_pte(pmap, va);
+			if (__improbable(*pte & INTEL_PDE_LPAGE)) {
+				/* the run's bits, then this page's kept ones */
+				attributes |= (int)(*pte & bits);
+				pte = pmap_lpage_pte(pmap, pte, va);
+			}
 			if (!is_ept) {
 				attributes |= (int)(*pte & bits);
 			} else {
@@ -2332,7 +2758,7 @@ pmap_change_wiring(
 
 	PMAP_LOCK_SHARED(map);
 
-	if ((pte = pmap_pte(map, vaddr)) == PT_ENTRY_NULL) {
+	if ((pte = pmap_pte_demote(map, vaddr)) == PT_ENTRY_NULL) {
 		panic("pmap_change_wiring(%p,0x%llx,%d): pte missing",
 		    map, vaddr, wired);
 	}
@@ -2515,12 +2941,17 @@ pmap_query_resident(
 		pde = pmap_pde(pmap, s64);
 
 		if (pde && (*pde & PTE_VALID_MASK(is_ept))) {
-			if (*pde & PTE_PS) {
+			if ((*pde & PTE_PS) && !(*pde & INTEL_PDE_LPAGE)) {
 				/* superpage: not supported */
 			} else {
-				spte = pmap_pte(pmap,
-				    (s64 & ~(PDE_MAPPED_SIZE - 1)));
-				spte = &spte[ptenum(s64)];
+				if (__improbable(*pde & INTEL_PDE_LPAGE)) {
+					/* promoted run: its kept PTEs are accurate */
+					spte = pmap_lpage_pte(pmap, pde, s64);
+				} else {
+					spte = pmap_pte(pmap,
+					    (s64 & ~(PDE_MAPPED_SIZE - 1)));
+					spte = &spte[ptenum(s64)];
+				}
 				epte = &spte[intel_btop(l64 - s64)];
 
 				for (; spte < epte; spte++) {
@@ -2586,6 +3017,9 @@ pmap_query_page_info(
 	PMAP_LOCK_EXCLUSIVE(pmap);
 
 	pde_p = pmap_pde(pmap, va);
+	if (pde_p && __improbable(*pde_p & INTEL_PDE_LPAGE)) {
+		pmap_lpage_demote(pmap, pde_p, va);
+	}
 	if (!pde_p ||
 	    !(*pde_p & PTE_VALID_MASK(is_ept)) ||
 	    (*pde_p & PTE_PS)) {
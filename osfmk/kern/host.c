@@ -98,6 +98,7 @@
 #include <vm/vm_purgeable_xnu.h>
 #include <vm/vm_pageout.h>
 #include <vm/vm_kern_xnu.h>
+#include <vm/vm_lpage_internal.h>
 
 #include <IOKit/IOBSD.h> // IOTaskHasEntitlement
 #include <IOKit/IOKitKeys.h> // DriverKit entitlement strings
@@ -594,11 +595,13 @@ static LCK_MTX_DECLARE(host_statistics_lck, &host_statistics_lck_grp);
 #define HOST_EXPIRED_TASK_INFO_REV1     9
 #define HOST_VM_COMPRESSOR_Q_LEN_REV0   10
 #define HOST_VM_INFO64_REV2             11
-#define NUM_HOST_INFO_DATA_TYPES        12
+#define HOST_VM_INFO64_REV3             12
+#define NUM_HOST_INFO_DATA_TYPES        13
 
 static vm_statistics64_data_t host_vm_info64_rev0 = {};
 static vm_statistics64_data_t host_vm_info64_rev1 = {};
 static vm_statistics64_data_t host_vm_info64_rev2 = {};
+static vm_statistics64_data_t host_vm_info64_rev3 = {};
 static vm_extmod_statistics_data_t host_extmod_info64 = {};
 static host_load_info_data_t host_load_info = {};
 static vm_statistics_data_t host_vm_info_rev0 = {};
@@ -630,6 +633,7 @@ static struct host_stats_cache g_host_stats_cache[NUM_HOST_INFO_DATA_TYPES] = {
 	[HOST_EXPIRED_TASK_INFO_REV1] = { .last_access = 0, .current_requests = 0, .max_requests = 0, .data = (uintptr_t)&host_expired_task_info2, .count = TASK_POWER_INFO_V2_COUNT},
 	[HOST_VM_COMPRESSOR_Q_LEN_REV0] = { .last_access = 0, .current_requests = 0, .max_requests = 0, .data = (uintptr_t)&host_vm_compressor_q_lens, .count = VM_COMPRESSOR_Q_LENS_COUNT},
 	[HOST_VM_INFO64_REV2] = { .last_access = 0, .current_requests = 0, .max_requests = 0, .data = (uintptr_t)&host_vm_info64_rev2, .count = HOST_VM_INFO64_REV2_COUNT },
+	[HOST_VM_INFO64_REV3] = { .last_access = 0, .current_requests = 0, .max_requests = 0, .data = (uintptr_t)&host_vm_info64_rev3, .count = HOST_VM_INFO64_REV3_COUNT },
 };
 
 
@@ -679,6 +683,9 @@ get_host_info_data_index(bool is_stat64, host_flavor_t flavor, mach_msg_type_num
 			*ret = KERN_FAILURE;
 			return -1;
 		}
+		if (*count >= HOST_VM_INFO64_REV3_COUNT) {
+			return HOST_VM_INFO64_REV3;
+		}
 		if (*count >= HOST_VM_INFO64_REV2_COUNT) {
 			return HOST_VM_INFO64_REV2;
 		}
@@ -877,6 +884,17 @@ vm_stats(void *info, unsigned int *count)
 		stat->swapped_count = os_atomic_load(&vm_page_swapped_count, relaxed);
 		*count = HOST_VM_INFO64_REV2_COUNT;
 	}
+	if (original_count >= HOST_VM_INFO64_REV3_COUNT) {
+		/* rev3 added "large page" info */
+		struct vm_lpage_stats lpage_stats;
+
+		vm_lpage_stats(&lpage_stats);
+		stat->large_page_promotions = lpage_stats.vls_promotions;
+		stat->large_page_demotions = lpage_stats.vls_demotions;
+		stat->large_page_mappings = lpage_stats.vls_mappings;
+		stat->large_page_fault_allocs = lpage_stats.vls_fault_allocs;
+		*count = HOST_VM_INFO64_REV3_COUNT;
+	}
 
 	return KERN_SUCCESS;
 }
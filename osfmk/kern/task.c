@@ -2053,6 +2053,11 @@ task_rollup_accounting_info(task_t to_task, task_t from_task)
 	to_task->c_switch = from_task->c_switch;
 	to_task->p_switch = from_task->p_switch;
 	to_task->ps_switch = from_task->ps_switch;
+#if CONFIG_PHANTOM_CACHE
+	to_task->refaults = from_task->refaults;
+	to_task->refaults_protected = from_task->refaults_protected;
+	to_task->refault_distance = from_task->refault_distance;
+#endif /* CONFIG_PHANTOM_CACHE */
 	to_task->extmod_statistics = from_task->extmod_statistics;
 	to_task->low_mem_notified_warn = from_task->low_mem_notified_warn;
 	to_task->low_mem_notified_critical = from_task->low_mem_notified_critical;
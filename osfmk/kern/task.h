@@ -325,6 +325,11 @@ struct task {
 	uint32_t c_switch;            /* total context switches */
 	uint32_t p_switch;            /* total processor switches */
 	uint32_t ps_switch;           /* total pset switches */
+#if CONFIG_PHANTOM_CACHE
+	uint32_t refaults;            /* file pages read back in while in the phantom cache */
+	uint32_t refaults_protected;  /* refaults activated for being within the working set */
+	uint64_t refault_distance;    /* sum of the refault distances, in evictions */
+#endif /* CONFIG_PHANTOM_CACHE */
 
 #ifdef  MACH_BSD
 	struct proc_ro *                bsd_info_ro;
@@ -174,6 +174,11 @@ struct vm_statistics64 {
 	uint64_t        total_uncompressed_pages_in_compressor; /* # of pages (uncompressed) held within the compressor. */
 	/* added for rev2 */
 	uint64_t        swapped_count;          /* # of compressor-stored pages currently stored in swap */
+	/* added for rev3 */
+	uint64_t        large_page_promotions;  /* # of aligned runs mapped with a large page (lifetime) */
+	uint64_t        large_page_demotions;   /* # of large mappings split back into pages (lifetime) */
+	uint64_t        large_page_mappings;    /* # of large mappings currently in place */
+	uint64_t        large_page_fault_allocs; /* # of aligned runs populated by a zero-fill fault (lifetime) */
 } __attribute__((aligned(8)));
 
 typedef struct vm_statistics64  *vm_statistics64_t;
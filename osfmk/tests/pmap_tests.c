@@ -57,6 +57,7 @@ kern_return_t test_pmap_iommu_disconnect(void);
 kern_return_t test_pmap_extended(void);
 void test_pmap_call_overhead(unsigned int num_loops);
 uint64_t test_pmap_page_protect_overhead(unsigned int num_loops, unsigned int num_aliases);
+uint64_t test_pmap_refmod_batch_overhead(unsigned int num_loops, unsigned int num_pages, bool batched);
 #if CONFIG_SPTM
 kern_return_t test_pmap_huge_pv_list(unsigned int num_loops, unsigned int num_mappings);
 kern_return_t test_pmap_reentrance(unsigned int num_loops);
@@ -586,6 +587,75 @@ ppo_cleanup:
 	return duration;
 }
 
+#define PMAP_TEST_REFMOD_MAX_PAGES 64
+
+uint64_t
+test_pmap_refmod_batch_overhead(unsigned int num_loops __unused, unsigned int num_pages __unused, bool batched __unused)
+{
+	uint64_t duration = 0;
+#if defined(__arm64__)
+	pmap_t new_pmap = pmap_create_wrapper(0);
+	vm_page_t pages[PMAP_TEST_REFMOD_MAX_PAGES] = { VM_PAGE_NULL };
+	ppnum_t pns[PMAP_TEST_REFMOD_MAX_PAGES];
+	unsigned int refmod[PMAP_TEST_REFMOD_MAX_PAGES];
+	kern_return_t kr = KERN_SUCCESS;
+
+	if (num_pages > PMAP_TEST_REFMOD_MAX_PAGES) {
+		num_pages = PMAP_TEST_REFMOD_MAX_PAGES;
+	}
+	if (new_pmap == NULL) {
+		goto prb_cleanup;
+	}
+	for (unsigned int i = 0; i < num_pages; ++i) {
+		pages[i] = pmap_test_alloc_vm_page();
+		if (pages[i] == VM_PAGE_NULL) {
+			goto prb_cleanup;
+		}
+		pns[i] = VM_PAGE_GET_PHYS_PAGE(pages[i]);
+	}
+
+	for (unsigned int loop = 0; loop < num_loops; ++loop) {
+		/* a read fault type leaves every page referenced */
+		for (unsigned int i = 0; i < num_pages; ++i) {
+			kr = pmap_enter(new_pmap, PMAP_TEST_VA + (PAGE_SIZE * i), pns[i],
+			    VM_PROT_READ, VM_PROT_READ, VM_WIMG_USE_DEFAULT, FALSE, PMAP_MAPPING_TYPE_INFER);
+			assert(kr == KERN_SUCCESS);
+		}
+
+		uint64_t start_time = mach_absolute_time();
+
+		if (batched) {
+			pmap_clear_refmod_batch(pns, refmod, num_pages, VM_MEM_REFERENCED, 0);
+		} else {
+			for (unsigned int i = 0; i < num_pages; ++i) {
+				refmod[i] = pmap_get_refmod(pns[i]);
+				if (refmod[i] & VM_MEM_REFERENCED) {
+					pmap_clear_refmod(pns[i], VM_MEM_REFERENCED);
+				}
+			}
+		}
+
+		duration += (mach_absolute_time() - start_time);
+
+		for (unsigned int i = 0; i < num_pages; ++i) {
+			assert(refmod[i] & VM_MEM_REFERENCED);
+			assert(!(pmap_get_refmod(pns[i]) & VM_MEM_REFERENCED));
+		}
+
+		pmap_remove(new_pmap, PMAP_TEST_VA, PMAP_TEST_VA + (num_pages * PAGE_SIZE));
+	}
+
+prb_cleanup:
+	for (unsigned int i = 0; i < num_pages; ++i) {
+		pmap_test_free_vm_page(pages[i]);
+	}
+	if (new_pmap != NULL) {
+		pmap_destroy(new_pmap);
+	}
+#endif
+	return duration;
+}
+
 #if CONFIG_SPTM
 
 typedef struct {
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Portable C implementation of the WKdm page compressor.
+ *
+ * The output is bit-identical to the hand written versions in
+ * osfmk/x86_64/WKdmCompress_new.s and osfmk/arm64/WKdmCompress_{4k,16k}.s,
+ * including the zero/single value page detection, the early abort
+ * checkpoint and the sparse (MZV) packer.  See WKdmCompress_new.s for a
+ * description of the algorithm and of the compressed stream format.
+ *
+ * The scan is inherently serial (each word updates the dictionary), so
+ * vector code is only used where it pays off independently of the
+ * dictionary: skipping runs of zero words while tagging, and storing runs
+ * of zero words while decoding.  Tags and queue positions are packed and
+ * unpacked with the same 64-bit SWAR tricks the assembly uses.
+ *
+ * The vector paths are selected at compile time and are off in the kernel,
+ * where C code may not use the vector register file.  Userspace tools and
+ * tests that build this file get AVX2, SSE4.1 or NEON depending on the
+ * target flags.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "WKdm_new.h"
+
+#ifndef WKDM_GEN_SIMD
+#if KERNEL
+#define WKDM_GEN_SIMD 0
+#else
+#define WKDM_GEN_SIMD 1
+#endif
+#endif /* WKDM_GEN_SIMD */
+
+#if WKDM_GEN_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#define WKDM_GEN_AVX2 1
+#elif WKDM_GEN_SIMD && defined(__SSE4_1__)
+#include <smmintrin.h>
+#define WKDM_GEN_SSE4 1
+#elif WKDM_GEN_SIMD && defined(__ARM_NEON) && defined(__LP64__)
+#include <arm_neon.h>
+#define WKDM_GEN_NEON 1
+#endif
+
+#define WKDM_GEN_INLINE                 static inline __attribute__((__always_inline__))
+
+#define WKDM_GEN_DICTIONARY_SIZE        16
+#define WKDM_GEN_HEADER_SIZE_IN_WORDS   3
+#define WKDM_GEN_MZV_MAGIC              17185   /* identifies a page encoded by the sparse packer */
+#define WKDM_GEN_CHKPT_BYTES            416     /* early abort check after this many input bytes (x scale) */
+#define WKDM_GEN_CHKPT_WORDS            (WKDM_GEN_CHKPT_BYTES / 4)
+#define WKDM_GEN_CHKPT_TAG_BYTES        (WKDM_GEN_CHKPT_BYTES / 16)
+#define WKDM_GEN_CHKPT_SHRUNK_BYTES     426     /* max estimated output at the checkpoint (x scale) */
+
+/* input words examined per zero test; must divide WKDM_GEN_CHKPT_WORDS */
+#define WKDM_GEN_SCAN_BLOCK_WORDS       8
+/* output words covered by one packed tags word */
+#define WKDM_GEN_TAGS_PER_WORD          16
+
+_Static_assert(WKDM_GEN_CHKPT_WORDS % WKDM_GEN_SCAN_BLOCK_WORDS == 0,
+    "the early abort checkpoint must fall on a scan block boundary");
+
+enum {
+	WKDM_GEN_ZERO_TAG    = 0,
+	WKDM_GEN_PARTIAL_TAG = 1,
+	WKDM_GEN_MISS_TAG    = 2,
+	WKDM_GEN_EXACT_TAG   = 3,
+};
+
+/*
+ * Dictionary index for the 8 bits above the low 10 bits of a word.
+ * Same table as hashLookupTable{,_new} in the assembly, which stores byte
+ * offsets (index * 4) instead of indices.
+ */
+static const uint8_t WKdm_gen_hash_lookup[256] = {
+	0, 13, 2, 14, 4, 3, 7, 5, 1, 9, 12, 6, 11, 10, 8, 15,
+	2, 3, 7, 5, 1, 15, 4, 9, 6, 12, 11, 8, 13, 14, 10, 3,
+	2, 12, 4, 13, 15, 7, 14, 8, 5, 6, 9, 10, 11, 1, 2, 10,
+	15, 8, 5, 11, 1, 9, 13, 6, 4, 14, 12, 3, 7, 4, 2, 10,
+	9, 7, 8, 3, 1, 11, 13, 5, 6, 12, 15, 14, 10, 12, 2, 8,
+	7, 9, 1, 11, 5, 14, 15, 6, 13, 4, 3, 3, 1, 12, 5, 2,
+	13, 4, 15, 6, 9, 11, 7, 14, 10, 8, 9, 5, 6, 15, 10, 11,
+	13, 4, 8, 1, 12, 2, 7, 14, 3, 7, 8, 10, 13, 9, 4, 5,
+	12, 2, 1, 15, 6, 14, 11, 3, 2, 9, 6, 7, 4, 15, 5, 14,
+	8, 10, 12, 3, 1, 11, 13, 11, 10, 3, 14, 2, 9, 6, 15, 7,
+	12, 1, 8, 5, 4, 13, 15, 3, 6, 9, 2, 1, 4, 14, 12, 11,
+	10, 13, 8, 5, 7, 8, 3, 9, 7, 6, 14, 10, 4, 13, 11, 1,
+	5, 15, 2, 12, 12, 13, 3, 5, 8, 11, 9, 7, 1, 10, 6, 2,
+	14, 15, 4, 9, 8, 2, 10, 1, 13, 6, 11, 5, 3, 7, 12, 14,
+	4, 15, 1, 13, 15, 12, 5, 4, 14, 11, 6, 2, 10, 3, 8, 7,
+	9, 6, 8, 3, 1, 5, 4, 15, 9, 7, 2, 13, 10, 12, 11, 14,
+};
+
+WKDM_GEN_INLINE uint64_t
+wkdm_gen_load8(const void *ptr)
+{
+	uint64_t data;
+	__builtin_memcpy(&data, ptr, sizeof(data));
+	return data;
+}
+
+WKDM_GEN_INLINE void
+wkdm_gen_store8(void *ptr, uint64_t data)
+{
+	__builtin_memcpy(ptr, &data, sizeof(data));
+}
+
+WKDM_GEN_INLINE WK_word
+wkdm_gen_load4(const void *ptr)
+{
+	WK_word data;
+	__builtin_memcpy(&data, ptr, sizeof(data));
+	return data;
+}
+
+WKDM_GEN_INLINE void
+wkdm_gen_store4(void *ptr, WK_word data)
+{
+	__builtin_memcpy(ptr, &data, sizeof(data));
+}
+
+WKDM_GEN_INLINE uint16_t
+wkdm_gen_load2(const void *ptr)
+{
+	uint16_t data;
+	__builtin_memcpy(&data, ptr, sizeof(data));
+	return data;
+}
+
+WKDM_GEN_INLINE void
+wkdm_gen_store2(void *ptr, uint16_t data)
+{
+	__builtin_memcpy(ptr, &data, sizeof(data));
+}
+
+/* Return non-zero if the WKDM_GEN_SCAN_BLOCK_WORDS words at p are all zero. */
+WKDM_GEN_INLINE int
+wkdm_gen_block_is_zero(const WK_word *p)
+{
+#if WKDM_GEN_AVX2
+	__m256i v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+	return _mm256_testz_si256(v, v);
+#elif WKDM_GEN_SSE4
+	__m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(const void *)p),
+	    _mm_loadu_si128((const __m128i *)(const void *)(p + 4)));
+	return _mm_testz_si128(v, v);
+#elif WKDM_GEN_NEON
+	uint32x4_t v = vorrq_u32(vld1q_u32(p), vld1q_u32(p + 4));
+	return vmaxvq_u32(v) == 0;
+#else
+	return (wkdm_gen_load8(p) | wkdm_gen_load8(p + 2) |
+	       wkdm_gen_load8(p + 4) | wkdm_gen_load8(p + 6)) == 0;
+#endif
+}
+
+/* Clear the WKDM_GEN_TAGS_PER_WORD words at p. */
+WKDM_GEN_INLINE void
+wkdm_gen_zero_tag_run(WK_word *p)
+{
+#if WKDM_GEN_AVX2
+	__m256i z = _mm256_setzero_si256();
+	_mm256_storeu_si256((__m256i *)(void *)p, z);
+	_mm256_storeu_si256((__m256i *)(void *)(p + 8), z);
+#elif WKDM_GEN_SSE4
+	__m128i z = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i *)(void *)p, z);
+	_mm_storeu_si128((__m128i *)(void *)(p + 4), z);
+	_mm_storeu_si128((__m128i *)(void *)(p + 8), z);
+	_mm_storeu_si128((__m128i *)(void *)(p + 12), z);
+#elif WKDM_GEN_NEON
+	uint32x4_t z = vdupq_n_u32(0);
+	vst1q_u32(p, z);
+	vst1q_u32(p + 4, z);
+	vst1q_u32(p + 8, z);
+	vst1q_u32(p + 12, z);
+#else
+	for (unsigned int i = 0; i < WKDM_GEN_TAGS_PER_WORD; i += 2) {
+		wkdm_gen_store8(p + i, 0);
+	}
+#endif
+}
+
+/*
+ * Estimated size of the default encoding of what has been tagged so far,
+ * excluding header and tags: 2/3 of the bytes used by the 10-bit low bits,
+ * the full words, and half a byte per queue position.  Uses the same
+ * fixed point approximation of 2/3 as the assembly.
+ */
+WKDM_GEN_INLINE size_t
+wkdm_gen_estimate(size_t low_bits_bytes, size_t full_patt_bytes, size_t qpos_bytes)
+{
+	return ((low_bits_bytes * 1365) >> 11) + full_patt_bytes + (qpos_bytes >> 1);
+}
+
+WKDM_GEN_INLINE int
+WKdm_compress_gen_common(const WK_word *src_buf, WK_word *dest_buf,
+    WK_word *scratch, unsigned int limit, const unsigned int num_input_words)
+{
+	const unsigned int scale = num_input_words / 1024;
+	const unsigned int tags_area_words = num_input_words / WKDM_GEN_TAGS_PER_WORD;
+	const unsigned int fixed_bytes = 4 * (WKDM_GEN_HEADER_SIZE_IN_WORDS + tags_area_words);
+	WK_word dictionary[WKDM_GEN_DICTIONARY_SIZE] = { 0 };
+
+	/*
+	 * scratch layout, same as the assembly:
+	 *	[0, n)          tags, one per byte
+	 *	[n, 2n)         queue positions, one per byte
+	 *	[2n, 4n)        low bits, one per half word
+	 */
+	uint8_t *const tempTagsArray = (uint8_t *)scratch;
+	uint8_t *const tempQPosArray = tempTagsArray + num_input_words;
+	uint16_t *const tempLowBitsArray = (uint16_t *)(void *)(tempQPosArray + num_input_words);
+
+	uint8_t *next_tag = tempTagsArray;
+	uint8_t *next_qp = tempQPosArray;
+	uint16_t *next_low_bits = tempLowBitsArray;
+	WK_word *const start_next_full_patt = dest_buf + WKDM_GEN_HEADER_SIZE_IN_WORDS + tags_area_words;
+	WK_word *next_full_patt = start_next_full_patt;
+
+	const WK_word *next_input_word = src_buf;
+	const WK_word *const end_of_input = src_buf + num_input_words;
+	const WK_word *checkpoint = src_buf + WKDM_GEN_CHKPT_WORDS * scale;
+
+	int32_t byte_count = (int32_t)limit - (int32_t)fixed_bytes;
+	if (byte_count <= 0) {
+		return -1;
+	}
+
+	for (;;) {
+		while (next_input_word < checkpoint) {
+			if (wkdm_gen_block_is_zero(next_input_word)) {
+				wkdm_gen_store8(next_tag, 0);
+				next_tag += WKDM_GEN_SCAN_BLOCK_WORDS;
+				next_input_word += WKDM_GEN_SCAN_BLOCK_WORDS;
+				continue;
+			}
+
+			for (unsigned int i = 0; i < WKDM_GEN_SCAN_BLOCK_WORDS; i++) {
+				WK_word input_word = *next_input_word++;
+
+				if (input_word == 0) {
+					*next_tag++ = WKDM_GEN_ZERO_TAG;
+					continue;
+				}
+
+				uint8_t dict_index = WKdm_gen_hash_lookup[(input_word >> 10) & 0xff];
+				WK_word dict_word = dictionary[dict_index];
+
+				if (dict_word == input_word) {
+					*next_tag++ = WKDM_GEN_EXACT_TAG;
+					*next_qp++ = dict_index;
+				} else if (((input_word ^ dict_word) >> 10) == 0) {
+					*next_tag++ = WKDM_GEN_PARTIAL_TAG;
+					*next_qp++ = dict_index;
+					*next_low_bits++ = (uint16_t)(input_word & 0x3ff);
+					dictionary[dict_index] = input_word;
+				} else {
+					byte_count -= 4;
+					if (byte_count <= 0) {
+						return -1;
+					}
+					*next_tag++ = WKDM_GEN_MISS_TAG;
+					*next_full_patt++ = input_word;
+					dictionary[dict_index] = input_word;
+				}
+			}
+		}
+
+		if (checkpoint == end_of_input) {
+			break;
+		}
+
+		/* early abort if the first few hundred bytes do not shrink enough */
+		size_t estimate = wkdm_gen_estimate(
+			(size_t)((uint8_t *)next_low_bits - (uint8_t *)tempLowBitsArray),
+			(size_t)((uint8_t *)next_full_patt - (uint8_t *)start_next_full_patt),
+			(size_t)(next_qp - tempQPosArray));
+		if (estimate + WKDM_GEN_CHKPT_TAG_BYTES * scale > WKDM_GEN_CHKPT_SHRUNK_BYTES * scale) {
+			return -1;
+		}
+		checkpoint = end_of_input;
+	}
+
+	const size_t misses = (size_t)(next_full_patt - start_next_full_patt);
+	const size_t hits = (size_t)(next_qp - tempQPosArray);
+	const size_t partials = (size_t)(next_low_bits - tempLowBitsArray);
+
+	/* zero page */
+	if (misses == 0 && hits == 0) {
+		return 0;
+	}
+
+	/*
+	 * single value page: either the first word missed and all the others
+	 * matched exactly, or the first word was a partial match against the
+	 * zeroed dictionary and all the others matched exactly.
+	 */
+	if ((partials == 0 && hits == num_input_words - 1 && misses == 1 &&
+	    tempTagsArray[0] == WKDM_GEN_MISS_TAG) ||
+	    (partials == 1 && hits == num_input_words &&
+	    tempTagsArray[0] == WKDM_GEN_PARTIAL_TAG)) {
+		return 0;
+	}
+
+	/* mostly zero page: is the sparse packer smaller than the default one? */
+	const size_t sparse_bytes = (misses + hits) * 6 + 4;
+	const size_t default_bytes = wkdm_gen_estimate(partials * 2, misses * 4, hits) + fixed_bytes;
+
+	if (default_bytes >= sparse_bytes) {
+		if (sparse_bytes > limit) {
+			return -1;
+		}
+
+		uint8_t *next_sparse = (uint8_t *)dest_buf;
+
+		wkdm_gen_store4(next_sparse, WKDM_GEN_MZV_MAGIC);
+		next_sparse += 4;
+
+		for (unsigned int i = 0; i < num_input_words; i += WKDM_GEN_SCAN_BLOCK_WORDS) {
+			if (wkdm_gen_block_is_zero(src_buf + i)) {
+				continue;
+			}
+			for (unsigned int j = i; j < i + WKDM_GEN_SCAN_BLOCK_WORDS; j++) {
+				if (src_buf[j] != 0) {
+					wkdm_gen_store4(next_sparse, src_buf[j]);
+					wkdm_gen_store2(next_sparse + 4, (uint16_t)(j * sizeof(WK_word)));
+					next_sparse += 6;
+				}
+			}
+		}
+		return (int)sparse_bytes;
+	}
+
+	/* default packer */
+	dest_buf[0] = (WK_word)(next_full_patt - dest_buf);
+
+	/* tags, 16 per word: byte j of the word holds tags j, j+4, j+8, j+12 */
+	WK_word *next_tags_word = dest_buf + WKDM_GEN_HEADER_SIZE_IN_WORDS;
+	for (const uint8_t *t = tempTagsArray; t < next_tag; t += WKDM_GEN_TAGS_PER_WORD) {
+		uint64_t x = wkdm_gen_load8(t) | (wkdm_gen_load8(t + 8) << 4);
+		*next_tags_word++ = (WK_word)(x | (x >> 30));
+	}
+
+	/* queue positions, 8 per word: byte j of the word holds positions j, j+4 */
+	size_t num_packed_words = (hits + 7) >> 3;
+	byte_count -= (int32_t)(num_packed_words * 4);
+	if (byte_count < 0) {
+		return -1;
+	}
+	uint8_t *const endQPosArray = tempQPosArray + num_packed_words * 8;
+	while (next_qp < endQPosArray) {
+		*next_qp++ = 0;
+	}
+
+	WK_word *boundary_tmp = next_full_patt;
+	for (const uint8_t *q = tempQPosArray; q < endQPosArray; q += 8) {
+		uint64_t x = wkdm_gen_load8(q);
+		*boundary_tmp++ = (WK_word)(x | (x >> 28));
+	}
+	dest_buf[1] = (WK_word)(boundary_tmp - dest_buf);
+
+	/* low bits, 3 per word */
+	const uint16_t *lb = tempLowBitsArray;
+	size_t remaining = partials;
+	while (remaining >= 3) {
+		byte_count -= 4;
+		if (byte_count <= 0) {
+			return -1;
+		}
+		*boundary_tmp++ = (WK_word)lb[0] | ((WK_word)lb[1] << 10) | ((WK_word)lb[2] << 20);
+		lb += 3;
+		remaining -= 3;
+	}
+	if (remaining != 0) {
+		byte_count -= 4;
+		if (byte_count <= 0) {
+			return -1;
+		}
+		WK_word w = lb[0];
+		if (remaining == 2) {
+			w |= (WK_word)lb[1] << 10;
+		}
+		*boundary_tmp++ = w;
+	}
+	dest_buf[2] = (WK_word)(boundary_tmp - dest_buf);
+
+	return (int)((boundary_tmp - dest_buf) * sizeof(WK_word));
+}
+
+WKDM_GEN_INLINE void
+WKdm_decompress_gen_common(const WK_word *src_buf, WK_word *dest_buf,
+    WK_word *scratch, unsigned int bytes, const unsigned int num_output_words)
+{
+	const unsigned int tags_area_words = num_output_words / WKDM_GEN_TAGS_PER_WORD;
+
+	if (src_buf[0] == WKDM_GEN_MZV_MAGIC) {
+		const uint8_t *src = (const uint8_t *)src_buf;
+
+		for (unsigned int i = 0; i < num_output_words; i += WKDM_GEN_TAGS_PER_WORD) {
+			wkdm_gen_zero_tag_run(dest_buf + i);
+		}
+		for (unsigned int off = 4; off + 6 <= bytes; off += 6) {
+			uint16_t index = wkdm_gen_load2(src + off + 4);
+			if (index <= (num_output_words - 1) * sizeof(WK_word)) {
+				wkdm_gen_store4((uint8_t *)dest_buf + index, wkdm_gen_load4(src + off));
+			}
+		}
+		return;
+	}
+
+	WK_word dictionary[WKDM_GEN_DICTIONARY_SIZE] = { 0 };
+	uint8_t *const tempQPosArray = (uint8_t *)scratch + num_output_words;
+	uint16_t *const tempLowBitsArray = (uint16_t *)(void *)(tempQPosArray + num_output_words);
+
+	const WK_word *const tags_area = src_buf + WKDM_GEN_HEADER_SIZE_IN_WORDS;
+	const WK_word *const full_patt_end = src_buf + src_buf[0];
+	const WK_word *const qpos_end = src_buf + src_buf[1];
+	const WK_word *const low_bits_end = src_buf + src_buf[2];
+
+	/* queue positions: inverse of the packing in the compressor */
+	uint8_t *next_qp = tempQPosArray;
+	for (const WK_word *w = full_patt_end; w < qpos_end &&
+	    next_qp < tempQPosArray + num_output_words; w++) {
+		uint64_t x = ((uint64_t)*w << 28) | *w;
+		wkdm_gen_store8(next_qp, x & 0x0f0f0f0f0f0f0f0fULL);
+		next_qp += 8;
+	}
+
+	uint16_t *next_low_bits = tempLowBitsArray;
+	uint16_t *const low_bits_limit = tempLowBitsArray + num_output_words;
+	for (const WK_word *w = qpos_end; w < low_bits_end && next_low_bits < low_bits_limit; w++) {
+		next_low_bits[0] = (uint16_t)(*w & 0x3ff);
+		if (next_low_bits + 1 < low_bits_limit) {
+			next_low_bits[1] = (uint16_t)((*w >> 10) & 0x3ff);
+		}
+		if (next_low_bits + 2 < low_bits_limit) {
+			next_low_bits[2] = (uint16_t)((*w >> 20) & 0x3ff);
+		}
+		next_low_bits += 3;
+	}
+
+	const WK_word *next_full_patt = tags_area + tags_area_words;
+	const uint8_t *next_qpos = tempQPosArray;
+	const uint16_t *next_low = tempLowBitsArray;
+	WK_word *next_output = dest_buf;
+
+	for (unsigned int i = 0; i < tags_area_words; i++, next_output += WKDM_GEN_TAGS_PER_WORD) {
+		WK_word packed = tags_area[i];
+
+		if (packed == 0) {
+			wkdm_gen_zero_tag_run(next_output);
+			continue;
+		}
+
+		uint8_t tags[WKDM_GEN_TAGS_PER_WORD];
+		uint64_t x = ((uint64_t)(packed >> 2) << 32) | packed;
+		wkdm_gen_store8(&tags[0], x & 0x0303030303030303ULL);
+		wkdm_gen_store8(&tags[8], (x >> 4) & 0x0303030303030303ULL);
+
+		for (unsigned int j = 0; j < WKDM_GEN_TAGS_PER_WORD; j++) {
+			WK_word w;
+
+			switch (tags[j]) {
+			case WKDM_GEN_ZERO_TAG:
+				w = 0;
+				break;
+			case WKDM_GEN_EXACT_TAG:
+				w = dictionary[*next_qpos++ & 0xf];
+				break;
+			case WKDM_GEN_PARTIAL_TAG: {
+				uint8_t dict_index = *next_qpos++ & 0xf;
+				w = (dictionary[dict_index] & ~(WK_word)0x3ff) | *next_low++;
+				dictionary[dict_index] = w;
+				break;
+			}
+			default:
+				w = *next_full_patt++;
+				dictionary[WKdm_gen_hash_lookup[(w >> 10) & 0xff]] = w;
+				break;
+			}
+			next_output[j] = w;
+		}
+	}
+}
+
+int
+WKdm_compress_gen(const WK_word *src_buf, WK_word *dest_buf, WK_word *scratch,
+    unsigned int limit, unsigned int page_size)
+{
+	if (page_size == 4096) {
+		return WKdm_compress_gen_common(src_buf, dest_buf, scratch, limit, 4096 / sizeof(WK_word));
+	}
+	return WKdm_compress_gen_common(src_buf, dest_buf, scratch, limit, 16384 / sizeof(WK_word));
+}
+
+void
+WKdm_decompress_gen(const WK_word *src_buf, WK_word *dest_buf, WK_word *scratch,
+    unsigned int bytes, unsigned int page_size)
+{
+	if (page_size == 4096) {
+		WKdm_decompress_gen_common(src_buf, dest_buf, scratch, bytes, 4096 / sizeof(WK_word));
+	} else {
+		WKdm_decompress_gen_common(src_buf, dest_buf, scratch, bytes, 16384 / sizeof(WK_word));
+	}
+}
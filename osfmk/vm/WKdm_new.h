@@ -110,6 +110,24 @@ WKdm_compress_new(const WK_word* src_buf,
     unsigned int limit);
 #endif
 
+/*
+ * Portable C implementation (WKdm_gen.c), bit-identical to the assembly
+ * above.  page_size must be 4096 or 16384; scratch must be page_size bytes.
+ */
+int
+WKdm_compress_gen(const WK_word* src_buf,
+    WK_word* dest_buf,
+    WK_word* scratch,
+    unsigned int limit,
+    unsigned int page_size);
+
+void
+WKdm_decompress_gen(const WK_word* src_buf,
+    WK_word* dest_buf,
+    WK_word* scratch,
+    unsigned int bytes,
+    unsigned int page_size);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
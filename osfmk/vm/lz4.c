@@ -43,13 +43,17 @@ lz4raw_decode_buffer(uint8_t * __restrict dst_buffer, size_t dst_size,
 	uint8_t * dst = dst_buffer;
 
 	// Go fast if we can, keeping away from the end of buffers
-#if LZ4_ENABLE_ASSEMBLY_DECODE
 	if (dst_size > LZ4_GOFAST_SAFETY_MARGIN && src_size > LZ4_GOFAST_SAFETY_MARGIN) {
+#if LZ4_ENABLE_ASSEMBLY_DECODE
 		if (lz4_decode_asm(&dst, dst_buffer, dst_buffer + dst_size - LZ4_GOFAST_SAFETY_MARGIN, &src, src_buffer + src_size - LZ4_GOFAST_SAFETY_MARGIN)) {
 			return 0; // FAIL
 		}
-	}
+#else
+		if (lz4_decode_fast(&dst, dst_buffer, dst_buffer + dst_size - LZ4_GOFAST_SAFETY_MARGIN, &src, src_buffer + src_size - LZ4_GOFAST_SAFETY_MARGIN)) {
+			return 0; // FAIL
+		}
 #endif
+	}
 //DRKTODO: Can the 'C' "safety" decode be eliminated for 4/16K fixed-sized buffers?
 
 	// Finish safe
@@ -72,11 +76,20 @@ lz4raw_decode_buffer(uint8_t * __restrict dst_buffer, size_t dst_size,
 #if defined(__x86_64__) || defined(__x86_64h__)
 # define LZ4_MATCH_SEARCH_INIT_SIZE 32
 # define LZ4_MATCH_SEARCH_LOOP_SIZE 32
+# if !KERNEL && defined(__AVX2__)
+#  define LZ4_SIMD_MATCH_AVX2 1
+# elif !KERNEL && defined(__SSE2__)
+#  define LZ4_SIMD_MATCH_SSE2 1
+# endif
 #else
 # define LZ4_MATCH_SEARCH_INIT_SIZE 8
 # define LZ4_MATCH_SEARCH_LOOP_SIZE 8
 #endif
 
+#if LZ4_SIMD_MATCH_AVX2 || LZ4_SIMD_MATCH_SSE2
+#include <immintrin.h>
+#endif
+
 // Return hash for 4-byte sequence X
 static inline uint32_t
 lz4_hash(uint32_t x)
@@ -117,11 +130,24 @@ lz4_nmatch16(const uint8_t * a, const uint8_t * b)
 }
 
 // Return number of matching bytes 0..32 at positions A and B.
+// Userspace builds compare the whole window with one vector compare; the kernel
+// can't touch vector registers here and uses the 8-byte scalar steps.
 static inline size_t
 lz4_nmatch32(const uint8_t * a, const uint8_t * b)
 {
+#if LZ4_SIMD_MATCH_AVX2
+	__m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)a), _mm256_loadu_si256((const __m256i *)b));
+	uint32_t ne = ~(uint32_t)_mm256_movemask_epi8(eq);
+	return (ne == 0)?32:__builtin_ctz(ne);
+#elif LZ4_SIMD_MATCH_SSE2
+	__m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+	__m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16)));
+	uint32_t ne = ~((uint32_t)_mm_movemask_epi8(eq0) | (uint32_t)_mm_movemask_epi8(eq1) << 16);
+	return (ne == 0)?32:__builtin_ctz(ne);
+#else
 	size_t n = lz4_nmatch16(a, b);
 	return (n == 16)?(16 + lz4_nmatch16(a + 16, b + 16)):n;
+#endif
 }
 
 // Return number of matching bytes 0..64 at positions A and B.
@@ -257,10 +283,13 @@ lz4_encode_2gb(uint8_t ** dst_ptr,
 		ptrdiff_t match_distance = 0;
 		for (match_begin = src; match_begin < src_end; match_begin += 1) {
 			const uint32_t pos = (uint32_t)(match_begin - src_begin);
-			const uint32_t w0 = load4(match_begin);
-			const uint32_t w1 = load4(match_begin + 1);
-			const uint32_t w2 = load4(match_begin + 2);
-			const uint32_t w3 = load4(match_begin + 3);
+			// The four candidate words overlap: derive them from one 8-byte load.
+			// Reads at most 7 bytes past match_begin, well inside the safety margin.
+			const uint64_t w = load8(match_begin);
+			const uint32_t w0 = (uint32_t)w;
+			const uint32_t w1 = (uint32_t)(w >> 8);
+			const uint32_t w2 = (uint32_t)(w >> 16);
+			const uint32_t w3 = (uint32_t)(w >> 24);
 			const int i0 = lz4_hash(w0);
 			const int i1 = lz4_hash(w1);
 			const int i2 = lz4_hash(w2);
@@ -606,3 +635,182 @@ OUT_FAIL:
 IN_FAIL:
 	return 1; // FAIL
 }
+
+#pragma mark - Wild copy decoder
+
+#if !KERNEL && defined(__SSSE3__)
+#include <tmmintrin.h>
+#define LZ4_SIMD_DECODE_SSSE3 1
+#endif
+
+// Pattern for matches with distance D < 16: byte i of the 32-byte pattern is ref[i % D]
+static const uint8_t lz4_match_permtable[16][32] __attribute__((aligned(64))) = {
+	{  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+	{  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+	{  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,
+	   0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1,  0,  1 },
+	{  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,
+	   1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1,  2,  0,  1 },
+	{  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,
+	   0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+	{  0,  1,  2,  3,  4,  0,  1,  2,  3,  4,  0,  1,  2,  3,  4,  0,
+	   1,  2,  3,  4,  0,  1,  2,  3,  4,  0,  1,  2,  3,  4,  0,  1 },
+	{  0,  1,  2,  3,  4,  5,  0,  1,  2,  3,  4,  5,  0,  1,  2,  3,
+	   4,  5,  0,  1,  2,  3,  4,  5,  0,  1,  2,  3,  4,  5,  0,  1 },
+	{  0,  1,  2,  3,  4,  5,  6,  0,  1,  2,  3,  4,  5,  6,  0,  1,
+	   2,  3,  4,  5,  6,  0,  1,  2,  3,  4,  5,  6,  0,  1,  2,  3 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  0,  1,  2,  3,  4,  5,  6,  7,
+	   0,  1,  2,  3,  4,  5,  6,  7,  0,  1,  2,  3,  4,  5,  6,  7 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  0,  1,  2,  3,  4,  5,  6,
+	   7,  8,  0,  1,  2,  3,  4,  5,  6,  7,  8,  0,  1,  2,  3,  4 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  1,  2,  3,  4,  5,
+	   6,  7,  8,  9,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  1 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10,  0,  1,  2,  3,  4,
+	   5,  6,  7,  8,  9, 10,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3,
+	   4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3,  4,  5,  6,  7 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12,  0,  1,  2,
+	   3,  4,  5,  6,  7,  8,  9, 10, 11, 12,  0,  1,  2,  3,  4,  5 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13,  0,  1,
+	   2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13,  0,  1,  2,  3 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  0,
+	   1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  0,  1 },
+};
+
+// Usable length of the 32-byte pattern: the largest multiple of D that is <= 32
+static const uint8_t lz4_match_disttable[16] = {
+	32, 32, 32, 30, 32, 30, 30, 28, 32, 27, 30, 22, 24, 26, 28, 30
+};
+
+// Replicate the first D bytes at REF (D < 16) into PATTERN
+static inline void
+lz4_match_pattern(uint8_t pattern[32], const uint8_t * ref, uint64_t D)
+{
+	const uint8_t * perm = lz4_match_permtable[D];
+#if LZ4_SIMD_DECODE_SSSE3
+	__m128i x = _mm_loadu_si128((const __m128i *)ref);
+	_mm_storeu_si128((__m128i *)pattern, _mm_shuffle_epi8(x, _mm_load_si128((const __m128i *)perm)));
+	_mm_storeu_si128((__m128i *)(pattern + 16), _mm_shuffle_epi8(x, _mm_load_si128((const __m128i *)(perm + 16))));
+#else
+	for (int i = 0; i < 32; i++) {
+		pattern[i] = ref[perm[i]];
+	}
+#endif
+}
+
+int
+lz4_decode_fast(uint8_t ** dst_ptr,
+    uint8_t * dst_begin,
+    uint8_t * dst_end,
+    const uint8_t ** src_ptr,
+    const uint8_t * src_end)
+{
+	uint8_t * dst = *dst_ptr;
+	const uint8_t * src = *src_ptr;
+	uint8_t pattern[32] __attribute__((aligned(32)));
+
+	for (;;) {
+		// Keep last good position
+		*src_ptr = src;
+		*dst_ptr = dst;
+
+		if (__improbable(src >= src_end || dst >= dst_end)) {
+			return 0;
+		}
+
+		uint8_t cmd = *src++;                   // 1 byte encoding literal+(match-4) length: LLLLMMMM
+		size_t literalLength = cmd >> 4;        // 0..15
+		size_t matchLength = 4 + (cmd & 15);    // 4..19
+
+		if (__probable(literalLength < 15)) {
+			// Short literal: one 16-byte copy covers it
+			copy16(dst, src);
+			src += literalLength;
+			dst += literalLength;
+		} else {
+			uint8_t s;
+			do {
+				if (__improbable(src >= src_end)) {
+					return 0;
+				}
+				s = *src++;
+				literalLength += s;
+			} while (__improbable(s == 255));
+
+			// Both ends must stay ahead of the literal, we may loop an arbitrary number of times
+			if (__improbable(literalLength >= (size_t)(src_end - src) ||
+			    literalLength >= (size_t)(dst_end - dst))) {
+				return 0;
+			}
+			const uint8_t * copy_src = src;
+			uint8_t * copy_dst = dst;
+			src += literalLength;
+			dst += literalLength;
+			copy32(copy_dst, copy_src);
+			copy32(copy_dst + 32, copy_src + 32);
+			copy_dst += 64; copy_src += 64;
+			while (copy_dst < dst) {
+				copy32(copy_dst, copy_src);
+				copy_dst += 32; copy_src += 32;
+			}
+		}
+
+		// match distance
+		uint64_t matchDistance = load2(src);    // 0x0000 <= matchDistance <= 0xffff
+		src += 2;
+		if (__improbable(matchDistance == 0 || matchDistance > (size_t)(dst - dst_begin))) {
+			return -1;                      // 0x0000 invalid, or out of range
+		}
+		const uint8_t * ref = dst - matchDistance;
+
+		// extra bytes for matchLength
+		if (__improbable(matchLength == 19)) {
+			uint8_t s;
+			do {
+				if (__improbable(src >= src_end)) {
+					return 0;
+				}
+				s = *src++;
+				matchLength += s;
+			} while (__improbable(s == 255));
+		}
+
+		if (__probable(matchLength <= 16)) {
+			// Short match: one 16-byte store
+			if (matchDistance >= 16) {
+				copy16(dst, ref);
+			} else {
+				lz4_match_pattern(pattern, ref, matchDistance);
+				copy16(dst, pattern);
+			}
+			dst += matchLength;
+			continue;
+		}
+
+		// Long match
+		if (__improbable(matchLength >= (size_t)(dst_end - dst))) {
+			return 0;
+		}
+		uint8_t * copy_dst = dst;
+		dst += matchLength;
+		if (matchDistance >= 16) {
+			// 16-byte steps, so that every load reads bytes stored by a previous step
+			copy16(copy_dst, ref);
+			copy_dst += 16; ref += 16;
+			while (copy_dst < dst) {
+				copy16(copy_dst, ref);
+				copy16(copy_dst + 16, ref + 16);
+				copy_dst += 32; ref += 32;
+			}
+		} else {
+			lz4_match_pattern(pattern, ref, matchDistance);
+			const size_t step = lz4_match_disttable[matchDistance];
+			do {
+				copy32(copy_dst, pattern);
+				copy_dst += step;
+			} while (copy_dst < dst);
+		}
+	}
+}
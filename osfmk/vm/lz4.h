@@ -29,8 +29,16 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#if KERNEL
 #include <kern/assert.h>
+#else
+#include <assert.h>
+#endif
 #include <machine/limits.h>
+#if !defined(__probable) && !defined(__improbable)
+#define __probable(x)   __builtin_expect(!!(x), 1)
+#define __improbable(x) __builtin_expect(!!(x), 0)
+#endif
 #include "lz4_assembly_select.h"
 #include "lz4_constants.h"
 
@@ -63,6 +71,14 @@ extern void lz4_encode_2gb(uint8_t **dst_ptr, size_t dst_size,
 extern int lz4_decode(uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
     const uint8_t **src_ptr, const uint8_t *src_end);
 
+// Same contract as lz4_decode_asm: DST_END and SRC_END are "relaxed" ends, at least
+// LZ4_GOFAST_SAFETY_MARGIN bytes before the real ones, and copies may run past them.
+// Stops at the first command that would cross a relaxed end; on return *DST_PTR and
+// *SRC_PTR point to that command, and lz4_decode finishes the buffer safely from there.
+// Return 0 on success, and -1 on invalid input.
+extern int lz4_decode_fast(uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
+    const uint8_t **src_ptr, const uint8_t *src_end);
+
 #if LZ4_ENABLE_ASSEMBLY_DECODE
 extern int lz4_decode_asm(uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
     const uint8_t **src_ptr, const uint8_t *src_end);
@@ -636,6 +636,23 @@ pmap_clear_refmod_range_options(
 	unsigned int mask,
 	unsigned int options);
 
+/*
+ * Harvests the reference and modified bits of a batch of physical pages.
+ * refmod[i] receives what pmap_get_refmod(pns[i]) would return, and the
+ * bits in "mask" are then cleared on every page that had any of them set.
+ * Rather than waiting for a TLB flush on every page, the invalidations
+ * are issued as the pages are visited and waited for once for the whole
+ * batch; PMAP_OPTIONS_NOFLUSH skips them altogether, which is only
+ * allowed when clearing the reference bit.
+ */
+extern void
+pmap_clear_refmod_batch(
+	const ppnum_t *pns,
+	unsigned int *refmod,
+	unsigned int count,
+	unsigned int mask,
+	unsigned int options);
+
 
 extern void pmap_flush_context_init(pmap_flush_context *);
 extern void pmap_flush(pmap_flush_context *);
@@ -690,6 +707,20 @@ extern kern_return_t pmap_unnest_options(pmap_t,
     unsigned int);
 extern boolean_t pmap_adjust_unnest_parameters(pmap_t, vm_map_offset_t *, vm_map_offset_t *);
 extern void             pmap_advise_pagezero_range(pmap_t, uint64_t);
+
+#if __x86_64__
+/*
+ * Replaces the base mappings of the naturally aligned large page containing
+ * "va" with a single large mapping.  This only succeeds when every base page
+ * of the run is mapped, the pages are physically contiguous from an aligned
+ * base, and their mappings carry identical, unwired attributes; any later
+ * change to one of the base pages splits the mapping again.
+ * Returns KERN_NOT_SUPPORTED for pmaps that cannot be promoted.
+ */
+extern kern_return_t    pmap_promote_large(pmap_t pmap, vm_map_offset_t va);
+extern void             pmap_large_page_stats(uint64_t *promotions,
+    uint64_t *demotions, uint64_t *mappings);
+#endif /* __x86_64__ */
 #endif  /* MACH_KERNEL_PRIVATE */
 
 extern boolean_t        pmap_is_noencrypt(ppnum_t);
@@ -201,6 +201,15 @@ vmc_hash(char *cp, int len)
 #define UNPACK_C_SIZE(cs)       ((cs->c_size == (PAGE_SIZE-1)) ? PAGE_SIZE : cs->c_size)
 #define PACK_C_SIZE(cs, size)   (cs->c_size = ((size == PAGE_SIZE) ? PAGE_SIZE - 1 : size))
 
+/*
+ * c_size of the slots holding a pattern page (c_slot.c_pattern set): the
+ * page repeats the C_SLOT_PATTERN*_SIZE bytes stored in the segment.
+ * A codec can produce these sizes too (WKdm does for a page with two
+ * non-zero words), so the size alone never identifies a pattern slot.
+ */
+#define C_SLOT_PATTERN8_SIZE    8
+#define C_SLOT_PATTERN16_SIZE   16
+
 
 struct c_sv_hash_entry {
 	union {
@@ -310,6 +319,13 @@ uint32_t        c_segment_svp_nonzero_compressions;
 uint32_t        c_segment_svp_zero_decompressions;
 uint32_t        c_segment_svp_nonzero_decompressions;
 
+uint64_t        c_segment_pattern_scanned;
+uint64_t        c_segment_pattern_zero;
+uint64_t        c_segment_pattern_value;
+uint64_t        c_segment_pattern8;
+uint64_t        c_segment_pattern16;
+uint64_t        c_segment_pattern_decompressions;
+
 uint32_t        c_segment_noncompressible_pages;
 
 uint32_t        c_segment_pages_compressed = 0; /* Tracks # of uncompressed pages fed into the compressor, including SV (single value) pages */
@@ -461,6 +477,19 @@ vm_compressor_get_swapped_segment_count(void)
 	return c_swappedout_count + c_swappedout_sparse_count;
 }
 
+void
+vm_compressor_pattern_page_info(struct c_pattern_page_info *info)
+{
+	bzero(info, sizeof(*info));
+	info->cppi_magic = VM_C_PATTERN_PAGE_INFO_MAGIC;
+	info->cppi_scanned = os_atomic_load(&c_segment_pattern_scanned, relaxed);
+	info->cppi_zero = os_atomic_load(&c_segment_pattern_zero, relaxed);
+	info->cppi_value = os_atomic_load(&c_segment_pattern_value, relaxed);
+	info->cppi_pattern8 = os_atomic_load(&c_segment_pattern8, relaxed);
+	info->cppi_pattern16 = os_atomic_load(&c_segment_pattern16, relaxed);
+	info->cppi_decompressions = os_atomic_load(&c_segment_pattern_decompressions, relaxed);
+}
+
 uint32_t
 vm_compressor_incore_fragmentation_wasted_pages(void)
 {
@@ -698,6 +727,9 @@ cslot_copy(c_slot_t cdst, c_slot_t csrc)
 #if defined(__arm64__)
 	cdst->c_codec = csrc->c_codec;
 #endif
+#if C_SLOT_C_PATTERN_BITS
+	cdst->c_pattern = csrc->c_pattern;
+#endif
 }
 
 #if XNU_TARGET_OS_OSX
@@ -4782,44 +4814,81 @@ c_compressed_record_data(char *src, int c_size)
 	memcpy(c_compressed_record_cptr, src, c_size);
 	c_compressed_record_cptr += c_size;
 }
+
+static void
+c_compressed_record_flush(void)
+{
+	if ((c_compressed_record_cptr - c_compressed_record_sbuf) >= c_seg_allocsize) {
+		c_compressed_record_write(c_compressed_record_sbuf, (int)(c_compressed_record_cptr - c_compressed_record_sbuf));
+		c_compressed_record_cptr = c_compressed_record_sbuf;
+	}
+}
 #endif
 
+/*
+ * Return the period (4, 8 or 16 bytes) with which the page repeats its first
+ * 16 bytes, or 0 if it doesn't, and the pattern in pattern[].
+ *
+ * The page is compared 64 bytes at a time against the pattern, with no
+ * branch inside a block, so that the compiler can use wide loads and
+ * compares; pages that aren't a pattern usually bail out on the first block.
+ */
+static uint32_t
+c_page_pattern_period(const char *src, uint64_t pattern[2])
+{
+	const uint64_t *words = (const uint64_t *)(uintptr_t)src;
+	const uint64_t p0 = words[0];
+	const uint64_t p1 = words[1];
+
+	for (unsigned int i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 8) {
+		uint64_t diff = 0;
+
+		for (unsigned int j = 0; j < 8; j += 2) {
+			diff |= (words[i + j] ^ p0) | (words[i + j + 1] ^ p1);
+		}
+		if (diff) {
+			return 0;
+		}
+	}
+	pattern[0] = p0;
+	pattern[1] = p1;
+
+	if (p0 != p1) {
+		return C_SLOT_PATTERN16_SIZE;
+	}
+	if ((uint32_t)p0 != (uint32_t)(p0 >> 32)) {
+		return C_SLOT_PATTERN8_SIZE;
+	}
+	return sizeof(uint32_t);
+}
+
 
 /**
- * Do the actual compression of the given page
+ * Compress one page into the filling c_seg returned by c_seg_allocate()
+ * @param c_seg [IN] current filling c_seg, locked, with c_nextslot allocated and buffer populated
  * @param src [IN] address in the physical aperture of the page to compress.
  * @param slot_ptr [OUT] fill the slot-mapping of the c_seg+slot where the page ends up being stored
- * @param current_chead [IN-OUT] current filling c_seg. pointer comes from the current compression thread state
- *          On the very first call this is going to point to NULL and this function will fill that pointer with a new
- *          filling c_sec if the current filling c_seg doesn't have enough space, it will be replaced in this location
- *          with a new filling c_seg
+ * @param current_chead [IN-OUT] current filling c_seg. Set to NULL if c_seg is finalized
  * @param scratch_buf [IN] pointer from the current thread state, used by the compression codec
- * @return KERN_RESOURCE_SHORTAGE if the compressor has been exhausted
+ * @param c_size_p [OUT] bytes written by the codec, or 0 if the page went to the single value hash
+ * @param c_rounded_size_p [OUT] bytes consumed in the c_seg buffer
+ * @return false if c_seg did not have enough space for the page. In that case c_seg has been
+ *          finalized, nothing was stored and the caller needs to retry with a fresh c_seg
  */
-static kern_return_t
-c_compress_page(
+static bool
+c_compress_page_into_segment(
+	c_segment_t      c_seg,
 	char             *src,
 	c_slot_mapping_t slot_ptr,
 	c_segment_t      *current_chead,
 	char             *scratch_buf,
-	__unused vm_compressor_options_t flags)
+	int              *c_size_p,
+	int              *c_rounded_size_p)
 {
 	int              c_size = -1;
 	int              c_rounded_size = 0;
 	int              max_csize;
-	bool             nearing_limits;
 	c_slot_t         cs;
-	c_segment_t      c_seg;
-
-	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, 0, 0, 0, 0);
-retry:  /* may need to retry if the currently filling c_seg will not have enough space */
-	c_seg = c_seg_allocate(current_chead, &nearing_limits);
-	if (c_seg == NULL) {
-		if (nearing_limits) {
-			memorystatus_respond_to_compressor_exhaustion();
-		}
-		return KERN_RESOURCE_SHORTAGE;
-	}
 
 	/*
 	 * c_seg_allocate() returns with c_seg lock held
@@ -4855,7 +4924,48 @@ retry:  /* may need to retry if the currently filling c_seg will not have enough
 		max_csize_adj = 0;
 	}
 
-	if (max_csize > 0 && max_csize_adj > 0) {
+	uint64_t pattern[2];
+	uint32_t period = 0;
+
+#if C_SLOT_C_PATTERN_BITS
+	cs->c_pattern = 0;
+#endif
+	if (max_csize_adj >= C_SLOT_PATTERN16_SIZE) {
+		vm_memtag_disable_checking();
+		period = c_page_pattern_period(src, pattern);
+		vm_memtag_enable_checking();
+		os_atomic_inc(&c_segment_pattern_scanned, relaxed);
+	}
+#if !C_SLOT_C_PATTERN_BITS
+	/*
+	 * Without a c_pattern bit in the slot, 8 and 16 byte patterns can't
+	 * be told apart from codec output: let the codec encode them.
+	 */
+	if (period > sizeof(uint32_t)) {
+		period = 0;
+	}
+#endif
+
+	if (period != 0) {
+		/* pattern page: skip the codec */
+#if C_SLOT_C_CODEC_BITS
+		cs->c_codec = CCWK;
+#endif
+		if (period == sizeof(uint32_t)) {
+			/* single 32 bit value, goes to the SV hash below */
+			os_atomic_inc(pattern[0] ? &c_segment_pattern_value : &c_segment_pattern_zero, relaxed);
+			c_size = 0;
+		} else {
+			os_atomic_inc(period == C_SLOT_PATTERN8_SIZE ? &c_segment_pattern8 : &c_segment_pattern16, relaxed);
+#if C_SLOT_C_PATTERN_BITS
+			cs->c_pattern = 1;
+#endif
+			c_size = period;
+			vm_memtag_disable_checking();
+			memcpy(&c_seg->c_store.c_buffer[cs->c_offset], pattern, c_size);
+			vm_memtag_enable_checking();
+		}
+	} else if (max_csize > 0 && max_csize_adj > 0) {
 		if (vm_compressor_algorithm() != VM_COMPRESSOR_DEFAULT_CODEC) {
 #if defined(__arm64__)
 			uint16_t ccodec = CINVALID;
@@ -4915,14 +5025,10 @@ retry:  /* may need to retry if the currently filling c_seg will not have enough
 		if (max_csize < PAGE_SIZE) {
 			c_current_seg_filled(c_seg, current_chead);
 			assert(*current_chead == NULL);
-
-			lck_mtx_unlock_always(&c_seg->c_lock);
 			/* TODO: it may be worth requiring codecs to distinguish
 			 * between incompressible inputs and failures due to budget exhaustion.
 			 * right now this assumes that if the space we had is > PAGE_SIZE, then the codec failed due to incompressible input */
-
-			PAGE_REPLACEMENT_DISALLOWED(FALSE);
-			goto retry;  /* previous c_seg didn't have enough space, we finalized it and can try again with a fresh c_seg */
+			return false;  /* c_seg didn't have enough space, we finalized it and the caller can try again with a fresh c_seg */
 		}
 		c_size = PAGE_SIZE; /* tag:WK-INCOMPRESSIBLE */
 
@@ -5009,34 +5115,122 @@ sv_compression:
 		assert(*current_chead == NULL);
 	}
 
-	lck_mtx_unlock_always(&c_seg->c_lock);
+	*c_size_p = c_size;
+	*c_rounded_size_p = c_rounded_size;
+	return true;
+}
 
-	PAGE_REPLACEMENT_DISALLOWED(FALSE);
+/*
+ * Can the next page of a batch go into c_seg without dropping its lock?
+ * This is the subset of c_seg_allocate() that does not need to block:
+ * the segment must still be filling, have a slot ready and enough of
+ * its buffer populated for a page.
+ */
+static bool
+c_seg_can_fill_locked(c_segment_t c_seg, c_segment_t *current_chead)
+{
+	LCK_MTX_ASSERT(&c_seg->c_lock, LCK_MTX_ASSERT_OWNED);
 
 #if RECORD_THE_COMPRESSED_DATA
+	/* the record buffer only has room for one more page past c_seg_allocsize */
 	if ((c_compressed_record_cptr - c_compressed_record_sbuf) >= c_seg_allocsize) {
-		c_compressed_record_write(c_compressed_record_sbuf, (int)(c_compressed_record_cptr - c_compressed_record_sbuf));
-		c_compressed_record_cptr = c_compressed_record_sbuf;
+		return false;
+	}
+#endif
+	if (*current_chead != c_seg) {
+		return false;
+	}
+	if (vm_compressor_pages_compressed() >= c_segment_pages_compressed_nearing_limit) {
+		return false;
 	}
+	if (c_seg->c_nextslot >= c_seg_fixed_array_len &&
+	    (c_seg->c_nextslot - c_seg_fixed_array_len) >= c_seg->c_slot_var_array_len) {
+		return false;
+	}
+	if (C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset) < c_seg_allocsize &&
+	    C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset - c_seg->c_nextoffset) <
+	    (unsigned)(PAGE_SIZE + (c_seg_allocsize - c_seg_bufsize))) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Global accounting for pages stored by c_compress_page_into_segment(),
+ * done once the c_seg lock has been dropped.
+ */
+static void
+c_compress_page_account(uint64_t c_size, uint64_t c_rounded_size, uint32_t npages)
+{
+#if RECORD_THE_COMPRESSED_DATA
+	c_compressed_record_flush();
 #endif
 	if (c_size) {
 		os_atomic_add(&c_segment_compressed_bytes, c_size, relaxed);
 		os_atomic_add(&compressor_bytes_used, c_rounded_size, relaxed);
 	}
-	os_atomic_add(&c_segment_input_bytes, PAGE_SIZE, relaxed);
+	os_atomic_add(&c_segment_input_bytes, (uint64_t)npages * PAGE_SIZE, relaxed);
 
-	os_atomic_inc(&c_segment_pages_compressed, relaxed);
+	os_atomic_add(&c_segment_pages_compressed, npages, relaxed);
 #if DEVELOPMENT || DEBUG
 	if (!compressor_running_perf_test) {
 		/*
 		 * The perf_compressor benchmark should not be able to trigger
 		 * compressor thrashing jetsams.
 		 */
-		os_atomic_inc(&sample_period_compression_count, relaxed);
+		os_atomic_add(&sample_period_compression_count, npages, relaxed);
 	}
 #else /* DEVELOPMENT || DEBUG */
-	os_atomic_inc(&sample_period_compression_count, relaxed);
+	os_atomic_add(&sample_period_compression_count, npages, relaxed);
 #endif /* DEVELOPMENT || DEBUG */
+}
+
+/**
+ * Do the actual compression of the given page
+ * @param src [IN] address in the physical aperture of the page to compress.
+ * @param slot_ptr [OUT] fill the slot-mapping of the c_seg+slot where the page ends up being stored
+ * @param current_chead [IN-OUT] current filling c_seg. pointer comes from the current compression thread state
+ *          On the very first call this is going to point to NULL and this function will fill that pointer with a new
+ *          filling c_sec if the current filling c_seg doesn't have enough space, it will be replaced in this location
+ *          with a new filling c_seg
+ * @param scratch_buf [IN] pointer from the current thread state, used by the compression codec
+ * @return KERN_RESOURCE_SHORTAGE if the compressor has been exhausted
+ */
+static kern_return_t
+c_compress_page(
+	char             *src,
+	c_slot_mapping_t slot_ptr,
+	c_segment_t      *current_chead,
+	char             *scratch_buf,
+	__unused vm_compressor_options_t flags)
+{
+	int              c_size;
+	int              c_rounded_size;
+	bool             nearing_limits;
+	c_segment_t      c_seg;
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, 0, 0, 0, 0);
+retry:  /* may need to retry if the currently filling c_seg will not have enough space */
+	c_seg = c_seg_allocate(current_chead, &nearing_limits);
+	if (c_seg == NULL) {
+		if (nearing_limits) {
+			memorystatus_respond_to_compressor_exhaustion();
+		}
+		return KERN_RESOURCE_SHORTAGE;
+	}
+
+	if (!c_compress_page_into_segment(c_seg, src, slot_ptr, current_chead, scratch_buf,
+	    &c_size, &c_rounded_size)) {
+		lck_mtx_unlock_always(&c_seg->c_lock);
+		PAGE_REPLACEMENT_DISALLOWED(FALSE);
+		goto retry;
+	}
+
+	lck_mtx_unlock_always(&c_seg->c_lock);
+
+	PAGE_REPLACEMENT_DISALLOWED(FALSE);
+
+	c_compress_page_account(c_size, c_rounded_size, 1);
 
 	if (nearing_limits) {
 		memorystatus_respond_to_compressor_exhaustion();
@@ -5047,6 +5241,84 @@ sv_compression:
 	return KERN_SUCCESS;
 }
 
+/**
+ * Compress several pages back to back into the current filling c_seg.
+ * The c_seg lock and PAGE_REPLACEMENT_DISALLOWED are taken once and held for as long as the
+ * segment can take the next page without blocking, and the global counters are updated once
+ * for the whole batch. The codec scratch buffer stays hot across the pages.
+ * @param srcs [IN] addresses in the physical aperture of the pages to compress
+ * @param slots [OUT] slot-mappings to fill, one per page
+ * @param count [IN] number of pages, at most VM_COMPRESSOR_PUT_BATCH_MAX
+ * @param current_chead [IN-OUT] current filling c_seg, same as for c_compress_page()
+ * @param scratch_buf [IN] pointer from the current thread state, used by the compression codec
+ * @param compressed_p [OUT] number of pages, from the start of the batch, that were stored
+ * @return KERN_RESOURCE_SHORTAGE if the compressor was exhausted before the whole batch was stored
+ */
+static kern_return_t
+c_compress_pages(
+	char             **srcs,
+	c_slot_mapping_t *slots,
+	uint32_t         count,
+	c_segment_t      *current_chead,
+	char             *scratch_buf,
+	uint32_t         *compressed_p)
+{
+	c_segment_t      c_seg = NULL;
+	bool             nearing_limits = false, nearing;
+	int              c_size, c_rounded_size;
+	uint64_t         batch_size = 0, batch_rounded_size = 0;
+	uint32_t         i = 0;
+	kern_return_t    kr = KERN_SUCCESS;
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, count, 0, 0, 0);
+
+	while (i < count) {
+		if (c_seg == NULL) {
+			c_seg = c_seg_allocate(current_chead, &nearing);
+			nearing_limits |= nearing;
+			if (c_seg == NULL) {
+				kr = KERN_RESOURCE_SHORTAGE;
+				break;
+			}
+		}
+		if (!c_compress_page_into_segment(c_seg, srcs[i], slots[i], current_chead, scratch_buf,
+		    &c_size, &c_rounded_size)) {
+			/* c_seg was finalized without storing the page, retry in a fresh one */
+			lck_mtx_unlock_always(&c_seg->c_lock);
+			PAGE_REPLACEMENT_DISALLOWED(FALSE);
+			c_seg = NULL;
+			continue;
+		}
+		batch_size += c_size;
+		batch_rounded_size += c_rounded_size;
+		i++;
+
+		if (i < count && !c_seg_can_fill_locked(c_seg, current_chead)) {
+			lck_mtx_unlock_always(&c_seg->c_lock);
+			PAGE_REPLACEMENT_DISALLOWED(FALSE);
+			c_seg = NULL;
+#if RECORD_THE_COMPRESSED_DATA
+			c_compressed_record_flush();
+#endif
+		}
+	}
+	if (c_seg != NULL) {
+		lck_mtx_unlock_always(&c_seg->c_lock);
+		PAGE_REPLACEMENT_DISALLOWED(FALSE);
+	}
+
+	c_compress_page_account(batch_size, batch_rounded_size, i);
+
+	if (nearing_limits) {
+		memorystatus_respond_to_compressor_exhaustion();
+	}
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_END, *current_chead, batch_size, c_segment_input_bytes, c_segment_compressed_bytes, i);
+
+	*compressed_p = i;
+	return kr;
+}
+
 static inline void
 sv_decompress(int32_t *ddst, int32_t pattern)
 {
@@ -5094,6 +5366,23 @@ sv_decompress(int32_t *ddst, int32_t pattern)
 #endif
 }
 
+static inline void
+pattern_decompress(uint64_t *ddst, const char *pattern, uint32_t size)
+{
+	uint64_t p0, p1;
+
+	/* an 8 byte pattern is its own second half */
+	memcpy(&p0, pattern, sizeof(p0));
+	memcpy(&p1, pattern + size - sizeof(p1), sizeof(p1));
+
+	for (unsigned int i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 4) {
+		ddst[i] = p0;
+		ddst[i + 1] = p1;
+		ddst[i + 2] = p0;
+		ddst[i + 3] = p1;
+	}
+}
+
 static vm_decompress_result_t
 c_decompress_page(
 	char            *dst,
@@ -5314,6 +5603,15 @@ bypass_busy_check:
 			vm_memtag_disable_checking();
 			sv_decompress(dptr, data);
 			vm_memtag_enable_checking();
+#if C_SLOT_C_PATTERN_BITS
+		} else if (cs->c_pattern) {
+			/* page repeats the 8 or 16 byte pattern stored in the segment */
+			assert(c_size == C_SLOT_PATTERN8_SIZE || c_size == C_SLOT_PATTERN16_SIZE);
+			vm_memtag_disable_checking();
+			pattern_decompress((uint64_t *)(uintptr_t)dst, &c_seg->c_store.c_buffer[cs->c_offset], c_size);
+			vm_memtag_enable_checking();
+			os_atomic_inc(&c_segment_pattern_decompressions, relaxed);
+#endif /* C_SLOT_C_PATTERN_BITS */
 		} else {  /* normal segment decompress */
 			uint32_t        my_cpu_no;
 			char            *scratch_buf;
@@ -5760,6 +6058,55 @@ vm_compressor_put(ppnum_t pn, int *slot, void  **current_chead, char *scratch_bu
 	return kr;
 }
 
+void
+vm_compressor_put_batch(struct vm_compressor_put_req *reqs, uint32_t count, void **current_chead, char *scratch_buf)
+{
+	char             *srcs[VM_COMPRESSOR_PUT_BATCH_MAX];
+	c_slot_mapping_t slots[VM_COMPRESSOR_PUT_BATCH_MAX];
+	uint32_t         index[VM_COMPRESSOR_PUT_BATCH_MAX];
+	uint32_t         npages = 0, compressed = 0;
+	kern_return_t    kr;
+
+	assert(count <= VM_COMPRESSOR_PUT_BATCH_MAX);
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct vm_compressor_put_req *req = &reqs[i];
+
+#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
+		if (req->flags & C_PAGE_UNMODIFIED) {
+			if (*req->slot) {
+				os_atomic_inc(&compressor_ro_uncompressed_skip_returned, relaxed);
+				req->kr = KERN_SUCCESS;
+				continue;
+			}
+			if (vm_uncompressed_put(req->ppnum, req->slot) == KERN_SUCCESS) {
+				os_atomic_inc(&compressor_ro_uncompressed_put, relaxed);
+				req->kr = KERN_SUCCESS;
+				continue;
+			}
+		}
+#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+
+		/* get the address of the page in the physical apperture in the kernel task virtual memory */
+		srcs[npages] = pmap_map_compressor_page(req->ppnum);
+		assert(srcs[npages] != NULL);
+		slots[npages] = (c_slot_mapping_t)req->slot;
+		index[npages] = i;
+		npages++;
+	}
+
+	if (npages == 0) {
+		return;
+	}
+
+	kr = c_compress_pages(srcs, slots, npages, (c_segment_t *)current_chead, scratch_buf, &compressed);
+
+	for (uint32_t i = 0; i < npages; i++) {
+		pmap_unmap_compressor_page(reqs[index[i]].ppnum, srcs[i]);
+		reqs[index[i]].kr = (i < compressed) ? KERN_SUCCESS : kr;
+	}
+}
+
 void
 vm_compressor_transfer(
 	int     *dst_slot_p,
@@ -33,6 +33,7 @@
 #include "WKdm_new.h"
 #include <vm/vm_compressor_algorithms_internal.h>
 #include <vm/vm_compressor_internal.h>
+#include <vm/vm_compressor_info.h>
 
 #define MZV_MAGIC (17185)
 #if defined(__arm64__)
@@ -77,6 +78,8 @@ compressor_tuneables_t vmctune = {
 	.lz4_run_preselection_threshold = ~0U,
 	.lz4_run_continue_bytes = 0,
 	.lz4_profitable_bytes = 0,
+	.csel_mem_weight = 1024,
+	.csel_explore_interval = 64,
 };
 
 compressor_state_t vmcstate = {
@@ -104,6 +107,11 @@ vm_compressor_mode_t vm_compressor_current_codec = VM_COMPRESSOR_DEFAULT_CODEC;
 
 boolean_t vm_compressor_force_sw_wkdm = FALSE;
 
+#if DEVELOPMENT || DEBUG
+/* route WKdm through the portable C implementation, for profiling and validation */
+boolean_t vm_compressor_wkdm_gen = FALSE;
+#endif
+
 boolean_t verbose = FALSE;
 
 #define VMDBGSTAT (DEBUG)
@@ -212,6 +220,170 @@ compressor_selector_update(int lz4sz, int didwk, int wksz)
 	}
 }
 
+/*
+ * Cost model codec selection (CMODE_ADAPTIVE).
+ *
+ * Every page is classified by the byte entropy of a strided sample of its
+ * contents.  For each class, the compressed size and compression time of
+ * each codec are tracked as moving averages, and the page goes to the codec
+ * with the lowest expected cost: compression time plus the memory the result
+ * is expected to hold, charged at vmctune.csel_mem_weight ns per KB.  One page
+ * in vmctune.csel_explore_interval goes to the other codec so its estimates
+ * follow the workload.  As with vmcstate, the model is global and updated
+ * without synchronization by the compressor threads; a lost update only
+ * slows convergence.
+ */
+#define CSEL_SAMPLE_RUNS        32
+#define CSEL_SAMPLE_RUN_BYTES   8
+#define CSEL_EWMA_SHIFT         3
+
+static_assert(CSEL_SAMPLE_RUNS * CSEL_SAMPLE_RUN_BYTES == 256,
+    "the entropy estimate assumes 256 samples");
+
+typedef struct {
+	uint32_t samples[VM_C_CODEC_SELECTION_CODECS];
+	uint32_t avg_size[VM_C_CODEC_SELECTION_CODECS];
+	uint32_t avg_ns[VM_C_CODEC_SELECTION_CODECS];
+	uint32_t since_explore;
+	uint64_t selected[VM_C_CODEC_SELECTION_CODECS];
+	uint64_t explored[VM_C_CODEC_SELECTION_CODECS];
+	uint64_t failures[VM_C_CODEC_SELECTION_CODECS];
+} compressor_csel_class_t;
+
+static compressor_csel_class_t vmcsel[VM_C_CODEC_SELECTION_CLASSES];
+
+/* log2(x) in 24.8 fixed point, linearly interpolated between powers of two */
+static inline uint32_t
+compressor_log2_q8(uint32_t x)
+{
+	uint32_t ip = 31 - __builtin_clz(x);
+
+	return (ip << 8) + ((x << 8) >> ip) - 256;
+}
+
+static uint32_t
+compressor_entropy_class(const uint8_t *in)
+{
+	uint16_t hist[256];
+	uint32_t stride = PAGE_SIZE / CSEL_SAMPLE_RUNS;
+	uint32_t sum = 0, h;
+
+	bzero(hist, sizeof(hist));
+	for (uint32_t run = 0; run < CSEL_SAMPLE_RUNS; run++) {
+		/* walk the sample position through the stride so that
+		 * page-aligned structures do not dominate the histogram */
+		const uint8_t *p = in + run * stride +
+		    ((run * 7 * CSEL_SAMPLE_RUN_BYTES) & (stride - CSEL_SAMPLE_RUN_BYTES));
+
+		for (uint32_t i = 0; i < CSEL_SAMPLE_RUN_BYTES; i++) {
+			hist[p[i]]++;
+		}
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		if (hist[i]) {
+			sum += hist[i] * compressor_log2_q8(hist[i]);
+		}
+	}
+
+	/* H = log2(N) - sum(c * log2(c)) / N, N = 256, in bits per byte */
+	h = (8 << 8) - (sum >> 8);
+	return MIN((h + 128) >> 8, VM_C_CODEC_SELECTION_CLASSES - 1);
+}
+
+static inline uint64_t
+compressor_csel_cost(const compressor_csel_class_t *cc, vm_compressor_codec_t c)
+{
+	return cc->avg_ns[c] + (((uint64_t)cc->avg_size[c] * vmctune.csel_mem_weight) >> 10);
+}
+
+static inline vm_compressor_codec_t
+compressor_csel_select(uint32_t cls, boolean_t *explore)
+{
+	compressor_csel_class_t *cc = &vmcsel[cls];
+	vm_compressor_codec_t best;
+
+	*explore = FALSE;
+
+	/* zero, single value and nearly uniform pages: WKdm encodes them in a few bytes */
+	if (cls == 0) {
+		return CCWK;
+	}
+
+	if (cc->samples[CCWK] == 0) {
+		*explore = TRUE;
+		return CCWK;
+	}
+	if (cc->samples[CCLZ4] == 0) {
+		*explore = TRUE;
+		return CCLZ4;
+	}
+
+	best = (compressor_csel_cost(cc, CCLZ4) < compressor_csel_cost(cc, CCWK)) ? CCLZ4 : CCWK;
+
+	if (vmctune.csel_explore_interval &&
+	    ++cc->since_explore >= vmctune.csel_explore_interval) {
+		cc->since_explore = 0;
+		*explore = TRUE;
+		return best ^ 1;
+	}
+	return best;
+}
+
+static inline void
+compressor_csel_update(uint32_t cls, vm_compressor_codec_t c, boolean_t explore,
+    int sz, uint64_t abstime)
+{
+	compressor_csel_class_t *cc = &vmcsel[cls];
+	uint64_t ns;
+	int32_t size, nsec;
+
+	/* charge what c_compress_page() will store: a whole page on failure, 4 bytes for SV pages */
+	size = (sz < 0) ? PAGE_SIZE : (sz == 0) ? 4 : sz;
+	absolutetime_to_nanoseconds(abstime, &ns);
+	nsec = (int32_t)MIN(ns, INT32_MAX);
+
+	if (explore) {
+		cc->explored[c]++;
+	} else {
+		cc->selected[c]++;
+	}
+	if (sz < 0) {
+		cc->failures[c]++;
+	}
+
+	if (cc->samples[c]++ == 0) {
+		cc->avg_size[c] = size;
+		cc->avg_ns[c] = nsec;
+	} else {
+		cc->avg_size[c] += (size - (int32_t)cc->avg_size[c]) >> CSEL_EWMA_SHIFT;
+		cc->avg_ns[c] += (nsec - (int32_t)cc->avg_ns[c]) >> CSEL_EWMA_SHIFT;
+	}
+}
+
+void
+vm_compressor_codec_selection_info(struct c_codec_selection_info *info)
+{
+	bzero(info, sizeof(*info));
+	info->ccsi_magic = VM_C_CODEC_SELECTION_INFO_MAGIC;
+	info->ccsi_active = (vm_compressor_current_codec == CMODE_ADAPTIVE);
+	info->ccsi_mem_weight = vmctune.csel_mem_weight;
+	info->ccsi_explore_interval = vmctune.csel_explore_interval;
+	info->ccsi_nclasses = VM_C_CODEC_SELECTION_CLASSES;
+
+	for (uint32_t cls = 0; cls < VM_C_CODEC_SELECTION_CLASSES; cls++) {
+		const compressor_csel_class_t *cc = &vmcsel[cls];
+		struct c_codec_class_info *ci = &info->ccsi_classes[cls];
+
+		for (uint32_t c = 0; c < VM_C_CODEC_SELECTION_CODECS; c++) {
+			ci->ccci_selected[c] = cc->selected[c];
+			ci->ccci_explored[c] = cc->explored[c];
+			ci->ccci_failures[c] = cc->failures[c];
+			ci->ccci_avg_size[c] = cc->avg_size[c];
+			ci->ccci_avg_ns[c] = cc->avg_ns[c];
+		}
+	}
+}
 
 static inline void
 WKdm_hv(uint32_t *wkbuf)
@@ -242,6 +414,13 @@ WKdmD(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch, unsigned int bytes,
 #if defined(__arm64__)
 #endif
 	WKdm_hv(src_buf);
+#if DEVELOPMENT || DEBUG
+	if (vm_compressor_wkdm_gen) {
+		WKdm_decompress_gen(src_buf, dest_buf, scratch, bytes, PAGE_SIZE);
+		VM_COMPRESSOR_STAT(compressor_stats.wks_decompressions++);
+		return true;
+	}
+#endif
 #if defined(__arm64__)
 #ifndef __ARM_16K_PG__
 	if (PAGE_SIZE == 4096) {
@@ -272,6 +451,13 @@ WKdmC(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch,
 {
 	(void)incomp_copy;
 	int wkcval;
+#if DEVELOPMENT || DEBUG
+	if (vm_compressor_wkdm_gen) {
+		wkcval = WKdm_compress_gen(src_buf, dest_buf, scratch, limit, PAGE_SIZE);
+		VM_COMPRESSOR_STAT(compressor_stats.wks_compressions++);
+		return wkcval;
+	}
+#endif
 #if defined(__arm64__)
 #ifndef __ARM_16K_PG__
 	if (PAGE_SIZE == 4096) {
@@ -295,6 +481,46 @@ WKdmC(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch,
 	return wkcval;
 }
 
+static int
+compressor_adaptive_compress(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *codec,
+    compressor_encode_scratch_t *cscratch, boolean_t *incomp_copy, uint32_t *pop_count)
+{
+	boolean_t explore;
+	uint32_t cls = compressor_entropy_class(in);
+	vm_compressor_codec_t c = compressor_csel_select(cls, &explore);
+	uint64_t start = mach_absolute_time();
+	int sz;
+
+	*codec = c;
+	if (c == CCWK) {
+		VM_COMPRESSOR_STAT(compressor_stats.wk_compressions++);
+		sz = WKdmC(in, cdst, &cscratch->wkscratch[0], incomp_copy, outbufsz, pop_count);
+
+		if (sz == -1) {
+			VM_COMPRESSOR_STAT(compressor_stats.wk_compressed_bytes_total += PAGE_SIZE);
+			VM_COMPRESSOR_STAT(compressor_stats.wk_compression_failures++);
+		} else if (sz == 0) {
+			VM_COMPRESSOR_STAT(compressor_stats.wk_sv_compressions++);
+			VM_COMPRESSOR_STAT(compressor_stats.wk_compressed_bytes_total += 4);
+		} else {
+			VM_COMPRESSOR_STAT(compressor_stats.wk_compressed_bytes_total += sz);
+		}
+	} else {
+		VM_COMPRESSOR_STAT(compressor_stats.lz4_compressions++);
+		sz = (int) lz4raw_encode_buffer(cdst, outbufsz, in, PAGE_SIZE, &cscratch->lz4state[0]);
+
+		if (sz == 0) {
+			VM_COMPRESSOR_STAT(compressor_stats.lz4_compressed_bytes += PAGE_SIZE);
+			VM_COMPRESSOR_STAT(compressor_stats.lz4_compression_failures++);
+			sz = -1;
+		} else {
+			VM_COMPRESSOR_STAT(compressor_stats.lz4_compressed_bytes += sz);
+		}
+	}
+
+	compressor_csel_update(cls, c, explore, sz, mach_absolute_time() - start);
+	return sz;
+}
 
 int
 metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *codec,
@@ -307,6 +533,11 @@ metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *cod
 	/* Not all paths lead to an inline population count. */
 	uint32_t pop_count = C_SLOT_NO_POPCOUNT;
 
+	if (vm_compressor_current_codec == CMODE_ADAPTIVE) {
+		sz = compressor_adaptive_compress(in, cdst, outbufsz, codec, cscratch, incomp_copy, &pop_count);
+		goto cexit;
+	}
+
 	if (vm_compressor_current_codec == CMODE_WK) {
 		dowk = TRUE;
 	} else if (vm_compressor_current_codec == CMODE_LZ4) {
@@ -458,8 +689,11 @@ vm_compressor_algorithm_init(void)
 #endif
 
 	PE_parse_boot_argn("vm_compressor_codec", &new_codec, sizeof(new_codec));
+#if DEVELOPMENT || DEBUG
+	PE_parse_boot_argn("vm_compressor_wkdm_gen", &vm_compressor_wkdm_gen, sizeof(vm_compressor_wkdm_gen));
+#endif
 	assertf(((new_codec == VM_COMPRESSOR_DEFAULT_CODEC) || (new_codec == CMODE_WK) ||
-	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB)),
+	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB) || (new_codec == CMODE_ADAPTIVE)),
 	    "Invalid VM compression codec: %u", new_codec);
 
 #if defined(__arm64__)
@@ -468,6 +702,8 @@ vm_compressor_algorithm_init(void)
 		new_codec = VM_COMPRESSOR_DEFAULT_CODEC;
 	} else if (PE_parse_boot_argn("-vm_compressor_hybrid", &tmpc, sizeof(tmpc))) {
 		new_codec = CMODE_HYB;
+	} else if (PE_parse_boot_argn("-vm_compressor_adaptive", &tmpc, sizeof(tmpc))) {
+		new_codec = CMODE_ADAPTIVE;
 	}
 
 	vm_compressor_current_codec = new_codec;
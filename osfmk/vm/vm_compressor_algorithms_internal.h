@@ -48,7 +48,8 @@ typedef enum {
 	CMODE_LZ4 = 1,
 	CMODE_HYB = 2,
 	VM_COMPRESSOR_DEFAULT_CODEC = 3,
-	CMODE_INVALID = 4
+	CMODE_ADAPTIVE = 4,
+	CMODE_INVALID = 5
 } vm_compressor_mode_t;
 
 void vm_compressor_algorithm_init(void);
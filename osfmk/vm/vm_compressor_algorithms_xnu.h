@@ -86,8 +86,13 @@ typedef struct {
 	uint32_t lz4_run_preselection_threshold;
 	uint32_t lz4_run_continue_bytes;
 	uint32_t lz4_profitable_bytes;
+	uint32_t csel_mem_weight;
+	uint32_t csel_explore_interval;
 } compressor_tuneables_t;
 
 extern compressor_tuneables_t vmctune;
 
+struct c_codec_selection_info;
+extern void vm_compressor_codec_selection_info(struct c_codec_selection_info *info);
+
 #endif /* XNU_KERNEL_PRIVATE */
@@ -66,6 +66,56 @@ struct c_segment_info {
 
 #define VM_C_SEGMENT_INFO_MAGIC 'C002'
 
+/*
+ * c_codec_selection_info is the output of sysctl vm.compressor_codec_selection.
+ * It describes the state of the adaptive (cost model) codec selector: pages are
+ * classified by the sampled byte entropy of their contents, and for each class the
+ * selector keeps a moving average of the compressed size and compression time of
+ * every codec. Codec indices are those of vm_compressor_codec_t (0 WKdm, 1 LZ4).
+ * Every change to this format should increment the version number in VM_C_CODEC_SELECTION_INFO_MAGIC
+ */
+#define VM_C_CODEC_SELECTION_CODECS     2
+#define VM_C_CODEC_SELECTION_CLASSES    9       /* sampled entropy 0..8 bits per byte */
+
+struct c_codec_class_info {
+	uint64_t       ccci_selected[VM_C_CODEC_SELECTION_CODECS];   /* pages the cost model sent to each codec */
+	uint64_t       ccci_explored[VM_C_CODEC_SELECTION_CODECS];   /* pages sent to a codec only to refresh its estimates */
+	uint64_t       ccci_failures[VM_C_CODEC_SELECTION_CODECS];   /* pages the codec could not compress */
+	uint32_t       ccci_avg_size[VM_C_CODEC_SELECTION_CODECS];   /* moving average of compressed bytes per page */
+	uint32_t       ccci_avg_ns[VM_C_CODEC_SELECTION_CODECS];     /* moving average of compression time per page */
+} __attribute__((packed));
+
+struct c_codec_selection_info {
+	uint32_t       ccsi_magic;
+	uint32_t       ccsi_active;              /* the adaptive codec mode is currently selected */
+	uint32_t       ccsi_mem_weight;          /* cost in ns charged for holding 1KB of compressed data */
+	uint32_t       ccsi_explore_interval;    /* one page in this many is sent to the codec the model did not pick */
+	uint32_t       ccsi_nclasses;            /* count of ccsi_classes */
+	struct c_codec_class_info ccsi_classes[VM_C_CODEC_SELECTION_CLASSES];
+} __attribute__((packed));
+
+#define VM_C_CODEC_SELECTION_INFO_MAGIC 'D001'
+
+/*
+ * c_pattern_page_info is the output of sysctl vm.compressor_pattern_pages.
+ * Pages that repeat a 4, 8 or 16 byte pattern (zero filled pages included) are
+ * recognized before they reach a codec and stored as the pattern alone: 4 byte
+ * patterns use the single value hash, longer ones are kept in the c_segment.
+ * Every change to this format should increment the version number in VM_C_PATTERN_PAGE_INFO_MAGIC
+ */
+struct c_pattern_page_info {
+	uint32_t       cppi_magic;
+	uint32_t       cppi_reserved;
+	uint64_t       cppi_scanned;             /* pages checked for a pattern */
+	uint64_t       cppi_zero;                /* zero filled pages */
+	uint64_t       cppi_value;               /* pages repeating a non-zero 32 bit value */
+	uint64_t       cppi_pattern8;            /* pages repeating an 8 byte pattern */
+	uint64_t       cppi_pattern16;           /* pages repeating a 16 byte pattern */
+	uint64_t       cppi_decompressions;      /* 8 and 16 byte pattern pages decompressed */
+} __attribute__((packed));
+
+#define VM_C_PATTERN_PAGE_INFO_MAGIC 'E001'
+
 /*
  * vm_map_info_hdr and vm_map_entry_info are used for output of ###
  * a starting header gives the number of entries that follow, the every entry in the vm_map
@@ -746,19 +746,19 @@ zfree_slot_array(compressor_slot_t *slots, size_t size)
 #endif /* !defined(__LP64__) */
 }
 
-kern_return_t
-vm_compressor_pager_put(
+/*
+ * Find (creating it if needed) the slot-mapping for offset in mem_obj, which vm_compressor_put()
+ * is then going to fill. If a compressed copy of the page is already there, it is released.
+ */
+static compressor_slot_t *
+compressor_pager_put_slot(
 	memory_object_t                 mem_obj,
 	memory_object_offset_t          offset,
-	ppnum_t                         ppnum,
-	void                            **current_chead,
-	char                            *scratch_buf,
 	int                             *compressed_count_delta_p, /* OUT */
 	vm_compressor_options_t         flags)
 {
 	compressor_pager_t pager;
 	compressor_slot_t *slot_p;
-	kern_return_t kr;
 
 	compressor_pager_stats.put++;
 
@@ -778,7 +778,7 @@ vm_compressor_pager_put(
 	if (os_convert_overflow(offset / PAGE_SIZE, &dummy_conv)) {
 		/* overflow, page number doesn't fit in a uint32 */
 		panic("%s: offset 0x%llx overflow", __FUNCTION__, (uint64_t) offset);
-		return KERN_RESOURCE_SHORTAGE;
+		return NULL;
 	}
 
 	/* we're looking for the slot_mapping that corresponds to the offset, which vm_compressor_put() is then going to
@@ -800,6 +800,26 @@ vm_compressor_pager_put(
 		vm_compressor_free(slot_p, flags);
 		*compressed_count_delta_p -= 1;
 	}
+	return slot_p;
+}
+
+kern_return_t
+vm_compressor_pager_put(
+	memory_object_t                 mem_obj,
+	memory_object_offset_t          offset,
+	ppnum_t                         ppnum,
+	void                            **current_chead,
+	char                            *scratch_buf,
+	int                             *compressed_count_delta_p, /* OUT */
+	vm_compressor_options_t         flags)
+{
+	compressor_slot_t *slot_p;
+	kern_return_t kr;
+
+	slot_p = compressor_pager_put_slot(mem_obj, offset, compressed_count_delta_p, flags);
+	if (slot_p == NULL) {
+		return KERN_RESOURCE_SHORTAGE;
+	}
 
 	/*
 	 * If the compressor operation succeeds, we presumably don't need to
@@ -814,6 +834,29 @@ vm_compressor_pager_put(
 	return kr;
 }
 
+void
+vm_compressor_pager_put_batch(
+	struct vm_compressor_put_req    *reqs,
+	uint32_t                        count,
+	void                            **current_chead,
+	char                            *scratch_buf)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		reqs[i].slot = compressor_pager_put_slot(reqs[i].mem_obj, reqs[i].offset,
+		    &reqs[i].compressed_count_delta, reqs[i].flags);
+		reqs[i].kr = KERN_RESOURCE_SHORTAGE;
+		assert(reqs[i].slot != NULL);
+	}
+
+	vm_compressor_put_batch(reqs, count, current_chead, scratch_buf);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (reqs[i].kr == KERN_SUCCESS) {
+			reqs[i].compressed_count_delta += 1;
+		}
+	}
+}
+
 
 kern_return_t
 vm_compressor_pager_get(
@@ -44,6 +44,29 @@ extern kern_return_t vm_compressor_pager_put(
 	int                             *compressed_count_delta_p,
 	vm_compressor_options_t         flags);
 
+/*
+ * One page of a vm_compressor_pager_put_batch() request.
+ * All the pages of a batch are stored through the same current_chead,
+ * so that they can be compressed back to back into the same c_seg.
+ */
+#define VM_COMPRESSOR_PUT_BATCH_MAX     8
+
+struct vm_compressor_put_req {
+	memory_object_t                 mem_obj;                /* IN */
+	memory_object_offset_t          offset;                 /* IN */
+	ppnum_t                         ppnum;                  /* IN */
+	vm_compressor_options_t         flags;                  /* IN */
+	int                             *slot;                  /* slot-mapping, resolved by the pager */
+	int                             compressed_count_delta; /* OUT */
+	kern_return_t                   kr;                     /* OUT */
+};
+
+extern void vm_compressor_pager_put_batch(
+	struct vm_compressor_put_req    *reqs,
+	uint32_t                        count,
+	void                            **current_chead,
+	char                            *scratch_buf);
+
 
 extern unsigned int vm_compressor_pager_state_clr(
 	memory_object_t         mem_obj,
@@ -77,6 +100,7 @@ extern bool osenvironment_is_diagnostics(void);
 extern void vm_compressor_init(void);
 extern bool vm_compressor_is_slot_compressed(int *slot);
 extern kern_return_t vm_compressor_put(ppnum_t pn, int *slot, void **current_chead, char *scratch_buf, vm_compressor_options_t flags);
+extern void vm_compressor_put_batch(struct vm_compressor_put_req *reqs, uint32_t count, void **current_chead, char *scratch_buf);
 extern vm_decompress_result_t vm_compressor_get(ppnum_t pn, int *slot, vm_compressor_options_t flags);
 extern int vm_compressor_free(int *slot, vm_compressor_options_t flags);
 
@@ -90,8 +90,9 @@
 
 #define C_SLOT_C_SIZE_BITS              12
 #define C_SLOT_C_CODEC_BITS             1
+#define C_SLOT_C_PATTERN_BITS           1
 #define C_SLOT_C_POPCOUNT_BITS          0
-#define C_SLOT_C_PADDING_BITS           3
+#define C_SLOT_C_PADDING_BITS           2
 
 #elif defined(__arm64__)                /* 32G from the heap start */
 #define C_SLOT_PACKED_PTR_BITS          33
@@ -100,16 +101,22 @@
 
 #define C_SLOT_C_SIZE_BITS              14
 #define C_SLOT_C_CODEC_BITS             1
+#define C_SLOT_C_PATTERN_BITS           0 /* no room, see c_compress_page_into_segment() */
 #define C_SLOT_C_POPCOUNT_BITS          0
 #define C_SLOT_C_PADDING_BITS           0
 
-#elif defined(__x86_64__)               /* 256G from the heap start */
-#define C_SLOT_PACKED_PTR_BITS          36
+#elif defined(__x86_64__)               /* 128G from the heap start */
+/*
+ * Still covers VM_PAGE_PACKED_PTR's 128G reach, which is the tighter of
+ * the two bounds on the zone VM submap (zone_restricted_va_max()).
+ */
+#define C_SLOT_PACKED_PTR_BITS          35
 #define C_SLOT_PACKED_PTR_SHIFT         2
 #define C_SLOT_PACKED_PTR_BASE          ((uintptr_t)KERNEL_PMAP_HEAP_RANGE_START)
 
 #define C_SLOT_C_SIZE_BITS              12
 #define C_SLOT_C_CODEC_BITS             0 /* not used */
+#define C_SLOT_C_PATTERN_BITS           1
 #define C_SLOT_C_POPCOUNT_BITS          0
 #define C_SLOT_C_PADDING_BITS           0
 
@@ -126,19 +133,23 @@
 #define C_SLOT_NO_POPCOUNT              ((16u << C_SLOT_C_SIZE_BITS) - 1)
 
 static_assert((C_SEG_OFFSET_BITS + C_SLOT_C_SIZE_BITS +
-    C_SLOT_C_CODEC_BITS + C_SLOT_C_POPCOUNT_BITS +
+    C_SLOT_C_CODEC_BITS + C_SLOT_C_PATTERN_BITS + C_SLOT_C_POPCOUNT_BITS +
     C_SLOT_C_PADDING_BITS + C_SLOT_PACKED_PTR_BITS) % 32 == 0);
 
 struct c_slot {
 	uint64_t        c_offset:C_SEG_OFFSET_BITS __kernel_ptr_semantics;
 	/* 0 means it's an empty slot
 	 * 4 means it's a short-value that did not fit in the hash
-	 * [5 : PAGE_SIZE-1] means it is normally compressed
+	 * [5 : PAGE_SIZE-1] means it is normally compressed, unless c_pattern is set
 	 * PAGE_SIZE means it was incompressible (see tag:WK-INCOMPRESSIBLE) */
 	uint64_t        c_size:C_SLOT_C_SIZE_BITS;
 #if C_SLOT_C_CODEC_BITS
 	uint64_t        c_codec:C_SLOT_C_CODEC_BITS;
 #endif
+#if C_SLOT_C_PATTERN_BITS
+	/* the page repeats the c_size (8 or 16) bytes stored in the segment */
+	uint64_t        c_pattern:C_SLOT_C_PATTERN_BITS;
+#endif
 #if C_SLOT_C_POPCOUNT_BITS
 	/*
 	 * This value may not agree with c_pop_cdata, as it may be the
@@ -545,6 +556,8 @@ bool vm_compressor_swapout_is_ripe(void);
 uint32_t vm_compressor_pages_compressed(void);
 void vm_compressor_process_special_swapped_in_segments(void);
 uint32_t vm_compressor_get_swapped_segment_count(void);
+struct c_pattern_page_info;
+void vm_compressor_pattern_page_info(struct c_pattern_page_info *info);
 
 
 #if DEVELOPMENT || DEBUG
@@ -94,6 +94,7 @@
 #include <vm/vm_map_internal.h>
 #include <vm/vm_object_internal.h>
 #include <vm/vm_page_internal.h>
+#include <vm/vm_lpage_internal.h>
 #include <vm/vm_kern_internal.h>
 #include <vm/pmap.h>
 #include <vm/vm_pageout_internal.h>
@@ -4222,6 +4223,251 @@ uint64_t vm_copied_on_read = 0;
 uint64_t vm_copied_on_read_kernel_map = 0;
 uint64_t vm_copied_on_read_platform_map = 0;
 
+/*
+ * Fault-around
+ *
+ * A read fault that was resolved from a resident page of the top object
+ * also maps the resident pages around it, so that a process walking
+ * through a file or a freshly populated heap takes one fault per window
+ * instead of one per page.  The window grows with the sequential run the
+ * faulting page extends and points in the direction of that run.
+ */
+#define VM_FAULT_AROUND_MIN     4
+#define VM_FAULT_AROUND_LIMIT   64
+
+TUNABLE_WRITEABLE(uint32_t, vm_fault_around_max, "vm_fault_around", 16);
+SCALABLE_COUNTER_DEFINE(vm_fault_around_count);
+
+/*
+ * Size the window from the state vm_fault_is_sequential() left behind
+ * on the previous fault.  A run only counts if this fault extends it:
+ * anything else gets a small window centered on the faulting page.
+ */
+static void
+vm_fault_around_window(
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_behavior_t           behavior,
+	uint32_t                *ahead,
+	uint32_t                *behind)
+{
+	uint32_t                max = MIN(vm_fault_around_max, VM_FAULT_AROUND_LIMIT);
+	vm_object_offset_t      last_alloc = object->last_alloc;
+	int32_t                 sequential = object->sequential;
+	uint32_t                window;
+
+	*ahead = *behind = 0;
+	if (max == 0 || behavior == VM_BEHAVIOR_RANDOM) {
+		return;
+	}
+
+	if (behavior == VM_BEHAVIOR_SEQUENTIAL) {
+		*ahead = max;
+	} else if (behavior == VM_BEHAVIOR_RSEQNTL) {
+		*behind = max;
+	} else if (offset == last_alloc + PAGE_SIZE_64 && sequential >= 0) {
+		window = VM_FAULT_AROUND_MIN + ((uint32_t)sequential >> PAGE_SHIFT);
+		*ahead = MIN(max, window);
+	} else if (offset + PAGE_SIZE_64 == last_alloc && sequential <= 0) {
+		window = VM_FAULT_AROUND_MIN + ((uint32_t)-sequential >> PAGE_SHIFT);
+		*behind = MIN(max, window);
+	} else {
+		window = MIN(max, VM_FAULT_AROUND_MIN);
+		*ahead = window / 2;
+		*behind = window - *ahead;
+	}
+}
+
+/*
+ * Map the resident page at "offset" in "object" at "vaddr".
+ * Returns 1 if the page is now mapped, 0 if it was skipped,
+ * and -1 if the caller should not try any further page.
+ *
+ * object must be locked, the map must be locked shared.
+ */
+static int
+vm_fault_around_page(
+	pmap_t                  pmap,
+	vm_map_offset_t         vaddr,
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_prot_t               prot,
+	vm_object_fault_info_t  fault_info,
+	uint8_t                 *object_lock_type)
+{
+	vm_page_t       m;
+	kern_return_t   kr;
+	boolean_t       need_retry = FALSE;
+	bool            page_sleep_needed = false;
+	int             type_of_fault = DBG_CACHE_HIT_FAULT;
+
+	m = vm_page_lookup(object, offset);
+	if (m == VM_PAGE_NULL ||
+	    m->vmp_busy || m->vmp_laundry || m->vmp_cleaning ||
+	    vm_page_is_fictitious(m) ||
+	    (m->vmp_unusual && (m->vmp_error || m->vmp_restart ||
+	    vm_page_is_private(m) || m->vmp_absent))) {
+		return 0;
+	}
+	if (vm_fault_cs_need_validation(pmap, m, object, PAGE_SIZE, 0)) {
+		/* validation needs the object locked exclusive and the page busy */
+		return 0;
+	}
+	/*
+	 * Leave alone any page vm_fault_cs_check_violation() would object
+	 * to even without execute access: the process would be made to pay
+	 * for a page it never touched.
+	 */
+	if (!fault_info->cs_bypass &&
+	    (VMP_CS_TAINTED(m, PAGE_SIZE, 0) ||
+	    (pmap_get_vm_map_cs_enforced(pmap) &&
+	    VMP_CS_VALIDATED(m, PAGE_SIZE, 0) && m->vmp_wpmapped))) {
+		return 0;
+	}
+	if (pmap_find_phys(pmap, vaddr) != 0) {
+		return 1;
+	}
+
+	/*
+	 * need_retry keeps vm_fault_enter() from blocking in the pmap
+	 * layer with the object locked: when the page table needs to be
+	 * expanded, we just stop here.
+	 */
+	kr = vm_fault_enter(m, pmap, vaddr, PAGE_SIZE, 0,
+	    prot, VM_PROT_READ, FALSE, VM_KERN_MEMORY_NONE,
+	    fault_info, &need_retry, &type_of_fault,
+	    object_lock_type, &page_sleep_needed);
+	if (kr != KERN_SUCCESS || need_retry || page_sleep_needed) {
+		return -1;
+	}
+	counter_inc(&vm_fault_around_count);
+	return 1;
+}
+
+/*
+ * Called with the faulting page entered, and the map and object still
+ * locked as they were for vm_fault_enter().  Neighbouring pages are only
+ * looked up within the object range the map entry covers ([lo_offset,
+ * hi_offset) in the fault info) and are mapped without write or execute
+ * access: dirty tracking and copy-on-write are left to the fault that
+ * actually writes to them, and code signing checks to the fault that
+ * actually executes them.
+ *
+ * Returns the number of pages now mapped contiguously after (positive)
+ * or before (negative) the faulting page, in the direction of the run,
+ * for vm_fault_around_sequential().
+ */
+static int32_t
+vm_fault_around(
+	pmap_t                  pmap,
+	vm_map_offset_t         vaddr,
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_prot_t               prot,
+	vm_object_fault_info_t  fault_info,
+	uint8_t                 *object_lock_type)
+{
+	vm_object_offset_t      lo, hi, cur;
+	uint32_t                ahead, behind;
+	int32_t                 contig_ahead = 0, contig_behind = 0;
+	bool                    contig = true;
+	int                     ret;
+
+	if (pmap == kernel_pmap ||
+	    object->phys_contiguous ||
+	    object->resident_page_count <= 1) {
+		return 0;
+	}
+	prot &= ~(VM_PROT_WRITE | VM_PROT_EXECUTE);
+	if (!(prot & VM_PROT_READ)) {
+		return 0;
+	}
+	if (pmap_has_prot_policy(pmap, fault_info->pmap_options & PMAP_OPTIONS_TRANSLATED_ALLOW_EXECUTE, prot)) {
+		return 0;
+	}
+
+	offset = vm_object_trunc_page(offset);
+	vm_fault_around_window(object, offset, fault_info->behavior, &ahead, &behind);
+
+	lo = vm_object_round_page(fault_info->lo_offset);
+	hi = vm_object_trunc_page(MIN(fault_info->hi_offset, object->vo_size));
+	if (lo > offset || hi <= offset) {
+		return 0;
+	}
+	if (offset - lo > ptoa_64(behind)) {
+		lo = offset - ptoa_64(behind);
+	}
+	if (hi - offset > ptoa_64(ahead + 1)) {
+		hi = offset + ptoa_64(ahead + 1);
+	}
+
+	/* walk away from the faulting page in both directions */
+	for (cur = offset + PAGE_SIZE_64; cur < hi; cur += PAGE_SIZE_64) {
+		ret = vm_fault_around_page(pmap, vaddr + (cur - offset),
+		    object, cur, prot, fault_info, object_lock_type);
+		if (ret < 0) {
+			break;
+		}
+		contig = contig && ret > 0;
+		if (contig) {
+			contig_ahead++;
+		}
+	}
+	contig = true;
+	for (cur = offset; cur > lo; cur -= PAGE_SIZE_64) {
+		ret = vm_fault_around_page(pmap, vaddr - (offset - cur + PAGE_SIZE_64),
+		    object, cur - PAGE_SIZE_64, prot, fault_info, object_lock_type);
+		if (ret < 0) {
+			break;
+		}
+		contig = contig && ret > 0;
+		if (contig) {
+			contig_behind++;
+		}
+	}
+
+	return (ahead >= behind) ? contig_ahead : -contig_behind;
+}
+
+/*
+ * The pages fault-around mapped won't fault on their own, so account
+ * for them as if they had been touched in sequence after the faulting
+ * one, for the next fault to find the run it extends.
+ *
+ * Same locking and update rules as vm_fault_is_sequential().
+ */
+static void
+vm_fault_around_sequential(
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	int32_t                 pages)
+{
+	int32_t                 orig_sequential = object->sequential;
+	int32_t                 sequential = orig_sequential;
+	vm_object_offset_t      last_alloc;
+
+	offset = vm_object_trunc_page(offset);
+	if (object->last_alloc != offset) {
+		return;
+	}
+	if (pages > 0) {
+		sequential = MIN(MAX(sequential, 0) + (int32_t)ptoa_32(pages),
+		    MAX_SEQUENTIAL_RUN);
+		last_alloc = offset + ptoa_64(pages);
+	} else {
+		if (offset < ptoa_64(-pages)) {
+			return;
+		}
+		sequential = MAX(MIN(sequential, 0) - (int32_t)ptoa_32(-pages),
+		    -MAX_SEQUENTIAL_RUN);
+		last_alloc = offset - ptoa_64(-pages);
+	}
+	if (!OSCompareAndSwap(orig_sequential, sequential, (UInt32 *)&object->sequential)) {
+		return;
+	}
+	object->last_alloc = last_alloc;
+}
+
 /*
  * Cleanup after a vm_fault_enter.
  * At this point, the fault should either have failed (kr != KERN_SUCCESS)
@@ -4256,6 +4502,7 @@ vm_fault_complete(
 	__unused vm_map_offset_t real_vaddr,
 #endif /* CONFIG_DTRACE */
 	int type_of_fault,
+	int32_t faulted_around,
 	boolean_t need_retry,
 	kern_return_t kr,
 	ppnum_t *physpage_p,
@@ -4324,6 +4571,9 @@ vm_fault_complete(
 		 * state being up to date
 		 */
 		vm_fault_is_sequential(m_object, cur_offset, fault_info->behavior);
+		if (faulted_around != 0) {
+			vm_fault_around_sequential(m_object, cur_offset, faulted_around);
+		}
 
 		vm_fault_deactivate_behind(m_object, cur_offset, fault_info->behavior);
 	}
@@ -4439,6 +4689,7 @@ vm_fault_internal(
 	vm_object_t             resilient_media_object = VM_OBJECT_NULL;
 	vm_object_offset_t      resilient_media_offset = (vm_object_offset_t)-1;
 	bool                    page_needs_data_sync = false;
+	int32_t                 faulted_around = 0;
 	/*
 	 * Was the VM object contended when vm_map_lookup_and_lock_object locked it?
 	 * If so, the zero fill path will drop the lock
@@ -5251,6 +5502,24 @@ FastPmapEnter:
 					    &page_sleep_needed);
 				}
 
+				if (kr == KERN_SUCCESS && !need_retry &&
+				    !page_sleep_needed &&
+				    object == m_object &&
+				    top_object == VM_OBJECT_NULL &&
+				    map == original_map && real_map == map &&
+				    caller_pmap == PMAP_NULL &&
+				    physpage_p == NULL &&
+				    !(fault_type & VM_PROT_WRITE) &&
+				    !fault_info->fi_change_wiring &&
+				    !resilient_media_retry &&
+				    fault_page_size == PAGE_SIZE) {
+					faulted_around = vm_fault_around(pmap, vaddr,
+					    object, offset, prot, fault_info,
+					    &object_lock_type);
+				} else {
+					faulted_around = 0;
+				}
+
 				vm_fault_complete(
 					map,
 					real_map,
@@ -5263,6 +5532,7 @@ FastPmapEnter:
 					caller_prot,
 					real_vaddr,
 					vm_fault_type_for_tracing(need_copy_on_read, type_of_fault),
+					faulted_around,
 					need_retry,
 					kr,
 					physpage_p,
@@ -5808,7 +6078,28 @@ FastPmapEnter:
 				}
 #endif /* MACH_ASSERT */
 
-				m = vm_page_grab_options(grab_options);
+				m = VM_PAGE_NULL;
+				bool m_prezeroed = false;
+#if VM_LPAGE
+				/*
+				 * try to populate the whole aligned run at once,
+				 * so that it can later be mapped with a large page
+				 */
+				if (vm_lpage_enabled &&
+				    caller_pmap == PMAP_NULL &&
+				    real_map == map &&
+				    pmap != kernel_pmap &&
+				    !fault_info->fi_change_wiring &&
+				    !map->no_zero_fill) {
+					m = vm_lpage_fault_grab(map, vaddr, object,
+					    vm_object_trunc_page(offset), fault_info);
+					/* the pool's runs were zeroed when set aside */
+					m_prezeroed = (m != VM_PAGE_NULL);
+				}
+#endif /* VM_LPAGE */
+				if (m == VM_PAGE_NULL) {
+					m = vm_page_grab_options(grab_options);
+				}
 				m_object = NULL;
 
 				if (m == VM_PAGE_NULL) {
@@ -5954,9 +6245,11 @@ FastPmapEnter:
 						 *   NOTE: This code holds the map
 						 *   lock across the zero fill.
 						 */
-						vm_page_zero_fill(
-							m
-							);
+						if (!m_prezeroed) {
+							vm_page_zero_fill(
+								m
+								);
+						}
 						counter_inc(&vm_statistics_zero_fill_count);
 						DTRACE_VM2(zfod, int, 1, (uint64_t *), NULL);
 					}
@@ -6061,6 +6354,7 @@ zero_fill_cleanup:
 					caller_prot,
 					real_vaddr,
 					type_of_fault,
+					0,
 					need_retry,
 					kr,
 					physpage_p,
@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Transparent large pages for anonymous memory.
+ *
+ * When the first page of an aligned 2MB range of a private anonymous
+ * object is zero-filled, the fault takes a whole physically contiguous,
+ * aligned run of zeroed pages instead of a single page, and inserts all of
+ * it.  Finding such a run (vm_page_find_contiguous()) is far too slow for
+ * the fault path, so runs are set aside ahead of time, while memory is
+ * plentiful, by the "VM_lpage" thread.
+ *
+ * The same thread then maps the rest of each run the fault populated and
+ * asks the pmap to replace its base mappings with one large mapping
+ * (pmap_promote_large()).  The pmap splits the mapping again on its own
+ * whenever one base page is changed: protected, unmapped, paged out or
+ * compressed.
+ *
+ * Off unless the "vm_lpage" boot-arg or the vm.lpage_enabled sysctl turns
+ * it on.
+ */
+
+#include <kern/kern_types.h>
+#include <kern/locks.h>
+#include <kern/sched_prim.h>
+#include <kern/thread.h>
+#include <kern/startup.h>
+#include <libkern/OSAtomic.h>
+
+#include <vm/cpm_internal.h>
+#include <vm/pmap.h>
+#include <vm/vm_fault_internal.h>
+#include <vm/vm_kern_xnu.h>
+#include <vm/vm_lpage_internal.h>
+#include <vm/vm_map_internal.h>
+#include <vm/vm_object_internal.h>
+#include <vm/vm_page_internal.h>
+
+#if VM_LPAGE
+
+#define VM_LPAGE_MASK           ((vm_map_offset_t)SUPERPAGE_SIZE - 1)
+#define VM_LPAGE_POOL_MAX       16      /* ceiling for vm.lpage_pool_target */
+#define VM_LPAGE_CANDIDATES     64      /* runs waiting for promotion */
+#define VM_LPAGE_TRIES          4       /* promotion attempts per run */
+#define VM_LPAGE_PERIOD_MS      1000    /* pool check interval while enabled */
+
+/* free pages the pool leaves alone above vm_page_free_target */
+#define VM_LPAGE_FREE_RESERVE   (4 * SUPERPAGE_NBASEPAGES)
+
+TUNABLE_WRITEABLE(uint32_t, vm_lpage_enabled, "vm_lpage", 0);
+TUNABLE_WRITEABLE(uint32_t, vm_lpage_pool_target, "vm_lpage_pool", 4);
+
+struct vm_lpage_candidate {
+	vm_map_t                vlc_map;        /* holds a reference */
+	vm_map_offset_t         vlc_va;         /* start of the run */
+	uint32_t                vlc_tries;
+};
+
+static LCK_GRP_DECLARE(vm_lpage_lck_grp, "vm_lpage");
+static LCK_SPIN_DECLARE(vm_lpage_lock, &vm_lpage_lck_grp);
+
+/* protected by vm_lpage_lock */
+static vm_page_t                        vm_lpage_pool[VM_LPAGE_POOL_MAX];
+uint32_t                                vm_lpage_pool_count;
+static struct vm_lpage_candidate        vm_lpage_candidates[VM_LPAGE_CANDIDATES];
+static uint32_t                         vm_lpage_candidate_head;
+static uint32_t                         vm_lpage_candidate_count;
+
+uint64_t vm_lpage_fault_allocs;
+uint64_t vm_lpage_pool_empty;
+uint64_t vm_lpage_promote_failed;
+
+static event_t  vm_lpage_event = (event_t)&vm_lpage_pool_count;
+
+static void     vm_lpage_thread(void);
+
+/*
+ * Returns the pages of a run cpm_allocate() left gobbled to the free list.
+ */
+static void
+vm_lpage_run_free(vm_page_t pages)
+{
+	vm_page_t       m;
+
+	vm_page_lockspin_queues();
+	for (m = pages; m != VM_PAGE_NULL; m = NEXT_PAGE(m)) {
+		assert(m->vmp_gobbled);
+		m->vmp_gobbled = FALSE;
+	}
+	vm_page_gobble_count -= SUPERPAGE_NBASEPAGES;
+	vm_page_wire_count -= SUPERPAGE_NBASEPAGES;
+	vm_page_unlock_queues();
+
+	vm_page_free_list(pages, false);
+}
+
+/*
+ * Keep vm_lpage_pool_target zeroed runs aside while free memory is
+ * comfortably above the free target, and give them all back as soon as
+ * it is not.
+ */
+static void
+vm_lpage_pool_balance(void)
+{
+	vm_page_t       pages;
+	uint32_t        target;
+
+	target = vm_lpage_enabled ? MIN(vm_lpage_pool_target, VM_LPAGE_POOL_MAX) : 0;
+	if (vm_page_free_count < vm_page_free_target) {
+		target = 0;
+	}
+
+	for (;;) {
+		pages = VM_PAGE_NULL;
+		lck_spin_lock(&vm_lpage_lock);
+		if (vm_lpage_pool_count > target) {
+			pages = vm_lpage_pool[--vm_lpage_pool_count];
+		}
+		lck_spin_unlock(&vm_lpage_lock);
+		if (pages == VM_PAGE_NULL) {
+			break;
+		}
+		vm_lpage_run_free(pages);
+	}
+
+	while (os_atomic_load(&vm_lpage_pool_count, relaxed) < target &&
+	    vm_page_free_count > vm_page_free_target + VM_LPAGE_FREE_RESERVE) {
+		if (cpm_allocate(SUPERPAGE_SIZE, &pages, 0, SUPERPAGE_NBASEPAGES - 1,
+		    FALSE, KMA_ZERO) != KERN_SUCCESS) {
+			break;
+		}
+		lck_spin_lock(&vm_lpage_lock);
+		if (vm_lpage_pool_count < VM_LPAGE_POOL_MAX) {
+			vm_lpage_pool[vm_lpage_pool_count++] = pages;
+			pages = VM_PAGE_NULL;
+		}
+		lck_spin_unlock(&vm_lpage_lock);
+		if (pages != VM_PAGE_NULL) {
+			vm_lpage_run_free(pages);
+			break;
+		}
+	}
+}
+
+static void
+vm_lpage_candidate_add(vm_map_t map, vm_map_offset_t va, uint32_t tries)
+{
+	struct vm_lpage_candidate *vlc;
+
+	lck_spin_lock(&vm_lpage_lock);
+	if (vm_lpage_candidate_count == VM_LPAGE_CANDIDATES) {
+		lck_spin_unlock(&vm_lpage_lock);
+		vm_map_deallocate(map);
+		return;
+	}
+	vlc = &vm_lpage_candidates[(vm_lpage_candidate_head +
+	    vm_lpage_candidate_count++) % VM_LPAGE_CANDIDATES];
+	vlc->vlc_map = map;
+	vlc->vlc_va = va;
+	vlc->vlc_tries = tries;
+	lck_spin_unlock(&vm_lpage_lock);
+
+	thread_wakeup(vm_lpage_event);
+}
+
+/*
+ * Map every page of the run at "va" and try to promote it.
+ * Returns KERN_SUCCESS once promoted, KERN_FAILURE if the run cannot be
+ * promoted as it stands, and KERN_RESOURCE_SHORTAGE if it is worth trying
+ * again later.
+ */
+static kern_return_t
+vm_lpage_promote(vm_map_t map, vm_map_offset_t va)
+{
+	vm_map_entry_t          entry;
+	vm_object_t             object;
+	vm_object_offset_t      offset;
+	vm_prot_t               prot;
+	vm_page_t               m;
+	ppnum_t                 base = 0;
+	uint8_t                 object_lock_type = OBJECT_LOCK_EXCLUSIVE;
+	kern_return_t           kr = KERN_FAILURE;
+	unsigned int            i;
+	struct vm_object_fault_info fault_info = {
+		.interruptible = THREAD_UNINT,
+	};
+
+	vm_map_lock_read(map);
+	if (map->pmap == PMAP_NULL || map->pmap == kernel_pmap ||
+	    !vm_map_lookup_entry(map, va, &entry) ||
+	    entry->is_sub_map ||
+	    entry->vme_end < va + SUPERPAGE_SIZE ||
+	    entry->wired_count != 0 ||
+	    entry->used_for_jit ||
+	    (entry->protection & VM_PROT_EXECUTE)) {
+		goto done;
+	}
+	object = VME_OBJECT(entry);
+	offset = VME_OFFSET(entry) + (va - entry->vme_start);
+	if (object == VM_OBJECT_NULL || (offset & VM_LPAGE_MASK) != 0) {
+		goto done;
+	}
+	prot = entry->protection;
+	if (entry->needs_copy) {
+		prot &= ~VM_PROT_WRITE;
+	}
+
+	fault_info.behavior = entry->behavior;
+	fault_info.lo_offset = VME_OFFSET(entry);
+	fault_info.hi_offset = VME_OFFSET(entry) + (entry->vme_end - entry->vme_start);
+
+	vm_object_lock(object);
+	if (!object->internal ||
+	    object->shadow != VM_OBJECT_NULL ||
+	    object->vo_copy != VM_OBJECT_NULL ||
+	    object->purgable != VM_PURGABLE_DENY ||
+	    object->phys_contiguous) {
+		goto unlock_object;
+	}
+	for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+		m = vm_page_lookup(object, offset + ptoa_64(i));
+		if (m == VM_PAGE_NULL ||
+		    m->vmp_busy || m->vmp_cleaning || m->vmp_laundry ||
+		    vm_page_is_fictitious(m) || VM_PAGE_WIRED(m) ||
+		    (m->vmp_unusual && (VMP_ERROR_GET(m) || m->vmp_restart ||
+		    vm_page_is_private(m) || m->vmp_absent))) {
+			if (m != VM_PAGE_NULL && (m->vmp_busy || m->vmp_cleaning)) {
+				kr = KERN_RESOURCE_SHORTAGE;
+			}
+			goto unlock_object;
+		}
+		if (i == 0) {
+			base = VM_PAGE_GET_PHYS_PAGE(m);
+			if (base & (SUPERPAGE_NBASEPAGES - 1)) {
+				goto unlock_object;
+			}
+		} else if (VM_PAGE_GET_PHYS_PAGE(m) != base + i) {
+			goto unlock_object;
+		}
+	}
+
+	for (i = 0; i < SUPERPAGE_NBASEPAGES; i++) {
+		boolean_t       need_retry = FALSE;
+		bool            page_sleep_needed = false;
+		int             type_of_fault = DBG_CACHE_HIT_FAULT;
+
+		m = vm_page_lookup(object, offset + ptoa_64(i));
+		/*
+		 * need_retry keeps vm_fault_enter() from blocking in the
+		 * pmap layer with the object locked.
+		 */
+		kr = vm_fault_enter(m, map->pmap, va + ptoa(i), PAGE_SIZE, 0,
+		    prot, VM_PROT_READ, FALSE, VM_KERN_MEMORY_NONE,
+		    &fault_info, &need_retry, &type_of_fault,
+		    &object_lock_type, &page_sleep_needed);
+		if (kr != KERN_SUCCESS || need_retry || page_sleep_needed) {
+			kr = KERN_RESOURCE_SHORTAGE;
+			goto unlock_object;
+		}
+	}
+	vm_object_unlock(object);
+
+	kr = pmap_promote_large(map->pmap, va);
+	vm_map_unlock_read(map);
+	return kr;
+
+unlock_object:
+	vm_object_unlock(object);
+done:
+	vm_map_unlock_read(map);
+	return kr;
+}
+
+static void
+vm_lpage_promote_candidates(void)
+{
+	struct vm_lpage_candidate vlc;
+	uint32_t        count;
+	kern_return_t   kr;
+
+	/* only what was queued so far: retries wait for the next round */
+	lck_spin_lock(&vm_lpage_lock);
+	count = vm_lpage_candidate_count;
+	lck_spin_unlock(&vm_lpage_lock);
+
+	while (count-- > 0) {
+		lck_spin_lock(&vm_lpage_lock);
+		vlc = vm_lpage_candidates[vm_lpage_candidate_head];
+		vm_lpage_candidate_head = (vm_lpage_candidate_head + 1) % VM_LPAGE_CANDIDATES;
+		vm_lpage_candidate_count--;
+		lck_spin_unlock(&vm_lpage_lock);
+
+		kr = vm_lpage_enabled ? vm_lpage_promote(vlc.vlc_map, vlc.vlc_va) : KERN_FAILURE;
+		if (kr == KERN_RESOURCE_SHORTAGE && ++vlc.vlc_tries < VM_LPAGE_TRIES) {
+			vm_lpage_candidate_add(vlc.vlc_map, vlc.vlc_va, vlc.vlc_tries);
+			continue;
+		}
+		if (kr != KERN_SUCCESS) {
+			os_atomic_inc(&vm_lpage_promote_failed, relaxed);
+		}
+		vm_map_deallocate(vlc.vlc_map);
+	}
+}
+
+static void
+vm_lpage_thread(void)
+{
+	vm_lpage_promote_candidates();
+	vm_lpage_pool_balance();
+
+	if (vm_lpage_enabled || vm_lpage_pool_count != 0) {
+		assert_wait_timeout(vm_lpage_event, THREAD_UNINT,
+		    VM_LPAGE_PERIOD_MS, NSEC_PER_MSEC);
+	} else {
+		assert_wait(vm_lpage_event, THREAD_UNINT);
+	}
+	thread_block((thread_continue_t)vm_lpage_thread);
+	/*NOTREACHED*/
+}
+
+void
+vm_lpage_init(void)
+{
+	kern_return_t   result;
+	thread_t        thread;
+
+	result = kernel_thread_start_priority((thread_continue_t)vm_lpage_thread,
+	    NULL, BASEPRI_DEFAULT, &thread);
+	if (result != KERN_SUCCESS) {
+		panic("vm_lpage_init: create failed");
+	}
+	thread_set_thread_name(thread, "VM_lpage");
+	thread_deallocate(thread);
+}
+
+vm_page_t
+vm_lpage_fault_grab(
+	vm_map_t                map,
+	vm_map_offset_t         vaddr,
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_object_fault_info_t  fault_info)
+{
+	vm_object_offset_t      run_offset, cur;
+	vm_map_offset_t         run_va;
+	vm_page_t               pages, m, next, fault_m = VM_PAGE_NULL;
+	unsigned int            fault_index, i;
+
+	vm_object_lock_assert_exclusive(object);
+
+	run_offset = offset & ~(vm_object_offset_t)VM_LPAGE_MASK;
+	run_va = vaddr & ~VM_LPAGE_MASK;
+	fault_index = (unsigned int)atop_64(offset - run_offset);
+
+	if (vaddr - run_va != offset - run_offset ||
+	    !object->internal ||
+	    object->shadow != VM_OBJECT_NULL ||
+	    object->vo_copy != VM_OBJECT_NULL ||
+	    object->purgable != VM_PURGABLE_DENY ||
+	    object->phys_contiguous ||
+	    run_offset < fault_info->lo_offset ||
+	    run_offset + SUPERPAGE_SIZE > fault_info->hi_offset ||
+	    run_offset + SUPERPAGE_SIZE > object->vo_size) {
+		return VM_PAGE_NULL;
+	}
+
+	/*
+	 * The whole run must still be untouched.  Start next to the
+	 * faulting page, where an earlier fault is most likely to be.
+	 */
+	for (i = 1; i < SUPERPAGE_NBASEPAGES; i++) {
+		cur = run_offset + ptoa_64((fault_index + i) % SUPERPAGE_NBASEPAGES);
+		if (object->resident_page_count != 0 &&
+		    vm_page_lookup(object, cur) != VM_PAGE_NULL) {
+			return VM_PAGE_NULL;
+		}
+		if (object->pager != MEMORY_OBJECT_NULL &&
+		    vm_object_compressor_pager_state_get(object, cur) == VM_EXTERNAL_STATE_EXISTS) {
+			return VM_PAGE_NULL;
+		}
+	}
+
+	pages = VM_PAGE_NULL;
+	lck_spin_lock(&vm_lpage_lock);
+	if (vm_lpage_pool_count != 0) {
+		pages = vm_lpage_pool[--vm_lpage_pool_count];
+	}
+	lck_spin_unlock(&vm_lpage_lock);
+	thread_wakeup(vm_lpage_event);
+	if (pages == VM_PAGE_NULL) {
+		os_atomic_inc(&vm_lpage_pool_empty, relaxed);
+		return VM_PAGE_NULL;
+	}
+
+	/*
+	 * The pool's runs are already zeroed: insert all but the faulting
+	 * page, then put them on the active queue, which also takes care of
+	 * their gobbled state.  The run stays linked through vmp_snext until
+	 * then, which shares storage with vmp_pageq.
+	 */
+	for (i = 0, m = pages; m != VM_PAGE_NULL; i++, m = NEXT_PAGE(m)) {
+		if (i == fault_index) {
+			fault_m = m;
+			continue;
+		}
+		m->vmp_busy = FALSE;
+		vm_page_insert(m, object, run_offset + ptoa_64(i));
+	}
+	assert(i == SUPERPAGE_NBASEPAGES && fault_m != VM_PAGE_NULL);
+
+	/*
+	 * Like vm_page_do_delayed_work(), hold the page queues lock for a
+	 * bounded batch of pages at a time rather than for the whole run.
+	 * The object lock keeps the run's pages where they are in between.
+	 */
+	m = pages;
+	while (m != VM_PAGE_NULL) {
+		vm_page_lockspin_queues();
+		for (i = 0; m != VM_PAGE_NULL && i < DEFAULT_DELAYED_WORK_LIMIT; m = next) {
+			next = NEXT_PAGE(m);
+			NEXT_PAGE(m) = VM_PAGE_NULL;
+			if (m != fault_m) {
+				vm_page_activate(m);
+				i++;
+			}
+		}
+		if (m != VM_PAGE_NULL) {
+			vm_page_unlock_queues();
+		}
+	}
+	fault_m->vmp_gobbled = FALSE;
+	vm_page_gobble_count--;
+	vm_page_wire_count--;
+	vm_page_unlock_queues();
+
+	fault_m->vmp_busy = TRUE;
+	os_atomic_inc(&vm_lpage_fault_allocs, relaxed);
+
+	vm_map_reference(map);
+	vm_lpage_candidate_add(map, run_va, 0);
+
+	return fault_m;
+}
+
+#endif /* VM_LPAGE */
+
+void
+vm_lpage_stats(struct vm_lpage_stats *stats)
+{
+	bzero(stats, sizeof(*stats));
+#if VM_LPAGE
+	pmap_large_page_stats(&stats->vls_promotions, &stats->vls_demotions,
+	    &stats->vls_mappings);
+	stats->vls_fault_allocs = os_atomic_load(&vm_lpage_fault_allocs, relaxed);
+	stats->vls_pool_empty = os_atomic_load(&vm_lpage_pool_empty, relaxed);
+#endif /* VM_LPAGE */
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _VM_VM_LPAGE_INTERNAL_H_
+#define _VM_VM_LPAGE_INTERNAL_H_
+
+#include <sys/cdefs.h>
+#include <vm/vm_options.h>
+#include <mach/mach_types.h>
+
+__BEGIN_DECLS
+
+#ifdef  MACH_KERNEL_PRIVATE
+
+/*
+ * Transparent large pages for anonymous memory.
+ */
+
+/*
+ * Counters reported through host_statistics64(HOST_VM_INFO64) and the
+ * vm.lpage_* sysctls.  All zero where VM_LPAGE is off.
+ */
+struct vm_lpage_stats {
+	uint64_t        vls_promotions;         /* runs mapped with a large page */
+	uint64_t        vls_demotions;          /* ... and split back into base pages */
+	uint64_t        vls_mappings;           /* large mappings currently in place */
+	uint64_t        vls_fault_allocs;       /* aligned runs populated by a zero-fill fault */
+	uint64_t        vls_pool_empty;         /* ... that found no run ready */
+};
+
+extern void             vm_lpage_stats(struct vm_lpage_stats *stats);
+
+#if VM_LPAGE
+extern void             vm_lpage_init(void);
+
+/*
+ * Called from the zero-fill fault path, with the map locked shared and the
+ * top object locked exclusive, in place of vm_page_grab().  Returns NULL
+ * unless the whole aligned run around "offset" can be populated at once;
+ * otherwise the other pages of the run are inserted into "object" and the
+ * page for "offset" is returned busy, for the caller to insert and map.
+ */
+extern vm_page_t        vm_lpage_fault_grab(
+	vm_map_t                map,
+	vm_map_offset_t         vaddr,
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_object_fault_info_t  fault_info);
+
+extern uint32_t         vm_lpage_enabled;
+#endif /* VM_LPAGE */
+
+#endif  /* MACH_KERNEL_PRIVATE */
+
+__END_DECLS
+
+#endif  /* _VM_VM_LPAGE_INTERNAL_H_ */
@@ -330,6 +330,9 @@ static const struct vm_object vm_object_template = {
 #endif /* COMPRESSOR_PAGEOUT_CHEADS_MAX_COUNT > 1 */
 #if CONFIG_PHANTOM_CACHE
 	.phantom_object_id = 0,
+	.phantom_refaults = 0,
+	.phantom_refaults_protected = 0,
+	.phantom_refault_distance = 0,
 #endif
 	.cow_hint = ~(vm_offset_t)0,
 
@@ -374,6 +374,10 @@ struct vm_object {
 
 #if CONFIG_PHANTOM_CACHE
 	uint32_t                phantom_object_id;
+	/* hold object lock when altering */
+	uint32_t                phantom_refaults;
+	uint32_t                phantom_refaults_protected;
+	uint64_t                phantom_refault_distance;
 #endif
 #if CONFIG_IOSCHED || UPL_DEBUG
 	queue_head_t            uplq;           /* List of outstanding upls */
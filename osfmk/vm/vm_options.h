@@ -62,4 +62,14 @@
 
 #define PAGE_SLEEP_WITH_INHERITOR (1)
 
+/*
+ * Transparent large pages for anonymous memory (see vm_lpage.c): needs
+ * pmap_promote_large(), which only the x86_64 pmap provides.
+ */
+#if defined(__x86_64__)
+#define VM_LPAGE 1
+#else /* defined(__x86_64__) */
+#define VM_LPAGE 0
+#endif /* defined(__x86_64__) */
+
 #endif /* __VM_VM_OPTIONS_H__ */
@@ -754,6 +754,19 @@ extern void             vm_page_free_unlocked(
 extern void             vm_page_balance_inactive(
 	int             max_to_move);
 
+extern bool             vm_mglru_enabled;
+
+extern void             vm_mglru_page_enqueued(
+	vm_page_t       page,
+	boolean_t       first);
+
+extern void             vm_mglru_page_dequeued(
+	vm_page_t       page);
+
+extern void             vm_page_requeue_tail(
+	vm_page_queue_head_t    *q,
+	vm_page_t               page);
+
 extern void             vm_page_activate(
 	vm_page_t       page);
 
@@ -1099,6 +1112,10 @@ struct vm_page_delayed_work_ctx {
 
 kern_return_t vm_page_do_delayed_work(vm_object_t object, vm_tag_t tag, struct vm_page_delayed_work *dwp, int dw_count);
 
+#if CONFIG_PHANTOM_CACHE
+extern void vm_pageout_refault(vm_object_t object, struct vm_page_delayed_work *dwp, uint32_t distance);
+#endif /* CONFIG_PHANTOM_CACHE */
+
 #define DELAYED_WORK_LIMIT(max) ((vm_max_delayed_work_limit >= max ? max : vm_max_delayed_work_limit))
 
 /*
@@ -122,6 +122,7 @@
 #if CONFIG_PHANTOM_CACHE
 #include <vm/vm_phantom_cache_internal.h>
 #endif
+#include <vm/vm_lpage_internal.h>
 
 
 #if UPL_DEBUG
@@ -1231,8 +1232,7 @@ vm_pageout_disconnect_all_pages_in_queue(vm_page_queue_head_t *q, int qcount)
 			disconnected_count++;
 		}
 reenter_pg_on_q:
-		vm_page_queue_remove(q, m, vmp_pageq);
-		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_requeue_tail(q, m);
 
 		qcount--;
 		try_failed_count = 0;
@@ -1539,8 +1539,7 @@ vm_pageout_page_queue(vm_page_queue_head_t *q, size_t qcount, bool perf_test)
 		goto next_pg;
 
 reenter_pg_on_q:
-		vm_page_queue_remove(q, m, vmp_pageq);
-		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_requeue_tail(q, m);
 next_pg:
 		qcount--;
 		try_failed_count = 0;
@@ -2907,6 +2906,9 @@ vps_deal_with_throttled_queues(vm_page_t m, vm_object_t *object, uint32_t *vm_pa
 		m->vmp_q_state = VM_PAGE_ON_ACTIVE_Q;
 		vm_page_active_count++;
 		vm_page_pageable_external_count++;
+		if (vm_mglru_enabled) {
+			vm_mglru_page_enqueued(m, FALSE);
+		}
 
 		vm_pageout_adjust_eq_iothrottle(&pgo_iothread_external_state, FALSE);
 
@@ -2950,32 +2952,291 @@ vps_deal_with_throttled_queues(vm_page_t m, vm_object_t *object, uint32_t *vm_pa
 }
 
 
+/*
+ * vm_page_balance_inactive() takes pages off the head of the active queue,
+ * mostly a page or two at a time.  Rather than going to the pmap layer for
+ * the reference bit of each of them, it clears the bits of up to
+ * VM_PAGEOUT_REFMOD_BATCH pages there in one call.
+ *
+ * The two-list path deactivates the pages it cleared right away, without
+ * dropping the page queues lock.  vm_mglru_balance_inactive() needs the
+ * bits before it decides what to do with each page, so it harvests the
+ * next VM_PAGEOUT_REFMOD_BATCH pages, folds their bits into vmp_reference
+ * and remembers which pages those were.  If the head of the queue is no
+ * longer the next page we harvested (pages were inserted at the head or
+ * pulled off the queue behind our back), the rest of the batch is dropped
+ * and a new one is harvested from the current head.
+ *
+ * Protected by the page queues lock.
+ */
+#define VM_PAGEOUT_REFMOD_BATCH 32
+
+static struct {
+	vm_page_t       vprh_pages[VM_PAGEOUT_REFMOD_BATCH];
+	unsigned int    vprh_next;
+	unsigned int    vprh_count;
+} vm_pageout_refmod_harvest;
+
+SCALABLE_COUNTER_DEFINE(vm_pageout_refmod_batches);
+
+/*
+ * Clear the pmap reference bits of "count" pages and fold the ones that
+ * were set into vmp_reference.
+ */
+static void
+vm_pageout_clear_references(vm_page_t *pages, unsigned int count)
+{
+	vm_page_t       pmapped[VM_PAGEOUT_REFMOD_BATCH];
+	ppnum_t         pns[VM_PAGEOUT_REFMOD_BATCH];
+	unsigned int    refmod[VM_PAGEOUT_REFMOD_BATCH];
+	unsigned int    npmapped = 0;
+	unsigned int    i;
+
+	assert(count <= VM_PAGEOUT_REFMOD_BATCH);
+
+	for (i = 0; i < count; i++) {
+		if (pages[i]->vmp_pmapped == TRUE) {
+			pmapped[npmapped] = pages[i];
+			pns[npmapped] = VM_PAGE_GET_PHYS_PAGE(pages[i]);
+			npmapped++;
+		}
+	}
+	if (npmapped == 0) {
+		return;
+	}
+	/*
+	 * We might be holding the page queue lock as a
+	 * spin lock and clearing the "referenced" bits could
+	 * take a while if there are lots of mappings of
+	 * these pages, so make sure we acquire the lock as
+	 * as mutex to avoid a spinlock timeout.
+	 *
+	 * by not passing in a pmap_flush_context we will forgo any TLB flushing, local or otherwise...
+	 *
+	 * a TLB flush isn't really needed here since at worst we'll miss the reference bit being
+	 * updated in the PTE if a remote processor still has this mapping cached in its TLB when the
+	 * new reference happens. If no futher references happen on the page after that remote TLB flushes
+	 * we'll see a clean, non-referenced page when it eventually gets pulled out of the inactive queue
+	 * by pageout_scan, which is just fine since the last reference would have happened quite far
+	 * in the past (TLB caches don't hang around for very long), and of course could just as easily
+	 * have happened before we moved the page
+	 */
+	vm_page_lockconvert_queues();
+	pmap_clear_refmod_batch(pns, refmod, npmapped, VM_MEM_REFERENCED, PMAP_OPTIONS_NOFLUSH);
+
+	for (i = 0; i < npmapped; i++) {
+		if (refmod[i] & VM_MEM_REFERENCED) {
+			pmapped[i]->vmp_reference = TRUE;
+		}
+	}
+	counter_inc(&vm_pageout_refmod_batches);
+}
+
+static void
+vm_pageout_harvest_active_head(void)
+{
+	vm_page_t       m;
+	unsigned int    count = 0;
+
+	for (m = (vm_page_t) vm_page_queue_first(&vm_page_queue_active);
+	    !vm_page_queue_end(&vm_page_queue_active, (vm_page_queue_entry_t) m) &&
+	    count < VM_PAGEOUT_REFMOD_BATCH;
+	    m = (vm_page_t) vm_page_queue_next(&m->vmp_pageq)) {
+		vm_pageout_refmod_harvest.vprh_pages[count++] = m;
+	}
+	vm_pageout_refmod_harvest.vprh_next = 0;
+	vm_pageout_refmod_harvest.vprh_count = count;
+
+	vm_pageout_clear_references(vm_pageout_refmod_harvest.vprh_pages, count);
+}
+
+/*
+ * Returns the page at the head of the active queue, with its pmap
+ * reference bit folded into vmp_reference and cleared.
+ */
+static vm_page_t
+vm_pageout_active_head_harvested(void)
+{
+	vm_page_t       m;
+
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	m = (vm_page_t) vm_page_queue_first(&vm_page_queue_active);
+
+	if (vm_pageout_refmod_harvest.vprh_next >= vm_pageout_refmod_harvest.vprh_count ||
+	    vm_pageout_refmod_harvest.vprh_pages[vm_pageout_refmod_harvest.vprh_next] != m) {
+		vm_pageout_harvest_active_head();
+	}
+	vm_pageout_refmod_harvest.vprh_next++;
+
+	return m;
+}
+
+
+/*
+ * Multi-generation aging of the active queue (boot-arg "vm_mglru").
+ *
+ * The active queue is kept as a FIFO of up to VM_MGLRU_NGENS generations:
+ * a page entering it at the tail is tagged with the youngest generation
+ * (vm_mglru_max_seq), so the head always holds the oldest one.  The tag
+ * lives in vmp_local_id, which is unused while a page is on
+ * VM_PAGE_ON_ACTIVE_Q; 0 means untagged (pages spliced in at the head from
+ * the throttled or local queues) and counts as older than any generation.
+ *
+ * vm_page_balance_inactive() then feeds the inactive queue from the oldest
+ * generation only, promoting a page referenced since it was enqueued to the
+ * youngest generation instead of deactivating it.  A new generation is
+ * opened once the youngest holds its share of the active queue, and the
+ * oldest is retired once it is empty.
+ */
+#define VM_MGLRU_NGENS          4
+#define VM_MGLRU_GEN(seq)       ((seq) % VM_MGLRU_NGENS)
+
+TUNABLE(bool, vm_mglru_enabled, "vm_mglru", false);
+
+uint32_t        vm_mglru_max_seq = 0;
+uint32_t        vm_mglru_min_seq = 0;
+uint32_t        vm_mglru_gen_count[VM_MGLRU_NGENS];
+
+SCALABLE_COUNTER_DEFINE(vm_mglru_promoted);
+SCALABLE_COUNTER_DEFINE(vm_mglru_refault_activated);
+
+static void
+vm_mglru_inc_max_seq(void)
+{
+	if (vm_mglru_max_seq - vm_mglru_min_seq < VM_MGLRU_NGENS - 1) {
+		vm_mglru_max_seq++;
+	}
+}
+
 void
-vm_page_balance_inactive(int max_to_move)
+vm_mglru_page_enqueued(vm_page_t m, boolean_t first)
 {
-	vm_page_t m;
+	uint32_t gen;
 
 	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+	assert(m->vmp_q_state == VM_PAGE_ON_ACTIVE_Q);
+	assert(m->vmp_local_id == 0);
 
-	if (hibernation_vmqueues_inspection || hibernate_cleaning_in_progress) {
-		/*
-		 * It is likely that the hibernation code path is
-		 * dealing with these very queues as we are about
-		 * to move pages around in/from them and completely
-		 * change the linkage of the pages.
-		 *
-		 * And so we skip the rebalancing of these queues.
-		 */
+	if (first) {
+		/* the head is older than any generation: leave it untagged */
 		return;
 	}
-	vm_page_inactive_target = VM_PAGE_INACTIVE_TARGET(vm_page_active_count +
-	    vm_page_inactive_count +
-	    vm_page_speculative_count);
+	gen = VM_MGLRU_GEN(vm_mglru_max_seq);
+	m->vmp_local_id = (uint16_t)(gen + 1);
+
+	if (++vm_mglru_gen_count[gen] > vm_page_active_count / VM_MGLRU_NGENS) {
+		vm_mglru_inc_max_seq();
+	}
+}
+
+void
+vm_mglru_page_dequeued(vm_page_t m)
+{
+	uint32_t gen;
+
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (m->vmp_local_id == 0) {
+		return;
+	}
+	gen = m->vmp_local_id - 1;
+	m->vmp_local_id = 0;
+
+	assert(vm_mglru_gen_count[gen] > 0);
+	vm_mglru_gen_count[gen]--;
+
+	while (vm_mglru_min_seq != vm_mglru_max_seq &&
+	    vm_mglru_gen_count[VM_MGLRU_GEN(vm_mglru_min_seq)] == 0) {
+		vm_mglru_min_seq++;
+	}
+}
+
+/*
+ * Move "m" to the tail of "q", the queue it is on.  On the active queue
+ * with vm_mglru, the tail is the youngest generation: the page is re-tagged
+ * to match, or it would keep an older generation's tag behind younger ones.
+ *
+ * Called with the page queues locked.
+ */
+void
+vm_page_requeue_tail(vm_page_queue_head_t *q, vm_page_t m)
+{
+	vm_page_queue_remove(q, m, vmp_pageq);
+	vm_page_queue_enter(q, m, vmp_pageq);
+
+	if (vm_mglru_enabled && m->vmp_q_state == VM_PAGE_ON_ACTIVE_Q) {
+		vm_mglru_page_dequeued(m);
+		vm_mglru_page_enqueued(m, FALSE);
+	}
+}
+
+#if CONFIG_PHANTOM_CACHE
+/*
+ * Working-set protection (boot-arg "vm_refault_protect").
+ *
+ * A file page found in the phantom cache when it is read back in comes
+ * with its refault distance: the number of file pages evicted since it
+ * left.  Had the active queue been that many pages larger, the page would
+ * never have been evicted, so a page whose refault distance is within the
+ * size of the active queue is part of the working set: rather than
+ * letting it age through the speculative or inactive queues again, it is
+ * activated straight away (into the youngest generation with vm_mglru).
+ * A page refaulting from further away is left on the queue the pagein
+ * chose, where it has to prove itself like any other page.
+ *
+ * With vm_refault_protect set to 0, the distance is ignored: every
+ * refault is activated with vm_mglru, and none without it.
+ *
+ * Called with the page queues and the page's object locked.
+ */
+TUNABLE_WRITEABLE(uint32_t, vm_refault_protect, "vm_refault_protect", 1);
+
+SCALABLE_COUNTER_DEFINE(vm_refault_activated);
+SCALABLE_COUNTER_DEFINE(vm_refault_deferred);
+
+void
+vm_pageout_refault(vm_object_t object, struct vm_page_delayed_work *dwp, uint32_t distance)
+{
+	task_t task;
+
+	if ((dwp->dw_mask & DW_vm_page_free) ||
+	    !(dwp->dw_mask & (DW_vm_page_speculate | DW_vm_page_deactivate_internal))) {
+		return;
+	}
+	if (vm_refault_protect == 0) {
+		if (!vm_mglru_enabled) {
+			return;
+		}
+	} else if (distance > vm_page_active_count) {
+		counter_inc(&vm_refault_deferred);
+		return;
+	}
+	dwp->dw_mask &= ~(DW_vm_page_speculate | DW_vm_page_deactivate_internal);
+	dwp->dw_mask |= DW_vm_page_activate;
+
+	object->phantom_refaults_protected++;
+	task = current_task();
+	if (task != kernel_task) {
+		os_atomic_inc(&task->refaults_protected, relaxed);
+	}
+
+	counter_inc(&vm_refault_activated);
+	if (vm_mglru_enabled) {
+		counter_inc(&vm_mglru_refault_activated);
+	}
+}
+#endif /* CONFIG_PHANTOM_CACHE */
+
+static void
+vm_mglru_balance_inactive(int max_to_move)
+{
+	vm_page_t       m;
 
 	while (max_to_move-- && (vm_page_inactive_count + vm_page_speculative_count) < vm_page_inactive_target) {
 		VM_PAGEOUT_DEBUG(vm_pageout_balanced, 1);
 
-		m = (vm_page_t) vm_page_queue_first(&vm_page_queue_active);
+		m = vm_pageout_active_head_harvested();
 
 		assert(m->vmp_q_state == VM_PAGE_ON_ACTIVE_Q);
 		assert(!m->vmp_laundry);
@@ -2984,27 +3245,27 @@ vm_page_balance_inactive(int max_to_move)
 
 		DTRACE_VM2(scan, int, 1, (uint64_t *), NULL);
 
-		/*
-		 * by not passing in a pmap_flush_context we will forgo any TLB flushing, local or otherwise...
-		 *
-		 * a TLB flush isn't really needed here since at worst we'll miss the reference bit being
-		 * updated in the PTE if a remote processor still has this mapping cached in its TLB when the
-		 * new reference happens. If no futher references happen on the page after that remote TLB flushes
-		 * we'll see a clean, non-referenced page when it eventually gets pulled out of the inactive queue
-		 * by pageout_scan, which is just fine since the last reference would have happened quite far
-		 * in the past (TLB caches don't hang around for very long), and of course could just as easily
-		 * have happened before we moved the page
-		 */
-		if (m->vmp_pmapped == TRUE) {
+		if (m->vmp_local_id == VM_MGLRU_GEN(vm_mglru_max_seq) + 1) {
 			/*
-			 * We might be holding the page queue lock as a
-			 * spin lock and clearing the "referenced" bit could
-			 * take a while if there are lots of mappings of
-			 * that page, so make sure we acquire the lock as
-			 * as mutex to avoid a spinlock timeout.
+			 * we've worked our way into the youngest generation:
+			 * open a new one so that the pages we promote from
+			 * here on are kept apart from it
 			 */
-			vm_page_lockconvert_queues();
-			pmap_clear_refmod_options(VM_PAGE_GET_PHYS_PAGE(m), VM_MEM_REFERENCED, PMAP_OPTIONS_NOFLUSH, (void *)NULL);
+			vm_mglru_inc_max_seq();
+		}
+
+		/*
+		 * the pmap reference bit has already been folded into
+		 * vmp_reference: a reference we missed because of a stale
+		 * TLB entry only costs the page its promotion
+		 */
+		if (m->vmp_reference) {
+			m->vmp_reference = FALSE;
+
+			vm_page_requeue_tail(&vm_page_queue_active, m);
+
+			counter_inc(&vm_mglru_promoted);
+			continue;
 		}
 
 		/*
@@ -3016,6 +3277,86 @@ vm_page_balance_inactive(int max_to_move)
 	}
 }
 
+void
+vm_page_balance_inactive(int max_to_move)
+{
+	vm_page_t       m;
+	vm_page_t       pages[VM_PAGEOUT_REFMOD_BATCH];
+	unsigned int    count, n, i;
+
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (hibernation_vmqueues_inspection || hibernate_cleaning_in_progress) {
+		/*
+		 * It is likely that the hibernation code path is
+		 * dealing with these very queues as we are about
+		 * to move pages around in/from them and completely
+		 * change the linkage of the pages.
+		 *
+		 * And so we skip the rebalancing of these queues.
+		 */
+		return;
+	}
+	vm_page_inactive_target = VM_PAGE_INACTIVE_TARGET(vm_page_active_count +
+	    vm_page_inactive_count +
+	    vm_page_speculative_count);
+
+	if (vm_mglru_enabled) {
+		vm_mglru_balance_inactive(max_to_move);
+		return;
+	}
+
+	while (max_to_move > 0 && (vm_page_inactive_count + vm_page_speculative_count) < vm_page_inactive_target) {
+		/*
+		 * each deactivation adds at most one page to the inactive
+		 * and speculative queues, so we never take more pages than
+		 * the shortfall
+		 */
+		count = MIN((unsigned int)max_to_move, VM_PAGEOUT_REFMOD_BATCH);
+		count = MIN(count, vm_page_inactive_target -
+		    (vm_page_inactive_count + vm_page_speculative_count));
+
+		n = 0;
+		for (m = (vm_page_t) vm_page_queue_first(&vm_page_queue_active);
+		    !vm_page_queue_end(&vm_page_queue_active, (vm_page_queue_entry_t) m) &&
+		    n < count;
+		    m = (vm_page_t) vm_page_queue_next(&m->vmp_pageq)) {
+			pages[n++] = m;
+		}
+		if (n == 0) {
+			break;
+		}
+		max_to_move -= n;
+
+		/*
+		 * the queue lock is held from here until the last of these
+		 * pages is deactivated, so no reference can come in between
+		 * and survive into the inactive queue
+		 */
+		vm_pageout_clear_references(pages, n);
+
+		for (i = 0; i < n; i++) {
+			m = pages[i];
+
+			VM_PAGEOUT_DEBUG(vm_pageout_balanced, 1);
+
+			assert(m->vmp_q_state == VM_PAGE_ON_ACTIVE_Q);
+			assert(!m->vmp_laundry);
+			assert(!is_kernel_object(VM_PAGE_OBJECT(m)));
+			assert(!vm_page_is_guard(m));
+
+			DTRACE_VM2(scan, int, 1, (uint64_t *), NULL);
+
+			/*
+			 * The page might be absent or busy,
+			 * but vm_page_deactivate can handle that.
+			 * FALSE indicates that we don't want a H/W clear reference
+			 */
+			vm_page_deactivate_internal(m, FALSE);
+		}
+	}
+}
+
 /*
  *	vm_pageout_scan does the dirty work for the pageout daemon.
  *	It returns with both vm_page_queue_free_lock and vm_page_queue_lock
@@ -3566,6 +3907,13 @@ reclaim_page:
 		 *	(Fictitious pages are either busy or absent.)
 		 *	First, update the reference and dirty bits
 		 *	to make sure the page is unreferenced.
+		 *
+		 *	This stays a per-page pmap_get_refmod() rather than
+		 *	a vm_pageout_clear_references() batch: the bits are
+		 *	sampled under the object lock right before we decide
+		 *	whether to steal the page, and the pages behind it on
+		 *	the queue may be reactivated, freed or relocked by the
+		 *	time we get to them.
 		 */
 		refmod_state = -1;
 
@@ -4144,9 +4492,32 @@ vm_pageout_record_thread_time(int cqid, int ncomps)
 }
 #endif
 
+/* which of the thread's filling c_segs m should go to, without consuming its donate marking */
+static void *
+vm_pageout_filling_chead(struct pgo_iothread_state *cq, vm_page_t m)
+{
+	if (m->vmp_on_specialq == VM_PAGE_SPECIAL_Q_DONATE) {
+#if XNU_TARGET_OS_OSX /* tag:DONATE */
+		return &cq->current_early_swapout_chead;
+#else /* XNU_TARGET_OS_OSX */
+		return &cq->current_late_swapout_chead;
+#endif /* XNU_TARGET_OS_OSX */
+	}
+
+	uint32_t sel_i = 0;
+#if COMPRESSOR_PAGEOUT_CHEADS_MAX_COUNT > 1
+	vm_object_t object = VM_PAGE_OBJECT(m);
+	sel_i = object->vo_chead_hint;
+#endif
+	assert(sel_i < COMPRESSOR_PAGEOUT_CHEADS_MAX_COUNT);
+	return &cq->current_regular_swapout_cheads[sel_i];
+}
+
 static void *
 vm_pageout_select_filling_chead(struct pgo_iothread_state *cq, vm_page_t m)
 {
+	void *chead = vm_pageout_filling_chead(cq, m);
+
 	/*
 	 * Technically we need the pageq locks to manipulate the vmp_on_specialq field.
 	 * However, this page has been removed from all queues and is only
@@ -4156,24 +4527,76 @@ vm_pageout_select_filling_chead(struct pgo_iothread_state *cq, vm_page_t m)
 	 * put special pages like this one on that queue in the block above
 	 * under the pageq lock to avoid this 'works but not clean' logic.
 	 */
-	void *donate_queue_head;
-#if XNU_TARGET_OS_OSX /* tag:DONATE */
-	donate_queue_head = &cq->current_early_swapout_chead;
-#else /* XNU_TARGET_OS_OSX */
-	donate_queue_head = &cq->current_late_swapout_chead;
-#endif /* XNU_TARGET_OS_OSX */
 	if (m->vmp_on_specialq == VM_PAGE_SPECIAL_Q_DONATE) {
 		m->vmp_on_specialq = VM_PAGE_SPECIAL_Q_EMPTY;
-		return donate_queue_head;
 	}
+	return chead;
+}
 
-	uint32_t sel_i = 0;
-#if COMPRESSOR_PAGEOUT_CHEADS_MAX_COUNT > 1
-	vm_object_t object = VM_PAGE_OBJECT(m);
-	sel_i = object->vo_chead_hint;
-#endif
-	assert(sel_i < COMPRESSOR_PAGEOUT_CHEADS_MAX_COUNT);
-	return &cq->current_regular_swapout_cheads[sel_i];
+static memory_object_t vm_pageout_compress_page_prepare(vm_page_t m, vm_compressor_options_t *flags);
+static void vm_pageout_compress_page_complete(vm_page_t m, memory_object_t pager,
+    int compressed_count_delta, kern_return_t retval);
+
+/*
+ * Take up to VM_COMPRESSOR_PUT_BATCH_MAX pages off the head of *local_q that go
+ * to the same filling c_seg and hand them to the compressor in one batch, so that
+ * they are compressed back to back under a single c_seg lock acquisition.
+ * Pages that were compressed are pushed on *freeq.
+ * Returns the number of pages taken off *local_q.
+ */
+static int
+vm_pageout_compress_batch(struct pgo_iothread_state *cq, vm_page_t *local_q,
+    vm_page_t *freeq, int *freed, int *compressed)
+{
+	struct vm_compressor_put_req reqs[VM_COMPRESSOR_PUT_BATCH_MAX];
+	vm_page_t       pages[VM_COMPRESSOR_PUT_BATCH_MAX];
+	memory_object_t pager;
+	vm_compressor_options_t flags;
+	void            *chead;
+	vm_page_t       m;
+	int             npages = 0, nreqs = 0;
+
+	chead = vm_pageout_filling_chead(cq, *local_q);
+	do {
+		m = *local_q;
+		*local_q = m->vmp_snext;
+		m->vmp_snext = NULL;
+
+		__assert_only void *m_chead = vm_pageout_select_filling_chead(cq, m);
+		assert(m_chead == chead);
+
+		pager = vm_pageout_compress_page_prepare(m, &flags);
+		if (pager != MEMORY_OBJECT_NULL) {
+			pages[nreqs] = m;
+			reqs[nreqs] = (struct vm_compressor_put_req){
+				.mem_obj = pager,
+				.offset = m->vmp_offset + VM_PAGE_OBJECT(m)->paging_offset,
+				.ppnum = VM_PAGE_GET_PHYS_PAGE(m),
+				.flags = flags,
+			};
+			nreqs++;
+		}
+	} while (++npages < VM_COMPRESSOR_PUT_BATCH_MAX && *local_q != NULL &&
+	    vm_pageout_filling_chead(cq, *local_q) == chead);
+
+	if (nreqs == 0) {
+		return npages;
+	}
+
+	vm_compressor_pager_put_batch(reqs, nreqs, chead, cq->scratch_buf);
+
+	for (int i = 0; i < nreqs; i++) {
+		vm_pageout_compress_page_complete(pages[i], reqs[i].mem_obj,
+		    reqs[i].compressed_count_delta, reqs[i].kr);
+
+		if (reqs[i].kr == KERN_SUCCESS) {
+			pages[i]->vmp_snext = *freeq;
+			*freeq = pages[i];
+			(*freed)++;
+			(*compressed)++;
+		}
+	}
+	return npages;
 }
 
 #define         MAX_FREE_BATCH          32
@@ -4195,7 +4618,6 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 	boolean_t marked_active = FALSE;
 	int       num_pages_processed = 0;
 #endif
-	void *chead = NULL;
 
 	KDBG_FILTERED(0xe040000c | DBG_FUNC_END);
 
@@ -4299,25 +4721,20 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 			KDBG_FILTERED(0xe0400018 | DBG_FUNC_END, q->pgo_laundry);
 
 			while (local_q) {
-				KDBG_FILTERED(0xe0400024 | DBG_FUNC_START, local_cnt);
-
-				m = local_q;
-				local_q = m->vmp_snext;
-				m->vmp_snext = NULL;
+				__unused int batch_pages;
+				int batch_compressed = 0;
 
+				KDBG_FILTERED(0xe0400024 | DBG_FUNC_START, local_cnt);
 
-				chead = vm_pageout_select_filling_chead(cq, m);
+				batch_pages = vm_pageout_compress_batch(cq, &local_q,
+				    &local_freeq, &local_freed, &batch_compressed);
 
-				if (vm_pageout_compress_page(chead, cq->scratch_buf, m) == KERN_SUCCESS) {
+				if (batch_compressed) {
 #if DEVELOPMENT || DEBUG
-					ncomps++;
+					ncomps += batch_compressed;
 #endif
 					KDBG_FILTERED(0xe0400024 | DBG_FUNC_END, local_cnt);
 
-					m->vmp_snext = local_freeq;
-					local_freeq = m;
-					local_freed++;
-
 					/* if we gathered enough free pages, free them now */
 					if (local_freed >= MAX_FREE_BATCH) {
 						OSAddAtomic64(local_freed, &vm_pageout_vminfo.vm_pageout_compressions);
@@ -4329,7 +4746,7 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 					}
 				}
 #if DEVELOPMENT || DEBUG
-				num_pages_processed++;
+				num_pages_processed += batch_pages;
 #endif /* DEVELOPMENT || DEBUG */
 #if !CONFIG_JETSAM /* Maybe: if there's no JETSAM, be more proactive in waking up anybody that needs free pages */
 				while (vm_page_free_count < COMPRESSOR_FREE_RESERVED_LIMIT) {
@@ -4437,14 +4854,15 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 	/*NOTREACHED*/
 }
 
-/* resolves the pager and maintain stats in the pager and in the vm_object */
-kern_return_t
-vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
+/*
+ * Make sure the page's object has a compressor pager. Returns the pager, or
+ * MEMORY_OBJECT_NULL if there is none, in which case the page was reactivated.
+ */
+static memory_object_t
+vm_pageout_compress_page_prepare(vm_page_t m, vm_compressor_options_t *flags)
 {
 	vm_object_t     object;
 	memory_object_t pager;
-	int             compressed_count_delta;
-	kern_return_t   retval;
 
 	object = VM_PAGE_OBJECT(m);
 
@@ -4494,7 +4912,7 @@ vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
 			vm_object_activity_end(object);
 			vm_object_unlock(object);
 
-			return KERN_FAILURE;
+			return MEMORY_OBJECT_NULL;
 		}
 		vm_object_unlock(object);
 
@@ -4509,23 +4927,23 @@ vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
 	}
 #endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
-	vm_compressor_options_t flags = 0;
+	*flags = 0;
 
 #if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
 	if (m->vmp_unmodified_ro) {
-		flags |= C_PAGE_UNMODIFIED;
+		*flags |= C_PAGE_UNMODIFIED;
 	}
 #endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
+	return pager;
+}
 
-	retval = vm_compressor_pager_put(
-		pager,
-		m->vmp_offset + object->paging_offset,
-		VM_PAGE_GET_PHYS_PAGE(m),
-		current_chead,
-		scratch_buf,
-		&compressed_count_delta,
-		flags);
+/* maintain stats in the pager and in the vm_object once the compressor is done with the page */
+static void
+vm_pageout_compress_page_complete(vm_page_t m, memory_object_t pager,
+    int compressed_count_delta, kern_return_t retval)
+{
+	vm_object_t     object = VM_PAGE_OBJECT(m);
 
 	vm_object_lock(object);
 
@@ -4569,6 +4987,32 @@ vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
 	}
 	vm_object_activity_end(object);
 	vm_object_unlock(object);
+}
+
+/* resolves the pager and maintain stats in the pager and in the vm_object */
+kern_return_t
+vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
+{
+	memory_object_t pager;
+	vm_compressor_options_t flags;
+	int             compressed_count_delta;
+	kern_return_t   retval;
+
+	pager = vm_pageout_compress_page_prepare(m, &flags);
+	if (pager == MEMORY_OBJECT_NULL) {
+		return KERN_FAILURE;
+	}
+
+	retval = vm_compressor_pager_put(
+		pager,
+		m->vmp_offset + VM_PAGE_OBJECT(m)->paging_offset,
+		VM_PAGE_GET_PHYS_PAGE(m),
+		current_chead,
+		scratch_buf,
+		&compressed_count_delta,
+		flags);
+
+	vm_pageout_compress_page_complete(m, pager, compressed_count_delta, retval);
 
 	return retval;
 }
@@ -5393,6 +5837,9 @@ vm_pageout(void)
 #if CONFIG_PHANTOM_CACHE
 	vm_phantom_cache_init();
 #endif
+#if VM_LPAGE
+	vm_lpage_init();
+#endif /* VM_LPAGE */
 #if VM_PAGE_BUCKETS_CHECK
 #if VM_PAGE_FAKE_BUCKETS
 	printf("**** DEBUG: protecting fake buckets [0x%llx:0x%llx]\n",
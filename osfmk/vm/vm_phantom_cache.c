@@ -26,6 +26,7 @@
  * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
  */
 
+#include <kern/task.h>
 #include <vm/vm_page_internal.h>
 #include <vm/vm_object_internal.h>
 #include <vm/vm_kern_xnu.h>
@@ -33,6 +34,7 @@
 #include <vm/vm_phantom_cache_internal.h>
 #include <vm/vm_compressor_internal.h>
 #include <vm/vm_protos_internal.h>
+#include <vm/memory_object_internal.h>
 
 
 uint32_t phantom_cache_eval_period_in_msecs = 250;
@@ -65,6 +67,15 @@ uint32_t        sample_period_ghost_added_count_ssd = 0;
 uint32_t        sample_period_ghost_found_count = 0;
 uint32_t        sample_period_ghost_found_count_ssd = 0;
 
+/*
+ * The eviction clock: the number of file pages that have entered the
+ * phantom cache, protected by the page queues lock.  Each ghost remembers
+ * its value as of its latest eviction, so that when a page is read back in
+ * the difference is its refault distance: how much larger the file cache
+ * would have needed to be for the page to still be resident.
+ */
+uint32_t        vm_phantom_cache_evictions = 0;
+
 uint32_t        vm_phantom_object_id = 1;
 #define         VM_PHANTOM_OBJECT_ID_AFTER_WRAP 1000000
 
@@ -213,6 +224,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 	} else {
 		if ((vpce = vm_phantom_cache_lookup_ghost(m, 0))) {
 			vpce->g_pages_held |= pg_mask;
+			vpce->g_evict_seq = vm_phantom_cache_evictions;
 
 			phantom_cache_stats.pcs_added_page_to_entry++;
 			goto done;
@@ -267,6 +279,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 	vpce->g_pages_held = pg_mask;
 	vpce->g_obj_offset = (m->vmp_offset >> (PAGE_SHIFT + VM_GHOST_PAGE_SHIFT)) & VM_GHOST_OFFSET_MASK;
 	vpce->g_obj_id = object->phantom_object_id;
+	vpce->g_evict_seq = vm_phantom_cache_evictions;
 
 	ghost_hash_index = vm_phantom_hash(vpce->g_obj_id, vpce->g_obj_offset);
 	vpce->g_next_index = vm_phantom_cache_hash[ghost_hash_index];
@@ -274,6 +287,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 
 done:
 	vm_pageout_vminfo.vm_phantom_cache_added_ghost++;
+	vm_phantom_cache_evictions++;
 
 	if (object->phantom_isssd) {
 		OSAddAtomic(1, &sample_period_ghost_added_count_ssd);
@@ -327,12 +341,18 @@ vm_phantom_cache_lookup_ghost(vm_page_t m, uint32_t pg_mask)
 
 
 
-void
-vm_phantom_cache_update(vm_page_t m)
+/*
+ * Returns TRUE if the page was found in the phantom cache,
+ * i.e. it is being read back in shortly after its eviction,
+ * and its refault distance in "distance".
+ */
+boolean_t
+vm_phantom_cache_update(vm_page_t m, uint32_t *distance)
 {
 	int             pg_mask;
 	vm_ghost_t      vpce;
 	vm_object_t     object;
+	task_t          task;
 
 	object = VM_PAGE_OBJECT(m);
 
@@ -340,13 +360,29 @@ vm_phantom_cache_update(vm_page_t m)
 	vm_object_lock_assert_exclusive(object);
 
 	if (vm_phantom_cache_num_entries == 0) {
-		return;
+		return FALSE;
 	}
 
 	pg_mask = pg_masks[(m->vmp_offset >> PAGE_SHIFT) & VM_GHOST_PAGE_MASK];
 
 	if ((vpce = vm_phantom_cache_lookup_ghost(m, pg_mask))) {
 		vpce->g_pages_held &= ~pg_mask;
+		*distance = vm_phantom_cache_evictions - vpce->g_evict_seq;
+
+		object->phantom_refaults++;
+		object->phantom_refault_distance += *distance;
+
+		/*
+		 * charge the task committing the read: the reader itself
+		 * for page-ins and synchronous reads, while asynchronous
+		 * read-ahead completing in a kernel thread is only
+		 * accounted to the object
+		 */
+		task = current_task();
+		if (task != kernel_task) {
+			os_atomic_inc(&task->refaults, relaxed);
+			os_atomic_add(&task->refault_distance, *distance, relaxed);
+		}
 
 		phantom_cache_stats.pcs_updated_phantom_state++;
 		vm_pageout_vminfo.vm_phantom_cache_found_ghost++;
@@ -356,7 +392,36 @@ vm_phantom_cache_update(vm_page_t m)
 		} else {
 			OSAddAtomic(1, &sample_period_ghost_found_count);
 		}
+		return TRUE;
 	}
+	return FALSE;
+}
+
+
+kern_return_t
+vm_phantom_cache_refault_stats(memory_object_control_t control, struct vm_refault_stats *stats)
+{
+	vm_object_t     object;
+
+	object = memory_object_control_to_vm_object(control);
+	if (object == VM_OBJECT_NULL) {
+		return KERN_INVALID_ARGUMENT;
+	}
+	vm_object_lock_shared(object);
+	stats->vrs_refaults = object->phantom_refaults;
+	stats->vrs_refaults_protected = object->phantom_refaults_protected;
+	stats->vrs_distance_total = object->phantom_refault_distance;
+	vm_object_unlock(object);
+
+	return KERN_SUCCESS;
+}
+
+void
+vm_phantom_cache_task_refault_stats(task_t task, struct vm_refault_stats *stats)
+{
+	stats->vrs_refaults = os_atomic_load(&task->refaults, relaxed);
+	stats->vrs_refaults_protected = os_atomic_load(&task->refaults_protected, relaxed);
+	stats->vrs_distance_total = os_atomic_load(&task->refault_distance, relaxed);
 }
 
 
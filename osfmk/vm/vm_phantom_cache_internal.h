@@ -27,6 +27,7 @@
  */
 
 #include <vm/vm_page.h>
+#include <vm/vm_phantom_cache_xnu.h>
 
 #define         VM_GHOST_OFFSET_BITS    39
 #define         VM_GHOST_OFFSET_MASK    0x7FFFFFFFFF
@@ -40,6 +41,7 @@ struct  vm_ghost {
 	    g_pages_held:VM_GHOST_PAGES_PER_ENTRY,
 	    g_obj_offset:VM_GHOST_OFFSET_BITS;
 	uint32_t        g_obj_id;
+	uint32_t        g_evict_seq;    /* eviction clock when a page last went into this entry */
 } __attribute__((packed));
 
 typedef struct vm_ghost *vm_ghost_t;
@@ -48,6 +50,6 @@ typedef struct vm_ghost *vm_ghost_t;
 extern  void            vm_phantom_cache_init(void);
 extern  void            vm_phantom_cache_add_ghost(vm_page_t);
 extern  vm_ghost_t      vm_phantom_cache_lookup_ghost(vm_page_t, uint32_t);
-extern  void            vm_phantom_cache_update(vm_page_t);
+extern  boolean_t       vm_phantom_cache_update(vm_page_t, uint32_t *);
 extern  boolean_t       vm_phantom_cache_check_pressure(void);
 extern  void            vm_phantom_cache_restart_sample(void);
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _VM_VM_PHANTOM_CACHE_XNU_H_
+#define _VM_VM_PHANTOM_CACHE_XNU_H_
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+#include <mach/mach_types.h>
+#include <mach/memory_object_types.h>
+
+#ifdef XNU_KERNEL_PRIVATE
+
+#if CONFIG_PHANTOM_CACHE
+
+/*
+ * Refault statistics of a vnode's vm_object or of a task,
+ * as reported by the vm.vnode_refault_stats and
+ * vm.task_refault_stats sysctls.
+ */
+struct vm_refault_stats {
+	uint64_t        vrs_refaults;           /* file pages read back in while in the phantom cache */
+	uint64_t        vrs_refaults_protected; /* ... and activated for being within the working set */
+	uint64_t        vrs_distance_total;     /* sum of their refault distances, in evictions */
+};
+
+extern  kern_return_t   vm_phantom_cache_refault_stats(memory_object_control_t, struct vm_refault_stats *);
+extern  void            vm_phantom_cache_task_refault_stats(task_t, struct vm_refault_stats *);
+
+#endif /* CONFIG_PHANTOM_CACHE */
+
+#endif /* XNU_KERNEL_PRIVATE */
+__END_DECLS
+
+#endif  /* _VM_VM_PHANTOM_CACHE_XNU_H_ */
@@ -7678,7 +7678,11 @@ vm_page_do_delayed_work(
 		}
 #if CONFIG_PHANTOM_CACHE
 		if (dwp->dw_mask & DW_vm_phantom_cache_update) {
-			vm_phantom_cache_update(m);
+			uint32_t refault_distance;
+
+			if (vm_phantom_cache_update(m, &refault_distance)) {
+				vm_pageout_refault(object, dwp, refault_distance);
+			}
 		}
 #endif
 		if (dwp->dw_mask & DW_vm_page_wire) {
@@ -8215,8 +8219,7 @@ hibernate_flush_queue(vm_page_queue_head_t *q, int qcount)
 		goto next_pg;
 
 reenter_pg_on_q:
-		vm_page_queue_remove(q, m, vmp_pageq);
-		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_requeue_tail(q, m);
 
 		hibernate_stats.hibernate_reentered_on_q++;
 next_pg:
@@ -9825,6 +9828,9 @@ vm_page_queues_remove(vm_page_t mem, boolean_t remove_from_specialq)
 	{
 		vm_page_queue_remove(&vm_page_queue_active, mem, vmp_pageq);
 		vm_page_active_count--;
+		if (vm_mglru_enabled) {
+			vm_mglru_page_dequeued(mem);
+		}
 		break;
 	}
 
@@ -10019,6 +10025,9 @@ vm_page_enqueue_active(vm_page_t mem, boolean_t first)
 		vm_page_queue_enter(&vm_page_queue_active, mem, vmp_pageq);
 	}
 	vm_page_active_count++;
+	if (vm_mglru_enabled) {
+		vm_mglru_page_enqueued(mem, first);
+	}
 
 	if (m_object->internal) {
 		vm_page_pageable_internal_count++;
@@ -1807,6 +1807,10 @@ pmap_destroy(pmap_t     p)
 		return; /* still in use */
 	}
 
+	if (p->pm_lpage_count != 0) {
+		pmap_lpage_destroy(p);
+	}
+
 	/*
 	 *	Free the memory maps, then the
 	 *	pmap structure.
@@ -1911,6 +1915,7 @@ pmap_protect_options(
 	int             num_found = 0;
 	boolean_t       is_ept;
 	uint64_t        cur_vaddr;
+	uint64_t        clear_bits, set_bits;
 
 	pmap_intr_assert();
 
@@ -1940,6 +1945,37 @@ pmap_protect_options(
 		set_NX = FALSE;
 	}
 #endif
+
+	clear_bits = 0;
+	set_bits = 0;
+
+	if (is_ept) {
+		if (!(prot & VM_PROT_READ)) {
+			clear_bits |= PTE_READ(is_ept);
+		}
+	}
+	if (!(prot & VM_PROT_WRITE)) {
+		clear_bits |= PTE_WRITE(is_ept);
+	}
+#if DEVELOPMENT || DEBUG
+	else if ((options & PMAP_OPTIONS_PROTECT_IMMEDIATE) &&
+	    map == kernel_pmap) {
+		set_bits |= PTE_WRITE(is_ept);
+	}
+#endif /* DEVELOPMENT || DEBUG */
+
+	if (set_NX) {
+		if (!is_ept) {
+			set_bits |= INTEL_PTE_NX;
+		} else {
+			clear_bits |= INTEL_EPT_EX | INTEL_EPT_UEX;
+		}
+	} else if (is_ept) {
+		/* This is the exception to the "Don't add permissions" statement, above */
+		set_bits |= ((prot & VM_PROT_EXECUTE) ? INTEL_EPT_EX : 0) |
+		    ((prot & VM_PROT_UEXEC) ? INTEL_EPT_UEX : 0);
+	}
+
 	PMAP_LOCK_EXCLUSIVE(map);
 
 	orig_sva = sva;
@@ -1959,6 +1995,17 @@ pmap_protect_options(
 
 		pde = pmap_pde(map, sva);
 		if (pde && (*pde & PTE_VALID_MASK(is_ept))) {
+			if (__improbable(*pde & INTEL_PDE_LPAGE)) {
+				if (lva - sva == I386_LPGBYTES &&
+				    pmap_lpage_update(pde, clear_bits, set_bits)) {
+					/* whole promoted run: it stays promoted */
+					cur_vaddr += I386_LPGBYTES;
+					num_found++;
+					sva = lva;
+					continue;
+				}
+				pmap_lpage_demote(map, pde, sva);
+			}
 			if (*pde & PTE_PS) {
 				/* superpage */
 				spte = pde;
@@ -1972,42 +2019,10 @@ pmap_protect_options(
 			}
 
 			for (; spte < epte; spte++) {
-				uint64_t clear_bits, set_bits;
-
 				if (!(*spte & PTE_VALID_MASK(is_ept))) {
 					continue;
 				}
 
-				clear_bits = 0;
-				set_bits = 0;
-
-				if (is_ept) {
-					if (!(prot & VM_PROT_READ)) {
-						clear_bits |= PTE_READ(is_ept);
-					}
-				}
-				if (!(prot & VM_PROT_WRITE)) {
-					clear_bits |= PTE_WRITE(is_ept);
-				}
-#if DEVELOPMENT || DEBUG
-				else if ((options & PMAP_OPTIONS_PROTECT_IMMEDIATE) &&
-				    map == kernel_pmap) {
-					set_bits |= PTE_WRITE(is_ept);
-				}
-#endif /* DEVELOPMENT || DEBUG */
-
-				if (set_NX) {
-					if (!is_ept) {
-						set_bits |= INTEL_PTE_NX;
-					} else {
-						clear_bits |= INTEL_EPT_EX | INTEL_EPT_UEX;
-					}
-				} else if (is_ept) {
-					/* This is the exception to the "Don't add permissions" statement, above */
-					set_bits |= ((prot & VM_PROT_EXECUTE) ? INTEL_EPT_EX : 0) |
-					    ((prot & VM_PROT_UEXEC) ? INTEL_EPT_UEX : 0);
-				}
-
 				pmap_update_pte(is_ept, spte, clear_bits, set_bits, false);
 
 				DTRACE_VM3(set_pte, pmap_t, map, void *, cur_vaddr, uint64_t, *spte);
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Differential test of the compiled filters in bsd/net/bpf_filter.c.
+ *
+ * Random valid programs are run on random packets by both bpf_filter()
+ * and bpf_jit_filter(), which must agree.  Every program is also run on
+ * a truncated view of each packet the way the kernel runs it on the first
+ * mbuf of a chain: unless the compiled program asks to fall back to the
+ * interpreter, its result must be the one of the whole packet.
+ */
+
+#include <darwintest.h>
+#include <mach/mach_time.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <net/bpf.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_RUN_CONCURRENTLY(true));
+
+/* from bsd/net/bpf_filter.c, built into this test */
+struct bpf_jit_prog;
+u_int bpf_filter(const struct bpf_insn *, u_int, u_char *, u_int, u_int);
+struct bpf_jit_prog *bpf_jit_compile(const struct bpf_insn *, u_int);
+void bpf_jit_free(struct bpf_jit_prog *);
+u_int bpf_jit_filter(const struct bpf_jit_prog *, const u_char *, u_int, u_int, int *);
+
+#define FUZZ_PROGRAMS           20000
+#define FUZZ_PACKETS            32
+#define FUZZ_MAX_INSNS          48
+#define FUZZ_MAX_PKT            96
+
+/* tcpdump -dd 'tcp dst port 80' */
+static const struct bpf_insn tcp_port_80[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 4, 0x000086dd },
+	{ 0x30, 0, 0, 0x00000014 },
+	{ 0x15, 0, 11, 0x00000006 },
+	{ 0x28, 0, 0, 0x00000038 },
+	{ 0x15, 8, 9, 0x00000050 },
+	{ 0x15, 0, 8, 0x00000800 },
+	{ 0x30, 0, 0, 0x00000017 },
+	{ 0x15, 0, 6, 0x00000006 },
+	{ 0x28, 0, 0, 0x00000014 },
+	{ 0x45, 4, 0, 0x00001fff },
+	{ 0xb1, 0, 0, 0x0000000e },
+	{ 0x48, 0, 0, 0x00000010 },
+	{ 0x15, 0, 1, 0x00000050 },
+	{ 0x6, 0, 0, 0x00040000 },
+	{ 0x6, 0, 0, 0x00000000 },
+};
+
+static uint32_t
+fuzz_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static u_int32_t
+fuzz_offset(uint32_t *state)
+{
+	switch (fuzz_rand(state) % 8) {
+	case 0:
+		return fuzz_rand(state);
+	case 1:
+		return 0xfffffffc + fuzz_rand(state) % 4;
+	default:
+		return fuzz_rand(state) % (FUZZ_MAX_PKT + 8);
+	}
+}
+
+static u_int32_t
+fuzz_constant(uint32_t *state)
+{
+	switch (fuzz_rand(state) % 4) {
+	case 0:
+		return fuzz_rand(state);
+	case 1:
+		return fuzz_rand(state) % 32;
+	default:
+		return fuzz_rand(state) & 0xff;
+	}
+}
+
+/* generate a program that bpf_validate() would accept */
+static u_int
+fuzz_program(struct bpf_insn *f, uint32_t *state)
+{
+	static const u_int16_t codes[] = {
+		BPF_LD | BPF_W | BPF_ABS, BPF_LD | BPF_H | BPF_ABS, BPF_LD | BPF_B | BPF_ABS,
+		BPF_LD | BPF_W | BPF_IND, BPF_LD | BPF_H | BPF_IND, BPF_LD | BPF_B | BPF_IND,
+		BPF_LDX | BPF_MSH | BPF_B, BPF_LD | BPF_W | BPF_LEN, BPF_LDX | BPF_W | BPF_LEN,
+		BPF_LD | BPF_IMM, BPF_LDX | BPF_IMM, BPF_LD | BPF_MEM, BPF_LDX | BPF_MEM,
+		BPF_ST, BPF_STX, BPF_JMP | BPF_JA,
+		BPF_JMP | BPF_JGT | BPF_K, BPF_JMP | BPF_JGE | BPF_K,
+		BPF_JMP | BPF_JEQ | BPF_K, BPF_JMP | BPF_JSET | BPF_K,
+		BPF_JMP | BPF_JGT | BPF_X, BPF_JMP | BPF_JGE | BPF_X,
+		BPF_JMP | BPF_JEQ | BPF_X, BPF_JMP | BPF_JSET | BPF_X,
+		BPF_ALU | BPF_ADD | BPF_X, BPF_ALU | BPF_SUB | BPF_X, BPF_ALU | BPF_MUL | BPF_X,
+		BPF_ALU | BPF_DIV | BPF_X, BPF_ALU | BPF_AND | BPF_X, BPF_ALU | BPF_OR | BPF_X,
+		BPF_ALU | BPF_ADD | BPF_K, BPF_ALU | BPF_SUB | BPF_K, BPF_ALU | BPF_MUL | BPF_K,
+		BPF_ALU | BPF_DIV | BPF_K, BPF_ALU | BPF_AND | BPF_K, BPF_ALU | BPF_OR | BPF_K,
+		BPF_ALU | BPF_LSH | BPF_K, BPF_ALU | BPF_RSH | BPF_K, BPF_ALU | BPF_NEG,
+		BPF_MISC | BPF_TAX, BPF_MISC | BPF_TXA, BPF_RET | BPF_A, BPF_RET | BPF_K,
+	};
+	u_int len = 1 + fuzz_rand(state) % FUZZ_MAX_INSNS;
+
+	for (u_int i = 0; i < len; i++) {
+		struct bpf_insn *p = &f[i];
+		u_int left = len - i - 1;
+
+		memset(p, 0, sizeof(*p));
+		if (left == 0) {
+			p->code = (fuzz_rand(state) & 1) ? BPF_RET | BPF_A : BPF_RET | BPF_K;
+			p->k = fuzz_constant(state);
+			break;
+		}
+		if (left > 1 && fuzz_rand(state) % 4 == 0) {
+			/* the load and branch pairs the compiler fuses */
+			p->code = codes[fuzz_rand(state) % 3];
+			p->k = fuzz_offset(state);
+			p = &f[++i];
+			p->code = BPF_JMP | BPF_K | (u_int16_t)((1 + fuzz_rand(state) % 4) << 4);
+			p->k = fuzz_constant(state);
+			p->jt = (u_char)(fuzz_rand(state) % (left - 1));
+			p->jf = (u_char)(fuzz_rand(state) % (left - 1));
+			continue;
+		}
+		p->code = codes[fuzz_rand(state) % (sizeof(codes) / sizeof(codes[0]))];
+		switch (BPF_CLASS(p->code)) {
+		case BPF_LD:
+		case BPF_LDX:
+			if (BPF_MODE(p->code) == BPF_MEM) {
+				p->k = fuzz_rand(state) % BPF_MEMWORDS;
+			} else if (BPF_MODE(p->code) == BPF_IMM) {
+				p->k = fuzz_constant(state);
+			} else {
+				p->k = fuzz_offset(state);
+			}
+			break;
+		case BPF_ST:
+		case BPF_STX:
+			p->k = fuzz_rand(state) % BPF_MEMWORDS;
+			break;
+		case BPF_JMP:
+			if (BPF_OP(p->code) == BPF_JA) {
+				p->k = fuzz_rand(state) % left;
+			} else {
+				p->k = fuzz_constant(state);
+				p->jt = (u_char)(fuzz_rand(state) % left);
+				p->jf = (u_char)(fuzz_rand(state) % left);
+			}
+			break;
+		case BPF_ALU:
+			if (BPF_OP(p->code) == BPF_LSH || BPF_OP(p->code) == BPF_RSH) {
+				p->k = fuzz_rand(state) % 32;
+			} else {
+				p->k = fuzz_constant(state);
+			}
+			if (BPF_OP(p->code) == BPF_DIV && p->k == 0) {
+				p->k = 1;
+			}
+			break;
+		default:
+			p->k = fuzz_constant(state);
+			break;
+		}
+	}
+	return len;
+}
+
+static u_int
+fuzz_packet(u_char *pkt, uint32_t *state)
+{
+	u_int len = fuzz_rand(state) % (FUZZ_MAX_PKT + 1);
+
+	for (u_int i = 0; i < len; i++) {
+		/* small values make the generated constants match more often */
+		pkt[i] = (u_char)((fuzz_rand(state) & 1) ? fuzz_rand(state) : fuzz_rand(state) % 4);
+	}
+	return len;
+}
+
+static void
+check_program(const struct bpf_insn *f, u_int len, const u_char *pkt, u_int pktlen,
+    uint32_t *state, u_int *fallbacks)
+{
+	struct bpf_jit_prog *prog = bpf_jit_compile(f, len);
+	u_int wirelen = pktlen + fuzz_rand(state) % 8;
+	u_int expected, got, split;
+	int fallback = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(prog, "compile a valid program of %u insns", len);
+
+	expected = bpf_filter(f, len, (u_char *)(uintptr_t)pkt, wirelen, pktlen);
+	got = bpf_jit_filter(prog, pkt, wirelen, pktlen, NULL);
+	T_QUIET; T_ASSERT_EQ(got, expected, "compiled and interpreted filters agree");
+
+	split = pktlen ? fuzz_rand(state) % (pktlen + 1) : 0;
+	got = bpf_jit_filter(prog, pkt, wirelen, split, &fallback);
+	if (fallback) {
+		(*fallbacks)++;
+	} else {
+		T_QUIET; T_ASSERT_EQ(got, expected,
+		    "filter on %u of %u bytes agrees without falling back", split, pktlen);
+	}
+	bpf_jit_free(prog);
+}
+
+T_DECL(bpf_jit_differential,
+    "compiled filters match the interpreter on random programs and packets")
+{
+	static struct bpf_insn f[FUZZ_MAX_INSNS];
+	static u_char pkt[FUZZ_MAX_PKT];
+	uint32_t state = 0x2545f491;
+	u_int fallbacks = 0;
+
+	for (u_int i = 0; i < FUZZ_PROGRAMS; i++) {
+		u_int len = fuzz_program(f, &state);
+
+		for (u_int j = 0; j < FUZZ_PACKETS; j++) {
+			u_int pktlen = fuzz_packet(pkt, &state);
+
+			check_program(f, len, pkt, pktlen, &state, &fallbacks);
+		}
+	}
+	T_PASS("%u programs on %u packets each, %u partial runs fell back",
+	    FUZZ_PROGRAMS, FUZZ_PACKETS, fallbacks);
+}
+
+T_DECL(bpf_jit_tcpdump,
+    "a tcpdump program matches the interpreter on IPv4 and IPv6 TCP packets")
+{
+	static u_char pkt[FUZZ_MAX_PKT];
+	u_int len = sizeof(tcp_port_80) / sizeof(tcp_port_80[0]);
+	uint32_t state = 1;
+	u_int fallbacks = 0;
+
+	for (u_int i = 0; i < 10000; i++) {
+		u_int pktlen = fuzz_packet(pkt, &state);
+
+		if (pktlen > 60) {
+			bool v6 = i & 1;
+
+			pkt[12] = v6 ? 0x86 : 0x08;
+			pkt[13] = v6 ? 0xdd : 0x00;
+			pkt[v6 ? 20 : 23] = 6;
+			pkt[14] = 0x45;
+			pkt[20] &= v6 ? 0xff : 0xe0;
+			pkt[21] = v6 ? pkt[21] : 0;
+			pkt[v6 ? 56 : 36] = 0;
+			pkt[v6 ? 57 : 37] = (i & 2) ? 80 : 81;
+		}
+		check_program(tcp_port_80, len, pkt, pktlen, &state, &fallbacks);
+	}
+	T_PASS("tcp dst port 80, %u partial runs fell back", fallbacks);
+}
+
+static double
+abs_to_seconds(uint64_t abstime)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (double)abstime * tb.numer / tb.denom / 1e9;
+}
+
+T_DECL(bpf_jit_throughput,
+    "packets per second of the interpreter and of compiled filters",
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_PERF)
+{
+	static u_char pkt[64];
+	u_int len = sizeof(tcp_port_80) / sizeof(tcp_port_80[0]);
+	struct bpf_jit_prog *prog = bpf_jit_compile(tcp_port_80, len);
+	const u_int rounds = 10000000;
+	volatile u_int sink = 0;
+	uint64_t start, interp, jit;
+
+	T_QUIET; T_ASSERT_NOTNULL(prog, "compile tcp dst port 80");
+	pkt[12] = 0x08;
+	pkt[14] = 0x45;
+	pkt[23] = 6;
+	pkt[37] = 80;
+
+	start = mach_absolute_time();
+	for (u_int i = 0; i < rounds; i++) {
+		sink += bpf_filter(tcp_port_80, len, pkt, sizeof(pkt), sizeof(pkt));
+	}
+	interp = mach_absolute_time() - start;
+
+	start = mach_absolute_time();
+	for (u_int i = 0; i < rounds; i++) {
+		sink += bpf_jit_filter(prog, pkt, sizeof(pkt), sizeof(pkt), NULL);
+	}
+	jit = mach_absolute_time() - start;
+
+	T_LOG("interpreter %.1f Mpps, compiled %.1f Mpps",
+	    rounds / abs_to_seconds(interp) / 1e6, rounds / abs_to_seconds(jit) / 1e6);
+	T_PERF("bpf_interpreter", rounds / abs_to_seconds(interp) / 1e6, "Mpps",
+	    "tcp dst port 80 through bpf_filter()");
+	T_PERF("bpf_jit", rounds / abs_to_seconds(jit) / 1e6, "Mpps",
+	    "tcp dst port 80 through bpf_jit_filter()");
+	bpf_jit_free(prog);
+}
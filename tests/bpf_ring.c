@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <darwintest.h>
+
+#include <sys/event.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <net/bpf.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <mach/mach.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bpflib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_ASROOT(true),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define RING_BLOCK_COUNT        8
+#define RING_PACKETS            64
+#define RING_PORT               47474
+
+static const char ring_marker[] = "bpf_ring_test_marker";
+
+static struct bpf_ring_block_hdr *
+ring_block(struct bpf_ring_req *brr, uint32_t idx)
+{
+	return (struct bpf_ring_block_hdr *)(uintptr_t)(brr->brr_addr + (uint64_t)idx * brr->brr_block_size);
+}
+
+static int
+ring_open(struct bpf_ring_req *brr)
+{
+	int fd = bpf_new();
+	T_ASSERT_POSIX_SUCCESS(fd, "bpf open fd %d", fd);
+
+	brr->brr_block_size = (uint32_t)vm_page_size;
+	brr->brr_block_count = RING_BLOCK_COUNT;
+	brr->brr_addr = 0;
+	T_ASSERT_POSIX_SUCCESS(ioctl(fd, BIOCSETRING, brr), "BIOCSETRING");
+	T_ASSERT_NE_ULLONG(brr->brr_addr, 0ULL, "ring mapped at 0x%llx", brr->brr_addr);
+	return fd;
+}
+
+static void
+ring_send(int count)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_port = htons(RING_PORT),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(s, "socket");
+	for (int i = 0; i < count; i++) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(sendto(s, ring_marker, sizeof(ring_marker), 0,
+		    (struct sockaddr *)&sin, sizeof(sin)), "sendto");
+	}
+	close(s);
+}
+
+/*
+ * Walk the packets of a block the reader owns and count the test datagrams
+ */
+static int
+ring_parse_block(struct bpf_ring_block_hdr *bh, uint32_t block_size)
+{
+	const uint8_t *p = (const uint8_t *)bh + BPF_RING_BLOCK_HDRLEN;
+	uint32_t len = bh->brb_len;
+	uint32_t off = 0;
+	int found = 0;
+
+	T_QUIET; T_ASSERT_LE(len, block_size - (uint32_t)BPF_RING_BLOCK_HDRLEN, "block length");
+	for (uint32_t i = 0; i < bh->brb_npkts; i++) {
+		const struct bpf_hdr *hp = (const struct bpf_hdr *)(const void *)(p + off);
+
+		T_QUIET; T_ASSERT_LE(off + hp->bh_hdrlen + hp->bh_caplen, len, "packet %u in block", i);
+		if (memmem(p + off + hp->bh_hdrlen, hp->bh_caplen, ring_marker, sizeof(ring_marker)) != NULL) {
+			found++;
+		}
+		off += BPF_WORDALIGN(hp->bh_hdrlen + hp->bh_caplen);
+	}
+	T_QUIET; T_ASSERT_GE(BPF_WORDALIGN(len), off, "packets fill the block");
+	return found;
+}
+
+T_DECL(bpf_ring_setup, "BIOCSETRING argument and state checks")
+{
+	struct bpf_ring_req brr = {};
+	int fd = bpf_new();
+	char buf[64];
+
+	T_ASSERT_POSIX_SUCCESS(fd, "bpf open fd %d", fd);
+
+	brr.brr_block_size = (uint32_t)vm_page_size + 1;
+	brr.brr_block_count = RING_BLOCK_COUNT;
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCSETRING, &brr), EINVAL, "block size not a page multiple");
+
+	brr.brr_block_size = (uint32_t)vm_page_size;
+	brr.brr_block_count = 1;
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCSETRING, &brr), EINVAL, "single block");
+
+	brr.brr_block_count = BPF_RING_MAX_BLOCKS + 1;
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCSETRING, &brr), EINVAL, "too many blocks");
+
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCROTRING), EINVAL, "BIOCROTRING without a ring");
+
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+	brr.brr_block_count = RING_BLOCK_COUNT;
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCSETRING, &brr), EINVAL, "BIOCSETRING after BIOCSETIF");
+	close(fd);
+
+	fd = ring_open(&brr);
+	T_ASSERT_POSIX_FAILURE(ioctl(fd, BIOCSETRING, &brr), EBUSY, "second BIOCSETRING");
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+	T_ASSERT_POSIX_FAILURE(read(fd, buf, sizeof(buf)), EOPNOTSUPP, "read() in ring mode");
+	for (uint32_t i = 0; i < brr.brr_block_count; i++) {
+		T_QUIET; T_ASSERT_EQ(ring_block(&brr, i)->brb_status, (uint32_t)BPF_RING_STATUS_KERNEL,
+		    "block %u owned by the kernel", i);
+	}
+	close(fd);
+	/* the mapping outlives the descriptor */
+	T_ASSERT_EQ(ring_block(&brr, 0)->brb_status, (uint32_t)BPF_RING_STATUS_KERNEL, "ring still mapped");
+	T_ASSERT_MACH_SUCCESS(mach_vm_deallocate(mach_task_self(), brr.brr_addr,
+	    (mach_vm_size_t)brr.brr_block_size * brr.brr_block_count), "unmap ring");
+}
+
+T_DECL(bpf_ring_capture, "capture through the shared ring and kqueue")
+{
+	struct bpf_ring_req brr = {};
+	struct kevent kev;
+	uint32_t next = 0;
+	uint64_t seq = 0;
+	int found = 0;
+	int kq;
+	int fd;
+
+	fd = ring_open(&brr);
+	T_ASSERT_POSIX_SUCCESS(bpf_set_immediate(fd, 1), "immediate mode");
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+
+	kq = kqueue();
+	T_ASSERT_POSIX_SUCCESS(kq, "kqueue");
+	EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	T_ASSERT_POSIX_SUCCESS(kevent(kq, &kev, 1, NULL, 0, NULL), "EVFILT_READ");
+
+	ring_send(RING_PACKETS);
+
+	while (found < RING_PACKETS) {
+		struct timespec ts = { .tv_sec = 5 };
+		struct bpf_ring_block_hdr *bh = ring_block(&brr, next);
+
+		if (atomic_load_explicit((_Atomic uint32_t *)&bh->brb_status, memory_order_acquire) !=
+		    BPF_RING_STATUS_USER) {
+			int n = kevent(kq, NULL, 0, &kev, 1, &ts);
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "kevent");
+			T_QUIET; T_ASSERT_EQ(n, 1, "a block is ready (found %d)", found);
+			T_QUIET; T_ASSERT_GT(kev.data, 0L, "kevent reports ready blocks");
+			continue;
+		}
+		T_QUIET; T_ASSERT_EQ(bh->brb_seq, seq, "blocks are handed over in order");
+		found += ring_parse_block(bh, brr.brr_block_size);
+		seq++;
+
+		atomic_store_explicit((_Atomic uint32_t *)&bh->brb_status, BPF_RING_STATUS_KERNEL,
+		    memory_order_release);
+		next = (next + 1) % brr.brr_block_count;
+	}
+	T_ASSERT_GE(found, RING_PACKETS, "captured all the datagrams in %llu blocks", seq);
+
+	close(kq);
+	close(fd);
+	mach_vm_deallocate(mach_task_self(), brr.brr_addr,
+	    (mach_vm_size_t)brr.brr_block_size * brr.brr_block_count);
+}
+
+T_DECL(bpf_ring_full, "packets are dropped while the reader owns the ring")
+{
+	struct bpf_ring_req brr = {};
+	struct bpf_stat bs = {};
+	uint32_t npkts = 0;
+	int fd;
+
+	fd = ring_open(&brr);
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+
+	/* enough traffic to fill every block, none of which is given back */
+	ring_send(4 * RING_PACKETS * RING_BLOCK_COUNT);
+	T_ASSERT_POSIX_SUCCESS(ioctl(fd, BIOCROTRING), "BIOCROTRING");
+
+	for (uint32_t i = 0; i < brr.brr_block_count; i++) {
+		struct bpf_ring_block_hdr *bh = ring_block(&brr, i);
+
+		T_QUIET; T_ASSERT_EQ(bh->brb_status, (uint32_t)BPF_RING_STATUS_USER, "block %u handed over", i);
+		T_QUIET; T_ASSERT_EQ(bh->brb_seq, (uint64_t)i, "block %u sequence", i);
+		ring_parse_block(bh, brr.brr_block_size);
+		npkts += bh->brb_npkts;
+	}
+	T_ASSERT_POSIX_SUCCESS(ioctl(fd, BIOCGSTATS, &bs), "BIOCGSTATS");
+	T_LOG("%u packets in the ring, %u received, %u dropped", npkts, bs.bs_recv, bs.bs_drop);
+	T_ASSERT_GT(bs.bs_drop, 0U, "packets dropped once the ring is full");
+	T_ASSERT_EQ(ring_block(&brr, brr.brr_block_count - 1)->brb_dcount, (uint64_t)0,
+	    "no drop before the ring is full");
+
+	close(fd);
+	mach_vm_deallocate(mach_task_self(), brr.brr_addr,
+	    (mach_vm_size_t)brr.brr_block_size * brr.brr_block_count);
+}
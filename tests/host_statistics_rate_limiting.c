@@ -24,6 +24,7 @@ struct all_host_info {
 	vm_statistics64_data_t host_vm_info64_rev0;
 	vm_statistics64_data_t host_vm_info64_rev1;
 	vm_statistics64_data_t host_vm_info64_rev2;
+	vm_statistics64_data_t host_vm_info64_rev3;
 	vm_extmod_statistics_data_t host_extmod_info64;
 	host_load_info_data_t host_load_info;
 	vm_statistics_data_t host_vm_info_rev0;
@@ -63,6 +64,11 @@ check_host_info(struct all_host_info* data, unsigned long iter, char lett)
 			T_QUIET; T_ASSERT_EQ(datap[i], lett, "HOST_VM_INFO64_REV0 byte %lu iter %lu", i, j);
 		}
 
+		datap = (char*) &data[j].host_vm_info64_rev2;
+		for (i = (HOST_VM_INFO64_REV2_COUNT * sizeof(int)); i < (HOST_VM_INFO64_REV3_COUNT * sizeof(int)); i++) {
+			T_QUIET; T_ASSERT_EQ(datap[i], lett, "HOST_VM_INFO64_REV2 byte %lu iter %lu", i, j);
+		}
+
 		datap = (char*) &data[j].host_vm_info_rev0;
 		for (i = (HOST_VM_INFO_REV0_COUNT * sizeof(int)); i < (HOST_VM_INFO_REV2_COUNT * sizeof(int)); i++) {
 			T_QUIET; T_ASSERT_EQ(datap[i], lett, "HOST_VM_INFO_REV0 byte %lu iter %lu", i, j);
@@ -110,6 +116,10 @@ get_host_info(struct all_host_info* data, host_t self, int iter)
 		T_QUIET; T_ASSERT_POSIX_ZERO(host_statistics64(self, HOST_VM_INFO64, (host_info64_t)&data[i].host_vm_info64_rev2, &count), NULL);
 		T_QUIET; T_ASSERT_EQ(count, HOST_VM_INFO64_REV2_COUNT, NULL);
 
+		count = HOST_VM_INFO64_REV3_COUNT;
+		T_QUIET; T_ASSERT_POSIX_ZERO(host_statistics64(self, HOST_VM_INFO64, (host_info64_t)&data[i].host_vm_info64_rev3, &count), NULL);
+		T_QUIET; T_ASSERT_EQ(count, HOST_VM_INFO64_REV3_COUNT, NULL);
+
 		count = HOST_EXTMOD_INFO64_COUNT;
 		T_QUIET; T_ASSERT_POSIX_ZERO(host_statistics64(self, HOST_EXTMOD_INFO64, (host_info64_t)&data[i].host_extmod_info64, &count), NULL);
 		T_QUIET; T_ASSERT_EQ(count, HOST_EXTMOD_INFO64_COUNT, NULL);
@@ -179,12 +189,13 @@ T_DECL(test_host_statistics, "testing rate limit for host_statistics",
 	T_QUIET; T_ASSERT_EQ(sizeof(data[0].host_expired_task_info2), TASK_POWER_INFO_V2_COUNT * sizeof(int), "TASK_POWER_INFO_V2_COUNT");
 
 	/* check that the latest revision is the COUNT */
-	T_QUIET; T_ASSERT_EQ(HOST_VM_INFO64_REV2_COUNT, HOST_VM_INFO64_COUNT, "HOST_VM_INFO64_REV2_COUNT");
+	T_QUIET; T_ASSERT_EQ(HOST_VM_INFO64_REV3_COUNT, HOST_VM_INFO64_COUNT, "HOST_VM_INFO64_REV3_COUNT");
 	T_QUIET; T_ASSERT_EQ(HOST_VM_INFO_REV2_COUNT, HOST_VM_INFO_COUNT, "HOST_VM_INFO_REV2_COUNT");
 
 	/* check that the previous revision are smaller than the latest */
 	T_QUIET; T_ASSERT_LE(HOST_VM_INFO64_REV0_COUNT, HOST_VM_INFO64_REV1_COUNT, "HOST_VM_INFO64_REV0");
 	T_QUIET; T_ASSERT_LE(HOST_VM_INFO64_REV1_COUNT, HOST_VM_INFO64_REV2_COUNT, "HOST_VM_INFO64_REV1");
+	T_QUIET; T_ASSERT_LE(HOST_VM_INFO64_REV2_COUNT, HOST_VM_INFO64_REV3_COUNT, "HOST_VM_INFO64_REV2");
 	T_QUIET; T_ASSERT_LE(HOST_VM_INFO_REV0_COUNT, HOST_VM_INFO_REV2_COUNT, "HOST_VM_INFO_REV0_COUNT");
 	T_QUIET; T_ASSERT_LE(HOST_VM_INFO_REV1_COUNT, HOST_VM_INFO_REV2_COUNT, "HOST_VM_INFO_REV1_COUNT");
 	T_QUIET; T_ASSERT_LE(TASK_POWER_INFO_COUNT, TASK_POWER_INFO_V2_COUNT, "TASK_POWER_INFO_COUNT");
@@ -3,8 +3,10 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include <darwintest.h>
+#include <mach/mach_time.h>
 
 T_GLOBAL_META(T_META_RUN_CONCURRENTLY(true));
 
@@ -233,3 +235,72 @@ T_DECL(in_cksum_49479689b, "tests os_cpu_in_cksum with many random packets in va
 		test_one_random_packet(4096);
 	}
 }
+
+T_DECL(in_cksum_large, "tests os_cpu_in_cksum on jumbo and TSO sized buffers in various memory alignment", T_META_TAG_VM_NOT_PREFERRED)
+{
+	const uint32_t maxlen = 65536;
+	const uint8_t MAXALIGN = 8;
+	uint8_t *data = malloc(maxlen);
+	uint8_t *tmpbuf = malloc(maxlen + MAXALIGN);
+
+	T_QUIET; T_ASSERT_NOTNULL(data, "malloc");
+	T_QUIET; T_ASSERT_NOTNULL(tmpbuf, "malloc");
+	for (int i = 0; i < 200; i++) {
+		uint32_t len = 256 + arc4random_uniform(maxlen - 256);
+		uint32_t seglens[2];
+		uint8_t aligns[2];
+
+		if (i % 4 == 0) {
+			/* all ones stresses the carries of the vector lanes */
+			memset(data, 0xff, len);
+		} else {
+			arc4random_buf(data, len);
+		}
+		uint16_t dsum = dumb_in_cksum(data, len);
+		seglens[0] = arc4random_uniform(len) & ~1U;
+		seglens[1] = len - seglens[0];
+		for (aligns[0] = 0; aligns[0] < MAXALIGN; aligns[0]++) {
+			aligns[1] = (uint8_t)arc4random_uniform(MAXALIGN);
+			uint16_t osum = split_in_cksum(data, 2, seglens, aligns, tmpbuf);
+			T_QUIET; T_ASSERT_EQ(osum, dsum, "len %u seg[0] %u align[0] %u align[1] %u: got 0x%04x expecting 0x%04x",
+			    len, seglens[0], aligns[0], aligns[1], htons(osum), htons(dsum));
+		}
+	}
+	T_PASS("OK");
+	free(tmpbuf);
+	free(data);
+}
+
+T_DECL(in_cksum_throughput, "measures os_cpu_in_cksum throughput across lengths and alignments",
+    T_META_RUN_CONCURRENTLY(false), T_META_TAG_PERF, T_META_TAG_VM_NOT_PREFERRED)
+{
+	static const uint32_t lens[] = { 64, 256, 1500, 9000, 65536 };
+	static const uint8_t aligns[] = { 0, 1, 2, 4 };
+	mach_timebase_info_data_t tb;
+	uint8_t *buf = malloc(65536 + 8);
+	volatile uint32_t sink = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	T_QUIET; T_ASSERT_MACH_SUCCESS(mach_timebase_info(&tb), "mach_timebase_info");
+	arc4random_buf(buf, 65536 + 8);
+
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		for (size_t j = 0; j < sizeof(aligns) / sizeof(aligns[0]); j++) {
+			/* about 1GB of data per configuration */
+			uint32_t rounds = (1U << 30) / lens[i];
+			uint64_t start = mach_absolute_time();
+
+			for (uint32_t r = 0; r < rounds; r++) {
+				sink += os_cpu_in_cksum(buf + aligns[j], lens[i], 0);
+			}
+			double secs = (double)(mach_absolute_time() - start) * tb.numer / tb.denom / 1e9;
+			double gbps = (double)rounds * lens[i] / secs / 1e9;
+			char name[64];
+
+			snprintf(name, sizeof(name), "in_cksum_%u_align%u", lens[i], aligns[j]);
+			T_LOG("len %5u align %u: %.2f GB/s", lens[i], aligns[j], gbps);
+			T_PERF(name, gbps, "GB/s", "os_cpu_in_cksum throughput");
+		}
+	}
+	free(buf);
+}
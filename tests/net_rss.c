@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * net_rss.c
+ * - flows received on an Ethernet interface are spread over the RSS input
+ *   threads (net_rss boot-arg) and must still be delivered in order
+ * - the packets of a bridge member go through the bridge before they are
+ *   steered
+ */
+
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <darwintest.h>
+
+#include "net_test_lib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_ASROOT(true),
+	T_META_CHECK_LEAKS(false));
+
+#define RSS_FLOWS               16
+#define RSS_DGRAMS              64
+
+#define RSS_SYSCTL_THREADS      "net.link.generic.system.rss_input_threads"
+#define FAKE_SYSCTL_BSD_MODE    "net.link.fake.bsd_mode"
+
+typedef struct {
+	uint32_t        flow;
+	uint32_t        seq;
+} rss_dgram;
+
+static network_interface_pair_list_t    S_feth_pairs;
+static network_interface                S_bridge;
+
+static void
+rss_cleanup(void)
+{
+	network_interface_destroy(&S_bridge);
+	network_interface_pair_list_destroy(S_feth_pairs);
+	S_feth_pairs = NULL;
+	sysctl_restore_all();
+	/* allow for the detach to be final before the next test */
+	usleep(100000);
+}
+
+static void
+rss_skip_if_disabled(void)
+{
+	unsigned int threads = 0;
+	size_t len = sizeof(threads);
+
+	if (sysctlbyname(RSS_SYSCTL_THREADS, &threads, &len, NULL, 0) != 0 ||
+	    threads == 0) {
+		T_SKIP("receive side steering is off (net_rss boot-arg)");
+	}
+	T_LOG("%u RSS input threads", threads);
+}
+
+/* a feth pair in BSD mode, whose input goes through a DLIL input thread */
+static network_interface_pair_t
+rss_feth_pair(void)
+{
+	network_interface_pair_t pair;
+
+	T_ATEND(rss_cleanup);
+	sysctl_set_integer(FAKE_SYSCTL_BSD_MODE, 1);
+
+	S_feth_pairs = network_interface_pair_list_alloc(1);
+	pair = S_feth_pairs->list;
+	network_interface_create(&pair->one, FETH_NAME);
+	network_interface_create(&pair->two, FETH_NAME);
+	fake_set_peer(pair->one.if_name, pair->two.if_name);
+	return pair;
+}
+
+/*
+ * Send RSS_FLOWS interleaved flows from "from" to the address "to" of
+ * interface "to_ifname", and check that every flow arrives complete and
+ * in order.
+ */
+static void
+rss_check_flows(network_interface_t from, const char *to_ifname,
+    struct in_addr to)
+{
+	int senders[RSS_FLOWS], receivers[RSS_FLOWS];
+	struct sockaddr_in rsin[RSS_FLOWS], ssin;
+	u_int total = 0;
+
+	for (u_int f = 0; f < RSS_FLOWS; f++) {
+		receivers[f] = inet_udp_socket_on_interface(to_ifname, to, &rsin[f]);
+		senders[f] = inet_udp_socket_on_interface(from->if_name, from->ip, &ssin);
+	}
+	for (uint32_t seq = 0; seq < RSS_DGRAMS; seq++) {
+		for (uint32_t f = 0; f < RSS_FLOWS; f++) {
+			rss_dgram d = { .flow = f, .seq = seq };
+
+			T_QUIET; T_ASSERT_EQ(sendto(senders[f], &d, sizeof(d), 0,
+			    (struct sockaddr *)&rsin[f], sizeof(rsin[f])),
+			    (ssize_t)sizeof(d), "flow %u seq %u", f, seq);
+		}
+	}
+	for (u_int f = 0; f < RSS_FLOWS; f++) {
+		uint32_t next = 0;
+		rss_dgram d;
+
+		while (recv(receivers[f], &d, sizeof(d), 0) == (ssize_t)sizeof(d)) {
+			T_QUIET; T_ASSERT_EQ(d.flow, f, "flow");
+			T_QUIET; T_ASSERT_GE(d.seq, next, "flow %u in order", f);
+			next = d.seq + 1;
+			total++;
+			if (next == RSS_DGRAMS) {
+				break;
+			}
+		}
+		T_QUIET; T_EXPECT_EQ(next, RSS_DGRAMS, "flow %u complete", f);
+		close(senders[f]);
+		close(receivers[f]);
+	}
+	T_EXPECT_EQ(total, RSS_FLOWS * RSS_DGRAMS,
+	    "%u flows of %u datagrams received in order", RSS_FLOWS, RSS_DGRAMS);
+}
+
+T_DECL(net_rss_flows, "flows steered over the RSS input threads stay in order")
+{
+	network_interface_pair_t pair;
+
+	rss_skip_if_disabled();
+	pair = rss_feth_pair();
+	network_interface_assign_address(&pair->one, 2, 1);
+	network_interface_assign_address(&pair->two, 2, 2);
+	rss_check_flows(&pair->one, pair->two.if_name, pair->two.ip);
+}
+
+T_DECL(net_rss_bridge, "packets of a bridge member are bridged before being steered")
+{
+	network_interface_pair_t pair;
+
+	rss_skip_if_disabled();
+	pair = rss_feth_pair();
+	network_interface_create(&S_bridge, BRIDGE_NAME);
+	bridge_add_member(S_bridge.if_name, pair->two.if_name);
+
+	/* the member has no address: local traffic is for the bridge */
+	network_interface_assign_address(&pair->one, 2, 1);
+	network_interface_assign_address(&S_bridge, 2, 2);
+	rss_check_flows(&pair->one, S_bridge.if_name, S_bridge.ip);
+}
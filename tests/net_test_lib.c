@@ -33,6 +33,7 @@
 #include <net/if_fake_var.h>
 #include <net/if_vlan_var.h>
 #include <net/if_bridgevar.h>
+#include <sys/sysctl.h>
 
 #define RTM_BUFLEN (sizeof(struct rt_msghdr) + 6 * SOCK_MAXADDRLEN)
 
@@ -1150,3 +1151,108 @@ force_zone_gc(void)
 		T_LOG("mach_zone_force_gc(): success\n");
 	}
 }
+
+void
+network_interface_assign_address(network_interface_t netif, uint8_t subnet,
+    u_int addr_index)
+{
+	netif->ip.s_addr = htonl(0x0a000000 | ((uint32_t)subnet << 16) | addr_index);
+	ifnet_add_ip_address(netif->if_name, netif->ip, inet_class_c_subnet_mask);
+	route_add_inet_scoped_subnet(netif->if_name, netif->if_index,
+	    netif->ip, inet_class_c_subnet_mask);
+}
+
+int
+inet_udp_socket_on_interface(const char * ifname, struct in_addr addr,
+    struct sockaddr_in * sin)
+{
+	socklen_t       solen = sizeof(*sin);
+	struct timeval  tv = { .tv_sec = 1 };
+	int             s;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(s = socket(AF_INET, SOCK_DGRAM, 0), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE,
+	    ifname, (socklen_t)strlen(ifname)), "SO_BINDTODEVICE %s", ifname);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_RCVTIMEO,
+	    &tv, sizeof(tv)), NULL);
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr = addr;
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(s, (struct sockaddr *)sin,
+	    sizeof(*sin)), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(s, (struct sockaddr *)sin,
+	    &solen), NULL);
+	return s;
+}
+
+/**
+** sysctl values set for a test
+**/
+
+#define SYSCTL_SAVED_MAX        16
+
+typedef struct {
+	char            name[128];
+	uint64_t        restore;
+	size_t          len;
+	bool            was_set;
+} sysctl_saved;
+
+static sysctl_saved     S_sysctl_saved[SYSCTL_SAVED_MAX];
+static u_int            S_sysctl_saved_count;
+
+static sysctl_saved *
+sysctl_saved_lookup(const char * name)
+{
+	for (u_int i = 0; i < S_sysctl_saved_count; i++) {
+		if (strcmp(S_sysctl_saved[i].name, name) == 0) {
+			return &S_sysctl_saved[i];
+		}
+	}
+	return NULL;
+}
+
+void
+sysctl_set_value(const char * name, const void * val, size_t len)
+{
+	sysctl_saved    *saved;
+	uint64_t        old = 0;
+	size_t          old_len = len;
+
+	T_QUIET; T_ASSERT_LE(len, sizeof(old), "%s fits", name);
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &old, &old_len, (void *)(uintptr_t)val, len),
+	    "sysctl %s", name);
+	T_QUIET; T_ASSERT_EQ(old_len, len, "%s size", name);
+
+	saved = sysctl_saved_lookup(name);
+	if (saved == NULL) {
+		T_QUIET; T_ASSERT_LT(S_sysctl_saved_count, SYSCTL_SAVED_MAX,
+		    "room to save %s", name);
+		saved = &S_sysctl_saved[S_sysctl_saved_count++];
+		strlcpy(saved->name, name, sizeof(saved->name));
+		saved->restore = old;
+		saved->len = len;
+	}
+	saved->was_set = (memcmp(&saved->restore, val, len) != 0);
+}
+
+void
+sysctl_set_integer(const char * name, int val)
+{
+	sysctl_set_value(name, &val, sizeof(val));
+}
+
+void
+sysctl_restore_all(void)
+{
+	/* in reverse, in case one setting depends on another */
+	while (S_sysctl_saved_count > 0) {
+		sysctl_saved *saved = &S_sysctl_saved[--S_sysctl_saved_count];
+
+		if (saved->was_set) {
+			T_QUIET; T_EXPECT_POSIX_SUCCESS(sysctlbyname(saved->name, NULL, 0,
+			    &saved->restore, saved->len), "sysctl %s", saved->name);
+		}
+	}
+}
@@ -253,4 +253,28 @@ extern int bridge_add_member(const char * bridge, const char * member);
 
 extern void force_zone_gc(void);
 
+/*
+ * Address 10.<subnet>.0.<addr_index>/24 on netif, with a scoped route to
+ * the subnet through it.
+ */
+extern void network_interface_assign_address(network_interface_t netif,
+    uint8_t subnet, u_int addr_index);
+
+/*
+ * A UDP socket bound to ifname and to addr, with a one second receive
+ * timeout.  On return, sin holds the address and port it is bound to.
+ */
+extern int inet_udp_socket_on_interface(const char * ifname,
+    struct in_addr addr, struct sockaddr_in * sin);
+
+/*
+ * Set a sysctl for the duration of a test: the first value each name is
+ * set from is saved, and sysctl_restore_all() puts back those that changed.
+ */
+extern void sysctl_set_value(const char * name, const void * val, size_t len);
+
+extern void sysctl_set_integer(const char * name, int val);
+
+extern void sysctl_restore_all(void);
+
 #endif /* __net_test_lib_h__ */
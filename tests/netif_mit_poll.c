@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * netif_mit_poll.c
+ * - drive the RX ring of a natively attached feth into the busy-poll
+ *   mitigation mode, and check that it leaves it once traffic stops
+ */
+
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <darwintest.h>
+
+#include "net_test_lib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"));
+
+/* index of MIT_MODE_ADVANCED_POLL in the mode_residency array */
+#define MIT_MODE_POLL           3
+#define MIT_MODES               4
+#define MIT_CFGS                5
+
+#define POLL_SEG_SIZE           100
+#define POLL_SEGS               32
+#define POLL_WAIT_MSEC          5000
+
+#define FAKE_SYSCTL_BSD_MODE    "net.link.fake.bsd_mode"
+#define NETIF_SYSCTL            "kern.skywalk.netif."
+
+static network_interface_pair_list_t    S_feth_pairs;
+
+static void
+netif_mit_cleanup(void)
+{
+	network_interface_pair_list_destroy(S_feth_pairs);
+	S_feth_pairs = NULL;
+	sysctl_restore_all();
+	/* allow for the detach to be final before the next test */
+	usleep(100000);
+}
+
+static void
+ring_knob_set(const char *ifname, const char *knob, unsigned int val)
+{
+	char name[128];
+
+	snprintf(name, sizeof(name), NETIF_SYSCTL "%s.rx_0.%s", ifname, knob);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, NULL, 0, &val,
+	    sizeof(val)), "sysctl %s %u", name, val);
+}
+
+static void
+ring_residency(const char *ifname, uint64_t res[MIT_MODES])
+{
+	char name[128];
+	size_t len = MIT_MODES * sizeof(res[0]);
+
+	snprintf(name, sizeof(name), NETIF_SYSCTL "%s.rx_0.mode_residency",
+	    ifname);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, res, &len, NULL, 0),
+	    "sysctl %s", name);
+	T_QUIET; T_ASSERT_EQ(len, MIT_MODES * sizeof(res[0]), "%s size", name);
+}
+
+T_DECL(netif_mit_poll, "a busy RX ring is polled, and goes back to interrupts when idle",
+    T_META_ASROOT(true),
+    T_META_CHECK_LEAKS(false),
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1),
+    T_META_BOOTARGS_SET("sk_netif_rx_mit=2"))
+{
+	network_interface_pair_t pair;
+	struct sockaddr_in ssin, rsin;
+	char buf[POLL_SEG_SIZE * POLL_SEGS] = {};
+	uint64_t res[MIT_MODES], res2[MIT_MODES];
+	uint64_t freeze = 1000 * 1000;  /* 1 ms, the minimum */
+	int rs, ss_fd, val;
+
+	T_ATEND(netif_mit_cleanup);
+	sysctl_set_integer(FAKE_SYSCTL_BSD_MODE, 0);            /* native feth */
+	sysctl_set_integer(NETIF_SYSCTL "mit_poll", 1);         /* polling on */
+	sysctl_set_integer(NETIF_SYSCTL "mit_poll_depth", 1);   /* 1% of the ring */
+	sysctl_set_value(NETIF_SYSCTL "ad_mit_freeze", &freeze, sizeof(freeze));
+
+	S_feth_pairs = network_interface_pair_list_alloc(1);
+	pair = S_feth_pairs->list;
+	network_interface_create(&pair->one, FETH_NAME);
+	network_interface_create(&pair->two, FETH_NAME);
+	network_interface_assign_address(&pair->one, 3, 1);
+	network_interface_assign_address(&pair->two, 3, 2);
+	fake_set_peer(pair->one.if_name, pair->two.if_name);
+
+	/* any traffic moves the receiving ring up the mitigation table */
+	for (int i = 0; i < MIT_CFGS; i++) {
+		char knob[16];
+
+		snprintf(knob, sizeof(knob), "%d_plowat", i);
+		ring_knob_set(pair->two.if_name, knob, 0);
+		snprintf(knob, sizeof(knob), "%d_blowat", i);
+		ring_knob_set(pair->two.if_name, knob, 0);
+		snprintf(knob, sizeof(knob), "%d_phiwat", i);
+		ring_knob_set(pair->two.if_name, knob, 1);
+		snprintf(knob, sizeof(knob), "%d_bhiwat", i);
+		ring_knob_set(pair->two.if_name, knob, 1);
+	}
+
+	rs = inet_udp_socket_on_interface(pair->two.if_name, pair->two.ip, &rsin);
+	ss_fd = inet_udp_socket_on_interface(pair->one.if_name, pair->one.ip, &ssin);
+	T_ASSERT_POSIX_SUCCESS(connect(ss_fd, (struct sockaddr *)&rsin, sizeof(rsin)), NULL);
+
+	/* trains land on the RX ring as bursts deep enough to poll */
+	val = POLL_SEG_SIZE;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, IPPROTO_UDP, UDP_SEGMENT, &val,
+	    sizeof(val)), NULL);
+
+	ring_residency(pair->two.if_name, res);
+	T_ASSERT_EQ(res[MIT_MODE_POLL], 0ULL, "%s rx_0 not polled yet", pair->two.if_name);
+	for (int msec = 0; msec < POLL_WAIT_MSEC; msec += 10) {
+		for (int i = 0; i < 64; i++) {
+			(void) send(ss_fd, buf, sizeof(buf), 0);
+		}
+		usleep(10 * 1000);
+		ring_residency(pair->two.if_name, res);
+		if (res[MIT_MODE_POLL] != 0) {
+			T_LOG("polled after %d msec of traffic", msec);
+			break;
+		}
+	}
+	T_LOG("residency usec: static %llu dynamic %llu poll %llu",
+	    res[1], res[2], res[MIT_MODE_POLL]);
+	T_ASSERT_GT(res[MIT_MODE_POLL], 0ULL, "%s rx_0 entered poll mode", pair->two.if_name);
+
+	/* once idle, the thread stops polling after mit_poll_idle empty passes */
+	usleep(500 * 1000);
+	ring_residency(pair->two.if_name, res);
+	usleep(200 * 1000);
+	ring_residency(pair->two.if_name, res2);
+	T_EXPECT_EQ(res2[MIT_MODE_POLL], res[MIT_MODE_POLL],
+	    "%s rx_0 back to interrupts when idle", pair->two.if_name);
+
+	close(ss_fd);
+	close(rs);
+}
@@ -40,3 +40,24 @@ T_DECL(pmap_page_protect_benchmark, "pmap_page_protect() overhead benchmark", T_
 		T_LOG("%u-loop duration (in ticks) for %u aliases: %llu", ppo_in.num_loops, ppo_in.num_aliases, duration);
 	}
 }
+
+T_DECL(pmap_refmod_batch_benchmark, "pmap_clear_refmod_batch() vs. per-page refmod harvesting", T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	struct {
+		unsigned int num_loops;
+		unsigned int num_pages;
+		unsigned int batched;
+	} prb_in;
+	prb_in.num_loops = 1000;
+	uint64_t duration[2];
+	size_t duration_size = sizeof(duration[0]);
+	for (prb_in.num_pages = 1; prb_in.num_pages <= 64; prb_in.num_pages <<= 1) {
+		for (prb_in.batched = 0; prb_in.batched <= 1; prb_in.batched++) {
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.pmap_refmod_batch_overhead_test",
+			    &duration[prb_in.batched], &duration_size, &prb_in, sizeof(prb_in)),
+			    "invoke pmap refmod batch overhead test sysctl");
+		}
+		T_LOG("%u-loop duration (in ticks) for %u pages: %llu per-page, %llu batched",
+		    prb_in.num_loops, prb_in.num_pages, duration[0], duration[1]);
+	}
+}
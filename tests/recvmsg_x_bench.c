@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <darwintest.h>
+#include <mach/mach_time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define BENCH_BATCH             64
+#define BENCH_ROUNDS            2000
+#define BENCH_PAYLOAD           64
+
+struct bench_ctx {
+	int                     rfd;
+	int                     sfd;
+	struct sockaddr_in      rsin;
+	struct sockaddr_in      ssin;
+};
+
+static double
+abs_to_seconds(uint64_t abstime)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (double)abstime * tb.numer / tb.denom / 1e9;
+}
+
+static void
+bench_open(struct bench_ctx *ctx)
+{
+	socklen_t len = sizeof(struct sockaddr_in);
+	int rcvbuf = 1024 * 1024;
+	int on = 1;
+
+	ctx->rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ctx->rfd, "socket");
+	ctx->sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ctx->sfd, "socket");
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(ctx->rfd, SOL_SOCKET, SO_RCVBUF,
+	    &rcvbuf, sizeof(rcvbuf)), "SO_RCVBUF");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(ctx->rfd, IPPROTO_IP, IP_RECVDSTADDR,
+	    &on, sizeof(on)), "IP_RECVDSTADDR");
+
+	ctx->rsin.sin_len = sizeof(ctx->rsin);
+	ctx->rsin.sin_family = AF_INET;
+	ctx->rsin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(ctx->rfd, (struct sockaddr *)&ctx->rsin,
+	    sizeof(ctx->rsin)), "bind");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(ctx->rfd, (struct sockaddr *)&ctx->rsin,
+	    &len), "getsockname");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(fcntl(ctx->rfd, F_SETFL, O_NONBLOCK), "O_NONBLOCK");
+
+	ctx->ssin = ctx->rsin;
+	ctx->ssin.sin_port = 0;
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(ctx->sfd, (struct sockaddr *)&ctx->ssin,
+	    sizeof(ctx->ssin)), "bind");
+	len = sizeof(ctx->ssin);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(ctx->sfd, (struct sockaddr *)&ctx->ssin,
+	    &len), "getsockname");
+}
+
+/*
+ * Queue a batch of numbered datagrams and wait until all of them sit in
+ * the receive buffer so that only the receive side is timed
+ */
+static void
+bench_fill(struct bench_ctx *ctx, uint32_t seq)
+{
+	char buf[BENCH_PAYLOAD] = {};
+	int npkts = 0;
+
+	for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+		uint32_t n = seq + i;
+
+		memcpy(buf, &n, sizeof(n));
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(sendto(ctx->sfd, buf, sizeof(buf), 0,
+		    (struct sockaddr *)&ctx->rsin, sizeof(ctx->rsin)), "sendto");
+	}
+	for (int tries = 0; npkts < BENCH_BATCH; tries++) {
+		socklen_t len = sizeof(npkts);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockopt(ctx->rfd, SOL_SOCKET, SO_NUMRCVPKT,
+		    &npkts, &len), "SO_NUMRCVPKT");
+		T_QUIET; T_ASSERT_LT(tries, 100000, "%d datagrams queued", npkts);
+	}
+}
+
+static void
+bench_check(struct bench_ctx *ctx, const char *buf, const struct sockaddr_in *from,
+    const void *control, socklen_t controllen, uint32_t seq)
+{
+	const struct cmsghdr *cm = control;
+	uint32_t n;
+
+	memcpy(&n, buf, sizeof(n));
+	T_QUIET; T_ASSERT_EQ(n, seq, "datagrams in order");
+	T_QUIET; T_ASSERT_EQ(from->sin_port, ctx->ssin.sin_port, "source port");
+	T_QUIET; T_ASSERT_GE(controllen, (socklen_t)CMSG_LEN(sizeof(struct in_addr)), "control");
+	T_QUIET; T_ASSERT_EQ(cm->cmsg_type, IP_RECVDSTADDR, "IP_RECVDSTADDR");
+	T_QUIET; T_ASSERT_EQ(((const struct in_addr *)(const void *)CMSG_DATA(cm))->s_addr,
+	    ctx->rsin.sin_addr.s_addr, "destination address");
+}
+
+static uint64_t
+bench_recvmsg(struct bench_ctx *ctx)
+{
+	static char buf[BENCH_BATCH][BENCH_PAYLOAD];
+	static char control[BENCH_BATCH][CMSG_SPACE(sizeof(struct in_addr))];
+	struct sockaddr_in from[BENCH_BATCH];
+	struct iovec iov[BENCH_BATCH];
+	struct msghdr msgs[BENCH_BATCH];
+	uint64_t elapsed = 0;
+	uint32_t seq = 0;
+
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		uint64_t start;
+
+		bench_fill(ctx, seq);
+		start = mach_absolute_time();
+		for (int i = 0; i < BENCH_BATCH; i++) {
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = sizeof(buf[i]);
+			msgs[i] = (struct msghdr) {
+				.msg_name = &from[i],
+				.msg_namelen = sizeof(from[i]),
+				.msg_iov = &iov[i],
+				.msg_iovlen = 1,
+				.msg_control = control[i],
+				.msg_controllen = sizeof(control[i]),
+			};
+			T_QUIET; T_ASSERT_EQ(recvmsg(ctx->rfd, &msgs[i], 0), (ssize_t)BENCH_PAYLOAD,
+			    "recvmsg");
+		}
+		elapsed += mach_absolute_time() - start;
+
+		for (int i = 0; i < BENCH_BATCH; i++) {
+			bench_check(ctx, buf[i], &from[i], control[i], msgs[i].msg_controllen, seq);
+			seq++;
+		}
+	}
+	return elapsed;
+}
+
+static uint64_t
+bench_recvmsg_x(struct bench_ctx *ctx)
+{
+	static char buf[BENCH_BATCH][BENCH_PAYLOAD];
+	static char control[BENCH_BATCH][CMSG_SPACE(sizeof(struct in_addr))];
+	struct sockaddr_in from[BENCH_BATCH];
+	struct iovec iov[BENCH_BATCH];
+	struct msghdr_x msgs[BENCH_BATCH];
+	uint64_t elapsed = 0;
+	uint32_t seq = 0;
+
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		uint64_t start;
+		int got = 0;
+
+		bench_fill(ctx, seq);
+		start = mach_absolute_time();
+		while (got < BENCH_BATCH) {
+			ssize_t n;
+
+			for (int i = got; i < BENCH_BATCH; i++) {
+				iov[i].iov_base = buf[i];
+				iov[i].iov_len = sizeof(buf[i]);
+				msgs[i] = (struct msghdr_x) {
+					.msg_name = &from[i],
+					.msg_namelen = sizeof(from[i]),
+					.msg_iov = &iov[i],
+					.msg_iovlen = 1,
+					.msg_control = control[i],
+					.msg_controllen = sizeof(control[i]),
+				};
+			}
+			n = recvmsg_x(ctx->rfd, &msgs[got], BENCH_BATCH - got, 0);
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recvmsg_x");
+			got += n;
+		}
+		elapsed += mach_absolute_time() - start;
+
+		for (int i = 0; i < BENCH_BATCH; i++) {
+			T_QUIET; T_ASSERT_EQ(msgs[i].msg_datalen, (size_t)BENCH_PAYLOAD, "datagram %d", i);
+			bench_check(ctx, buf[i], &from[i], control[i], msgs[i].msg_controllen, seq);
+			seq++;
+		}
+	}
+	return elapsed;
+}
+
+T_DECL(recvmsg_x_throughput,
+    "datagrams per second of recvmsg_x against a recvmsg loop",
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_PERF)
+{
+	struct bench_ctx ctx = {};
+	const double total = (double)BENCH_BATCH * BENCH_ROUNDS;
+	double single, batched;
+
+	bench_open(&ctx);
+	single = total / abs_to_seconds(bench_recvmsg(&ctx));
+	batched = total / abs_to_seconds(bench_recvmsg_x(&ctx));
+
+	T_LOG("recvmsg %.0f pps, recvmsg_x %.0f pps (batch of %d)",
+	    single, batched, BENCH_BATCH);
+	T_PERF("udp_recvmsg", single / 1e3, "Kpps",
+	    "UDP datagrams drained one recvmsg() at a time");
+	T_PERF("udp_recvmsg_x", batched / 1e3, "Kpps",
+	    "UDP datagrams drained with recvmsg_x()");
+	T_PASS("received %.0f datagrams each way", total);
+
+	close(ctx.sfd);
+	close(ctx.rfd);
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <darwintest.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <skywalk/os_skywalk_private.h>
+
+#include "net_test_lib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define BUSY_POLL_USEC          50
+
+static uint32_t
+busy_poll_max(void)
+{
+	uint32_t max = 0;
+	size_t len = sizeof(max);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.inet.ip.busy_poll_max",
+	    &max, &len, NULL, 0), "net.inet.ip.busy_poll_max");
+	return max;
+}
+
+T_DECL(so_busy_poll_opt, "SO_BUSY_POLL get and set")
+{
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	socklen_t len = sizeof(int);
+	int val = -1;
+
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, &len), "get");
+	T_ASSERT_EQ(val, 0, "off by default");
+
+	val = BUSY_POLL_USEC;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)), "set");
+	val = -1;
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, &len), "get");
+	T_ASSERT_EQ(val, BUSY_POLL_USEC, "budget kept");
+
+	val = -1;
+	T_ASSERT_POSIX_FAILURE(setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)),
+	    EINVAL, "negative budget");
+	val = (int)busy_poll_max() + 1;
+	T_ASSERT_POSIX_FAILURE(setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)),
+	    EINVAL, "budget above net.inet.ip.busy_poll_max");
+	close(s);
+
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	val = BUSY_POLL_USEC;
+	T_ASSERT_POSIX_FAILURE(setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)),
+	    EINVAL, "not an inet socket");
+	close(s);
+}
+
+static void *
+busy_poll_sender(void *arg)
+{
+	struct sockaddr_in *sin = arg;
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	char c = 'x';
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(s, "socket");
+	usleep(100 * 1000);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sendto(s, &c, sizeof(c), 0,
+	    (struct sockaddr *)sin, sizeof(*sin)), "sendto");
+	close(s);
+	return NULL;
+}
+
+T_DECL(so_busy_poll_recv, "blocking receive on a SO_BUSY_POLL socket")
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	pthread_t thread;
+	int val = BUSY_POLL_USEC;
+	char c = 0;
+	int s;
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)), "set");
+	T_ASSERT_POSIX_SUCCESS(bind(s, (struct sockaddr *)&sin, sizeof(sin)), "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(s, (struct sockaddr *)&sin, &len), "getsockname");
+
+	/* the sender shows up after the budget is spent, so this goes to sleep */
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, busy_poll_sender, &sin), "pthread_create");
+	T_ASSERT_EQ(recv(s, &c, sizeof(c), 0), (ssize_t)sizeof(c), "recv");
+	T_ASSERT_EQ(c, 'x', "datagram received");
+	T_ASSERT_POSIX_ZERO(pthread_join(thread, NULL), "pthread_join");
+	close(s);
+}
+
+/*
+ * The loopback interface above has no netif nexus, so that receive only
+ * sleeps.  A natively attached feth has RX rings to poll.
+ */
+#define FAKE_SYSCTL_BSD_MODE    "net.link.fake.bsd_mode"
+#define BUSY_POLL_DGRAMS        64
+
+static network_interface_pair_list_t    S_feth_pairs;
+
+static void
+busy_poll_cleanup(void)
+{
+	network_interface_pair_list_destroy(S_feth_pairs);
+	S_feth_pairs = NULL;
+	sysctl_restore_all();
+	/* allow for the detach to be final before the next test */
+	usleep(100000);
+}
+
+static uint64_t
+busy_poll_netif_stat(const char *ifname, int stat)
+{
+	struct sk_stats_net_if *sns;
+	uint64_t value = 0;
+	size_t len = 0;
+	bool found = false;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(SK_STATS_NET_IF, NULL, &len, NULL, 0),
+	    SK_STATS_NET_IF);
+	T_QUIET; T_ASSERT_NOTNULL(sns = malloc(len), "malloc");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(SK_STATS_NET_IF, sns, &len, NULL, 0),
+	    SK_STATS_NET_IF);
+	for (size_t i = 0; i < len / sizeof(*sns); i++) {
+		if (strncmp(sns[i].sns_if_name, ifname, IFNAMSIZ) == 0) {
+			value = sns[i].sns_nifs._arr[stat];
+			found = true;
+			break;
+		}
+	}
+	free(sns);
+	T_QUIET; T_ASSERT_TRUE(found, "%s has a netif nexus", ifname);
+	return value;
+}
+
+typedef struct {
+	int                     s;
+	struct sockaddr_in      to;
+} busy_poll_flow;
+
+static void *
+busy_poll_feth_sender(void *arg)
+{
+	busy_poll_flow *flow = arg;
+
+	for (uint32_t i = 0; i < BUSY_POLL_DGRAMS; i++) {
+		/* let the receiver drain and go back to polling */
+		usleep(2 * 1000);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(sendto(flow->s, &i, sizeof(i), 0,
+		    (struct sockaddr *)&flow->to, sizeof(flow->to)), "sendto %u", i);
+	}
+	return NULL;
+}
+
+T_DECL(so_busy_poll_netif, "a SO_BUSY_POLL socket polls the rings of its interface",
+    T_META_ASROOT(true))
+{
+	network_interface_pair_t pair;
+	busy_poll_flow flow;
+	struct sockaddr_in rsin;
+	uint64_t before, after;
+	pthread_t thread;
+	int val = (int)busy_poll_max();
+	int rs;
+
+	T_ATEND(busy_poll_cleanup);
+	sysctl_set_integer(FAKE_SYSCTL_BSD_MODE, 0);
+
+	S_feth_pairs = network_interface_pair_list_alloc(1);
+	pair = S_feth_pairs->list;
+	network_interface_create(&pair->one, FETH_NAME);
+	network_interface_create(&pair->two, FETH_NAME);
+	network_interface_assign_address(&pair->one, 4, 1);
+	network_interface_assign_address(&pair->two, 4, 2);
+	fake_set_peer(pair->one.if_name, pair->two.if_name);
+
+	/* bound to the interface, so that it is the one polled */
+	rs = inet_udp_socket_on_interface(pair->two.if_name, pair->two.ip, &rsin);
+	T_ASSERT_POSIX_SUCCESS(setsockopt(rs, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)),
+	    "SO_BUSY_POLL %d", val);
+	flow.s = inet_udp_socket_on_interface(pair->one.if_name, pair->one.ip, &flow.to);
+	flow.to = rsin;
+
+	before = busy_poll_netif_stat(pair->two.if_name, NETIF_STATS_RX_BUSY_POLL);
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, busy_poll_feth_sender, &flow),
+	    "pthread_create");
+	for (uint32_t i = 0; i < BUSY_POLL_DGRAMS; i++) {
+		uint32_t seq;
+
+		T_QUIET; T_ASSERT_EQ(recv(rs, &seq, sizeof(seq), 0), (ssize_t)sizeof(seq),
+		    "recv %u", i);
+		T_QUIET; T_ASSERT_EQ(seq, i, "datagram %u", i);
+	}
+	T_ASSERT_POSIX_ZERO(pthread_join(thread, NULL), "pthread_join");
+	after = busy_poll_netif_stat(pair->two.if_name, NETIF_STATS_RX_BUSY_POLL);
+
+	T_LOG("%llu busy-poll ring passes on %s", after - before, pair->two.if_name);
+	T_ASSERT_GT(after, before, "receives polled the rings of %s", pair->two.if_name);
+
+	close(flow.s);
+	close(rs);
+}
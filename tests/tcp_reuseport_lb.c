@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <darwintest.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define LB_LISTENERS            4
+#define LB_CONNECTIONS          64
+
+static int
+lb_listener(int family, in_port_t *port, int lb)
+{
+	struct sockaddr_storage ss = {};
+	socklen_t len;
+	int on = 1;
+	int s;
+
+	s = socket(family, SOCK_STREAM, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(s, "socket");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_REUSEPORT,
+	    &on, sizeof(on)), "SO_REUSEPORT");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_REUSEPORT_LB,
+	    &lb, sizeof(lb)), "SO_REUSEPORT_LB");
+
+	if (family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+		sin->sin_len = sizeof(*sin);
+		sin->sin_family = AF_INET;
+		sin->sin_port = *port;
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+		sin6->sin6_len = sizeof(*sin6);
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = *port;
+		sin6->sin6_addr = in6addr_loopback;
+	}
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(s, (struct sockaddr *)&ss, ss.ss_len), "bind");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listen(s, LB_CONNECTIONS), "listen");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(fcntl(s, F_SETFL, O_NONBLOCK), "O_NONBLOCK");
+
+	len = sizeof(ss);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(s, (struct sockaddr *)&ss, &len), "getsockname");
+	*port = (family == AF_INET) ? ((struct sockaddr_in *)&ss)->sin_port :
+	    ((struct sockaddr_in6 *)&ss)->sin6_port;
+	return s;
+}
+
+/*
+ * Open LB_CONNECTIONS connections to a set of listeners sharing a port
+ * and return how many listeners accepted at least one of them.
+ */
+static int
+lb_run(int family, int lb)
+{
+	int lfd[LB_LISTENERS];
+	int cfd[LB_CONNECTIONS];
+	int accepted[LB_LISTENERS] = {};
+	in_port_t port = 0;
+	int total = 0;
+	int used = 0;
+
+	for (int i = 0; i < LB_LISTENERS; i++) {
+		lfd[i] = lb_listener(family, &port, lb);
+	}
+
+	for (int i = 0; i < LB_CONNECTIONS; i++) {
+		struct sockaddr_storage ss = {};
+
+		if (family == AF_INET) {
+			struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+			sin->sin_len = sizeof(*sin);
+			sin->sin_family = AF_INET;
+			sin->sin_port = port;
+			sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		} else {
+			struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+			sin6->sin6_len = sizeof(*sin6);
+			sin6->sin6_family = AF_INET6;
+			sin6->sin6_port = port;
+			sin6->sin6_addr = in6addr_loopback;
+		}
+		cfd[i] = socket(family, SOCK_STREAM, 0);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(cfd[i], "socket");
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(connect(cfd[i], (struct sockaddr *)&ss, ss.ss_len),
+		    "connect %d", i);
+	}
+
+	for (int i = 0; i < LB_LISTENERS; i++) {
+		int s;
+
+		while ((s = accept(lfd[i], NULL, NULL)) >= 0) {
+			accepted[i]++;
+			close(s);
+		}
+		T_QUIET; T_ASSERT_EQ(errno, EWOULDBLOCK, "accept drained");
+		T_LOG("listener %d accepted %d connections", i, accepted[i]);
+		total += accepted[i];
+		if (accepted[i] != 0) {
+			used++;
+		}
+		close(lfd[i]);
+	}
+	T_ASSERT_EQ(total, LB_CONNECTIONS, "every connection was accepted");
+
+	for (int i = 0; i < LB_CONNECTIONS; i++) {
+		close(cfd[i]);
+	}
+	return used;
+}
+
+T_DECL(tcp_reuseport_lb_opt, "SO_REUSEPORT_LB get and set")
+{
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	socklen_t len = sizeof(int);
+	int val = -1;
+	int on = 1;
+
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, SOL_SOCKET, SO_REUSEPORT_LB, &val, &len), "get");
+	T_ASSERT_EQ(val, 0, "off by default");
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_REUSEPORT_LB, &on, sizeof(on)), "set");
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, SOL_SOCKET, SO_REUSEPORT_LB, &val, &len), "get");
+	T_ASSERT_NE(val, 0, "set");
+	close(s);
+}
+
+T_DECL(tcp_reuseport_lb_v4, "SO_REUSEPORT_LB spreads IPv4 connections across listeners")
+{
+	T_ASSERT_EQ(lb_run(AF_INET, 0), 1, "without SO_REUSEPORT_LB a single listener accepts");
+	T_ASSERT_EQ(lb_run(AF_INET, 1), LB_LISTENERS, "every listener accepts");
+}
+
+T_DECL(tcp_reuseport_lb_v6, "SO_REUSEPORT_LB spreads IPv6 connections across listeners")
+{
+	T_ASSERT_EQ(lb_run(AF_INET6, 1), LB_LISTENERS, "every listener accepts");
+}
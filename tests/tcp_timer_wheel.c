@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/sysctl.h>
+
+#include <darwintest.h>
+#include <stdint.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define WHEEL_CONNECTIONS       (1000 * 1000)
+
+T_DECL(tcp_timer_wheel_bench,
+    "arm and cancel TCP timers for a million connections",
+    T_META_ASROOT(true),
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_PERF,
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1))
+{
+	int64_t value = WHEEL_CONNECTIONS;
+	int64_t result = 0;
+	size_t s = sizeof(result);
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("debug.test.tcp_timer_wheel_bench",
+	    &result, &s, &value, sizeof(value)), "timer wheel benchmark");
+	T_LOG("%lld ns per timer arm or cancel", result);
+	T_PERF("tcp_timer_arm_cancel", (double)result, "ns",
+	    "TCP timer arm or cancel with a million connections armed");
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <darwintest.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define TLS_HDR_LEN             5
+#define TLS_TAG_LEN             16
+#define TLS_TYPE_HANDSHAKE      22
+#define TLS_TYPE_APPDATA        23
+
+static const char tls_plaintext[] = "tcp_tls_test_plaintext";
+
+/*
+ * Known answers for tls_plaintext sealed with the key 00 01 .. 1f (its
+ * first 16 bytes for AES-128), the IV a0 a1 .. ab and the record sequence
+ * number 0x0102030405060708: a handshake record followed by an application
+ * data record, as computed by an independent AEAD implementation.
+ */
+static const uint8_t tls_kat_aes128_13_0[] = {
+	0x17, 0x03, 0x03, 0x00, 0x27, 0x1c, 0x16, 0xe8, 0xed, 0x37, 0x56, 0x51,
+	0x9d, 0x53, 0xc6, 0xb8, 0xc6, 0x88, 0x40, 0x08, 0x5c, 0xf6, 0x1c, 0x6f,
+	0x4a, 0x53, 0xb7, 0xc4, 0x98, 0x39, 0xf3, 0xa5, 0x37, 0xec, 0x47, 0xb5,
+	0xcf, 0x62, 0x3b, 0x59, 0x55, 0x4d, 0x61, 0x8b,
+};
+
+static const uint8_t tls_kat_aes128_13_1[] = {
+	0x17, 0x03, 0x03, 0x00, 0x27, 0x2e, 0x4c, 0x6e, 0x63, 0xb9, 0x2e, 0x26,
+	0xdc, 0xe4, 0x44, 0x80, 0x65, 0x17, 0xe9, 0x03, 0xac, 0x6c, 0x66, 0xd7,
+	0xcb, 0xaf, 0xf0, 0x47, 0xc1, 0x32, 0xbb, 0xda, 0x5d, 0x3c, 0x83, 0x85,
+	0xce, 0x57, 0x38, 0x31, 0xdb, 0x83, 0x06, 0x42,
+};
+
+static const uint8_t tls_kat_aes256_12_0[] = {
+	0x16, 0x03, 0x03, 0x00, 0x2e, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa,
+	0xab, 0x92, 0x7b, 0x0c, 0x72, 0x31, 0xa7, 0x71, 0xe0, 0x16, 0x00, 0xf4,
+	0xa7, 0x58, 0x0a, 0xac, 0xbf, 0x19, 0xc2, 0x2d, 0x75, 0xea, 0xc3, 0x33,
+	0x9a, 0xc5, 0x2b, 0x23, 0xf2, 0x10, 0x94, 0xa0, 0xfa, 0x7c, 0x9a, 0xb7,
+	0x74, 0x31, 0xff,
+};
+
+static const uint8_t tls_kat_aes256_12_1[] = {
+	0x17, 0x03, 0x03, 0x00, 0x2e, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa,
+	0xac, 0xaf, 0xaf, 0x3b, 0x45, 0x5f, 0x98, 0x6f, 0x67, 0xc0, 0xa8, 0x6e,
+	0xf0, 0x1f, 0xb7, 0x61, 0xed, 0xd8, 0x99, 0x63, 0x4a, 0x0f, 0x46, 0x78,
+	0xcf, 0xd3, 0x9f, 0x85, 0xb9, 0xf7, 0x1b, 0x36, 0x39, 0xcd, 0x4c, 0x04,
+	0x61, 0xfc, 0x81,
+};
+
+static const uint8_t tls_kat_chacha_12_0[] = {
+	0x16, 0x03, 0x03, 0x00, 0x26, 0xd2, 0x9c, 0x34, 0x09, 0xa7, 0xe7, 0x4d,
+	0xc9, 0xc1, 0x99, 0x9f, 0x2e, 0x0c, 0x97, 0x28, 0x07, 0x1c, 0x7e, 0xff,
+	0x3c, 0x11, 0x04, 0x0c, 0x7f, 0xdb, 0x88, 0x4e, 0x3f, 0x10, 0xce, 0xb2,
+	0x5f, 0xcc, 0x59, 0x75, 0xb9, 0x2c, 0xec,
+};
+
+static const uint8_t tls_kat_chacha_12_1[] = {
+	0x17, 0x03, 0x03, 0x00, 0x26, 0x82, 0x1d, 0x7f, 0xb7, 0x60, 0x84, 0x4b,
+	0x21, 0x5c, 0x37, 0x86, 0xba, 0xfc, 0x80, 0xdd, 0x09, 0x4b, 0x18, 0x6b,
+	0xad, 0x3e, 0x38, 0x09, 0xb6, 0xf3, 0xfd, 0x1c, 0xdb, 0x43, 0x3b, 0x01,
+	0x3d, 0x94, 0x12, 0x0f, 0x5f, 0x52, 0xb6,
+};
+
+static const uint8_t tls_kat_chacha_13_0[] = {
+	0x17, 0x03, 0x03, 0x00, 0x27, 0xd2, 0x9c, 0x34, 0x09, 0xa7, 0xe7, 0x4d,
+	0xc9, 0xc1, 0x99, 0x9f, 0x2e, 0x0c, 0x97, 0x28, 0x07, 0x1c, 0x7e, 0xff,
+	0x3c, 0x11, 0x04, 0x61, 0x96, 0x83, 0x29, 0x13, 0xc7, 0x39, 0x72, 0x46,
+	0x76, 0xef, 0x52, 0x81, 0x96, 0x9f, 0xb9, 0x5b,
+};
+
+static const uint8_t tls_kat_chacha_13_1[] = {
+	0x17, 0x03, 0x03, 0x00, 0x27, 0x82, 0x1d, 0x7f, 0xb7, 0x60, 0x84, 0x4b,
+	0x21, 0x5c, 0x37, 0x86, 0xba, 0xfc, 0x80, 0xdd, 0x09, 0x4b, 0x18, 0x6b,
+	0xad, 0x3e, 0x38, 0x8e, 0x94, 0x24, 0x86, 0xed, 0x57, 0x97, 0x82, 0x1c,
+	0x2a, 0xc0, 0xb7, 0xd3, 0x8a, 0x4c, 0x19, 0xc0,
+};
+
+static void
+tls_pair(int *client, int *server)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	int l = socket(AF_INET, SOCK_STREAM, 0);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(l, "socket");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(l, (struct sockaddr *)&sin, sizeof(sin)), "bind");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listen(l, 1), "listen");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(l, (struct sockaddr *)&sin, &len), "getsockname");
+
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(*client, "socket");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(connect(*client, (struct sockaddr *)&sin, sizeof(sin)), "connect");
+	*server = accept(l, NULL, NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(*server, "accept");
+	close(l);
+}
+
+static void
+tls_info(struct tcp_tls_info *tti, uint16_t version, uint16_t cipher)
+{
+	memset(tti, 0, sizeof(*tti));
+	tti->tti_version = version;
+	tti->tti_cipher = cipher;
+	tti->tti_keylen = (cipher == TCP_TLS_CIPHER_AES_GCM_128) ? 16 : 32;
+	arc4random_buf(tti->tti_key, sizeof(tti->tti_key));
+	arc4random_buf(tti->tti_iv, sizeof(tti->tti_iv));
+}
+
+static void
+tls_recv_all(int s, uint8_t *buf, size_t len)
+{
+	size_t off = 0;
+
+	while (off < len) {
+		ssize_t n = recv(s, buf + off, len - off, 0);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recv");
+		T_QUIET; T_ASSERT_GT(n, 0L, "connection still open");
+		off += (size_t)n;
+	}
+}
+
+/*
+ * Read one record and check its header; returns the record length
+ */
+static size_t
+tls_recv_record(int s, uint8_t type, size_t len)
+{
+	uint8_t hdr[TLS_HDR_LEN];
+	uint8_t *body;
+	size_t rlen;
+
+	tls_recv_all(s, hdr, sizeof(hdr));
+	T_ASSERT_EQ(hdr[0], type, "record type");
+	T_ASSERT_EQ(hdr[1], 0x03, "legacy version major");
+	T_ASSERT_EQ(hdr[2], 0x03, "legacy version minor");
+	rlen = ((size_t)hdr[3] << 8) | hdr[4];
+	T_ASSERT_EQ(rlen, len, "record length");
+
+	body = malloc(rlen);
+	T_QUIET; T_ASSERT_NOTNULL(body, "malloc");
+	tls_recv_all(s, body, rlen);
+	T_ASSERT_NULL(memmem(body, rlen, tls_plaintext, sizeof(tls_plaintext) - 1),
+	    "no plaintext on the wire");
+	free(body);
+	return rlen;
+}
+
+/*
+ * Send a buffer as a single write of the given TLS content type
+ */
+static ssize_t
+tls_send_type(int s, const void *buf, size_t len, uint8_t type)
+{
+	uint8_t cbuf[CMSG_SPACE(sizeof(uint8_t))] = {};
+	struct iovec iov = {
+		.iov_base = (void *)(uintptr_t)buf,
+		.iov_len = len,
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+
+	cm->cmsg_level = IPPROTO_TCP;
+	cm->cmsg_type = TCP_TLS_RECORD_TYPE;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+	*(uint8_t *)CMSG_DATA(cm) = type;
+	return sendmsg(s, &msg, 0);
+}
+
+T_DECL(tcp_tls_opt, "TCP_TLS_TX argument and state checks")
+{
+	struct tcp_tls_info tti;
+	socklen_t len = sizeof(tti);
+	int c, s;
+
+	c = socket(AF_INET, SOCK_STREAM, 0);
+	T_ASSERT_POSIX_SUCCESS(c, "socket");
+	tls_info(&tti, TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_AES_GCM_128);
+	T_ASSERT_POSIX_FAILURE(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)),
+	    ENOTCONN, "not connected");
+	close(c);
+
+	tls_pair(&c, &s);
+	T_ASSERT_POSIX_FAILURE(getsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, &len),
+	    ENOENT, "get before set");
+
+	tls_info(&tti, 0x0302, TCP_TLS_CIPHER_AES_GCM_128);
+	T_ASSERT_POSIX_FAILURE(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)),
+	    EINVAL, "TLS 1.1");
+	tls_info(&tti, TCP_TLS_VERSION_1_3, 42);
+	T_ASSERT_POSIX_FAILURE(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)),
+	    EINVAL, "unknown cipher");
+	tls_info(&tti, TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_AES_GCM_256);
+	tti.tti_keylen = 16;
+	T_ASSERT_POSIX_FAILURE(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)),
+	    EINVAL, "key length doesn't match the cipher");
+
+	tls_info(&tti, TCP_TLS_VERSION_1_2, TCP_TLS_CIPHER_CHACHA20_POLY1305);
+	tti.tti_seq = 7;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)), "set");
+	T_ASSERT_POSIX_FAILURE(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)),
+	    EBUSY, "set twice");
+
+	memset(&tti, 0xff, sizeof(tti));
+	len = sizeof(tti);
+	T_ASSERT_POSIX_SUCCESS(getsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, &len), "get");
+	T_ASSERT_EQ(tti.tti_version, TCP_TLS_VERSION_1_2, "version");
+	T_ASSERT_EQ(tti.tti_cipher, TCP_TLS_CIPHER_CHACHA20_POLY1305, "cipher");
+	T_ASSERT_EQ(tti.tti_seq, 7ULL, "sequence number");
+	for (size_t i = 0; i < sizeof(tti.tti_key); i++) {
+		T_QUIET; T_ASSERT_EQ(tti.tti_key[i], 0, "key not returned");
+	}
+	close(c);
+	close(s);
+}
+
+static void
+tls_records(uint16_t version, uint16_t cipher)
+{
+	struct tcp_tls_info tti;
+	size_t big = TCP_TLS_MAX_RECORD + 100;
+	size_t overhead, inner;
+	char *buf;
+	int c, s;
+
+	/* TLS 1.3 appends the inner content type; 1.2 GCM prepends the explicit nonce */
+	inner = (version == TCP_TLS_VERSION_1_3) ? 1 : 0;
+	overhead = inner + TLS_TAG_LEN;
+	if (version == TCP_TLS_VERSION_1_2 && cipher != TCP_TLS_CIPHER_CHACHA20_POLY1305) {
+		overhead += 8;
+	}
+
+	tls_pair(&c, &s);
+	tls_info(&tti, version, cipher);
+	T_ASSERT_POSIX_SUCCESS(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)), "set");
+
+	T_ASSERT_EQ(send(c, tls_plaintext, sizeof(tls_plaintext) - 1, 0),
+	    (ssize_t)(sizeof(tls_plaintext) - 1), "send");
+	tls_recv_record(s, TLS_TYPE_APPDATA, sizeof(tls_plaintext) - 1 + overhead);
+
+	/* a write larger than a record is split */
+	buf = malloc(big);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	for (size_t off = 0; off + sizeof(tls_plaintext) - 1 <= big; off += sizeof(tls_plaintext) - 1) {
+		memcpy(buf + off, tls_plaintext, sizeof(tls_plaintext) - 1);
+	}
+	T_ASSERT_EQ(send(c, buf, big, 0), (ssize_t)big, "send");
+	tls_recv_record(s, TLS_TYPE_APPDATA, TCP_TLS_MAX_RECORD + overhead);
+	tls_recv_record(s, TLS_TYPE_APPDATA, big - TCP_TLS_MAX_RECORD + overhead);
+	free(buf);
+
+	/* the content type comes from the control message */
+	T_ASSERT_EQ(tls_send_type(c, tls_plaintext, sizeof(tls_plaintext) - 1,
+	    TLS_TYPE_HANDSHAKE), (ssize_t)(sizeof(tls_plaintext) - 1), "sendmsg");
+	tls_recv_record(s, (version == TCP_TLS_VERSION_1_3) ? TLS_TYPE_APPDATA : TLS_TYPE_HANDSHAKE,
+	    sizeof(tls_plaintext) - 1 + overhead);
+
+	close(c);
+	close(s);
+}
+
+T_DECL(tcp_tls_records_aes128, "TLS 1.3 AES-128-GCM record framing")
+{
+	tls_records(TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_AES_GCM_128);
+}
+
+T_DECL(tcp_tls_records_aes256_12, "TLS 1.2 AES-256-GCM record framing")
+{
+	tls_records(TCP_TLS_VERSION_1_2, TCP_TLS_CIPHER_AES_GCM_256);
+}
+
+T_DECL(tcp_tls_records_chacha, "TLS 1.3 ChaCha20-Poly1305 record framing")
+{
+	tls_records(TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_CHACHA20_POLY1305);
+}
+
+static void
+tls_kat(uint16_t version, uint16_t cipher, const uint8_t *rec0, size_t len0,
+    const uint8_t *rec1, size_t len1)
+{
+	struct tcp_tls_info tti = {
+		.tti_version = version,
+		.tti_cipher = cipher,
+		.tti_keylen = (cipher == TCP_TLS_CIPHER_AES_GCM_128) ? 16 : 32,
+		.tti_seq = 0x0102030405060708ULL,
+	};
+	uint8_t buf[64];
+	int c, s;
+
+	for (size_t i = 0; i < sizeof(tti.tti_key); i++) {
+		tti.tti_key[i] = (uint8_t)i;
+	}
+	for (size_t i = 0; i < sizeof(tti.tti_iv); i++) {
+		tti.tti_iv[i] = (uint8_t)(0xa0 + i);
+	}
+
+	tls_pair(&c, &s);
+	T_ASSERT_POSIX_SUCCESS(setsockopt(c, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)), "set");
+
+	T_ASSERT_EQ(tls_send_type(c, tls_plaintext, sizeof(tls_plaintext) - 1,
+	    TLS_TYPE_HANDSHAKE), (ssize_t)(sizeof(tls_plaintext) - 1), "sendmsg");
+	T_QUIET; T_ASSERT_LE(len0, sizeof(buf), NULL);
+	tls_recv_all(s, buf, len0);
+	T_ASSERT_EQ(memcmp(buf, rec0, len0), 0, "handshake record matches the known answer");
+
+	T_ASSERT_EQ(send(c, tls_plaintext, sizeof(tls_plaintext) - 1, 0),
+	    (ssize_t)(sizeof(tls_plaintext) - 1), "send");
+	T_QUIET; T_ASSERT_LE(len1, sizeof(buf), NULL);
+	tls_recv_all(s, buf, len1);
+	T_ASSERT_EQ(memcmp(buf, rec1, len1), 0, "next record matches the known answer");
+
+	close(c);
+	close(s);
+}
+
+T_DECL(tcp_tls_kat, "sealed records match known answers")
+{
+	tls_kat(TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_AES_GCM_128,
+	    tls_kat_aes128_13_0, sizeof(tls_kat_aes128_13_0),
+	    tls_kat_aes128_13_1, sizeof(tls_kat_aes128_13_1));
+	tls_kat(TCP_TLS_VERSION_1_2, TCP_TLS_CIPHER_AES_GCM_256,
+	    tls_kat_aes256_12_0, sizeof(tls_kat_aes256_12_0),
+	    tls_kat_aes256_12_1, sizeof(tls_kat_aes256_12_1));
+	tls_kat(TCP_TLS_VERSION_1_2, TCP_TLS_CIPHER_CHACHA20_POLY1305,
+	    tls_kat_chacha_12_0, sizeof(tls_kat_chacha_12_0),
+	    tls_kat_chacha_12_1, sizeof(tls_kat_chacha_12_1));
+	tls_kat(TCP_TLS_VERSION_1_3, TCP_TLS_CIPHER_CHACHA20_POLY1305,
+	    tls_kat_chacha_13_0, sizeof(tls_kat_chacha_13_0),
+	    tls_kat_chacha_13_1, sizeof(tls_kat_chacha_13_1));
+}
+
+#define TLS_LONG_WRITE          (256 * 1024)
+
+struct tls_writer {
+	int             s;
+	uint8_t         type;
+	char            *buf;
+};
+
+static void *
+tls_write_long(void *arg)
+{
+	struct tls_writer *w = arg;
+
+	T_ASSERT_EQ(tls_send_type(w->s, w->buf, TLS_LONG_WRITE, w->type),
+	    (ssize_t)TLS_LONG_WRITE, "long write");
+	return NULL;
+}
+
+T_DECL(tcp_tls_long_write, "every record of a write larger than the send buffer has its type")
+{
+	struct tcp_tls_info tti;
+	struct tls_writer w = { .type = TLS_TYPE_HANDSHAKE };
+	pthread_t thread;
+	size_t plen = 0;
+	u_int records = 0;
+	int sndbuf = 8192;
+	int s;
+
+	tls_pair(&w.s, &s);
+	T_ASSERT_POSIX_SUCCESS(setsockopt(w.s, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+	    sizeof(sndbuf)), "SO_SNDBUF");
+	tls_info(&tti, TCP_TLS_VERSION_1_2, TCP_TLS_CIPHER_AES_GCM_128);
+	T_ASSERT_POSIX_SUCCESS(setsockopt(w.s, IPPROTO_TCP, TCP_TLS_TX, &tti, sizeof(tti)), "set");
+
+	w.buf = calloc(1, TLS_LONG_WRITE);
+	T_QUIET; T_ASSERT_NOTNULL(w.buf, "calloc");
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, tls_write_long, &w), NULL);
+
+	/* the write is handed to TCP in many chunks, sealed separately */
+	while (plen < TLS_LONG_WRITE) {
+		uint8_t hdr[TLS_HDR_LEN];
+		uint8_t body[TCP_TLS_MAX_RECORD + 8 + TLS_TAG_LEN];
+		size_t rlen;
+
+		tls_recv_all(s, hdr, sizeof(hdr));
+		T_QUIET; T_ASSERT_EQ(hdr[0], TLS_TYPE_HANDSHAKE, "record %u type", records);
+		rlen = ((size_t)hdr[3] << 8) | hdr[4];
+		T_QUIET; T_ASSERT_GT(rlen, (size_t)(8 + TLS_TAG_LEN), "record %u length", records);
+		T_QUIET; T_ASSERT_LE(rlen, sizeof(body), "record %u length", records);
+		tls_recv_all(s, body, rlen);
+		plen += rlen - 8 - TLS_TAG_LEN;
+		records++;
+	}
+	T_ASSERT_EQ(plen, (size_t)TLS_LONG_WRITE, "%u handshake records", records);
+	T_ASSERT_POSIX_ZERO(pthread_join(thread, NULL), NULL);
+
+	/* and the next write is application data again */
+	T_ASSERT_EQ(send(w.s, tls_plaintext, sizeof(tls_plaintext) - 1, 0),
+	    (ssize_t)(sizeof(tls_plaintext) - 1), "send");
+	tls_recv_record(s, TLS_TYPE_APPDATA, sizeof(tls_plaintext) - 1 + 8 + TLS_TAG_LEN);
+
+	free(w.buf);
+	close(w.s);
+	close(s);
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <darwintest.h>
+#include <skywalk/os_skywalk_private.h>
+
+#include "net_test_lib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"));
+
+#define GSO_SEG_SIZE    1000
+#define GSO_SEGS        10
+#define GSO_LAST_SIZE   123
+
+T_DECL(udp_gso_opt, "UDP_SEGMENT argument checks")
+{
+	int s, val;
+	socklen_t len = sizeof(val);
+
+	T_ASSERT_POSIX_SUCCESS(s = socket(AF_INET, SOCK_DGRAM, 0), NULL);
+
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, &len), NULL);
+	T_ASSERT_EQ(val, 0, "disabled by default");
+
+	val = -1;
+	T_ASSERT_POSIX_FAILURE(setsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)),
+	    EINVAL, "negative size");
+	val = UINT16_MAX + 1;
+	T_ASSERT_POSIX_FAILURE(setsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)),
+	    EINVAL, "size too large");
+
+	val = GSO_SEG_SIZE;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)), NULL);
+	val = 0;
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, &len), NULL);
+	T_ASSERT_EQ(val, GSO_SEG_SIZE, "segment size");
+	close(s);
+}
+
+static void
+udp_gso_loopback(int af)
+{
+	struct sockaddr_storage ss = {};
+	socklen_t sslen;
+	char sbuf[GSO_SEG_SIZE * (GSO_SEGS - 1) + GSO_LAST_SIZE];
+	char rbuf[2 * GSO_SEG_SIZE];
+	int rs, ss_fd, val;
+	ssize_t n;
+
+	if (af == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+		sin->sin_len = sizeof(*sin);
+		sin->sin_family = AF_INET;
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+		sin6->sin6_len = sizeof(*sin6);
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_addr = in6addr_loopback;
+	}
+	sslen = ss.ss_len;
+
+	T_ASSERT_POSIX_SUCCESS(rs = socket(af, SOCK_DGRAM, 0), NULL);
+	T_ASSERT_POSIX_SUCCESS(bind(rs, (struct sockaddr *)&ss, sslen), NULL);
+	T_ASSERT_POSIX_SUCCESS(getsockname(rs, (struct sockaddr *)&ss, &sslen), NULL);
+
+	T_ASSERT_POSIX_SUCCESS(ss_fd = socket(af, SOCK_DGRAM, 0), NULL);
+	val = 64 * 1024;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)), NULL);
+	val = GSO_SEG_SIZE;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)), NULL);
+
+	for (size_t i = 0; i < sizeof(sbuf); i++) {
+		sbuf[i] = (char)(i / GSO_SEG_SIZE);
+	}
+	T_ASSERT_EQ(sendto(ss_fd, sbuf, sizeof(sbuf), 0, (struct sockaddr *)&ss, sslen),
+	    (ssize_t)sizeof(sbuf), "one send of %zu bytes", sizeof(sbuf));
+
+	for (int i = 0; i < GSO_SEGS; i++) {
+		size_t expected = (i == GSO_SEGS - 1) ? GSO_LAST_SIZE : GSO_SEG_SIZE;
+
+		n = recv(rs, rbuf, sizeof(rbuf), 0);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recv datagram %d", i);
+		T_QUIET; T_ASSERT_EQ((size_t)n, expected, "datagram %d length", i);
+		T_QUIET; T_ASSERT_EQ(memcmp(rbuf, sbuf + i * GSO_SEG_SIZE, expected), 0,
+		    "datagram %d payload", i);
+	}
+	T_PASS("received %d datagrams", GSO_SEGS);
+
+	/* a train longer than UDP_GSO_MAX_SEGS is refused */
+	val = 8;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)), NULL);
+	T_ASSERT_POSIX_FAILURE(sendto(ss_fd, sbuf, sizeof(sbuf), 0, (struct sockaddr *)&ss, sslen),
+	    EMSGSIZE, "too many segments");
+
+	close(ss_fd);
+	close(rs);
+}
+
+T_DECL(udp_gso_loopback_ipv4, "UDP_SEGMENT send over IPv4 loopback")
+{
+	udp_gso_loopback(AF_INET);
+}
+
+T_DECL(udp_gso_loopback_ipv6, "UDP_SEGMENT send over IPv6 loopback")
+{
+	udp_gso_loopback(AF_INET6);
+}
+
+T_DECL(udp_gro_opt, "UDP_GRO on and off, before and after connect")
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_port = htons(9),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int s, val;
+	socklen_t len = sizeof(val);
+
+	T_ASSERT_POSIX_SUCCESS(s = socket(AF_INET, SOCK_DGRAM, 0), NULL);
+
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, IPPROTO_UDP, UDP_GRO, &val, &len), NULL);
+	T_ASSERT_EQ(val, 0, "disabled by default");
+
+	val = 1;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)), NULL);
+	T_ASSERT_POSIX_SUCCESS(connect(s, (struct sockaddr *)&sin, sizeof(sin)), NULL);
+	val = 0;
+	T_ASSERT_POSIX_SUCCESS(getsockopt(s, IPPROTO_UDP, UDP_GRO, &val, &len), NULL);
+	T_ASSERT_EQ(val, 1, "enabled");
+
+	val = 0;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)), NULL);
+	val = 1;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)),
+	    "enable on a connected socket");
+	T_ASSERT_POSIX_SUCCESS(disconnectx(s, SAE_ASSOCID_ANY, SAE_CONNID_ANY), NULL);
+	close(s);
+}
+
+/*
+ * A feth pair attached natively, i.e. through a netif nexus plumbed under
+ * a flowswitch: trains sent over it are split by netif_gso_dispatch()
+ * rather than by udp_output().
+ */
+#define FAKE_SYSCTL_BSD_MODE    "net.link.fake.bsd_mode"
+#define FAKE_SYSCTL_HWCSUM      "net.link.fake.hwcsum"
+
+static network_interface_pair_list_t    S_feth_pairs;
+
+static void
+feth_native_cleanup(void)
+{
+	network_interface_pair_list_destroy(S_feth_pairs);
+	S_feth_pairs = NULL;
+	sysctl_restore_all();
+	/* allow for the detach to be final before the next test */
+	usleep(100000);
+}
+
+static network_interface_pair_t
+feth_native_pair(void)
+{
+	network_interface_pair_t pair;
+
+	T_ATEND(feth_native_cleanup);
+	sysctl_set_integer(FAKE_SYSCTL_BSD_MODE, 0);
+	sysctl_set_integer(FAKE_SYSCTL_HWCSUM, 1);
+
+	S_feth_pairs = network_interface_pair_list_alloc(1);
+	pair = S_feth_pairs->list;
+	network_interface_create(&pair->one, FETH_NAME);
+	network_interface_create(&pair->two, FETH_NAME);
+	network_interface_assign_address(&pair->one, 1, 1);
+	network_interface_assign_address(&pair->two, 1, 2);
+	fake_set_peer(pair->one.if_name, pair->two.if_name);
+	return pair;
+}
+
+/* one counter from the netif nexus attached to ifname */
+static uint64_t
+netif_stat(const char *ifname, int stat)
+{
+	struct sk_stats_net_if *sns;
+	uint64_t value = 0;
+	size_t len = 0;
+	bool found = false;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(SK_STATS_NET_IF, NULL, &len, NULL, 0),
+	    SK_STATS_NET_IF);
+	T_QUIET; T_ASSERT_NOTNULL(sns = malloc(len), "malloc");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(SK_STATS_NET_IF, sns, &len, NULL, 0),
+	    SK_STATS_NET_IF);
+	for (size_t i = 0; i < len / sizeof(*sns); i++) {
+		if (strncmp(sns[i].sns_if_name, ifname, IFNAMSIZ) == 0) {
+			value = sns[i].sns_nifs._arr[stat];
+			found = true;
+			break;
+		}
+	}
+	free(sns);
+	T_QUIET; T_ASSERT_TRUE(found, "%s has a netif nexus", ifname);
+	return value;
+}
+
+T_DECL(udp_gso_netif, "UDP_SEGMENT trains are split by netif on a native feth",
+    T_META_ASROOT(true),
+    T_META_CHECK_LEAKS(false))
+{
+	network_interface_pair_t pair;
+	struct sockaddr_in ssin, rsin;
+	char sbuf[GSO_SEG_SIZE * (GSO_SEGS - 1) + GSO_LAST_SIZE];
+	char rbuf[2 * GSO_SEG_SIZE];
+	uint64_t segs, pkts;
+	int rs, ss_fd, val;
+	ssize_t n;
+
+	pair = feth_native_pair();
+	rs = inet_udp_socket_on_interface(pair->two.if_name, pair->two.ip, &rsin);
+	ss_fd = inet_udp_socket_on_interface(pair->one.if_name, pair->one.ip, &ssin);
+	T_ASSERT_POSIX_SUCCESS(connect(ss_fd, (struct sockaddr *)&rsin, sizeof(rsin)), NULL);
+
+	val = GSO_SEG_SIZE;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)), NULL);
+	for (size_t i = 0; i < sizeof(sbuf); i++) {
+		sbuf[i] = (char)(i / GSO_SEG_SIZE);
+	}
+
+	segs = netif_stat(pair->one.if_name, NETIF_STATS_GSO_SEG);
+	pkts = netif_stat(pair->one.if_name, NETIF_STATS_GSO_PKT);
+	T_ASSERT_EQ(send(ss_fd, sbuf, sizeof(sbuf), 0), (ssize_t)sizeof(sbuf),
+	    "one send of %zu bytes over %s", sizeof(sbuf), pair->one.if_name);
+
+	for (int i = 0; i < GSO_SEGS; i++) {
+		size_t expected = (i == GSO_SEGS - 1) ? GSO_LAST_SIZE : GSO_SEG_SIZE;
+
+		n = recv(rs, rbuf, sizeof(rbuf), 0);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recv datagram %d", i);
+		T_QUIET; T_ASSERT_EQ((size_t)n, expected, "datagram %d length", i);
+		T_QUIET; T_ASSERT_EQ(memcmp(rbuf, sbuf + i * GSO_SEG_SIZE, expected), 0,
+		    "datagram %d payload", i);
+	}
+	T_PASS("received %d datagrams over %s", GSO_SEGS, pair->two.if_name);
+
+	/* the train went through netif as one packet, and came out as GSO_SEGS */
+	T_EXPECT_EQ(netif_stat(pair->one.if_name, NETIF_STATS_GSO_PKT) - pkts, 1ULL,
+	    "one GSO packet");
+	T_EXPECT_EQ(netif_stat(pair->one.if_name, NETIF_STATS_GSO_SEG) - segs, (uint64_t)GSO_SEGS,
+	    "%d GSO segments", GSO_SEGS);
+
+	close(ss_fd);
+	close(rs);
+}
+
+T_DECL(udp_gro_netif, "UDP_GRO sockets receive coalesced trains on a native feth",
+    T_META_ASROOT(true),
+    T_META_CHECK_LEAKS(false))
+{
+	network_interface_pair_t pair;
+	struct sockaddr_in ssin, rsin;
+	char sbuf[GSO_SEG_SIZE * GSO_SEGS];
+	char rbuf[sizeof(sbuf)];
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	size_t received = 0;
+	int coalesced = 0, msgs = 0;
+	int rs, ss_fd, val;
+
+	pair = feth_native_pair();
+	rs = inet_udp_socket_on_interface(pair->two.if_name, pair->two.ip, &rsin);
+	ss_fd = inet_udp_socket_on_interface(pair->one.if_name, pair->one.ip, &ssin);
+
+	/* the flowswitch flow that coalesces is installed on connect */
+	val = 1;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(rs, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)), NULL);
+	T_ASSERT_POSIX_SUCCESS(connect(rs, (struct sockaddr *)&ssin, sizeof(ssin)), NULL);
+	T_ASSERT_POSIX_SUCCESS(connect(ss_fd, (struct sockaddr *)&rsin, sizeof(rsin)), NULL);
+
+	/* a train puts the datagrams back to back in one receive batch */
+	val = GSO_SEG_SIZE;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(ss_fd, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)), NULL);
+	for (size_t i = 0; i < sizeof(sbuf); i++) {
+		sbuf[i] = (char)(i / GSO_SEG_SIZE);
+	}
+	T_ASSERT_EQ(send(ss_fd, sbuf, sizeof(sbuf), 0), (ssize_t)sizeof(sbuf),
+	    "one send of %zu bytes over %s", sizeof(sbuf), pair->one.if_name);
+
+	while (received < sizeof(sbuf)) {
+		struct iovec iov = { .iov_base = rbuf, .iov_len = sizeof(rbuf) };
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = cbuf,
+			.msg_controllen = sizeof(cbuf),
+		};
+		struct cmsghdr *cmsg;
+		int segsz = 0;
+		ssize_t n;
+
+		n = recvmsg(rs, &msg, 0);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recvmsg %d", msgs);
+		T_QUIET; T_ASSERT_EQ(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC), 0, "message %d not truncated", msgs);
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+				memcpy(&segsz, CMSG_DATA(cmsg), sizeof(segsz));
+			}
+		}
+		if (segsz != 0) {
+			T_QUIET; T_ASSERT_EQ(segsz, GSO_SEG_SIZE, "message %d segment size", msgs);
+			T_QUIET; T_ASSERT_EQ((size_t)n % GSO_SEG_SIZE, (size_t)0,
+			    "message %d holds whole segments", msgs);
+			coalesced++;
+		} else {
+			T_QUIET; T_ASSERT_EQ((size_t)n, (size_t)GSO_SEG_SIZE, "message %d length", msgs);
+		}
+		T_QUIET; T_ASSERT_LE(received + n, sizeof(sbuf), "message %d within the send", msgs);
+		T_QUIET; T_ASSERT_EQ(memcmp(rbuf, sbuf + received, n), 0, "message %d payload", msgs);
+		received += n;
+		msgs++;
+	}
+	T_LOG("%d datagrams received in %d messages, %d coalesced", GSO_SEGS, msgs, coalesced);
+	T_EXPECT_GT(coalesced, 0, "at least one coalesced message with a UDP_GRO control message");
+	T_EXPECT_LT(msgs, GSO_SEGS, "fewer messages than datagrams");
+
+	close(ss_fd);
+	close(rs);
+}
@@ -0,0 +1,349 @@
+/*
+ * Equivalence test and throughput benchmark for the LZ4 codec in
+ * osfmk/vm/lz4.c.
+ *
+ * lz4_decode_fast() is the C counterpart of the x86_64 assembly decoder
+ * (lz4_decode_x86_64.s) and must stop at the same command, with the same
+ * return value and the same output, on every stream: encoder output,
+ * hand-built streams exercising every short match distance, and corrupted
+ * streams.  The benchmark reports encode/decode GB/s and the compression
+ * ratio of 4K and 16K page sets.
+ */
+
+#include <darwintest.h>
+#include <mach/mach_time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_RUN_CONCURRENTLY(true));
+
+#define LZ4_MAX_PAGE_SIZE       16384
+/* the decoders may store up to LZ4_GOFAST_SAFETY_MARGIN bytes past the relaxed end */
+#define LZ4_BUF_SIZE            (LZ4_MAX_PAGE_SIZE + 2 * LZ4_GOFAST_SAFETY_MARGIN)
+#define CORPUS_PAGES            256
+#define BENCH_ROUNDS            32
+
+typedef enum {
+	CORPUS_ZERO,
+	CORPUS_SPARSE,
+	CORPUS_POINTERS,
+	CORPUS_TEXT,
+	CORPUS_SHORT_PERIOD,
+	CORPUS_RANDOM,
+	CORPUS_MIXED,
+	CORPUS_COUNT,
+} corpus_kind_t;
+
+static const char *corpus_names[CORPUS_COUNT] = {
+	[CORPUS_ZERO]         = "zero",
+	[CORPUS_SPARSE]       = "sparse",
+	[CORPUS_POINTERS]     = "pointers",
+	[CORPUS_TEXT]         = "text",
+	[CORPUS_SHORT_PERIOD] = "short-period",
+	[CORPUS_RANDOM]       = "random",
+	[CORPUS_MIXED]        = "mixed",
+};
+
+static uint32_t
+corpus_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void
+corpus_fill_page(corpus_kind_t kind, uint8_t *page, size_t page_size, uint32_t *state)
+{
+	static const char words[] = "the quick brown fox jumps over the lazy dog ";
+	uint32_t v = corpus_rand(state);
+	uint32_t period = 1 + v % 15;
+
+	for (size_t i = 0; i < page_size; i += sizeof(uint32_t)) {
+		uint32_t r = corpus_rand(state);
+		uint32_t w;
+
+		switch (kind) {
+		case CORPUS_ZERO:
+			w = 0;
+			break;
+		case CORPUS_SPARSE:
+			w = (r % 61 == 0) ? corpus_rand(state) : 0;
+			break;
+		case CORPUS_POINTERS:
+			w = (r % 4 == 0) ? 0 : ((v & 0xfff00000) | ((r >> 8) & 0xffff0));
+			break;
+		case CORPUS_TEXT:
+			memcpy(&w, &words[r % (sizeof(words) - 5)], sizeof(w));
+			break;
+		case CORPUS_SHORT_PERIOD:
+			/* overlapping matches with distance < 16 */
+			for (size_t b = 0; b < sizeof(w); b++) {
+				page[i + b] = (uint8_t)(v >> (8 * ((i + b) % period % 4)));
+			}
+			continue;
+		case CORPUS_RANDOM:
+			w = r;
+			break;
+		case CORPUS_MIXED:
+		default:
+			w = (r % 5 == 0) ? r : (r % 5 == 1) ? 0 : (v ^ (r & 0x3ff));
+			break;
+		}
+		memcpy(page + i, &w, sizeof(w));
+	}
+}
+
+static uint8_t *
+corpus_create(corpus_kind_t kind, size_t page_size)
+{
+	uint8_t *corpus = aligned_alloc(page_size, CORPUS_PAGES * page_size);
+	uint32_t state = 0x9e3779b9u ^ (uint32_t)kind;
+
+	T_QUIET; T_ASSERT_NOTNULL(corpus, "corpus allocation");
+	for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+		corpus_fill_page(kind, corpus + p * page_size, page_size, &state);
+	}
+	return corpus;
+}
+
+typedef int (*lz4_gofast_fn)(uint8_t **, uint8_t *, uint8_t *, const uint8_t **, const uint8_t *);
+
+/* lz4raw_decode_buffer() with the fast stage selected by the caller */
+static int
+lz4_decode_with(lz4_gofast_fn gofast, uint8_t *dst, size_t dst_size,
+    const uint8_t *src, size_t src_size, uint8_t **dst_stop, size_t *produced)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	int rc = 0;
+
+	if (dst_size > LZ4_GOFAST_SAFETY_MARGIN && src_size > LZ4_GOFAST_SAFETY_MARGIN) {
+		rc = gofast(&d, dst, dst + dst_size - LZ4_GOFAST_SAFETY_MARGIN,
+		    &s, src + src_size - LZ4_GOFAST_SAFETY_MARGIN);
+	}
+	*dst_stop = d;
+	if (rc == 0) {
+		rc = lz4_decode(&d, dst, dst + dst_size, &s, src + src_size) ? -1 : 0;
+	}
+	*produced = (size_t)(d - dst);
+	return rc;
+}
+
+/*
+ * Run both decoders on the same stream and check they agree on the return
+ * value, the command the fast stage stopped at, and every byte produced.
+ */
+static size_t
+lz4_check_decoders(const uint8_t *src, size_t src_size, size_t dst_size, const char *what)
+{
+	static uint8_t out_asm[LZ4_BUF_SIZE] __attribute__((aligned(64)));
+	static uint8_t out_c[LZ4_BUF_SIZE] __attribute__((aligned(64)));
+	uint8_t *stop_asm, *stop_c;
+	size_t produced_asm, produced_c;
+
+	memset(out_asm, 0xa5, sizeof(out_asm));
+	memset(out_c, 0xa5, sizeof(out_c));
+
+	int rc_asm = lz4_decode_with(lz4_decode_asm, out_asm, dst_size, src, src_size, &stop_asm, &produced_asm);
+	int rc_c = lz4_decode_with(lz4_decode_fast, out_c, dst_size, src, src_size, &stop_c, &produced_c);
+
+	T_QUIET; T_ASSERT_EQ(rc_c, rc_asm, "%s: return value", what);
+	T_QUIET; T_ASSERT_EQ((long)(stop_c - out_c), (long)(stop_asm - out_asm), "%s: fast stage stop", what);
+	T_QUIET; T_ASSERT_EQ(produced_c, produced_asm, "%s: bytes produced", what);
+	if (rc_asm == 0) {
+		T_QUIET; T_ASSERT_EQ(memcmp(out_c, out_asm, produced_asm), 0, "%s: output", what);
+	}
+	return rc_asm == 0 ? produced_asm : 0;
+}
+
+T_DECL(lz4_decode_fast_matches_assembly,
+    "lz4_decode_fast is equivalent to the x86_64 assembly decoder",
+    T_META_TAG_VM_PREFERRED)
+{
+	static lz4_hash_entry_t hash_table[LZ4_COMPRESS_HASH_ENTRIES];
+	static uint8_t stream[LZ4_BUF_SIZE] __attribute__((aligned(64)));
+	static uint8_t expect[LZ4_MAX_PAGE_SIZE];
+	static const size_t page_sizes[] = { 4096, 16384 };
+	unsigned int streams = 0;
+	uint32_t state = 1;
+	char what[96];
+
+	/* encoder output, then the same stream with a few corrupted bytes */
+	for (unsigned int ps = 0; ps < sizeof(page_sizes) / sizeof(page_sizes[0]); ps++) {
+		size_t page_size = page_sizes[ps];
+
+		for (corpus_kind_t kind = 0; kind < CORPUS_COUNT; kind++) {
+			uint8_t *corpus = corpus_create(kind, page_size);
+
+			for (unsigned int p = 0; p < CORPUS_PAGES; p++, streams++) {
+				const uint8_t *page = corpus + p * page_size;
+				size_t csize = lz4raw_encode_buffer(stream, page_size, page, page_size, hash_table);
+
+				if (csize == 0) {
+					continue;
+				}
+				snprintf(what, sizeof(what), "%zuK %s page %u", page_size / 1024, corpus_names[kind], p);
+				size_t produced = lz4_check_decoders(stream, csize, page_size, what);
+				T_QUIET; T_ASSERT_EQ(produced, page_size, "%s: decoded size", what);
+				T_QUIET; T_ASSERT_EQ(lz4raw_decode_buffer(expect, page_size, stream, csize, NULL), page_size,
+				    "%s: lz4raw_decode_buffer", what);
+				T_QUIET; T_ASSERT_EQ(memcmp(expect, page, page_size), 0, "%s: round trip", what);
+
+				for (unsigned int i = 0; i < 1 + p % 4; i++) {
+					stream[corpus_rand(&state) % csize] = (uint8_t)corpus_rand(&state);
+				}
+				snprintf(what, sizeof(what), "%zuK %s page %u corrupted", page_size / 1024, corpus_names[kind], p);
+				lz4_check_decoders(stream, csize, page_size, what);
+			}
+			free(corpus);
+		}
+	}
+
+	/*
+	 * Golden streams: D literals followed by a match of distance D, for every
+	 * distance around the 16 byte overlap threshold, and lengths on both sides
+	 * of the short (<= 16) and extended (>= 19) match encodings.
+	 */
+	static const uint32_t match_lengths[] = { 4, 15, 16, 17, 18, 19, 33, 300, 4000 };
+	for (uint32_t d = 1; d <= 40; d++) {
+		for (unsigned int m = 0; m < sizeof(match_lengths) / sizeof(match_lengths[0]); m++, streams++) {
+			uint32_t ml = match_lengths[m];
+			uint8_t *s = stream;
+			size_t n = 0;
+
+			/* literals */
+			*s++ = (uint8_t)((d < 15 ? d : 15) << 4 | (ml - 4 < 15 ? ml - 4 : 15));
+			if (d >= 15) {
+				*s++ = (uint8_t)(d - 15);
+			}
+			for (uint32_t i = 0; i < d; i++) {
+				expect[n++] = *s++ = (uint8_t)corpus_rand(&state);
+			}
+			/* match */
+			*s++ = (uint8_t)d;
+			*s++ = 0;
+			if (ml - 4 >= 15) {
+				uint32_t extra = ml - 4 - 15;
+				for (; extra >= 255; extra -= 255) {
+					*s++ = 255;
+				}
+				*s++ = (uint8_t)extra;
+			}
+			for (uint32_t i = 0; i < ml; i++, n++) {
+				expect[n] = expect[n - d];
+			}
+			/* trailing literals keep the match clear of the relaxed end */
+			*s++ = 0xf0;
+			*s++ = LZ4_GOFAST_SAFETY_MARGIN - 15;
+			for (uint32_t i = 0; i < LZ4_GOFAST_SAFETY_MARGIN; i++) {
+				expect[n++] = *s++ = (uint8_t)i;
+			}
+
+			snprintf(what, sizeof(what), "golden distance %u length %u", d, ml);
+			size_t produced = lz4_check_decoders(stream, (size_t)(s - stream), n, what);
+			T_QUIET; T_ASSERT_EQ(produced, n, "%s: decoded size", what);
+			T_QUIET; T_ASSERT_EQ(lz4raw_decode_buffer(stream + 8192, n, stream, (size_t)(s - stream), NULL), n,
+			    "%s: lz4raw_decode_buffer", what);
+			T_QUIET; T_ASSERT_EQ(memcmp(stream + 8192, expect, n), 0, "%s: output", what);
+		}
+	}
+	T_PASS("%u streams decoded identically", streams);
+}
+
+static double
+abs_to_seconds(uint64_t abstime)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (double)abstime * tb.numer / tb.denom / 1e9;
+}
+
+static void
+lz4_bench_corpus(corpus_kind_t kind, size_t page_size)
+{
+	static lz4_hash_entry_t hash_table[LZ4_COMPRESS_HASH_ENTRIES];
+	static uint8_t out[LZ4_MAX_PAGE_SIZE] __attribute__((aligned(64)));
+	uint8_t *corpus = corpus_create(kind, page_size);
+	uint8_t *compressed = calloc(CORPUS_PAGES, page_size);
+	size_t *csizes = calloc(CORPUS_PAGES, sizeof(size_t));
+	uint64_t compressed_bytes = 0, start, etime, dtime[2];
+	char label[64];
+
+	T_QUIET; T_ASSERT_NOTNULL(compressed, "compressed buffer allocation");
+	T_QUIET; T_ASSERT_NOTNULL(csizes, "size array allocation");
+
+	start = mach_absolute_time();
+	for (unsigned int round = 0; round < BENCH_ROUNDS; round++) {
+		for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+			csizes[p] = lz4raw_encode_buffer(compressed + p * page_size, page_size,
+			    corpus + p * page_size, page_size, hash_table);
+		}
+	}
+	etime = mach_absolute_time() - start;
+
+	for (int impl = 0; impl < 2; impl++) {
+		lz4_gofast_fn gofast = impl ? lz4_decode_fast : lz4_decode_asm;
+
+		start = mach_absolute_time();
+		for (unsigned int round = 0; round < BENCH_ROUNDS; round++) {
+			for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+				uint8_t *stop;
+				size_t produced;
+
+				/* incompressible pages are stored as is */
+				if (csizes[p] == 0) {
+					memcpy(out, corpus + p * page_size, page_size);
+					continue;
+				}
+				lz4_decode_with(gofast, out, page_size, compressed + p * page_size, csizes[p],
+				    &stop, &produced);
+			}
+		}
+		dtime[impl] = mach_absolute_time() - start;
+	}
+
+	for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+		compressed_bytes += csizes[p] ? csizes[p] : page_size;
+	}
+
+	double gbytes = (double)BENCH_ROUNDS * CORPUS_PAGES * page_size / 1e9;
+	double ratio = (double)CORPUS_PAGES * page_size / (double)compressed_bytes;
+
+	T_LOG("%2zuK %-12s: encode %6.2f GB/s, decode asm %6.2f GB/s, decode C %6.2f GB/s, ratio %5.2f",
+	    page_size / 1024, corpus_names[kind], gbytes / abs_to_seconds(etime),
+	    gbytes / abs_to_seconds(dtime[0]), gbytes / abs_to_seconds(dtime[1]), ratio);
+	snprintf(label, sizeof(label), "lz4_encode_%zuk_%s", page_size / 1024, corpus_names[kind]);
+	T_PERF(label, gbytes / abs_to_seconds(etime), "GB/s", "LZ4 encode throughput");
+	snprintf(label, sizeof(label), "lz4_asm_decode_%zuk_%s", page_size / 1024, corpus_names[kind]);
+	T_PERF(label, gbytes / abs_to_seconds(dtime[0]), "GB/s", "LZ4 assembly decode throughput");
+	snprintf(label, sizeof(label), "lz4_c_decode_%zuk_%s", page_size / 1024, corpus_names[kind]);
+	T_PERF(label, gbytes / abs_to_seconds(dtime[1]), "GB/s", "LZ4 C decode throughput");
+
+	free(csizes);
+	free(compressed);
+	free(corpus);
+}
+
+T_DECL(lz4_codec_throughput,
+    "encode/decode throughput and ratio of the LZ4 codec on 4K and 16K pages",
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_PERF)
+{
+	for (corpus_kind_t kind = 0; kind < CORPUS_COUNT; kind++) {
+		lz4_bench_corpus(kind, 4096);
+		lz4_bench_corpus(kind, 16384);
+	}
+}
@@ -4,7 +4,11 @@
  *
  * Functional tests for VM compressor/swap.
  */
+#include <sys/mman.h>
 #include <sys/sysctl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <darwintest.h>
 #include <darwintest_utils.h>
 #include <TargetConditionals.h>
@@ -92,6 +96,130 @@ T_DECL(sysctl_c_segments, "Check that the sysctl that dumps all the c_segments w
 	}
 }
 
+T_DECL(sysctl_codec_selection, "Check that the sysctl that reports the adaptive codec selector works correctly",
+    T_META_TAG_VM_PREFERRED)
+{
+	struct c_codec_selection_info info;
+	size_t len = sizeof(info);
+	int rc = sysctlbyname("vm.compressor_codec_selection", &info, &len, NULL, 0);
+	T_ASSERT_POSIX_SUCCESS(rc, "query `vm.compressor_codec_selection`");
+	T_ASSERT_EQ_ULONG(len, sizeof(info), "got the whole c_codec_selection_info");
+	T_ASSERT_EQ_UINT(info.ccsi_magic, VM_C_CODEC_SELECTION_INFO_MAGIC, "match magic value");
+	T_ASSERT_EQ_UINT(info.ccsi_nclasses, VM_C_CODEC_SELECTION_CLASSES, "match class count");
+
+	for (uint32_t cls = 0; cls < info.ccsi_nclasses; cls++) {
+		const struct c_codec_class_info *ci = &info.ccsi_classes[cls];
+		for (uint32_t c = 0; c < VM_C_CODEC_SELECTION_CODECS; c++) {
+			T_QUIET; T_EXPECT_LE_ULLONG(ci->ccci_failures[c], ci->ccci_selected[c] + ci->ccci_explored[c],
+			    "class %u codec %u: failures are a subset of compressions", cls, c);
+			T_QUIET; T_EXPECT_LE_UINT(ci->ccci_avg_size[c], (uint32_t)vm_kernel_page_size,
+			    "class %u codec %u: average size fits in a page", cls, c);
+		}
+		/* uniform pages always go to WKdm */
+		if (cls == 0) {
+			T_EXPECT_EQ_ULLONG(ci->ccci_selected[1] + ci->ccci_explored[1], 0ULL, "no LZ4 for uniform pages");
+		}
+	}
+}
+
+T_DECL(sysctl_pattern_pages, "Check that pattern pages are detected and reported",
+    T_META_TAG_VM_PREFERRED)
+{
+	struct c_pattern_page_info info;
+	size_t len = sizeof(info);
+	int rc = sysctlbyname("vm.compressor_pattern_pages", &info, &len, NULL, 0);
+	T_ASSERT_POSIX_SUCCESS(rc, "query `vm.compressor_pattern_pages`");
+	T_ASSERT_EQ_ULONG(len, sizeof(info), "got the whole c_pattern_page_info");
+	T_ASSERT_EQ_UINT(info.cppi_magic, VM_C_PATTERN_PAGE_INFO_MAGIC, "match magic value");
+	T_EXPECT_LE_ULLONG(info.cppi_zero + info.cppi_value + info.cppi_pattern8 + info.cppi_pattern16,
+	    info.cppi_scanned, "pattern pages are a subset of the scanned pages");
+}
+
+/*
+ * Pages that the pattern detector stores as is, and a sparse page whose
+ * WKdm encoding (4 bytes of header, 6 per non-zero word) is as short as
+ * a 16 byte pattern: each must come back from the compressor unchanged.
+ */
+enum {
+	CP_PATTERN8,
+	CP_PATTERN16,
+	CP_SPARSE2,
+	CP_SPARSE1,
+	CP_PAGES
+};
+
+static void
+compressor_fill_page(uint64_t *page, int kind)
+{
+	size_t nwords = vm_page_size / sizeof(uint64_t);
+
+	switch (kind) {
+	case CP_PATTERN8:
+		for (size_t i = 0; i < nwords; i++) {
+			page[i] = 0x0123456789abcdefULL;
+		}
+		break;
+	case CP_PATTERN16:
+		for (size_t i = 0; i < nwords; i++) {
+			page[i] = (i & 1) ? 0xfeedfacecafebeefULL : 0x0123456789abcdefULL;
+		}
+		break;
+	case CP_SPARSE2:
+		memset(page, 0, vm_page_size);
+		((uint32_t *)page)[17] = 0x11111111;
+		((uint32_t *)page)[501] = 0x22222222;
+		break;
+	case CP_SPARSE1:
+		memset(page, 0, vm_page_size);
+		((uint32_t *)page)[3] = 0x33333333;
+		break;
+	}
+}
+
+T_DECL(compressor_pattern_roundtrip, "Check that pattern and sparse pages survive compression",
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1),
+    T_META_TAG_VM_PREFERRED)
+{
+	size_t size = CP_PAGES * vm_page_size;
+	char *expected = malloc(size);
+	char *addr;
+	unsigned char vec;
+	int ret;
+
+	T_QUIET; T_ASSERT_NOTNULL(expected, "malloc");
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE_PTR((void *)addr, MAP_FAILED, "mmap");
+
+	for (int kind = 0; kind < CP_PAGES; kind++) {
+		compressor_fill_page((uint64_t *)(void *)(expected + kind * vm_page_size), kind);
+		memcpy(addr + kind * vm_page_size, expected + kind * vm_page_size, vm_page_size);
+	}
+
+	ret = madvise(addr, size, MADV_PAGEOUT);
+	if (ret == -1 && errno == ENOTSUP) {
+		T_SKIP("MADV_PAGEOUT not supported on this kernel");
+	}
+	T_ASSERT_POSIX_SUCCESS(ret, "madvise(MADV_PAGEOUT)");
+
+	/* wait for the pages to be (asynchronously) compressed */
+	for (int kind = 0; kind < CP_PAGES; kind++) {
+		do {
+			ret = mincore(addr + kind * vm_page_size, 1, (char *)&vec);
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "mincore(%d)", kind);
+		} while (vec & MINCORE_INCORE);
+		T_QUIET; T_EXPECT_TRUE(vec & MINCORE_PAGED_OUT, "page %d was compressed", kind);
+	}
+
+	/* fault them back in through c_decompress_page() */
+	for (int kind = 0; kind < CP_PAGES; kind++) {
+		T_EXPECT_EQ_INT(memcmp(addr + kind * vm_page_size, expected + kind * vm_page_size, vm_page_size), 0,
+		    "page %d decompressed unchanged", kind);
+	}
+
+	T_ASSERT_POSIX_SUCCESS(munmap(addr, size), "munmap");
+	free(expected);
+}
+
 T_DECL(sysctl_vm_object_dump, "Check that the sysctl that dumps the metadata of a vm_object works correctly",
     T_META_REQUIRES_SYSCTL_EQ("kern.development", 1))
 {
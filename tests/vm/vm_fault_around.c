@@ -0,0 +1,175 @@
+#include <darwintest.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+
+#include <mach/mach_init.h>
+#include <mach/mach_vm.h>
+#include <mach/task.h>
+#include <mach/vm_map.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"));
+
+#define FA_PAGES        256
+
+static uint32_t
+fault_around_max(void)
+{
+	uint32_t max = 0;
+	size_t len = sizeof(max);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.fault_around_max",
+	    &max, &len, NULL, 0), "vm.fault_around_max");
+	return max;
+}
+
+static int32_t
+task_faults(void)
+{
+	task_events_info_data_t info;
+	mach_msg_type_number_t count = TASK_EVENTS_INFO_COUNT;
+
+	T_QUIET; T_ASSERT_MACH_SUCCESS(task_info(mach_task_self(), TASK_EVENTS_INFO,
+	    (task_info_t)&info, &count), "task_info(TASK_EVENTS_INFO)");
+	return info.faults;
+}
+
+/*
+ * A file whose pages are all resident in the cache, with each page
+ * starting with its own index.
+ */
+static int
+make_resident_file(void)
+{
+	char path[MAXPATHLEN] = "/tmp/fault_around.XXXXXX";
+	char *buf = calloc(1, vm_page_size);
+	int fd;
+
+	T_QUIET; T_ASSERT_NOTNULL(buf, "calloc");
+	T_ASSERT_POSIX_SUCCESS(fd = mkstemp(path), "mkstemp");
+	T_ASSERT_POSIX_SUCCESS(unlink(path), "unlink");
+	for (uint32_t i = 0; i < FA_PAGES; i++) {
+		memcpy(buf, &i, sizeof(i));
+		T_QUIET; T_ASSERT_EQ(write(fd, buf, vm_page_size), (ssize_t)vm_page_size, "write");
+	}
+	free(buf);
+	return fd;
+}
+
+/* touch every page in order and return the number of faults taken */
+static int32_t
+walk(const char *addr, bool check)
+{
+	int32_t before = task_faults();
+
+	for (uint32_t i = 0; i < FA_PAGES; i++) {
+		uint32_t v;
+
+		memcpy(&v, addr + i * vm_page_size, sizeof(v));
+		if (check) {
+			T_QUIET; T_ASSERT_EQ(v, i, "page %u content", i);
+		}
+	}
+	return task_faults() - before;
+}
+
+T_DECL(vm_fault_around_file, "read faults on a resident file map the pages around them")
+{
+	size_t size = FA_PAGES * vm_page_size;
+	int32_t faults;
+	char *addr;
+	int fd;
+
+	if (fault_around_max() == 0) {
+		T_SKIP("fault-around is disabled");
+	}
+
+	fd = make_resident_file();
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	T_ASSERT_NE_PTR(addr, MAP_FAILED, "mmap");
+
+	faults = walk(addr, true);
+	T_LOG("%d faults for %d pages", faults, FA_PAGES);
+	T_EXPECT_LT(faults, FA_PAGES / 2, "fewer faults than pages");
+
+	/* the pages mapped around were not write-enabled */
+	T_ASSERT_POSIX_SUCCESS(munmap(addr, size), "munmap");
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	T_ASSERT_NE_PTR(addr, MAP_FAILED, "mmap private");
+	walk(addr, true);
+	for (uint32_t i = 0; i < FA_PAGES; i++) {
+		addr[i * vm_page_size + sizeof(uint32_t)] = 1;
+	}
+	T_ASSERT_POSIX_SUCCESS(munmap(addr, size), "munmap");
+
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	T_ASSERT_NE_PTR(addr, MAP_FAILED, "mmap");
+	walk(addr, true);
+	for (uint32_t i = 0; i < FA_PAGES; i++) {
+		T_QUIET; T_ASSERT_EQ(addr[i * vm_page_size + sizeof(uint32_t)], 0,
+		    "page %u untouched", i);
+	}
+	T_ASSERT_POSIX_SUCCESS(munmap(addr, size), "munmap");
+	close(fd);
+}
+
+T_DECL(vm_fault_around_random, "MADV_RANDOM mappings fault one page at a time")
+{
+	size_t size = FA_PAGES * vm_page_size;
+	int32_t faults;
+	char *addr;
+	int fd;
+
+	fd = make_resident_file();
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	T_ASSERT_NE_PTR(addr, MAP_FAILED, "mmap");
+	T_ASSERT_POSIX_SUCCESS(madvise(addr, size, MADV_RANDOM), "MADV_RANDOM");
+
+	faults = walk(addr, true);
+	T_LOG("%d faults for %d pages", faults, FA_PAGES);
+	T_EXPECT_GE(faults, FA_PAGES, "one fault per page");
+	T_ASSERT_POSIX_SUCCESS(munmap(addr, size), "munmap");
+	close(fd);
+}
+
+T_DECL(vm_fault_around_anon, "read faults on resident anonymous memory map the pages around them")
+{
+	mach_vm_size_t size = FA_PAGES * vm_page_size;
+	mach_vm_address_t addr = 0, alias = 0;
+	vm_prot_t cur, max;
+	int32_t faults;
+
+	if (fault_around_max() == 0) {
+		T_SKIP("fault-around is disabled");
+	}
+
+	T_ASSERT_MACH_SUCCESS(mach_vm_allocate(mach_task_self(), &addr, size,
+	    VM_FLAGS_ANYWHERE), "mach_vm_allocate");
+	for (uint32_t i = 0; i < FA_PAGES; i++) {
+		memcpy((char *)addr + i * vm_page_size, &i, sizeof(i));
+	}
+
+	/* a second mapping of the same, now resident, object */
+	T_ASSERT_MACH_SUCCESS(mach_vm_remap(mach_task_self(), &alias, size, 0,
+	    VM_FLAGS_ANYWHERE, mach_task_self(), addr, FALSE, &cur, &max,
+	    VM_INHERIT_DEFAULT), "mach_vm_remap");
+
+	faults = walk((const char *)alias, true);
+	T_LOG("%d faults for %d pages", faults, FA_PAGES);
+	T_EXPECT_LT(faults, FA_PAGES / 2, "fewer faults than pages");
+
+	/* writes through the alias still land in the shared object */
+	((uint32_t *)alias)[1] = 0xfeedface;
+	T_ASSERT_EQ(((uint32_t *)addr)[1], 0xfeedfaceU, "alias is shared");
+
+	mach_vm_deallocate(mach_task_self(), alias, size);
+	mach_vm_deallocate(mach_task_self(), addr, size);
+}
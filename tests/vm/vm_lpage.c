@@ -0,0 +1,196 @@
+#include <darwintest.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sysctl.h>
+
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
+
+#include "net_test_lib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"));
+
+#define LP_SIZE         (2ULL << 20)
+#define LP_RUNS         4
+#define LP_WAIT_SEC     10
+
+#define LP_SYSCTL_ENABLED       "vm.lpage_enabled"
+#define LP_SYSCTL_POOL_TARGET   "vm.lpage_pool_target"
+
+static uint32_t
+lpage_sysctl(const char *name)
+{
+	uint32_t val = 0;
+	size_t len = sizeof(val);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &val, &len, NULL, 0), "%s", name);
+	return val;
+}
+
+static vm_statistics64_data_t
+lpage_stats(void)
+{
+	vm_statistics64_data_t stats = {};
+	mach_msg_type_number_t count = HOST_VM_INFO64_REV3_COUNT;
+
+	T_QUIET; T_ASSERT_MACH_SUCCESS(host_statistics64(mach_host_self(),
+	    HOST_VM_INFO64, (host_info64_t)&stats, &count), "host_statistics64");
+	T_QUIET; T_ASSERT_EQ(count, HOST_VM_INFO64_REV3_COUNT, "rev3 count");
+	return stats;
+}
+
+/* an anonymous range starting on a large page boundary */
+static char *
+lpage_allocate(mach_vm_address_t *base, mach_vm_size_t *size)
+{
+	mach_vm_address_t addr;
+
+	*size = (LP_RUNS + 1) * LP_SIZE;
+	*base = 0;
+	T_ASSERT_MACH_SUCCESS(mach_vm_allocate(mach_task_self(), base, *size,
+	    VM_FLAGS_ANYWHERE), "mach_vm_allocate");
+	addr = (*base + LP_SIZE - 1) & ~(LP_SIZE - 1);
+	return (char *)addr;
+}
+
+static void
+lpage_fill(char *addr)
+{
+	for (uint64_t off = 0; off < LP_RUNS * LP_SIZE; off += vm_page_size) {
+		uint64_t v = off;
+
+		memcpy(addr + off, &v, sizeof(v));
+	}
+}
+
+static void
+lpage_check(const char *addr)
+{
+	for (uint64_t off = 0; off < LP_RUNS * LP_SIZE; off += vm_page_size) {
+		uint64_t v;
+
+		memcpy(&v, addr + off, sizeof(v));
+		T_QUIET; T_ASSERT_EQ(v, off, "content at offset 0x%llx", off);
+	}
+}
+
+/*
+ * Poll one counter until it moved by "delta": host_statistics64() is rate
+ * limited and may keep returning a cached copy for a while.
+ */
+static uint64_t
+lpage_wait(size_t field, uint64_t before, uint64_t delta)
+{
+	vm_statistics64_data_t stats;
+	uint64_t value = before;
+
+	for (int i = 0; i < LP_WAIT_SEC * 10; i++) {
+		stats = lpage_stats();
+		memcpy(&value, (char *)&stats + field, sizeof(value));
+		if (value - before >= delta) {
+			break;
+		}
+		usleep(100 * 1000);
+	}
+	return value - before;
+}
+
+T_DECL(vm_lpage_counters, "host_statistics64 reports the large page counters")
+{
+	vm_statistics64_data_t stats = lpage_stats();
+
+	T_LOG("promotions %llu demotions %llu mappings %llu fault allocs %llu",
+	    stats.large_page_promotions, stats.large_page_demotions,
+	    stats.large_page_mappings, stats.large_page_fault_allocs);
+	T_EXPECT_LE(stats.large_page_demotions, stats.large_page_promotions,
+	    "no more demotions than promotions");
+}
+
+/*
+ * Turn large pages on with room for LP_RUNS runs in the pool, and wait for
+ * the pool to fill so that each run of the test can be populated from it.
+ */
+static void
+lpage_pool_fill(void)
+{
+	mach_vm_address_t base;
+	mach_vm_size_t size;
+	uint32_t count = 0;
+	char *addr;
+
+	T_ATEND(sysctl_restore_all);
+	sysctl_set_integer(LP_SYSCTL_ENABLED, 1);
+	if (lpage_sysctl(LP_SYSCTL_POOL_TARGET) < LP_RUNS) {
+		sysctl_set_integer(LP_SYSCTL_POOL_TARGET, LP_RUNS);
+	}
+
+	/* the pool thread sleeps while disabled: a fault on an aligned run wakes it */
+	addr = lpage_allocate(&base, &size);
+	addr[0] = 1;
+	T_QUIET; T_ASSERT_MACH_SUCCESS(mach_vm_deallocate(mach_task_self(), base, size), NULL);
+
+	for (int i = 0; i < LP_WAIT_SEC * 10; i++) {
+		count = lpage_sysctl("vm.lpage_pool_count");
+		if (count >= LP_RUNS) {
+			break;
+		}
+		usleep(100 * 1000);
+	}
+	T_ASSERT_GE(count, LP_RUNS, "large page pool filled");
+}
+
+T_DECL(vm_lpage_promote, "aligned anonymous runs are promoted, and demoted by a partial protect",
+    T_META_ASROOT(true),
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1))
+{
+	vm_statistics64_data_t before, after;
+	mach_vm_address_t base;
+	mach_vm_size_t size;
+	uint64_t allocs, promoted;
+	char *addr;
+
+	if (sysctlbyname(LP_SYSCTL_ENABLED, NULL, NULL, NULL, 0) != 0) {
+		T_SKIP("no large page support");
+	}
+	lpage_pool_fill();
+
+	addr = lpage_allocate(&base, &size);
+	before = lpage_stats();
+	lpage_fill(addr);
+	after = lpage_stats();
+	allocs = after.large_page_fault_allocs - before.large_page_fault_allocs;
+	T_ASSERT_GT(allocs, 0ULL, "%llu runs populated from the pool", allocs);
+
+	/* wait for the promotion thread to get through the runs */
+	promoted = lpage_wait(offsetof(vm_statistics64_data_t, large_page_promotions),
+	    before.large_page_promotions, allocs);
+	T_ASSERT_GE(promoted, allocs, "%llu runs promoted", promoted);
+	lpage_check(addr);
+
+	/* write-protecting one page splits its run */
+	before = lpage_stats();
+	T_ASSERT_POSIX_SUCCESS(mprotect(addr + vm_page_size, vm_page_size, PROT_READ),
+	    "mprotect one page");
+	if (allocs >= LP_RUNS) {
+		T_EXPECT_GE(lpage_wait(offsetof(vm_statistics64_data_t, large_page_demotions),
+		    before.large_page_demotions, 1), 1ULL, "partial protect demoted");
+	}
+	lpage_check(addr);
+
+	/* the other pages of the run are still writable */
+	addr[0] = 1;
+	addr[2 * vm_page_size] = 1;
+	T_EXPECT_EQ(addr[vm_page_size + sizeof(uint64_t)], 0, "protected page intact");
+
+	T_ASSERT_MACH_SUCCESS(mach_vm_deallocate(mach_task_self(), base, size),
+	    "mach_vm_deallocate");
+	after = lpage_stats();
+	T_LOG("%llu large mappings left", after.large_page_mappings);
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <fcntl.h>
+#include <mach/mach.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#include <unistd.h>
+
+/*
+ * Replay of a mixed file and anonymous workload: a small hot file is read
+ * over and over while a much larger file is streamed through once and a
+ * large anonymous buffer is dirtied.  Each round records how many pages of
+ * the hot file had been evicted (and so had to be read back in) and how
+ * long the round took.  Run it with and without the "vm_mglru" boot-arg
+ * to compare the two active queue policies.
+ */
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_CHECK_LEAKS(false));
+
+#define MGLRU_NGENS             4
+#define REPLAY_HOT_SIZE         (64ULL << 20)
+#define REPLAY_ROUNDS           8
+
+/* mirrors struct vm_refault_stats */
+struct refault_stats {
+	uint64_t vrs_refaults;
+	uint64_t vrs_refaults_protected;
+	uint64_t vrs_distance_total;
+};
+
+static int
+mglru_enabled(void)
+{
+	int enabled = 0;
+	size_t len = sizeof(enabled);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.mglru_enabled",
+	    &enabled, &len, NULL, 0), "vm.mglru_enabled");
+	return enabled;
+}
+
+static uint64_t
+sysctl_u64(const char *name)
+{
+	uint64_t val = 0;
+	size_t len = sizeof(val);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &val, &len, NULL, 0), "%s", name);
+	return val;
+}
+
+static int
+make_file(const char *name, uint64_t size, bool fill)
+{
+	char path[MAXPATHLEN];
+	int fd;
+
+	snprintf(path, sizeof(path), "/tmp/%s.XXXXXX", name);
+	T_ASSERT_POSIX_SUCCESS(fd = mkstemp(path), "mkstemp");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(unlink(path), "unlink");
+
+	if (!fill) {
+		/* holes are enough to populate the file cache when read */
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(ftruncate(fd, (off_t)size), "ftruncate");
+		return fd;
+	}
+
+	char *buf = malloc(1 << 20);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	memset(buf, 0xa5, 1 << 20);
+	for (uint64_t off = 0; off < size; off += 1 << 20) {
+		T_QUIET; T_ASSERT_EQ(write(fd, buf, 1 << 20), (ssize_t)(1 << 20), "write");
+	}
+	free(buf);
+	return fd;
+}
+
+/* number of pages of the hot mapping that are not resident */
+static uint64_t
+hot_pages_evicted(const char *hot)
+{
+	size_t npages = REPLAY_HOT_SIZE / vm_page_size;
+	char *vec = malloc(npages);
+	uint64_t evicted = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(vec, "malloc");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(mincore(hot, REPLAY_HOT_SIZE, vec), "mincore");
+	for (size_t i = 0; i < npages; i++) {
+		if (!(vec[i] & MINCORE_INCORE)) {
+			evicted++;
+		}
+	}
+	free(vec);
+	return evicted;
+}
+
+T_DECL(vm_mglru_state, "generation bookkeeping of the active queue")
+{
+	uint32_t counts[MGLRU_NGENS] = {};
+	size_t len = sizeof(counts);
+	uint32_t seq[2], max_seq, min_seq;
+	uint64_t total = 0;
+
+	if (!mglru_enabled()) {
+		T_SKIP("vm_mglru boot-arg not set");
+	}
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.mglru_gen_count", counts, &len, NULL, 0),
+	    "vm.mglru_gen_count");
+	T_ASSERT_EQ(len, sizeof(counts), "one count per generation");
+
+	/* read as a pair: the generations can age between two sysctls */
+	len = sizeof(seq);
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.mglru_seq", seq, &len, NULL, 0),
+	    "vm.mglru_seq");
+	T_ASSERT_EQ(len, sizeof(seq), "min and max sequence");
+	min_seq = seq[0];
+	max_seq = seq[1];
+	T_ASSERT_LE(min_seq, max_seq, "oldest generation not younger than the youngest");
+	T_LOG("generations %u..%u: %u %u %u %u", min_seq, max_seq,
+	    counts[0], counts[1], counts[2], counts[3]);
+	T_ASSERT_LT(max_seq - min_seq, MGLRU_NGENS, "at most %d generations", MGLRU_NGENS);
+
+	for (int i = 0; i < MGLRU_NGENS; i++) {
+		total += counts[i];
+	}
+	T_ASSERT_GT(total, 0ULL, "active pages are tagged with a generation");
+}
+
+T_DECL(vm_mglru_replay, "replay mixed file and anonymous pressure",
+    T_META_TAG_PERF,
+    T_META_REQUIRE_NOT_VIRTUALIZED,
+    T_META_ASROOT(true))
+{
+	uint64_t memsize = sysctl_u64("hw.memsize");
+	uint64_t cold_size = memsize / 2;
+	uint64_t anon_size = memsize / 4;
+	uint64_t stream_size = cold_size / REPLAY_ROUNDS;
+	uint64_t promoted = 0, refault_activated = 0;
+	volatile char sink = 0;
+	int hot_fd, cold_fd;
+	char *hot, *anon, *buf;
+	bool mglru = mglru_enabled();
+
+	T_SETUPBEGIN;
+	hot_fd = make_file("mglru_hot", REPLAY_HOT_SIZE, true);
+	cold_fd = make_file("mglru_cold", cold_size, false);
+
+	hot = mmap(NULL, REPLAY_HOT_SIZE, PROT_READ, MAP_FILE | MAP_SHARED, hot_fd, 0);
+	T_ASSERT_NE_PTR(hot, MAP_FAILED, "mmap hot file");
+	anon = mmap(NULL, anon_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE_PTR(anon, MAP_FAILED, "mmap anonymous buffer");
+	buf = malloc(1 << 20);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+
+	if (mglru) {
+		promoted = sysctl_u64("vm.mglru_promoted");
+		refault_activated = sysctl_u64("vm.mglru_refault_activated");
+	}
+	T_SETUPEND;
+
+	dt_stat_time_t round_time = dt_stat_time_create("round_duration");
+	dt_stat_t hot_evicted = dt_stat_create("pages", "hot_pages_evicted");
+	dt_stat_set_variable(round_time, "mglru", mglru);
+	dt_stat_set_variable(hot_evicted, "mglru", mglru);
+
+	for (int round = 0; round < REPLAY_ROUNDS; round++) {
+		uint64_t evicted;
+
+		T_STAT_MEASURE(round_time) {
+			/* the working set: every page of the hot file, twice */
+			for (int pass = 0; pass < 2; pass++) {
+				for (uint64_t off = 0; off < REPLAY_HOT_SIZE; off += vm_page_size) {
+					sink += hot[off];
+				}
+			}
+			/* a scan: the next slice of the cold file, read once */
+			for (uint64_t off = 0; off < stream_size; off += 1 << 20) {
+				T_QUIET; T_ASSERT_POSIX_SUCCESS(pread(cold_fd, buf, 1 << 20,
+				    (off_t)(round * stream_size + off)), "pread");
+			}
+			/* anonymous pressure */
+			for (uint64_t off = 0; off < anon_size; off += vm_page_size) {
+				anon[off] = (char)round;
+			}
+		}
+		evicted = hot_pages_evicted(hot);
+		dt_stat_add(hot_evicted, (double)evicted);
+		T_LOG("round %d: %llu of %llu hot pages evicted", round, evicted,
+		    REPLAY_HOT_SIZE / vm_page_size);
+	}
+	dt_stat_finalize(round_time);
+	dt_stat_finalize(hot_evicted);
+
+	if (mglru) {
+		T_LOG("%llu pages promoted, %llu refaults activated",
+		    sysctl_u64("vm.mglru_promoted") - promoted,
+		    sysctl_u64("vm.mglru_refault_activated") - refault_activated);
+	}
+
+	struct refault_stats rs;
+	size_t rs_len = sizeof(rs);
+	int fd = hot_fd;
+
+	if (sysctlbyname("vm.vnode_refault_stats", &rs, &rs_len, &fd, sizeof(fd)) == 0) {
+		T_LOG("hot file: %llu refaults, %llu protected, mean distance %llu",
+		    rs.vrs_refaults, rs.vrs_refaults_protected,
+		    rs.vrs_refaults ? rs.vrs_distance_total / rs.vrs_refaults : 0);
+		T_EXPECT_LE(rs.vrs_refaults_protected, rs.vrs_refaults,
+		    "protected refaults are a subset of refaults");
+	}
+
+	free(buf);
+	munmap(anon, anon_size);
+	munmap(hot, REPLAY_HOT_SIZE);
+	close(cold_fd);
+	close(hot_fd);
+}
+
+#define REFAULT_SIZE            (1ULL << 20)
+
+static void
+refault_stats_vnode(int fd, struct refault_stats *rs)
+{
+	size_t len = sizeof(*rs);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.vnode_refault_stats",
+	    rs, &len, &fd, sizeof(fd)), "vm.vnode_refault_stats");
+	T_QUIET; T_ASSERT_EQ(len, sizeof(*rs), "vm.vnode_refault_stats size");
+}
+
+static void
+refault_stats_task(struct refault_stats *rs)
+{
+	size_t len = sizeof(*rs);
+	int pid = 0;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.task_refault_stats",
+	    rs, &len, &pid, sizeof(pid)), "vm.task_refault_stats");
+	T_QUIET; T_ASSERT_EQ(len, sizeof(*rs), "vm.task_refault_stats size");
+}
+
+static uint32_t
+phantom_cache_clock(void)
+{
+	uint32_t clock = 0;
+	size_t len = sizeof(clock);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.phantom_cache_evictions",
+	    &clock, &len, NULL, 0), "vm.phantom_cache_evictions");
+	return clock;
+}
+
+T_DECL(vm_refault_stats, "an evicted file page read back in is counted as a refault",
+    T_META_ASROOT(true),
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1))
+{
+	struct refault_stats vnode_rs, task_before, task_after;
+	char path[MAXPATHLEN];
+	uint32_t clock_before, clock_evicted, span;
+	uint64_t refaults;
+	char *buf;
+	int fd;
+
+	if (sysctlbyname("vm.phantom_cache_evictions", NULL, NULL, NULL, 0) != 0) {
+		T_SKIP("no phantom cache");
+	}
+
+	T_SETUPBEGIN;
+	buf = malloc(REFAULT_SIZE);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	memset(buf, 0xa5, REFAULT_SIZE);
+	strlcpy(path, "/tmp/vm_refault.XXXXXX", sizeof(path));
+	T_ASSERT_POSIX_SUCCESS(fd = mkstemp(path), "mkstemp");
+	T_ASSERT_EQ(write(fd, buf, REFAULT_SIZE), (ssize_t)REFAULT_SIZE, "write");
+	/* only clean pages are evicted */
+	T_ASSERT_POSIX_SUCCESS(fsync(fd), "fsync");
+	refault_stats_vnode(fd, &vnode_rs);
+	T_QUIET; T_ASSERT_EQ(vnode_rs.vrs_refaults, 0ULL, "new file has no refaults");
+	/* with its last reference gone, the file's object goes to the object cache */
+	T_ASSERT_POSIX_SUCCESS(close(fd), "close");
+	T_SETUPEND;
+
+	clock_before = phantom_cache_clock();
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.object_cache_evict", NULL, NULL, NULL, 0),
+	    "evict the pages of cached objects");
+	clock_evicted = phantom_cache_clock();
+	if (clock_evicted == clock_before) {
+		T_SKIP("no page was evicted through the phantom cache");
+	}
+	T_LOG("%u pages evicted", clock_evicted - clock_before);
+
+	refault_stats_task(&task_before);
+	T_ASSERT_POSIX_SUCCESS(fd = open(path, O_RDONLY), "open");
+	T_ASSERT_EQ(pread(fd, buf, REFAULT_SIZE, 0), (ssize_t)REFAULT_SIZE, "read back");
+	refault_stats_task(&task_after);
+	refault_stats_vnode(fd, &vnode_rs);
+
+	/* a page evicted above can't be further than the whole eviction run */
+	span = phantom_cache_clock() - clock_before;
+
+	T_LOG("file: %llu refaults, %llu protected, distance total %llu (span %u)",
+	    vnode_rs.vrs_refaults, vnode_rs.vrs_refaults_protected,
+	    vnode_rs.vrs_distance_total, span);
+	T_EXPECT_GT(vnode_rs.vrs_refaults, 0ULL, "file pages refaulted");
+	T_EXPECT_LE(vnode_rs.vrs_refaults, REFAULT_SIZE / vm_page_size,
+	    "at most one refault per page");
+	T_EXPECT_LE(vnode_rs.vrs_refaults_protected, vnode_rs.vrs_refaults,
+	    "protected refaults are a subset of refaults");
+	T_EXPECT_LE(vnode_rs.vrs_distance_total, vnode_rs.vrs_refaults * span,
+	    "file refault distances within the eviction run");
+
+	refaults = task_after.vrs_refaults - task_before.vrs_refaults;
+	T_LOG("task: %llu refaults, distance total %llu", refaults,
+	    task_after.vrs_distance_total - task_before.vrs_distance_total);
+	T_EXPECT_GT(refaults, 0ULL, "refaults charged to the reader");
+	T_EXPECT_LE(refaults, vnode_rs.vrs_refaults, "no more than the file's");
+	T_EXPECT_LE(task_after.vrs_distance_total - task_before.vrs_distance_total,
+	    refaults * span, "task refault distances within the eviction run");
+
+	close(fd);
+	unlink(path);
+	free(buf);
+}
+
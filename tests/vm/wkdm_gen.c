@@ -0,0 +1,257 @@
+/*
+ * Equivalence test and throughput benchmark for the portable WKdm
+ * implementation in osfmk/vm/WKdm_gen.c.
+ *
+ * Every page of a synthetic corpus is compressed with both the C code and
+ * the x86_64 assembly the kernel ships; the return values and compressed
+ * streams must match byte for byte, and both decompressors must reproduce
+ * the input.  The benchmark then reports compress/decompress GB/s and the
+ * compression ratio for each corpus class.
+ */
+
+#include <darwintest.h>
+#include <mach/mach_time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "WKdm_new.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_RUN_CONCURRENTLY(true));
+
+#define WKDM_PAGE_SIZE          4096
+#define WKDM_PAGE_WORDS         (WKDM_PAGE_SIZE / sizeof(WK_word))
+/* header + tags + one full word per input word, see WKdmCompress_new.s */
+#define WKDM_DEST_SIZE          (12 + 256 + WKDM_PAGE_SIZE)
+#define CORPUS_PAGES            512
+#define BENCH_ROUNDS            64
+
+typedef enum {
+	CORPUS_ZERO,
+	CORPUS_SINGLE_VALUE,
+	CORPUS_SPARSE,
+	CORPUS_POINTERS,
+	CORPUS_SMALL_INTS,
+	CORPUS_TEXT,
+	CORPUS_RANDOM,
+	CORPUS_MIXED,
+	CORPUS_COUNT,
+} corpus_kind_t;
+
+static const char *corpus_names[CORPUS_COUNT] = {
+	[CORPUS_ZERO]         = "zero",
+	[CORPUS_SINGLE_VALUE] = "single-value",
+	[CORPUS_SPARSE]       = "sparse",
+	[CORPUS_POINTERS]     = "pointers",
+	[CORPUS_SMALL_INTS]   = "small-ints",
+	[CORPUS_TEXT]         = "text",
+	[CORPUS_RANDOM]       = "random",
+	[CORPUS_MIXED]        = "mixed",
+};
+
+static uint32_t
+corpus_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void
+corpus_fill_page(corpus_kind_t kind, WK_word *page, uint32_t *state)
+{
+	uint32_t v = corpus_rand(state);
+	static const char words[] = "the quick brown fox jumps over the lazy dog ";
+
+	for (unsigned int i = 0; i < WKDM_PAGE_WORDS; i++) {
+		uint32_t r = corpus_rand(state);
+
+		switch (kind) {
+		case CORPUS_ZERO:
+			page[i] = 0;
+			break;
+		case CORPUS_SINGLE_VALUE:
+			page[i] = (v & 1) ? v : (v & 0x3ff);
+			break;
+		case CORPUS_SPARSE:
+			page[i] = (r % 61 == 0) ? corpus_rand(state) : 0;
+			break;
+		case CORPUS_POINTERS:
+			/* heap-like pointers: shared high bits, varying low bits */
+			page[i] = (r % 4 == 0) ? 0 : ((v & 0xfff00000) | ((r >> 8) & 0xffff0));
+			break;
+		case CORPUS_SMALL_INTS:
+			page[i] = (r % 3 == 0) ? 0 : (r & 0x3ff);
+			break;
+		case CORPUS_TEXT:
+			memcpy(&page[i], &words[(r % (sizeof(words) - 5))], sizeof(WK_word));
+			break;
+		case CORPUS_RANDOM:
+			page[i] = r;
+			break;
+		case CORPUS_MIXED:
+		default:
+			page[i] = (r % 5 == 0) ? r : (r % 5 == 1) ? 0 : (v ^ (r & 0x3ff));
+			break;
+		}
+	}
+}
+
+static WK_word *
+corpus_create(corpus_kind_t kind)
+{
+	WK_word *corpus = aligned_alloc(WKDM_PAGE_SIZE, CORPUS_PAGES * WKDM_PAGE_SIZE);
+	uint32_t state = 0x9e3779b9u ^ (uint32_t)kind;
+
+	T_QUIET; T_ASSERT_NOTNULL(corpus, "corpus allocation");
+	for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+		corpus_fill_page(kind, corpus + p * WKDM_PAGE_WORDS, &state);
+	}
+	return corpus;
+}
+
+T_DECL(wkdm_gen_matches_assembly,
+    "WKdm_compress_gen/WKdm_decompress_gen are bit-identical to the assembly",
+    T_META_TAG_VM_PREFERRED)
+{
+	static WK_word dest_asm[WKDM_DEST_SIZE / sizeof(WK_word)] __attribute__((aligned(64)));
+	static WK_word dest_gen[WKDM_DEST_SIZE / sizeof(WK_word)] __attribute__((aligned(64)));
+	static WK_word scratch[WKDM_PAGE_WORDS] __attribute__((aligned(64)));
+	static WK_word out_asm[WKDM_PAGE_WORDS] __attribute__((aligned(64)));
+	static WK_word out_gen[WKDM_PAGE_WORDS] __attribute__((aligned(64)));
+	unsigned int pages = 0;
+
+	for (corpus_kind_t kind = 0; kind < CORPUS_COUNT; kind++) {
+		WK_word *corpus = corpus_create(kind);
+		uint32_t state = 1;
+
+		for (unsigned int p = 0; p < CORPUS_PAGES; p++, pages++) {
+			const WK_word *src = corpus + p * WKDM_PAGE_WORDS;
+			/* exercise both a roomy budget and tight ones */
+			unsigned int limit = (p & 1) ? WKDM_PAGE_SIZE - 4 :
+			    100 + corpus_rand(&state) % (WKDM_PAGE_SIZE - 100);
+
+			memset(dest_asm, 0xa5, sizeof(dest_asm));
+			memset(dest_gen, 0xa5, sizeof(dest_gen));
+
+			int csize_asm = WKdm_compress_new(src, dest_asm, scratch, limit);
+			int csize_gen = WKdm_compress_gen(src, dest_gen, scratch, limit, WKDM_PAGE_SIZE);
+
+			T_QUIET; T_ASSERT_EQ(csize_gen, csize_asm,
+			    "%s page %u, limit %u: compressed size", corpus_names[kind], p, limit);
+			if (csize_asm <= 0) {
+				continue;
+			}
+			T_QUIET; T_ASSERT_EQ(memcmp(dest_gen, dest_asm, (size_t)csize_asm), 0,
+			    "%s page %u: compressed stream", corpus_names[kind], p);
+
+			WKdm_decompress_new(dest_asm, out_asm, scratch, (unsigned int)csize_asm);
+			WKdm_decompress_gen(dest_gen, out_gen, scratch, (unsigned int)csize_gen, WKDM_PAGE_SIZE);
+			T_QUIET; T_ASSERT_EQ(memcmp(out_asm, src, WKDM_PAGE_SIZE), 0,
+			    "%s page %u: assembly round trip", corpus_names[kind], p);
+			T_QUIET; T_ASSERT_EQ(memcmp(out_gen, src, WKDM_PAGE_SIZE), 0,
+			    "%s page %u: C round trip", corpus_names[kind], p);
+		}
+		free(corpus);
+	}
+	T_PASS("%u pages compressed identically", pages);
+}
+
+static double
+abs_to_seconds(uint64_t abstime)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (double)abstime * tb.numer / tb.denom / 1e9;
+}
+
+static void
+wkdm_bench_corpus(corpus_kind_t kind, bool use_gen)
+{
+	static WK_word scratch[WKDM_PAGE_WORDS] __attribute__((aligned(64)));
+	static WK_word out[WKDM_PAGE_WORDS] __attribute__((aligned(64)));
+	WK_word *corpus = corpus_create(kind);
+	WK_word *compressed = calloc(CORPUS_PAGES, WKDM_DEST_SIZE);
+	int *csizes = calloc(CORPUS_PAGES, sizeof(int));
+	uint64_t compressed_bytes = 0, start, ctime, dtime;
+	char label[64];
+
+	T_QUIET; T_ASSERT_NOTNULL(compressed, "compressed buffer allocation");
+	T_QUIET; T_ASSERT_NOTNULL(csizes, "size array allocation");
+
+	start = mach_absolute_time();
+	for (unsigned int round = 0; round < BENCH_ROUNDS; round++) {
+		for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+			WK_word *dst = (WK_word *)((char *)compressed + p * WKDM_DEST_SIZE);
+			const WK_word *src = corpus + p * WKDM_PAGE_WORDS;
+
+			csizes[p] = use_gen ?
+			    WKdm_compress_gen(src, dst, scratch, WKDM_PAGE_SIZE - 4, WKDM_PAGE_SIZE) :
+			    WKdm_compress_new(src, dst, scratch, WKDM_PAGE_SIZE - 4);
+		}
+	}
+	ctime = mach_absolute_time() - start;
+
+	start = mach_absolute_time();
+	for (unsigned int round = 0; round < BENCH_ROUNDS; round++) {
+		for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+			WK_word *src = (WK_word *)((char *)compressed + p * WKDM_DEST_SIZE);
+
+			/* mirror c_decompress_page() for incompressible and single value pages */
+			if (csizes[p] < 0) {
+				memcpy(out, corpus + p * WKDM_PAGE_WORDS, WKDM_PAGE_SIZE);
+			} else if (csizes[p] == 0) {
+				WK_word sv = corpus[p * WKDM_PAGE_WORDS];
+				for (unsigned int i = 0; i < WKDM_PAGE_WORDS; i++) {
+					out[i] = sv;
+				}
+			} else if (use_gen) {
+				WKdm_decompress_gen(src, out, scratch, (unsigned int)csizes[p], WKDM_PAGE_SIZE);
+			} else {
+				WKdm_decompress_new(src, out, scratch, (unsigned int)csizes[p]);
+			}
+		}
+	}
+	dtime = mach_absolute_time() - start;
+
+	for (unsigned int p = 0; p < CORPUS_PAGES; p++) {
+		/* mirror c_compress_page(): SV pages cost 4 bytes, failures a full page */
+		compressed_bytes += csizes[p] < 0 ? WKDM_PAGE_SIZE : csizes[p] == 0 ? 4 : (unsigned int)csizes[p];
+	}
+
+	double gbytes = (double)BENCH_ROUNDS * CORPUS_PAGES * WKDM_PAGE_SIZE / 1e9;
+	double ratio = (double)CORPUS_PAGES * WKDM_PAGE_SIZE / (double)compressed_bytes;
+	const char *impl = use_gen ? "gen" : "asm";
+
+	T_LOG("%-12s %s: compress %6.2f GB/s, decompress %6.2f GB/s, ratio %5.2f",
+	    corpus_names[kind], impl, gbytes / abs_to_seconds(ctime),
+	    gbytes / abs_to_seconds(dtime), ratio);
+	snprintf(label, sizeof(label), "wkdm_%s_compress_%s", impl, corpus_names[kind]);
+	T_PERF(label, gbytes / abs_to_seconds(ctime), "GB/s", "WKdm compression throughput");
+	snprintf(label, sizeof(label), "wkdm_%s_decompress_%s", impl, corpus_names[kind]);
+	T_PERF(label, gbytes / abs_to_seconds(dtime), "GB/s", "WKdm decompression throughput");
+
+	free(csizes);
+	free(compressed);
+	free(corpus);
+}
+
+T_DECL(wkdm_gen_throughput,
+    "compress/decompress throughput and ratio of the C and assembly WKdm",
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_PERF)
+{
+	for (corpus_kind_t kind = 0; kind < CORPUS_COUNT; kind++) {
+		wkdm_bench_corpus(kind, false);
+		wkdm_bench_corpus(kind, true);
+	}
+}